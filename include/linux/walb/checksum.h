@@ -8,10 +8,31 @@
 
 #include "common.h"
 
+#ifdef __KERNEL__
+#include <linux/crc32c.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#ifndef __KERNEL__
+/**
+ * CRC32C without pre and post inversion like the kernel's crc32c().
+ * This is implemented in tool/crc32c.c.
+ */
+u32 crc32c(u32 crc, const void *data, unsigned int size);
+#endif
+
+/**
+ * Checksum types of logs and super sectors.
+ * See SUPER_FORMAT_CRC32C.
+ */
+enum {
+	WALB_CSUM_SUM = 0, /* 32-bit word sum. See checksum(). */
+	WALB_CSUM_CRC32C,
+};
+
 /**
  * Calculate checksum incrementally.
  *
@@ -66,6 +87,84 @@ static inline u32 checksum(const void *data, u32 size, u32 salt)
 	return checksum_finish(checksum_partial(salt, data, size));
 }
 
+/**
+ * Start checksum calculation of a type.
+ * The walb_csum_xxx() functions are the same as checksum_xxx()
+ * for WALB_CSUM_SUM.
+ * For WALB_CSUM_CRC32C, the result is the standard CRC32C
+ * if the salt is 0.
+ *
+ * @type checksum type. WALB_CSUM_XXX.
+ * @salt checksum salt.
+ *
+ * @return initial checksum.
+ */
+static inline u32 walb_csum_init(unsigned int type, u32 salt)
+{
+	return type == WALB_CSUM_CRC32C ? ~salt : salt;
+}
+
+/**
+ * Calculate checksum of a type incrementally.
+ *
+ * @size data size in bytes. This must be dividable by sizeof(u32).
+ */
+static inline u32 walb_csum_partial(
+	unsigned int type, u32 sum, const void *data, u32 size)
+{
+	if (type == WALB_CSUM_CRC32C)
+		return crc32c(sum, data, size);
+	return checksum_partial(sum, data, size);
+}
+
+static inline u32 walb_csum_finish(unsigned int type, u32 sum)
+{
+	return type == WALB_CSUM_CRC32C ? ~sum : checksum_finish(sum);
+}
+
+/**
+ * Calculate checksum of a type of byte array.
+ */
+static inline u32 walb_csum(
+	unsigned int type, const void *data, u32 size, u32 salt)
+{
+	return walb_csum_finish(type,
+		walb_csum_partial(type, walb_csum_init(type, salt), data, size));
+}
+
+/**
+ * Calculate checksum of a block that contains its own checksum.
+ * The u32 checksum field is treated as zero, so the result must be equal
+ * to the stored checksum for valid blocks.
+ * For WALB_CSUM_SUM, this is compatible with the traditional way:
+ * checksum() of a valid block with its checksum is 0.
+ *
+ * @type checksum type.
+ * @data block.
+ * @size block size in bytes. This must be dividable by sizeof(u32).
+ * @csum_off offset of the checksum field in the block [byte].
+ * @salt checksum salt.
+ *
+ * @return checksum of the block.
+ */
+static inline u32 walb_csum_block(
+	unsigned int type, const void *data, u32 size, u32 csum_off, u32 salt)
+{
+	const u32 zero = 0;
+	const u8 *p = (const u8 *)data;
+	u32 sum;
+
+	ASSERT(csum_off % sizeof(u32) == 0);
+	ASSERT(csum_off + sizeof(u32) <= size);
+
+	sum = walb_csum_init(type, salt);
+	sum = walb_csum_partial(type, sum, p, csum_off);
+	sum = walb_csum_partial(type, sum, &zero, sizeof(u32));
+	p += csum_off + sizeof(u32);
+	sum = walb_csum_partial(type, sum, p, size - csum_off - sizeof(u32));
+	return walb_csum_finish(type, sum);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -27,6 +27,7 @@ extern "C" {
 #include "userland.h"
 #include "div64_userland.h"
 #include <assert.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdio.h>
 #define ASSERT(cond) assert(cond)
@@ -0,0 +1,188 @@
+/**
+ * Definitions for the dirty region bitmap.
+ */
+#ifndef WALB_DIRTY_BITMAP_H
+#define WALB_DIRTY_BITMAP_H
+
+#include "walb.h"
+#include "check.h"
+#include "checksum.h"
+#include "block_size.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * FORMAT: Dirty bitmap.
+ *
+ * dirty_bitmap {
+ *   for i in [0...super.dirty_bitmap_pb] {
+ *     DATA walb_dirty_bitmap_header header
+ *     DATA u8 bits[physical_bs - sizeof(header)]
+ *   }
+ * }
+ *
+ * PROPERTY1: Offset of dirty_bitmap is get_dirty_bitmap_offset_2(super)
+ *	      in the log address space, just after the ring buffer.
+ * PROPERTY2: Bit j (LSB first) of bits of the i'th block is
+ *	      the (i * get_n_bits_in_dirty_bitmap_block(pbs) + j)'th bit.
+ * PROPERTY3: The k'th bit covers
+ *	      [k * super.dirty_region_lb, (k + 1) * super.dirty_region_lb)
+ *	      of the walb device. The last bit also covers the rest.
+ */
+
+/**
+ * Bit indices of walb_dirty_bitmap_header.flags.
+ */
+enum {
+	/* The bitmap must not be cleared automatically
+	   because logs were lost by overflow or reset-wal.
+	   Only used in the first block. */
+	DIRTY_BITMAP_PINNED = 0,
+};
+
+/**
+ * Header of a dirty bitmap block.
+ */
+struct walb_dirty_bitmap_header {
+
+	/* 4 + 2 + 2 = 8 bytes */
+
+	/* Checksum of the whole block with salt 0.
+	   The checksum type is the same as the super sector. */
+	u32 checksum;
+
+	/* must be SECTOR_TYPE_DIRTY_BITMAP. */
+	u16 sector_type;
+
+	/* See DIRTY_BITMAP_XXX. */
+	u16 flags;
+
+} __attribute__((packed));
+
+/**
+ * Check a region size of a dirty bitmap.
+ * It must be a power of 2 [logical block].
+ */
+static inline int is_valid_dirty_region_lb(u32 region_lb)
+{
+	return region_lb > 0 && (region_lb & (region_lb - 1)) == 0;
+}
+
+/**
+ * Number of bits in a dirty bitmap block.
+ */
+static inline unsigned int get_n_bits_in_dirty_bitmap_block(unsigned int pbs)
+{
+	return (pbs - sizeof(struct walb_dirty_bitmap_header)) * 8;
+}
+
+/**
+ * Number of bits of a dirty bitmap.
+ *
+ * @device_size device size [logical block].
+ * @region_lb region size [logical block].
+ */
+static inline u64 get_dirty_bitmap_n_bits(u64 device_size, u32 region_lb)
+{
+	u64 rem;
+	u64 n = div64_u64_rem(device_size, region_lb, &rem);
+
+	if (rem > 0)
+		n++;
+	return n == 0 ? 1 : n;
+}
+
+/**
+ * Size of a dirty bitmap [physical block].
+ */
+static inline u32 get_dirty_bitmap_pb(u64 n_bits, unsigned int pbs)
+{
+	const unsigned int n = get_n_bits_in_dirty_bitmap_block(pbs);
+	u32 rem;
+	u64 n_pb = div_u64_rem(n_bits, n, &rem);
+
+	if (rem > 0)
+		n_pb++;
+	return (u32)n_pb;
+}
+
+/**
+ * Bit index of a dirty bitmap for a device offset.
+ *
+ * @pos offset of the walb device [logical block].
+ * @region_shift log2 of the region size [logical block].
+ * @n_bits number of bits.
+ */
+static inline u64 get_dirty_bitmap_bit(
+	u64 pos, unsigned int region_shift, u64 n_bits)
+{
+	const u64 bit = pos >> region_shift;
+
+	return bit < n_bits ? bit : n_bits - 1;
+}
+
+/**
+ * log2 of a region size.
+ *
+ * @region_lb power of 2 [logical block].
+ */
+static inline unsigned int get_dirty_region_shift(u32 region_lb)
+{
+	unsigned int shift = 0;
+
+	ASSERT(is_valid_dirty_region_lb(region_lb));
+	while ((1U << shift) < region_lb)
+		shift++;
+	return shift;
+}
+
+/**
+ * Calculate checksum of a dirty bitmap block.
+ * The checksum field is not used for the calculation.
+ *
+ * @blk dirty bitmap block image.
+ * @pbs physical block size [byte].
+ * @csum_type WALB_CSUM_XXX.
+ */
+static inline u32 calc_dirty_bitmap_block_checksum(
+	const struct walb_dirty_bitmap_header *blk, unsigned int pbs,
+	unsigned int csum_type)
+{
+	return walb_csum_block(csum_type, blk, pbs,
+			offsetof(struct walb_dirty_bitmap_header, checksum), 0);
+}
+
+/**
+ * Check a dirty bitmap block.
+ *
+ * RETURN:
+ *   non-zero if valid, or 0.
+ */
+static inline int is_valid_dirty_bitmap_block(
+	const struct walb_dirty_bitmap_header *blk, unsigned int pbs,
+	unsigned int csum_type)
+{
+	CHECKd(blk->sector_type == SECTOR_TYPE_DIRTY_BITMAP);
+	CHECKd(blk->checksum ==
+		calc_dirty_bitmap_block_checksum(blk, pbs, csum_type));
+	return 1;
+error:
+	return 0;
+}
+
+/**
+ * Get bits of a dirty bitmap block.
+ */
+static inline u8* get_dirty_bitmap_block_bits(
+	struct walb_dirty_bitmap_header *blk)
+{
+	return (u8 *)blk + sizeof(struct walb_dirty_bitmap_header);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WALB_DIRTY_BITMAP_H */
@@ -159,6 +159,7 @@ enum {
 	 *   ctl->u2k.wminor as walb device minor.
 	 *     Specify WALB_DYNAMIC_MINOR for automatic assign.
 	 *   ctl->u2k.buf as struct walb_start_param.
+	 *     It also contains the other log devices of a striped log.
 	 * OUTPUT:
 	 *   ctl->k2u.wmajor, ctl->k2u.wminor as walb device major/minor.
 	 *   ctl->k2u.buf as device name (ctl->k2u.buf_size >= DISK_NAME_LEN).
@@ -247,11 +248,17 @@ enum {
 	WALB_IOCTL_SET_OLDEST_LSID,
 
 	/*
-	 * NOT YET IMPLEMENTED (NYI).
-	 * ???
+	 * Get a snapshot of statistics.
 	 *
 	 * INPUT:
+	 *   ctl->k2u.buf_size as the buffer size.
+	 *     It must be at least WALB_STATUS_HEADER_SIZE.
 	 * OUTPUT:
+	 *   ctl->k2u.buf as struct walb_status.
+	 *     If the buffer is smaller than struct walb_status,
+	 *     the trailing fields are cut.
+	 * RETURN:
+	 *   0 in success, or -EFAULT.
 	 */
 	WALB_IOCTL_STATUS,
 
@@ -449,6 +456,110 @@ enum {
 	 */
 	WALB_IOCTL_IS_FROZEN,
 
+	/*
+	 * Get QoS limits of the device.
+	 *
+	 * INPUT:
+	 *   None.
+	 * OUTPUT:
+	 *   ctl->k2u.buf as struct walb_qos_param.
+	 * RETURN:
+	 *   0 in success, or -EFAULT.
+	 */
+	WALB_IOCTL_GET_QOS,
+
+	/*
+	 * Set QoS limits of the device.
+	 *
+	 * INPUT:
+	 *   ctl->u2k.buf as struct walb_qos_param.
+	 * OUTPUT:
+	 *   None.
+	 * RETURN:
+	 *   0 in success, or -EFAULT.
+	 */
+	WALB_IOCTL_SET_QOS,
+
+	/*
+	 * Get the dirty region bitmap.
+	 *
+	 * INPUT:
+	 *   None.
+	 * OUTPUT:
+	 *   ctl->val_u64 as the number of bits. 0 if there is no bitmap.
+	 *   ctl->val_u32 as the region size [logical block].
+	 *   ctl->val_int as non-zero if the bitmap is pinned,
+	 *     that is, logs have been lost since it was cleared.
+	 *   ctl->k2u.buf as the bits (LSB first) if ctl->k2u.buf_size > 0.
+	 *     The bitmap has ctl->val_u64 / 8 bytes
+	 *     and at most ctl->k2u.buf_size bytes are stored.
+	 * RETURN:
+	 *   0 in success, or -EFAULT.
+	 */
+	WALB_IOCTL_GET_DIRTY_BITMAP,
+
+	/*
+	 * Unpin the dirty region bitmap.
+	 * Call this after the backup has copied the dirty regions.
+	 * The current bits are cleared after the logs written until now
+	 * are extracted, that is, the oldest lsid passes the latest lsid.
+	 *
+	 * INPUT:
+	 *   None.
+	 * OUTPUT:
+	 *   None.
+	 * RETURN:
+	 *   0 in success, or -EFAULT.
+	 */
+	WALB_IOCTL_UNPIN_DIRTY_BITMAP,
+
+	/*
+	 * Read logpacks of an lsid range.
+	 * Logpacks (header and data blocks) are stored in the on-disk format
+	 * so the buffer can be written as the body of a wlog file.
+	 * Only permanent logpacks with valid headers are read.
+	 *
+	 * INPUT:
+	 *   ctl->u2k.buf as u64 lsid[2]. [lsid[0], lsid[1]).
+	 *     lsid[0] must be the lsid of a logpack.
+	 *     Logpacks which end after lsid[1] are not read.
+	 *   ctl->val_u32 as the timeout to wait for a new permanent log [ms].
+	 *     0 means not to wait.
+	 *   ctl->k2u.buf_size must be a multiple of the physical block size.
+	 * OUTPUT:
+	 *   ctl->k2u.buf as the logpacks.
+	 *   ctl->val_u64 as the lsid next to the last logpack read.
+	 *   ctl->val_int as the number of logpacks read.
+	 *   ctl->val_u32 as the size of the logpack at ctl->val_u64
+	 *     [physical block] if it was not read because it ends after
+	 *     lsid[1] or it does not fit the buffer, or 0.
+	 * RETURN:
+	 *   0 in success, -ENOSPC if the buffer is too small, or -EFAULT.
+	 *   -EFAULT means the lsid is out of range or the logs were lost.
+	 */
+	WALB_IOCTL_READ_LOG,
+
+	/*
+	 * Get logpack headers of an lsid range from the in-memory index.
+	 * Headers are stored as they are in the log device
+	 * so log extractors can know the positions of all the logpacks
+	 * and read their data in parallel.
+	 * Only permanent logpacks are got.
+	 *
+	 * INPUT:
+	 *   ctl->u2k.buf as u64 lsid[2]. [lsid[0], lsid[1]).
+	 *     lsid[0] must be the lsid of a logpack.
+	 *   ctl->k2u.buf_size must be a multiple of the physical block size.
+	 * OUTPUT:
+	 *   ctl->k2u.buf as the logpack header blocks.
+	 *   ctl->val_u64 as the lsid next to the last logpack got.
+	 *   ctl->val_int as the number of headers got.
+	 * RETURN:
+	 *   0 in success, -ENOENT if lsid[0] is not in the index, or -EFAULT.
+	 *   Read the headers from the log device in case of -ENOENT.
+	 */
+	WALB_IOCTL_GET_LOGPACK_HEADERS,
+
 	/* NIY means [N]ot [I]mplemented [Y]et. */
 };
 
@@ -484,6 +595,12 @@ struct walb_start_param
 	/* Max number of data IOs to be processed at once. */
 	unsigned int n_io_bulk;
 
+	/* Log devices of a striped log except the first one.
+	   The order must be the same as that at format. */
+	unsigned int n_sub_ldevs;
+	unsigned int sub_lmajor[WALB_MAX_LDEVS - 1];
+	unsigned int sub_lminor[WALB_MAX_LDEVS - 1];
+
 } __attribute__((packed));
 
 /**
@@ -504,11 +621,141 @@ static inline bool is_walb_start_param_valid(
 	CHECKd(param->log_flush_interval_mb * 2 <= param->max_pending_mb);
 	CHECKd(0 < param->n_pack_bulk);
 	CHECKd(0 < param->n_io_bulk);
+	CHECKd(param->n_sub_ldevs < WALB_MAX_LDEVS);
 	return true;
 error:
 	return false;
 };
 
+/**
+ * Minimum bandwidth limit [byte/sec] except for 0.
+ */
+#define WALB_QOS_MIN_BPS (64 * 1024)
+
+/**
+ * Maximum burst period [ms].
+ */
+#define WALB_QOS_MAX_BURST_MS 10000
+
+/**
+ * WALB_IOCTL_GET_QOS and WALB_IOCTL_SET_QOS.
+ *
+ * 0 means unlimited for each limit.
+ */
+struct walb_qos_param
+{
+	/* IOPS limits. */
+	u64 read_iops;
+	u64 write_iops;
+
+	/* Bandwidth limits [byte/sec]. */
+	u64 read_bps;
+	u64 write_bps;
+
+	/* IOs can be issued at once up to
+	   the amount allowed for this period [ms]. */
+	u32 burst_ms;
+
+	u32 reserved;
+} __attribute__((packed));
+
+/**
+ * Check QoS parameter validness.
+ */
+static inline bool is_walb_qos_param_valid(
+	const struct walb_qos_param *param)
+{
+	CHECKd(param);
+	CHECKd(param->read_bps == 0 || param->read_bps >= WALB_QOS_MIN_BPS);
+	CHECKd(param->write_bps == 0 || param->write_bps >= WALB_QOS_MIN_BPS);
+	CHECKd(1 <= param->burst_ms);
+	CHECKd(param->burst_ms <= WALB_QOS_MAX_BURST_MS);
+	return true;
+error:
+	return false;
+};
+
+/**
+ * Current version of struct walb_status.
+ */
+#define WALB_STATUS_VERSION 2
+
+/**
+ * WALB_IOCTL_STATUS
+ *
+ * All counters are cumulative since the device has been started.
+ * New fields will be appended only with the version incremented,
+ * so an old tool can read the prefix it knows.
+ */
+struct walb_status
+{
+	/* WALB_STATUS_VERSION of the kernel. */
+	u32 version;
+	/* Valid size of the structure [byte]. */
+	u32 size;
+
+	/* Accepted IOs. A write with preflush is counted as both.
+	   n_write includes write-zeroes IOs. */
+	u64 n_read;
+	u64 n_write;
+	u64 n_discard;
+	u64 n_flush;
+
+	/* Logpacks. */
+	u64 logged_bytes; /* including logpack headers. */
+	u64 n_logpack;
+	u64 n_log_record;
+
+	/* Log device flushes.
+	   n_log_flush_force includes n_log_flush_fua. */
+	u64 n_log_flush;
+	u64 n_log_flush_force;
+	u64 n_log_flush_fua;
+
+	/* Data IOs delayed due to overlapped IOs in flight. */
+	u64 n_overlap_delay;
+
+	/* Pending data [logical block]. */
+	u64 pending_sectors;
+	u64 max_pending_sectors_seen;
+
+	/* Queue stops due to pending data or freeze. */
+	u64 n_queue_stop;
+	u64 queue_stop_ms;
+
+	/* Stalls waiting for ring buffer space. */
+	u64 n_rb_stall;
+	u64 rb_stall_ms;
+
+	/* Delays by admission control. */
+	u64 n_admission_delay;
+	u64 admission_delay_ms;
+
+	/* Throttling by QoS limits. */
+	u64 n_qos_throttled;
+	u64 qos_throttled_ms;
+
+	/* lsids. */
+	u64 latest_lsid;
+	u64 permanent_lsid;
+	u64 written_lsid;
+	u64 oldest_lsid;
+
+	/* Log space [physical block]. */
+	u64 log_capacity;
+	u64 log_usage;
+
+	/* Since version 2. */
+	/* Writes logged as zero records without data,
+	   write-zeroes IOs and writes of all-zero data. */
+	u64 n_zero_write;
+} __attribute__((packed));
+
+/**
+ * Minimum buffer size for WALB_IOCTL_STATUS.
+ */
+#define WALB_STATUS_HEADER_SIZE (sizeof(u32) * 2)
+
 #ifdef __cplusplus
 }
 #endif
@@ -79,6 +79,9 @@ extern "C" {
  *   ring_buffer {
  *     DATA u8[super0.ring_buffer_size * SECTOR_SIZE]
  *   }
+ *   if (super0.format_flags has SUPER_FORMAT_DIRTY_BITMAP) {
+ *     dirty_bitmap (see dirty_bitmap.h)
+ *   }
  * }
  *
  * PROPERTY1: Offset of ring_buffer
@@ -142,6 +145,21 @@ static inline u64 get_super_sector1_offset(int sector_size)
 	return get_super_sector0_offset(sector_size) + 1;
 }
 
+/**
+ * Get offset of a super sector slot.
+ *
+ * @sector_size sector size in bytes.
+ * @slot 0 for super0 or 1 for super1.
+ * @return offset in sectors.
+ */
+static inline u64 get_super_sector_offset(int sector_size, unsigned int slot)
+{
+	ASSERT(slot < 2);
+	return slot == 0 ?
+		get_super_sector0_offset(sector_size) :
+		get_super_sector1_offset(sector_size);
+}
+
 /**
  * Get ring buffer offset.
  *
@@ -198,6 +216,81 @@ static inline u64 get_offset_of_lsid_2
 	return get_offset_of_lsid(lsid, get_ring_buffer_offset_2(super_sect), super_sect->ring_buffer_size);
 }
 
+/**
+ * Get dirty bitmap offset.
+ * The dirty bitmap follows the ring buffer.
+ *
+ * @return offset in the log address space [physical sector].
+ */
+static inline u64 get_dirty_bitmap_offset_2(const struct walb_super_sector* super_sect)
+{
+	ASSERT(super_sect != NULL);
+	return get_ring_buffer_offset_2(super_sect) + super_sect->ring_buffer_size;
+}
+
+/**
+ * Get the end of the log area including the dirty bitmap.
+ *
+ * @return size of the log address space in use [physical sector].
+ */
+static inline u64 get_log_end_offset_2(const struct walb_super_sector* super_sect)
+{
+	return get_dirty_bitmap_offset_2(super_sect)
+		+ get_dirty_bitmap_pb_of_super(super_sect);
+}
+
+/**
+ * Map an offset in the log address space to a log device of a striped log.
+ *
+ * The i'th stripe of the log address space is
+ * the (i / n_ldevs)'th stripe of the (i % n_ldevs)'th log device.
+ * The first stripe must contain the super sectors
+ * so that they are at the same offsets of the first log device.
+ *
+ * @off offset in the log address space.
+ *   It will be the offset in the log device.
+ * @n_ldevs number of log devices.
+ * @stripe stripe size in the same unit as the offset.
+ *
+ * RETURN:
+ *   index of the log device.
+ */
+static inline unsigned int map_striped_log_offset(
+	u64 *off, unsigned int n_ldevs, u64 stripe)
+{
+	u64 idx, rem;
+	u32 ldev_idx;
+
+	if (n_ldevs <= 1)
+		return 0;
+	ASSERT(stripe > 0);
+	idx = div64_u64_rem(*off, stripe, &rem);
+	idx = div_u64_rem(idx, n_ldevs, &ldev_idx);
+	*off = idx * stripe + rem;
+	return ldev_idx;
+}
+
+/**
+ * Get size of the log address space of a striped log.
+ *
+ * @dev_size minimum size of the log devices.
+ * @n_ldevs number of log devices.
+ * @stripe stripe size in the same unit as the size.
+ *
+ * RETURN:
+ *   size of the log address space.
+ */
+static inline u64 get_striped_log_size(
+	u64 dev_size, unsigned int n_ldevs, u64 stripe)
+{
+	u64 rem;
+
+	if (n_ldevs <= 1)
+		return dev_size;
+	ASSERT(stripe > 0);
+	return div64_u64_rem(dev_size, stripe, &rem) * stripe * n_ldevs;
+}
+
 /*******************************************************************************
  * Static inline functions.
  *******************************************************************************/
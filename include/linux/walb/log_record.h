@@ -15,6 +15,7 @@ extern "C" {
 #include "util.h"
 #include "u32bits.h"
 #include "checksum.h"
+#include "block_size.h"
 #if 0
 #include "logger.h"
 #endif
@@ -27,6 +28,8 @@ enum {
 	LOG_RECORD_EXIST = 0,
 	LOG_RECORD_PADDING, /* Non-zero if this is padding log */
 	LOG_RECORD_DISCARD, /* Discard IO */
+	LOG_RECORD_ZERO, /* Zero-filled IO without data in the log */
+	LOG_RECORD_COMPRESSED, /* IO data are LZ4-compressed in the log */
 };
 
 /**
@@ -49,7 +52,7 @@ struct walb_log_record {
 	u64 offset;
 
 	/* IO size [logical sector].
-	 * A discard IO size can be UINT32_MAX,
+	 * A discard or zero IO size can be UINT32_MAX,
 	 * while normal IO size must be less than UINT16_MAX. */
 	u32 io_size;
 
@@ -57,7 +60,11 @@ struct walb_log_record {
 	   lsid - lsid_local is logpack lsid. */
 	u16 lsid_local;
 
-	u16 reserved1;
+	/* Log data size [physical sector] of a LOG_RECORD_COMPRESSED record.
+	   The data consist of the compressed size [byte] as u32
+	   and an LZ4 block, padded with zero.
+	   Use get_log_record_data_pb(). */
+	u16 compressed_pb;
 
 	/* Log sequence id of the record. */
 	u64 lsid;
@@ -65,9 +72,11 @@ struct walb_log_record {
 } __attribute__((packed, aligned(8)));
 
 /**
- * Logpack header data inside sector.
+ * Logpack header data inside sector(s).
  *
  * sizeof(struct walb_logpack_header) <= walb_super_sector.sector_size.
+ * A header can span n_header_pb physical blocks
+ * and the records continue over the blocks.
  */
 struct walb_logpack_header {
 
@@ -79,8 +88,8 @@ struct walb_logpack_header {
 	u16 sector_type;
 
 	/* Total io size in the log pack [physical sector].
-	   Log pack size is total_io_size + 1.
-	   Discard request's size is not included. */
+	   Log pack size is total_io_size + get_logpack_header_pb().
+	   Discard and zero requests' size is not included. */
 	u16 total_io_size;
 
 	/* logpack lsid [physical sector]. */
@@ -93,7 +102,12 @@ struct walb_logpack_header {
 	/* Number of padding record. 0 or 1. */
 	u16 n_padding;
 
-	u32 reserved1;
+	/* Size of the logpack header [physical sector].
+	   0 means 1 for logpacks written by older versions.
+	   Use get_logpack_header_pb(). */
+	u16 n_header_pb;
+
+	u16 reserved1;
 
 	struct walb_log_record record[0];
 	/* continuous records */
@@ -125,17 +139,26 @@ struct walb_logpack_header {
  * Prototype of static inline functions.
  *******************************************************************************/
 
+static inline unsigned int get_logpack_header_pb(
+	const struct walb_logpack_header *lhead);
+static inline unsigned int max_n_log_record_in_header(
+	unsigned int pbs, unsigned int n_pb);
 static inline unsigned int max_n_log_record_in_sector(unsigned int pbs);
 static inline void log_record_init(struct walb_log_record *rec);
 static inline int is_valid_log_record(struct walb_log_record *rec);
 static inline int is_valid_log_record_const(const struct walb_log_record *rec);
 static inline int is_valid_logpack_header(const struct walb_logpack_header *lhead);
+static inline u32 calc_logpack_header_checksum(
+	const struct walb_logpack_header *lhead, unsigned int pbs,
+	u32 salt, unsigned int csum_type);
 static inline int is_valid_logpack_header_with_checksum(
-	const struct walb_logpack_header* lhead, unsigned int pbs, u32 salt);
+	const struct walb_logpack_header* lhead, unsigned int pbs,
+	u32 salt, unsigned int csum_type);
 static inline int is_valid_logpack_header_and_records(
 	const struct walb_logpack_header *lhead);
 static inline int is_valid_logpack_header_and_records_with_checksum(
-	const struct walb_logpack_header* lhead, unsigned int pbs, u32 salt);
+	const struct walb_logpack_header* lhead, unsigned int pbs,
+	u32 salt, unsigned int csum_type);
 static inline u64 get_next_lsid(const struct walb_logpack_header *lhead);
 
 /*******************************************************************************
@@ -143,14 +166,38 @@ static inline u64 get_next_lsid(const struct walb_logpack_header *lhead);
  *******************************************************************************/
 
 /**
- * Get number of log records that a log pack can store.
+ * Get size of a logpack header [physical block].
+ */
+static inline unsigned int get_logpack_header_pb(
+	const struct walb_logpack_header *lhead)
+{
+	return lhead->n_header_pb == 0 ? 1 : lhead->n_header_pb;
+}
+
+/**
+ * Get number of log records that a log pack header can store.
  * @pbs physical block size.
+ * @n_pb header size [physical block].
  */
-static inline unsigned int max_n_log_record_in_sector(unsigned int pbs)
+static inline unsigned int max_n_log_record_in_header(
+	unsigned int pbs, unsigned int n_pb)
 {
+	unsigned int n;
+
 	ASSERT(pbs > sizeof(struct walb_logpack_header));
-	return (pbs - sizeof(struct walb_logpack_header)) /
+	ASSERT(0 < n_pb && n_pb <= WALB_MAX_LOGPACK_HEADER_PB);
+	n = (pbs * n_pb - sizeof(struct walb_logpack_header)) /
 		sizeof(struct walb_log_record);
+	return n < UINT16_MAX ? n : UINT16_MAX;
+}
+
+/**
+ * Get number of log records that a one-block log pack header can store.
+ * @pbs physical block size.
+ */
+static inline unsigned int max_n_log_record_in_sector(unsigned int pbs)
+{
+	return max_n_log_record_in_header(pbs, 1);
 }
 
 /**
@@ -162,6 +209,37 @@ static inline void log_record_init(struct walb_log_record *rec)
 	memset(rec, 0, sizeof(*rec));
 }
 
+/**
+ * Discard and zero records do not have their data in the log.
+ *
+ * @return Non-zero if the record has no data, or 0.
+ */
+static inline int is_payload_free_log_record(
+	const struct walb_log_record *rec)
+{
+	return test_bit_u32(LOG_RECORD_DISCARD, &rec->flags) ||
+		test_bit_u32(LOG_RECORD_ZERO, &rec->flags);
+}
+
+/**
+ * Get the data size of a record in the log.
+ *
+ * @rec log record.
+ * @pbs physical block size.
+ *
+ * RETURN:
+ *   data size [physical block].
+ */
+static inline unsigned int get_log_record_data_pb(
+	const struct walb_log_record *rec, unsigned int pbs)
+{
+	if (is_payload_free_log_record(rec))
+		return 0;
+	if (test_bit_u32(LOG_RECORD_COMPRESSED, &rec->flags))
+		return rec->compressed_pb;
+	return (unsigned int)capacity_pb(pbs, rec->io_size);
+}
+
 /**
  * This is for validation of log record.
  *
@@ -174,9 +252,12 @@ static inline int is_valid_log_record(struct walb_log_record *rec)
 	if (!test_bit_u32(LOG_RECORD_PADDING, &rec->flags)) {
 		CHECKd(rec->io_size > 0);
 	}
-	if (!test_bit_u32(LOG_RECORD_DISCARD, &rec->flags)) {
+	if (!is_payload_free_log_record(rec)) {
 		CHECKd(rec->io_size <= WALB_MAX_NORMAL_IO_SECTORS);
 	}
+	if (test_bit_u32(LOG_RECORD_COMPRESSED, &rec->flags)) {
+		CHECKd(rec->compressed_pb > 0);
+	}
 	CHECKd(rec->lsid_local > 0);
 	CHECKd(rec->lsid <= MAX_LSID);
 
@@ -220,6 +301,7 @@ static inline int is_valid_logpack_header(
 
 	CHECKd(lhead);
 	CHECKd(lhead->sector_type == SECTOR_TYPE_LOGPACK);
+	CHECKd(lhead->n_header_pb <= WALB_MAX_LOGPACK_HEADER_PB);
 	if (lhead->n_records == 0) {
 		CHECKd(lhead->total_io_size == 0);
 		CHECKd(lhead->n_padding == 0);
@@ -228,8 +310,8 @@ static inline int is_valid_logpack_header(
 		CHECKd(lhead->n_padding <= lhead->n_records);
 
 		/* logpack_lsid overflow check. */
-		CHECKd(lhead->logpack_lsid <
-			lhead->logpack_lsid + 1 + lhead->total_io_size);
+		CHECKd(lhead->logpack_lsid < lhead->logpack_lsid
+			+ get_logpack_header_pb(lhead) + lhead->total_io_size);
 	}
 	return 1;
 error:
@@ -242,21 +324,46 @@ error:
 	return 0;
 }
 
+/**
+ * Calculate checksum of a logpack header.
+ * The checksum field is treated as zero.
+ * The whole header (get_logpack_header_pb() blocks) must be filled.
+ *
+ * RETURN:
+ *   the value to be stored in lhead->checksum.
+ */
+static inline u32 calc_logpack_header_checksum(
+	const struct walb_logpack_header *lhead, unsigned int pbs,
+	u32 salt, unsigned int csum_type)
+{
+	return walb_csum_block(
+		csum_type, lhead, pbs * get_logpack_header_pb(lhead),
+		offsetof(struct walb_logpack_header, checksum), salt);
+}
+
 /**
  * Check validness of a logpack header.
  *
  * @logpack logpack to be checked.
+ *   The whole header (get_logpack_header_pb() blocks) must be read.
  * @pbs physical block size.
- *   (This is logpack header size.)
+ * @salt checksum salt.
+ * @csum_type checksum type. See get_csum_type_of_super().
  *
  * @return Non-zero in success, or 0.
  */
 static inline int is_valid_logpack_header_with_checksum(
-	const struct walb_logpack_header* lhead, unsigned int pbs, u32 salt)
+	const struct walb_logpack_header* lhead, unsigned int pbs,
+	u32 salt, unsigned int csum_type)
 {
+	const unsigned int n_pb = get_logpack_header_pb(lhead);
+
 	CHECKld(error0, is_valid_logpack_header(lhead));
+	CHECKld(error0, lhead->n_records
+		<= max_n_log_record_in_header(pbs, n_pb));
 	if (lhead->n_records > 0) {
-		CHECKld(error1, checksum((const u8 *)lhead, pbs, salt) == 0);
+		CHECKld(error1, calc_logpack_header_checksum(
+				lhead, pbs, salt, csum_type) == lhead->checksum);
 	}
 	return 1;
 error0:
@@ -304,12 +411,12 @@ static inline int is_valid_logpack_header_and_records(
 }
 
 static inline int is_valid_logpack_header_and_records_with_checksum(
-	const struct walb_logpack_header* lhead, unsigned int pbs, u32 salt)
+	const struct walb_logpack_header* lhead, unsigned int pbs,
+	u32 salt, unsigned int csum_type)
 {
-	if (lhead->n_records > 0) {
-		if (checksum((const u8 *)lhead, pbs, salt) != 0) {
-			return 0;
-		}
+	if (!is_valid_logpack_header_with_checksum(
+			lhead, pbs, salt, csum_type)) {
+		return 0;
 	}
 	return is_valid_logpack_header_and_records(lhead);
 }
@@ -324,7 +431,8 @@ static inline u64 get_next_lsid_unsafe(const struct walb_logpack_header *lhead)
 		/* Zero-flush only. */
 		return lhead->logpack_lsid;
 	}
-	return lhead->logpack_lsid + 1 + lhead->total_io_size;
+	return lhead->logpack_lsid + get_logpack_header_pb(lhead)
+		+ lhead->total_io_size;
 }
 
 /**
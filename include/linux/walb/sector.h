@@ -572,18 +572,20 @@ static inline int sector_array_sprint(
  * @offset offset in bytes.
  * @size size in bytes.
  * @salt checksum salt.
+ * @csum_type checksum type. WALB_CSUM_XXX.
  *
  * RETURN:
  *   calculated checksum.
  */
 static inline u32 sector_array_checksum(
 	struct sector_data_array *sect_ary,
-	unsigned int offset, unsigned int size, u32 salt)
+	unsigned int offset, unsigned int size, u32 salt,
+	unsigned int csum_type)
 {
 	unsigned int remaining = size;
 	unsigned int sect_size;
 	unsigned int idx, off;
-	u32 sum = salt;
+	u32 sum = walb_csum_init(csum_type, salt);
 	unsigned int tsize;
 
 	ASSERT(size > 0);
@@ -596,14 +598,14 @@ static inline u32 sector_array_checksum(
 	while (remaining > 0) {
 		ASSERT(idx < sect_ary->size);
 		tsize = get_min_value(sect_size - off, remaining);
-		sum = checksum_partial(
-			sum, &((u8 *)sect_ary->array[idx]->data)[off],
-			tsize);
+		sum = walb_csum_partial(
+			csum_type, sum,
+			&((u8 *)sect_ary->array[idx]->data)[off], tsize);
 		remaining -= tsize;
 		idx++;
 		off = 0;
 	}
-	return checksum_finish(sum);
+	return walb_csum_finish(csum_type, sum);
 }
 
 /**
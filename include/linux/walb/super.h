@@ -11,6 +11,8 @@
 #include "block_size.h"
 #include "check.h"
 #include "util.h"
+#include "checksum.h"
+#include "dirty_bitmap.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -21,6 +23,23 @@ extern "C" {
  */
 #define ASSERT_SUPER_SECTOR(sect) ASSERT(is_valid_super_sector(sect))
 
+/**
+ * Bit indices of walb_super_sector.format_flags.
+ * They are decided at format and never changed.
+ */
+enum {
+	/* CRC32C is used for the super sectors, logpack headers
+	   and log data instead of the 32-bit word sum. */
+	SUPER_FORMAT_CRC32C = 0,
+	/* The log is striped over n_ldevs log devices. */
+	SUPER_FORMAT_STRIPED,
+	/* A dirty region bitmap follows the ring buffer.
+	   See dirty_region_lb and dirty_bitmap_pb. */
+	SUPER_FORMAT_DIRTY_BITMAP,
+	SUPER_FORMAT_MAX,
+};
+#define SUPER_FORMAT_MASK ((1U << SUPER_FORMAT_MAX) - 1)
+
 /**
  * Super block data of the log device.
  *
@@ -29,7 +48,8 @@ extern "C" {
 struct walb_super_sector {
 
 	/* (2 * 2) + (4) +
-	   (4 * 4) + 16 + 64 + (8 * 4) = 136 bytes */
+	   (4 * 4) + 16 + 32 + (8 * 5) + (4 * 2) +
+	   (4 + 2 * 2) + (4 * 2) = 136 bytes */
 
 	/*
 	 * Constant value inside the kernel.
@@ -42,11 +62,18 @@ struct walb_super_sector {
 	 *   uuid
 	 *   ring_buffer_size
 	 *   sector_type
+	 *   logpack_header_pb
+	 *   format_flags
+	 *   log_stripe_pb
+	 *   n_ldevs
+	 *   dirty_region_lb
+	 *   dirty_bitmap_pb
 	 *
 	 * Variable inside kernel (set only in sync down)
 	 *   checksum
 	 *   oldest_lsid
 	 *   written_lsid
+	 *   generation
 	 */
 
 	/* sector type */
@@ -110,6 +137,47 @@ struct walb_super_sector {
 	/* Size of wrapper block device [logical block] */
 	u64 device_size;
 
+	/* Generation number of the super sector.
+	 *
+	 * Super sectors are written to super0 and super1 alternately.
+	 * The slot is (generation % 2) and the valid one with
+	 * the larger generation is the latest.
+	 * Images written by older versions have 0 here.
+	 */
+	u64 generation;
+
+	/* Size of logpack headers [physical block].
+	 *
+	 * A logpack header near the end of the ring buffer
+	 * uses fewer blocks not to wrap around.
+	 * 0 means 1 for images written by older versions.
+	 */
+	u32 logpack_header_pb;
+
+	/* Format flags. See SUPER_FORMAT_XXX.
+	 * Older versions have 0 here. */
+	u32 format_flags;
+
+	/* Stripe size of a striped log [physical block].
+	 * See SUPER_FORMAT_STRIPED. 0 for non-striped logs. */
+	u32 log_stripe_pb;
+
+	/* Number of log devices of a striped log.
+	 * 0 for non-striped logs. */
+	u16 n_ldevs;
+
+	u16 reserved3;
+
+	/* Region size covered by a bit of the dirty bitmap [logical block].
+	 * A power of 2. See SUPER_FORMAT_DIRTY_BITMAP.
+	 * 0 if there is no dirty bitmap. */
+	u32 dirty_region_lb;
+
+	/* Size of the dirty bitmap [physical block].
+	 * It is not included in ring_buffer_size.
+	 * 0 if there is no dirty bitmap. */
+	u32 dirty_bitmap_pb;
+
 } __attribute__((packed, aligned(8)));
 
 /**
@@ -131,11 +199,30 @@ static inline int is_valid_super_sector_raw(
 	/* sector type */
 	CHECKd(sect->sector_type == SECTOR_TYPE_SUPER);
 	/* version */
-	CHECKd(sect->version == WALB_LOG_VERSION);
+	CHECKd(is_valid_log_version(sect->version));
 	/* block size */
 	CHECKd(sect->physical_bs == pbs);
 	CHECKd(sect->physical_bs >= sect->logical_bs);
 	CHECKd(sect->physical_bs % sect->logical_bs == 0);
+	/* logpack header size. */
+	CHECKd(sect->logpack_header_pb <=
+		get_max_logpack_header_pb(sect->physical_bs));
+	/* unknown format. */
+	CHECKd((sect->format_flags & ~SUPER_FORMAT_MASK) == 0);
+	/* striped log. */
+	if (sect->format_flags & (1U << SUPER_FORMAT_STRIPED)) {
+		CHECKd(2 <= sect->n_ldevs);
+		CHECKd(sect->n_ldevs <= WALB_MAX_LDEVS);
+		CHECKd(sect->log_stripe_pb > 0);
+	}
+	/* dirty bitmap. */
+	if (sect->format_flags & (1U << SUPER_FORMAT_DIRTY_BITMAP)) {
+		CHECKd(is_valid_dirty_region_lb(sect->dirty_region_lb));
+		CHECKd(sect->dirty_bitmap_pb > 0);
+	} else {
+		CHECKd(sect->dirty_region_lb == 0);
+		CHECKd(sect->dirty_bitmap_pb == 0);
+	}
 	/* lsid consistency. */
 	CHECKd(sect->oldest_lsid != INVALID_LSID);
 	CHECKd(sect->written_lsid != INVALID_LSID);
@@ -165,6 +252,42 @@ static inline int is_valid_super_sector(const struct sector_data* sect)
 		(const struct walb_super_sector *)sect->data, sect->size);
 }
 
+/**
+ * Get the super sector slot for a generation.
+ *
+ * @generation generation number of a super sector.
+ *
+ * RETURN:
+ *   0 for super0 or 1 for super1.
+ */
+static inline unsigned int get_super_sector_slot(u64 generation)
+{
+	return (unsigned int)(generation & 1);
+}
+
+/**
+ * Choose the latest super sector between the two slots.
+ *
+ * @valid0 non-zero if super0 is valid.
+ * @gen0 generation of super0.
+ * @valid1 non-zero if super1 is valid.
+ * @gen1 generation of super1.
+ *
+ * RETURN:
+ *   0 for super0, 1 for super1, or -1 if both are invalid.
+ */
+static inline int choose_latest_super_sector(
+	int valid0, u64 gen0, int valid1, u64 gen1)
+{
+	if (valid0 && valid1)
+		return gen1 > gen0 ? 1 : 0;
+	if (valid0)
+		return 0;
+	if (valid1)
+		return 1;
+	return -1;
+}
+
 /**
  * Set super sector name.
  *
@@ -184,6 +307,73 @@ static inline char* set_super_sector_name(
 	return super_sect->name;
 }
 
+/**
+ * Get size of logpack headers [physical block].
+ */
+static inline unsigned int get_logpack_header_pb_of_super(
+	const struct walb_super_sector *super_sect)
+{
+	return super_sect->logpack_header_pb == 0
+		? 1 : super_sect->logpack_header_pb;
+}
+
+/**
+ * Get the checksum type of the super sector, logpack headers and log data.
+ *
+ * RETURN:
+ *   WALB_CSUM_XXX.
+ */
+static inline unsigned int get_csum_type_of_super(
+	const struct walb_super_sector *super_sect)
+{
+	return (super_sect->format_flags & (1U << SUPER_FORMAT_CRC32C))
+		? WALB_CSUM_CRC32C : WALB_CSUM_SUM;
+}
+
+/**
+ * Get the number of log devices.
+ *
+ * RETURN:
+ *   1 for non-striped logs.
+ */
+static inline unsigned int get_n_ldevs_of_super(
+	const struct walb_super_sector *super_sect)
+{
+	return (super_sect->format_flags & (1U << SUPER_FORMAT_STRIPED))
+		? super_sect->n_ldevs : 1;
+}
+
+/**
+ * Get size of the dirty bitmap [physical block].
+ *
+ * RETURN:
+ *   0 if there is no dirty bitmap.
+ */
+static inline u32 get_dirty_bitmap_pb_of_super(
+	const struct walb_super_sector *super_sect)
+{
+	return (super_sect->format_flags & (1U << SUPER_FORMAT_DIRTY_BITMAP))
+		? super_sect->dirty_bitmap_pb : 0;
+}
+
+/**
+ * Calculate checksum of a super sector image.
+ * The checksum field is not used for the calculation.
+ *
+ * @super_sect super sector image.
+ * @pbs physical block size [byte].
+ *
+ * RETURN:
+ *   checksum to be stored in or compared with super_sect->checksum.
+ */
+static inline u32 calc_super_sector_checksum(
+	const struct walb_super_sector *super_sect, unsigned int pbs)
+{
+	return walb_csum_block(
+		get_csum_type_of_super(super_sect), super_sect, pbs,
+		offsetof(struct walb_super_sector, checksum), 0);
+}
+
 /**
  * Get super sector pointer.
  *
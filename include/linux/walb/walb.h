@@ -20,8 +20,51 @@ extern "C" {
  * ver2
  *   enlarge max IO size to 32bit from 16bit unsigned int.
  *   Still max IO size with data is limited to 16bit due to other reasons.
+ * ver3
+ *   logpack headers can span multiple physical blocks.
+ *   See logpack_header_pb in the super sector.
+ *   zero records (LOG_RECORD_ZERO) which do not have data in the log.
+ *   compressed records (LOG_RECORD_COMPRESSED) with compressed_pb.
+ *
+ * Log devices and walblog streams of older versions
+ * down to WALB_LOG_VERSION_MIN can be read.
+ */
+#define WALB_LOG_VERSION 3
+#define WALB_LOG_VERSION_MIN 2
+
+static inline bool is_valid_log_version(unsigned int version)
+{
+	return WALB_LOG_VERSION_MIN <= version && version <= WALB_LOG_VERSION;
+}
+
+/**
+ * Maximum number of physical blocks of a logpack header.
+ */
+#define WALB_MAX_LOGPACK_HEADER_PB 64
+
+/**
+ * Maximum size of a logpack header [byte].
+ * The kernel allocates each header as a physically contiguous buffer
+ * in the write path, so it must be at most order 3 with 4KiB pages.
+ */
+#define WALB_MAX_LOGPACK_HEADER_SIZE (32 * 1024)
+
+/**
+ * Get maximum number of physical blocks of a logpack header.
+ *
+ * @pbs physical block size [byte].
+ */
+static inline unsigned int get_max_logpack_header_pb(unsigned int pbs)
+{
+	const unsigned int n_pb = WALB_MAX_LOGPACK_HEADER_SIZE / pbs;
+
+	return n_pb < WALB_MAX_LOGPACK_HEADER_PB ? n_pb : WALB_MAX_LOGPACK_HEADER_PB;
+}
+
+/**
+ * Maximum number of log devices of a striped log.
  */
-#define WALB_LOG_VERSION 2
+#define WALB_MAX_LDEVS 8
 
 /**
  * Maximum IO size [logical block or sector].
@@ -61,6 +104,7 @@ extern "C" {
 #define SECTOR_TYPE_SNAPSHOT	     0x0002
 #define SECTOR_TYPE_LOGPACK	     0x0003
 #define SECTOR_TYPE_WALBLOG_HEADER  0x0004
+#define SECTOR_TYPE_DIRTY_BITMAP    0x0005
 
 /**
  * Constants for lsid.
@@ -357,11 +357,16 @@ bool alldevs_is_already_used(dev_t devt)
 {
 	struct walb_dev *wdev;
 	int key;
+	unsigned int i;
 
 	idr_for_each_entry(&all_wdevs_, wdev, key) {
 		ASSERT(get_key_from_wdev(wdev) == key);
 		if (devt == wdev->ldev->bd_dev || devt == wdev->ddev->bd_dev)
 			return true;
+		for (i = 1; i < wdev->n_ldevs; i++) {
+			if (devt == wdev->ldevs[i]->bd_dev)
+				return true;
+		}
 	}
 	return false;
 }
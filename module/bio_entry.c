@@ -7,6 +7,7 @@
 #include "check_kernel.h"
 #include <linux/module.h>
 #include <linux/list.h>
+#include <linux/ktime.h>
 #include "bio_entry.h"
 #include "bio_util.h"
 #include "bio_set.h"
@@ -120,6 +121,7 @@ static void bio_entry_end_io(struct bio *bio)
 	}
 
 	bioe->status = bio->bi_status;
+	bioe->end_ns = ktime_get_ns();
 	LOG_("complete bioe %p pos %" PRIu64 " len %u\n"
 		, bioe, bio_entry_pos(bioe), bio_entry_len(bioe));
 
@@ -140,6 +142,7 @@ void init_bio_entry(struct bio_entry *bioe, struct bio *bio)
 	bioe->iter = bio->bi_iter; /* copy */
 	bio->bi_private = bioe;
 	bio->bi_end_io = bio_entry_end_io;
+	bioe->end_ns = 0;
 #ifdef WALB_PERFORMANCE_ANALYSIS
 	memset(&bioe->end_ts, 0, sizeof(bioe->end_ts));
 #endif
@@ -289,7 +292,7 @@ struct bio* bio_deep_clone(struct bio *bio, gfp_t gfp_mask)
 	clone->bi_iter.bi_sector = bio->bi_iter.bi_sector;
 
 	if (size == 0) {
-		/* This is for discard IOs. */
+		/* This is for discard and write-zeroes IOs. */
 		clone->bi_iter.bi_size = bio->bi_iter.bi_size;
 	} else {
 		bio_copy_data(clone, bio);
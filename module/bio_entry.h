@@ -28,6 +28,7 @@ struct bio_entry
 
 	blk_status_t status; /* bio status. */
 	struct completion done;
+	u64 end_ns; /* ktime_get_ns() when end_io callback is called. */
 
 #ifdef WALB_PERFORMANCE_ANALYSIS
 	struct timespec end_ts; /* timestamp when end_io callback is called. */
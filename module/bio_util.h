@@ -62,16 +62,19 @@ static inline void bio_get_overlapped(
  *
  * @bio target bio
  * @salt checksum salt.
+ * @csum_type checksum type. WALB_CSUM_XXX.
  *
  * RETURN:
  *   checksum if bio->bi_size > 0, else 0.
  */
-static inline u32 bio_calc_checksum_iter(const struct bio *bio, struct bvec_iter iter, u32 salt)
+static inline u32 bio_calc_checksum_iter(
+	const struct bio *bio, struct bvec_iter iter,
+	u32 salt, unsigned int csum_type)
 {
 	struct bio *biox = (struct bio *)bio;
 	struct bio_vec bvec;
 	struct bvec_iter iterx;
-	u32 sum = salt;
+	u32 sum = walb_csum_init(csum_type, salt);
 
 	ASSERT(bio);
 
@@ -83,16 +86,17 @@ static inline u32 bio_calc_checksum_iter(const struct bio *bio, struct bvec_iter
 		const uint off = bio_iter_offset(bio, iterx);
 
 		u8 *buf = (u8 *)kmap_atomic(bio_iter_page(bio, iterx));
-		sum = checksum_partial(sum, buf + off, len);
+		sum = walb_csum_partial(csum_type, sum, buf + off, len);
 		kunmap_atomic(buf);
 	}
 
-	return checksum_finish(sum);
+	return walb_csum_finish(csum_type, sum);
 }
 
-static inline u32 bio_calc_checksum(const struct bio *bio, u32 salt)
+static inline u32 bio_calc_checksum(
+	const struct bio *bio, u32 salt, unsigned int csum_type)
 {
-	return bio_calc_checksum_iter(bio, bio->bi_iter, salt);
+	return bio_calc_checksum_iter(bio, bio->bi_iter, salt, csum_type);
 }
 
 #define SNPRINT_BIO_PROCEED(buf, size, w, s) do {			\
@@ -453,6 +457,102 @@ static inline uint bio_copy_data_partial(
 	return sectors - (remaining >> 9);
 }
 
+/**
+ * Fill bio data with zero partially.
+ * This does not use dst_bio->bi_iter.
+ *
+ * @dst_bio written bio.
+ * @dst_iter start iterator of the dst_bio.
+ * @sectors fill size [logical block].
+ *
+ * RETURN:
+ *   filled size [logical block].
+ */
+static inline uint bio_zero_data_partial(
+	struct bio *dst_bio, struct bvec_iter dst_iter, uint sectors)
+{
+	uint remaining = sectors << 9;
+
+	while (remaining > 0 && dst_iter.bi_size) {
+		const uint dst_off = bio_iter_offset(dst_bio, dst_iter);
+		const uint bytes = min(bio_iter_len(dst_bio, dst_iter), remaining);
+		u8 *dst_p = (u8 *)kmap_atomic(bio_iter_page(dst_bio, dst_iter));
+
+		memset(dst_p + dst_off, 0, bytes);
+		kunmap_atomic(dst_p);
+
+		bio_advance_iter(dst_bio, &dst_iter, bytes);
+		remaining -= bytes;
+	}
+
+	return sectors - (remaining >> 9);
+}
+
+/**
+ * Check whether all the data of a bio are zero.
+ * memchr_inv() compares a word at a time and returns
+ * at the first non-zero byte, so usual data are rejected quickly.
+ *
+ * RETURN:
+ *   true if the bio has data and all of them are zero.
+ */
+static inline bool bio_is_zero_filled(const struct bio *bio)
+{
+	struct bio *biox = (struct bio *)bio;
+	struct bio_vec bvec;
+	struct bvec_iter iter;
+
+	if (!bio_has_data(biox))
+		return false;
+
+	bio_for_each_segment(bvec, biox, iter) {
+		u8 *buf = (u8 *)kmap_atomic(bvec.bv_page);
+		const bool is_zero =
+			!memchr_inv(buf + bvec.bv_offset, 0, bvec.bv_len);
+		kunmap_atomic(buf);
+		if (!is_zero)
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Copy the whole data of a bio to a buffer.
+ *
+ * @buf buffer of bio->bi_iter.bi_size bytes at least.
+ */
+static inline void bio_copy_to_buf(u8 *buf, const struct bio *bio)
+{
+	struct bio *biox = (struct bio *)bio;
+	struct bio_vec bvec;
+	struct bvec_iter iter;
+
+	bio_for_each_segment(bvec, biox, iter) {
+		u8 *p = (u8 *)kmap_atomic(bvec.bv_page);
+		memcpy(buf, p + bvec.bv_offset, bvec.bv_len);
+		kunmap_atomic(p);
+		buf += bvec.bv_len;
+	}
+}
+
+/**
+ * Copy a buffer to the whole data of a bio.
+ *
+ * @buf buffer of bio->bi_iter.bi_size bytes at least.
+ */
+static inline void bio_copy_from_buf(struct bio *bio, const u8 *buf)
+{
+	struct bio_vec bvec;
+	struct bvec_iter iter;
+
+	bio_for_each_segment(bvec, bio, iter) {
+		u8 *p = (u8 *)kmap_atomic(bvec.bv_page);
+		memcpy(p + bvec.bv_offset, buf, bvec.bv_len);
+		kunmap_atomic(p);
+		buf += bvec.bv_len;
+	}
+}
+
 #define bio_list_for_each_safe(bio, n, bl)				\
 	for (bio = (bl)->head, n = (bio ? bio->bi_next : NULL);		\
 	     bio; bio = n, n = (n ? n->bi_next : NULL))
@@ -102,7 +102,7 @@ void print_bio_wrapper(const char *level, const struct bio_wrapper *biow)
 		"len %u "
 		"csum %08x "
 		"status %u "
-		"flags(%d%d%d"
+		"flags(%d%d%d%d"
 #ifdef WALB_OVERLAPPED_SERIALIZE
 		"%d"
 #endif
@@ -127,6 +127,7 @@ void print_bio_wrapper(const char *level, const struct bio_wrapper *biow)
 		, (u64)biow->pos, biow->len, biow->csum, biow->status
 		, bio_wrapper_state_is_started(biow) ? 1 : 0
 		, bio_wrapper_state_is_discard(biow) ? 1 : 0
+		, bio_wrapper_state_is_zero(biow) ? 1 : 0
 		, bio_wrapper_state_is_overwritten(biow) ? 1 : 0
 #ifdef WALB_OVERLAPPED_SERIALIZE
 		, bio_wrapper_state_is_delayed(biow) ? 1 : 0
@@ -175,10 +176,12 @@ void init_bio_wrapper(struct bio_wrapper *biow, struct bio *bio)
 	biow->status = BLK_STS_OK;
 	biow->csum = 0;
 	biow->private_data = NULL;
+	biow->mem_bytes = 0;
 	init_completion(&biow->done);
 	biow->flags = 0;
 	biow->lsid = 0;
 	biow->copied_bio = NULL;
+	biow->compressed_bio = NULL;
 
 	if (bio) {
 		biow->bio = bio;
@@ -192,6 +195,9 @@ void init_bio_wrapper(struct bio_wrapper *biow, struct bio *bio)
 		biow->pos = 0;
 		biow->len = 0;
 	}
+	biow->begin_ns = 0;
+	biow->stage_ns = 0;
+	biow->io_end_ns = 0;
 #ifdef WALB_OVERLAPPED_SERIALIZE
 	biow->n_overlapped = -1;
 #ifdef WALB_DEBUG
@@ -231,6 +237,8 @@ void destroy_bio_wrapper(struct bio_wrapper *biow)
 
 	if (biow->copied_bio)
 		bio_put_with_pages(biow->copied_bio);
+	if (biow->compressed_bio)
+		bio_put_with_pages(biow->compressed_bio);
 
 	kmem_cache_free(bio_wrapper_cache_, biow);
 }
@@ -284,9 +292,16 @@ bool bio_wrapper_copy_overlapped(
 		ASSERT((dst_iter.bi_size >> 9) >= sectors);
 		ASSERT((src_iter.bi_size >> 9) >= sectors);
 
-		written = bio_copy_data_partial(
-			dst_bio, dst_iter,
-			src_bio, src_iter, sectors);
+		if (bio_has_data(src_bio)) {
+			written = bio_copy_data_partial(
+				dst_bio, dst_iter,
+				src_bio, src_iter, sectors);
+		} else {
+			/* Write-zeroes IO. */
+			ASSERT(bio_wrapper_state_is_zero(src));
+			written = bio_zero_data_partial(
+				dst_bio, dst_iter, sectors);
+		}
 		ASSERT(written == sectors);
 
 		/* Split top */
@@ -49,6 +49,10 @@ struct bio_wrapper
 	   For discard IOs, this is NULL. */
 	struct bio *copied_bio;
 
+	/* Compressed data of copied_bio to be written to the log device,
+	   or NULL if they are not compressed. See iocore_compress(). */
+	struct bio *compressed_bio;
+
 	/* for temporary use for IOs for log/data devices. */
 	struct bio_entry cloned_bioe;
 
@@ -57,8 +61,17 @@ struct bio_wrapper
 
 	unsigned long start_time; /* for diskstats. */
 
+	/* For latency statistics [ns]. See latency.h. */
+	u64 begin_ns; /* when the IO has been accepted. */
+	u64 stage_ns; /* when the current stage has started. */
+	u64 io_end_ns; /* when the last IO for underlying devices has ended. */
+
 	void *private_data;
 
+	/* Memory accounted to the device for this wrapper [byte].
+	   See iocore_mem_charge(). */
+	unsigned int mem_bytes;
+
 #ifdef WALB_OVERLAPPED_SERIALIZE
 	int n_overlapped; /* initial value is -1. */
 #ifdef WALB_DEBUG
@@ -110,6 +123,10 @@ enum
 	 * Information bit.
 	 */
 	BIO_WRAPPER_DISCARD,
+	/* Set if the biow is logged as a zero record without data.
+	   Its copied_bio has no data if the data device
+	   supports REQ_OP_WRITE_ZEROES. */
+	BIO_WRAPPER_ZERO,
 	/* Set if the biow data will be fully overwritten by newer IO(s). */
 	BIO_WRAPPER_OVERWRITTEN,
 #ifdef WALB_OVERLAPPED_SERIALIZE
@@ -135,6 +152,11 @@ enum
 	test_bit(BIO_WRAPPER_STARTED, &(biow)->flags)
 #define bio_wrapper_state_is_discard(biow) \
 	test_bit(BIO_WRAPPER_DISCARD, &(biow)->flags)
+#define bio_wrapper_state_is_zero(biow) \
+	test_bit(BIO_WRAPPER_ZERO, &(biow)->flags)
+/* Discard and zero IOs do not have their data in the log. */
+#define bio_wrapper_state_is_payload_free(biow) \
+	(bio_wrapper_state_is_discard(biow) || bio_wrapper_state_is_zero(biow))
 #define bio_wrapper_state_is_overwritten(biow) \
 	test_bit(BIO_WRAPPER_OVERWRITTEN, &(biow)->flags)
 #ifdef WALB_OVERLAPPED_SERIALIZE
@@ -198,7 +220,8 @@ void bio_wrapper_exit(void);
 #define BIO_WRAPPER_PRINT_CSUM(prefix, biow) do {			\
 		const struct walb_dev *wdev = biow->private_data;	\
 		biow->csum = bio_calc_checksum(				\
-			biow->bio, wdev->log_checksum_salt);		\
+			biow->bio, wdev->log_checksum_salt,		\
+			wdev->log_csum_type);				\
 		print_bio_wrapper_short(KERN_INFO, biow, prefix);	\
 	} while (0)
 #define BIO_WRAPPER_PRINT_LS(prefix, biow, list_size) do {	\
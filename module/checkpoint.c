@@ -7,9 +7,74 @@
 #include "check_kernel.h"
 
 #include <linux/module.h>
+#include <linux/math64.h>
 #include "super.h"
 #include "checkpoint.h"
 #include "kern.h"
+#include "walb_trace.h"
+
+/*******************************************************************************
+ * Static functions prototype.
+ *******************************************************************************/
+
+static u32 calc_effective_interval(
+	struct walb_dev *wdev, u32 interval, u32 cur_interval,
+	bool is_idle, u64 usage);
+
+/*******************************************************************************
+ * Static functions definition.
+ *******************************************************************************/
+
+/**
+ * Calculate the next effective checkpoint interval.
+ *
+ * While the log is being filled, the interval is shortened
+ * in proportion to the free space of the ring buffer
+ * that had not been covered by the superblock before the checkpoint,
+ * that is, ring_buffer_size - usage.
+ * While the device is idle, the interval is doubled
+ * up to interval * WALB_CHECKPOINT_IDLE_FACTOR.
+ *
+ * @wdev walb device.
+ * @interval configured checkpoint interval [ms].
+ * @cur_interval current effective checkpoint interval [ms].
+ * @is_idle true if nothing has been written since the previous checkpoint.
+ * @usage latest_lsid - prev_written_lsid sampled before the checkpoint.
+ *   It must not be sampled after the checkpoint,
+ *   which sets prev_written_lsid to written_lsid.
+ *
+ * RETURN:
+ *   next effective checkpoint interval [ms].
+ */
+static u32 calc_effective_interval(
+	struct walb_dev *wdev, u32 interval, u32 cur_interval,
+	bool is_idle, u64 usage)
+{
+	const u64 rb_size = wdev->ring_buffer_size;
+	const u32 min_interval = min_t(u32, interval, WALB_MIN_CHECKPOINT_INTERVAL);
+	u64 max_interval, ret;
+
+	if (!checkpoint_adaptive_)
+		return interval;
+
+	if (is_idle) {
+		max_interval = min_t(u64, (u64)interval * WALB_CHECKPOINT_IDLE_FACTOR,
+				WALB_MAX_CHECKPOINT_INTERVAL);
+		ret = min_t(u64, (u64)max_t(u32, cur_interval, interval) * 2,
+			max_interval);
+		return (u32)ret;
+	}
+
+	if (usage >= rb_size)
+		return min_interval;
+
+	ret = div64_u64((u64)interval * (rb_size - usage), rb_size);
+	return (u32)max_t(u64, ret, min_interval);
+}
+
+/*******************************************************************************
+ * Global functions definition.
+ *******************************************************************************/
 
 /**
  * Initialize checkpointing.
@@ -20,6 +85,7 @@ void init_checkpointing(struct checkpoint_data *cpd)
 
 	init_rwsem(&cpd->lock);
 	cpd->interval = WALB_DEFAULT_CHECKPOINT_INTERVAL;
+	cpd->effective_interval = cpd->interval;
 	cpd->state = CP_STOPPED;
 }
 
@@ -34,6 +100,7 @@ void init_checkpointing(struct checkpoint_data *cpd)
 bool take_checkpoint(struct checkpoint_data *cpd)
 {
 	bool skip;
+	u64 written_lsid;
 	struct walb_dev *wdev;
 
 	ASSERT(cpd);
@@ -42,8 +109,10 @@ bool take_checkpoint(struct checkpoint_data *cpd)
 
 	/* Check the need of writing superblock. */
 	spin_lock(&wdev->lsid_lock);
-	skip = wdev->lsids.written == wdev->lsids.prev_written;
+	written_lsid = wdev->lsids.written;
+	skip = written_lsid == wdev->lsids.prev_written;
 	spin_unlock(&wdev->lsid_lock);
+	trace_walb_checkpoint(wdev_minor(wdev), written_lsid, skip);
 	if (skip) {
 		WLOG_(wdev, "skip superblock sync.\n");
 		return true;
@@ -59,8 +128,11 @@ bool take_checkpoint(struct checkpoint_data *cpd)
 void task_do_checkpointing(struct work_struct *work)
 {
 	unsigned long j0, j1;
-	unsigned long interval, sync_time_ms;
+	unsigned long sync_time_ms;
+	u32 interval, effective_interval;
 	long delay, sync_time, next_delay;
+	bool is_idle;
+	u64 usage;
 	int ret;
 
 	struct delayed_work *dwork =
@@ -72,6 +144,7 @@ void task_do_checkpointing(struct work_struct *work)
 	/* CP_WAITING --> CP_RUNNING. */
 	down_write(&cpd->lock);
 	interval = cpd->interval;
+	effective_interval = cpd->effective_interval;
 
 	ASSERT(interval > 0);
 	switch (cpd->state) {
@@ -89,6 +162,10 @@ void task_do_checkpointing(struct work_struct *work)
 	up_write(&cpd->lock);
 
 	/* Take a checkpoint. */
+	spin_lock(&wdev->lsid_lock);
+	is_idle = wdev->lsids.written == wdev->lsids.prev_written;
+	usage = wdev->lsids.latest - wdev->lsids.prev_written;
+	spin_unlock(&wdev->lsid_lock);
 	j0 = jiffies;
 	if (!take_checkpoint(cpd)) {
 		/* CP_RUNNING --> CP_STOPPED. */
@@ -100,7 +177,9 @@ void task_do_checkpointing(struct work_struct *work)
 	j1 = jiffies;
 
 	/* Calc next delay. */
-	delay = msecs_to_jiffies(interval);
+	effective_interval = calc_effective_interval(
+		wdev, interval, effective_interval, is_idle, usage);
+	delay = msecs_to_jiffies(effective_interval);
 	sync_time = (long)(j1 - j0);
 	next_delay = delay - sync_time;
 	sync_time_ms = jiffies_to_msecs(sync_time);
@@ -121,6 +200,7 @@ void task_do_checkpointing(struct work_struct *work)
 	/* CP_RUNNING --> CP_WAITING. */
 	down_write(&cpd->lock);
 	if (cpd->state == CP_RUNNING) {
+		cpd->effective_interval = effective_interval;
 		/* Register delayed work for next time */
 		INIT_DELAYED_WORK(&cpd->dwork, task_do_checkpointing);
 		ret = queue_delayed_work(wq_misc_, &cpd->dwork, next_delay);
@@ -159,6 +239,7 @@ void start_checkpointing(struct checkpoint_data *cpd)
 		return;
 	}
 	ASSERT(interval > 0);
+	cpd->effective_interval = interval;
 
 	delay = msecs_to_jiffies(interval);
 	ASSERT(delay > 0);
@@ -218,6 +299,24 @@ u32 get_checkpoint_interval(struct checkpoint_data *cpd)
 	return interval;
 }
 
+/**
+ * Get effective checkpoint interval
+ *
+ * @cpd checkpoint data.
+ *
+ * @return current effective checkpoint interval [ms].
+ */
+u32 get_effective_checkpoint_interval(struct checkpoint_data *cpd)
+{
+	u32 interval;
+
+	down_read(&cpd->lock);
+	interval = cpd->effective_interval;
+	up_read(&cpd->lock);
+
+	return interval;
+}
+
 /**
  * Set checkpoint interval.
  *
@@ -228,6 +327,7 @@ void set_checkpoint_interval(struct checkpoint_data *cpd, u32 interval)
 {
 	down_write(&cpd->lock);
 	cpd->interval = interval;
+	cpd->effective_interval = interval;
 	up_write(&cpd->lock);
 
 	stop_checkpointing(cpd);
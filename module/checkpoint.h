@@ -14,6 +14,14 @@
 #define WALB_DEFAULT_CHECKPOINT_INTERVAL 10000
 #define WALB_MAX_CHECKPOINT_INTERVAL (24 * 60 * 60 * 1000) /* 1 day */
 
+/*
+ * For adaptive checkpointing.
+ * The effective interval is in
+ *   [WALB_MIN_CHECKPOINT_INTERVAL, interval * WALB_CHECKPOINT_IDLE_FACTOR].
+ */
+#define WALB_MIN_CHECKPOINT_INTERVAL 100 /* ms */
+#define WALB_CHECKPOINT_IDLE_FACTOR 4
+
 /**
  * Checkpointing state.
  *
@@ -51,6 +59,12 @@ struct checkpoint_data
 	 */
 	u32 interval;
 
+	/*
+	 * Effective checkpointing interval [ms].
+	 * This is the same as interval unless checkpoint_adaptive_ is set.
+	 */
+	u32 effective_interval;
+
 	/*
 	 * CP_XXX
 	 */
@@ -69,6 +83,7 @@ void task_do_checkpointing(struct work_struct *work);
 void start_checkpointing(struct checkpoint_data *cpd);
 void stop_checkpointing(struct checkpoint_data *cpd);
 u32 get_checkpoint_interval(struct checkpoint_data *cpd);
+u32 get_effective_checkpoint_interval(struct checkpoint_data *cpd);
 void set_checkpoint_interval(struct checkpoint_data *cpd, u32 val);
 
 #endif /* WALB_CHECKPOINT_H_KERNEL */
@@ -10,7 +10,7 @@
 #include <linux/compat.h>
 #include <linux/rwsem.h>
 #include <linux/uaccess.h>
-#include <linux/vmalloc.h>
+#include <linux/mm.h>
 
 #include "kern.h"
 #include "control.h"
@@ -74,6 +74,7 @@ static int ioctl_start_dev(struct walb_ctl *ctl)
 	unsigned int wminor;
 	struct walb_dev *wdev;
 	struct walb_start_param *param0, *param1;
+	unsigned int i;
 
 	ASSERT(ctl->command == WALB_IOCTL_START_DEV);
 
@@ -120,6 +121,16 @@ static int ioctl_start_dev(struct walb_ctl *ctl)
 		ctl->error = -5;
 		goto error0;
 	}
+	for (i = 0; i < param0->n_sub_ldevs; i++) {
+		const dev_t sub_ldevt =
+			MKDEV(param0->sub_lmajor[i], param0->sub_lminor[i]);
+		if (alldevs_is_already_used(sub_ldevt)) {
+			LOGe("already used ldev %u:%u\n",
+				MAJOR(sub_ldevt), MINOR(sub_ldevt));
+			ctl->error = -4;
+			goto error0;
+		}
+	}
 
 	if (ctl->u2k.wminor == WALB_DYNAMIC_MINOR) {
 		wminor = alloc_any_minor();
@@ -445,6 +456,7 @@ static struct miscdevice walb_misc_ = {
 
 /**
  * Allocate memory and call @copy_from_user().
+ * Large buffers may be vmalloc()ed. Free it with kvfree().
  */
 void* walb_alloc_and_copy_from_user(
 	void __user *userbuf,
@@ -457,12 +469,8 @@ void* walb_alloc_and_copy_from_user(
 		goto error0;
 	}
 
-	if (buf_size <= PAGE_SIZE) {
-		buf = kmalloc(buf_size, gfp_mask);
-	} else {
-		ASSERT(gfp_mask == GFP_KERNEL);
-		buf = vmalloc(buf_size);
-	}
+	ASSERT(gfp_mask == GFP_KERNEL);
+	buf = kvmalloc(buf_size, gfp_mask);
 	if (!buf) {
 		LOGe("memory allocation for walb_ctl.u2k.buf failed.\n");
 		goto error0;
@@ -475,7 +483,7 @@ void* walb_alloc_and_copy_from_user(
 	return buf;
 
 error1:
-	kfree(buf);
+	kvfree(buf);
 error0:
 	return NULL;
 }
@@ -502,11 +510,7 @@ int walb_copy_to_user_and_free(
 		goto fin;
 	}
 fin:
-	if (buf_size <= PAGE_SIZE) {
-		kfree(buf);
-	} else {
-		vfree(buf);
-	}
+	kvfree(buf);
 	return ret;
 }
 
@@ -544,7 +548,7 @@ struct walb_ctl* walb_get_ctl(void __user *userctl, gfp_t gfp_mask)
 	}
 	/* Allocate ctl->k2u.kbuf. */
 	if (ctl->k2u.buf_size > 0) {
-		ctl->k2u.kbuf = kzalloc(ctl->k2u.buf_size, gfp_mask);
+		ctl->k2u.kbuf = kvzalloc(ctl->k2u.buf_size, gfp_mask);
 		if (!ctl->k2u.kbuf) {
 			goto error2;
 		}
@@ -554,12 +558,12 @@ struct walb_ctl* walb_get_ctl(void __user *userctl, gfp_t gfp_mask)
 #if 0
 error3:
 	if (ctl->k2u.buf_size > 0) {
-		kfree(ctl->k2u.kbuf);
+		kvfree(ctl->k2u.kbuf);
 	}
 #endif
 error2:
 	if (ctl->u2k.buf_size > 0) {
-		kfree(ctl->u2k.kbuf);
+		kvfree(ctl->u2k.kbuf);
 	}
 error1:
 	kfree(ctl);
@@ -579,7 +583,7 @@ int walb_put_ctl(void __user *userctl, struct walb_ctl *ctl)
 {
 	/* Free ctl->u2k.kbuf. */
 	if (ctl->u2k.buf_size > 0) {
-		kfree(ctl->u2k.kbuf);
+		kvfree(ctl->u2k.kbuf);
 	}
 
 	/* Copy and free ctl->k2u.kbuf. */
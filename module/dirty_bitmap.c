@@ -0,0 +1,389 @@
+/**
+ * dirty_bitmap.c - Persistent dirty region bitmap.
+ */
+#include "check_kernel.h"
+
+#include <linux/module.h>
+#include <linux/vmalloc.h>
+#include <linux/bitops.h>
+#include "linux/walb/logger.h"
+#include "kern.h"
+#include "sector_io.h"
+#include "wdev_util.h"
+#include "dirty_bitmap.h"
+
+/*******************************************************************************
+ * Static functions prototype.
+ *******************************************************************************/
+
+static size_t get_block_bytes(const struct walb_dirty_bitmap *dbmp);
+static size_t get_bitmap_bytes(const struct walb_dirty_bitmap *dbmp);
+static bool write_block(
+	struct walb_dev *wdev, struct sector_data *sect,
+	u64 off, u32 idx, bool is_pinned);
+
+/*******************************************************************************
+ * Static functions definition.
+ *******************************************************************************/
+
+/**
+ * Size of bits in a block [byte].
+ */
+static size_t get_block_bytes(const struct walb_dirty_bitmap *dbmp)
+{
+	return dbmp->pbs - sizeof(struct walb_dirty_bitmap_header);
+}
+
+/**
+ * Size of the whole bits [byte].
+ */
+static size_t get_bitmap_bytes(const struct walb_dirty_bitmap *dbmp)
+{
+	return get_block_bytes(dbmp) * dbmp->n_pb;
+}
+
+/**
+ * Write a block of the bitmap image.
+ *
+ * @off offset of the bitmap in the log address space [physical block].
+ * @idx block index.
+ */
+static bool write_block(
+	struct walb_dev *wdev, struct sector_data *sect,
+	u64 off, u32 idx, bool is_pinned)
+{
+	struct walb_dirty_bitmap *dbmp = &wdev->dirty_bitmap;
+	struct walb_dirty_bitmap_header *blk = sect->data;
+	const size_t n = get_block_bytes(dbmp);
+	struct block_device *ldev;
+
+	blk->sector_type = SECTOR_TYPE_DIRTY_BITMAP;
+	blk->flags = 0;
+	if (idx == 0 && is_pinned)
+		blk->flags |= 1U << DIRTY_BITMAP_PINNED;
+	memcpy(get_dirty_bitmap_block_bits(blk), dbmp->image + n * idx, n);
+	blk->checksum = calc_dirty_bitmap_block_checksum(
+		blk, dbmp->pbs, wdev->log_csum_type);
+
+	off += idx;
+	ldev = walb_map_log_pb(wdev, &off);
+	return sector_io(REQ_OP_WRITE, 0, ldev, off, sect);
+}
+
+/*******************************************************************************
+ * Global functions definition.
+ *******************************************************************************/
+
+/**
+ * Initialize a dirty bitmap as disabled.
+ */
+void walb_dirty_bitmap_init(struct walb_dirty_bitmap *dbmp)
+{
+	memset(dbmp, 0, sizeof(*dbmp));
+	spin_lock_init(&dbmp->lock);
+	dbmp->disk_off = INVALID_LSID;
+}
+
+/**
+ * Load the dirty bitmap from the log device.
+ *
+ * The ring buffer offset/size and log devices of wdev must be set.
+ * Blocks that are broken are regarded as all dirty.
+ * This does nothing if the log device has no dirty bitmap.
+ *
+ * RETURN:
+ *   true in success, or false.
+ */
+bool walb_dirty_bitmap_load(struct walb_dev *wdev)
+{
+	struct walb_dirty_bitmap *dbmp = &wdev->dirty_bitmap;
+	const unsigned int pbs = wdev->physical_bs;
+	struct walb_super_sector *super;
+	struct sector_data *sect;
+	u32 n_pb, region_lb, i;
+	u64 written_lsid, off;
+	size_t n, size;
+
+	spin_lock(&wdev->lsuper0_lock);
+	super = get_super_sector(wdev->lsuper0);
+	n_pb = get_dirty_bitmap_pb_of_super(super);
+	region_lb = super->dirty_region_lb;
+	written_lsid = super->written_lsid;
+	spin_unlock(&wdev->lsuper0_lock);
+
+	if (n_pb == 0)
+		return true;
+
+	dbmp->pbs = pbs;
+	dbmp->n_pb = n_pb;
+	dbmp->n_bits = (u64)n_pb * get_n_bits_in_dirty_bitmap_block(pbs);
+	dbmp->region_lb = region_lb;
+	dbmp->region_shift = get_dirty_region_shift(region_lb);
+	dbmp->epoch_lsid = written_lsid;
+	dbmp->next_lsid = written_lsid;
+	n = get_block_bytes(dbmp);
+	size = get_bitmap_bytes(dbmp);
+
+	dbmp->cur = vzalloc(size);
+	dbmp->prev = vzalloc(size);
+	dbmp->image = vzalloc(size);
+	dbmp->disk = vzalloc(size);
+	if (!dbmp->cur || !dbmp->prev || !dbmp->image || !dbmp->disk) {
+		WLOGe(wdev, "dirty bitmap allocation failed (%zu bytes).\n", size);
+		goto error0;
+	}
+	sect = sector_alloc(pbs, GFP_KERNEL);
+	if (!sect)
+		goto error0;
+
+	off = wdev->ring_buffer_off + wdev->ring_buffer_size;
+	for (i = 0; i < n_pb; i++) {
+		struct walb_dirty_bitmap_header *blk = sect->data;
+		u64 dev_off = off + i;
+		struct block_device *ldev = walb_map_log_pb(wdev, &dev_off);
+
+		if (!sector_io(REQ_OP_READ, 0, ldev, dev_off, sect)) {
+			WLOGe(wdev, "dirty bitmap read failed.\n");
+			goto error1;
+		}
+		if (!is_valid_dirty_bitmap_block(
+				blk, pbs, wdev->log_csum_type)) {
+			WLOGw(wdev, "dirty bitmap block %u is broken. "
+				"regarded as dirty.\n", i);
+			memset(dbmp->cur + n * i, 0xff, n);
+			continue;
+		}
+		memcpy(dbmp->cur + n * i, get_dirty_bitmap_block_bits(blk), n);
+		memcpy(dbmp->disk + n * i, dbmp->cur + n * i, n);
+		if (i == 0 && (blk->flags & (1U << DIRTY_BITMAP_PINNED))) {
+			dbmp->is_pinned = true;
+			dbmp->is_disk_pinned = true;
+		}
+	}
+	dbmp->disk_off = off;
+	sector_free(sect);
+
+	WLOGi(wdev, "dirty bitmap: %" PRIu64 " bits region %u lb%s.\n"
+		, dbmp->n_bits, region_lb
+		, dbmp->is_pinned ? " pinned" : "");
+	return true;
+
+error1:
+	sector_free(sect);
+error0:
+	walb_dirty_bitmap_destroy(dbmp);
+	return false;
+}
+
+/**
+ * Free the memory of a dirty bitmap and disable it.
+ */
+void walb_dirty_bitmap_destroy(struct walb_dirty_bitmap *dbmp)
+{
+	vfree(dbmp->cur);
+	vfree(dbmp->prev);
+	vfree(dbmp->image);
+	vfree(dbmp->disk);
+	walb_dirty_bitmap_init(dbmp);
+}
+
+/**
+ * Mark a written range.
+ * Call this for each write IO before its log is submitted.
+ *
+ * @pos IO offset [logical block].
+ * @len IO size [logical block].
+ * @lsid lsid of the log of the IO.
+ */
+void walb_dirty_bitmap_mark(
+	struct walb_dirty_bitmap *dbmp, u64 pos, unsigned int len, u64 lsid)
+{
+	u64 bit, last;
+
+	if (!walb_dirty_bitmap_enabled(dbmp) || len == 0)
+		return;
+
+	bit = get_dirty_bitmap_bit(pos, dbmp->region_shift, dbmp->n_bits);
+	last = get_dirty_bitmap_bit(
+		pos + len - 1, dbmp->region_shift, dbmp->n_bits);
+	spin_lock(&dbmp->lock);
+	for (; bit <= last; bit++)
+		dbmp->cur[bit >> 3] |= 1U << (bit & 7);
+	if (dbmp->next_lsid <= lsid)
+		dbmp->next_lsid = lsid + 1;
+	spin_unlock(&dbmp->lock);
+}
+
+/**
+ * Write the dirty bitmap to the log device.
+ *
+ * Call this before writing the superblock, which flushes the log device.
+ * The caller must hold wdev->super_sync_mutex.
+ *
+ * @oldest_lsid oldest lsid in the superblock on the log device.
+ * @latest_lsid current latest lsid.
+ *   The writes in cur may be newer than it because they are marked
+ *   before lsids.latest advances, so the new epoch starts after
+ *   all the marked writes as well.
+ *
+ * RETURN:
+ *   true in success, or false.
+ */
+bool walb_dirty_bitmap_sync(
+	struct walb_dev *wdev, u64 oldest_lsid, u64 latest_lsid)
+{
+	struct walb_dirty_bitmap *dbmp = &wdev->dirty_bitmap;
+	struct sector_data *sect;
+	bool is_pinned, is_moved, is_written = false;
+	size_t n, size, j;
+	u64 off;
+	u32 i;
+
+	if (!walb_dirty_bitmap_enabled(dbmp))
+		return true;
+
+	n = get_block_bytes(dbmp);
+	size = get_bitmap_bytes(dbmp);
+
+	spin_lock(&dbmp->lock);
+	if (test_bit(WALB_STATE_OVERFLOW, &wdev->flags))
+		dbmp->is_pinned = true;
+	if (!dbmp->is_pinned && oldest_lsid >= dbmp->epoch_lsid) {
+		/* All the logs of prev have been extracted. */
+		swap(dbmp->cur, dbmp->prev);
+		memset(dbmp->cur, 0, size);
+		dbmp->epoch_lsid = max_t(u64, latest_lsid, dbmp->next_lsid);
+	}
+	for (j = 0; j < size; j++)
+		dbmp->image[j] = dbmp->cur[j] | dbmp->prev[j];
+	is_pinned = dbmp->is_pinned;
+	spin_unlock(&dbmp->lock);
+
+	sect = sector_alloc(dbmp->pbs, GFP_NOIO);
+	if (!sect)
+		return false;
+
+	/* The bitmap moves when the ring buffer grows at reset-wal. */
+	off = wdev->ring_buffer_off + wdev->ring_buffer_size;
+	is_moved = off != dbmp->disk_off;
+	for (i = 0; i < dbmp->n_pb; i++) {
+		const bool is_flag_changed =
+			i == 0 && is_pinned != dbmp->is_disk_pinned;
+
+		if (!is_moved && !is_flag_changed &&
+			memcmp(dbmp->image + n * i, dbmp->disk + n * i, n) == 0)
+			continue;
+		if (!write_block(wdev, sect, off, i, is_pinned)) {
+			WLOGe(wdev, "dirty bitmap write failed.\n");
+			goto error;
+		}
+		memcpy(dbmp->disk + n * i, dbmp->image + n * i, n);
+		is_written = true;
+	}
+	dbmp->disk_off = off;
+	dbmp->is_disk_pinned = is_pinned;
+	sector_free(sect);
+
+	/* The first log device will be flushed with the superblock. */
+	if (is_written) {
+		for (i = 1; i < wdev->n_ldevs; i++) {
+			if (blkdev_issue_flush(wdev->ldevs[i], GFP_NOIO, NULL)) {
+				WLOGe(wdev, "ldev%u flush failed.\n", i);
+				return false;
+			}
+		}
+	}
+	return true;
+
+error:
+	sector_free(sect);
+	return false;
+}
+
+/**
+ * Pin the dirty bitmap.
+ * Call this when logs are lost without extraction.
+ * The lsids must have been reset to 0 with the iocore frozen.
+ */
+void walb_dirty_bitmap_pin(struct walb_dirty_bitmap *dbmp)
+{
+	spin_lock(&dbmp->lock);
+	dbmp->is_pinned = true;
+	dbmp->next_lsid = 0;
+	spin_unlock(&dbmp->lock);
+}
+
+/**
+ * Unpin the dirty bitmap.
+ *
+ * The current bits will be dropped after the logs until latest_lsid
+ * and all the marked writes are extracted,
+ * so the logs written before unpinning are still covered.
+ */
+void walb_dirty_bitmap_unpin(struct walb_dirty_bitmap *dbmp, u64 latest_lsid)
+{
+	size_t size, j;
+
+	if (!walb_dirty_bitmap_enabled(dbmp))
+		return;
+
+	size = get_bitmap_bytes(dbmp);
+	spin_lock(&dbmp->lock);
+	if (dbmp->is_pinned) {
+		for (j = 0; j < size; j++)
+			dbmp->prev[j] |= dbmp->cur[j];
+		memset(dbmp->cur, 0, size);
+		dbmp->epoch_lsid = max_t(u64, latest_lsid, dbmp->next_lsid);
+		dbmp->is_pinned = false;
+	}
+	spin_unlock(&dbmp->lock);
+}
+
+/**
+ * Get the dirty bits.
+ *
+ * @buf buffer to store the bits (LSB first). It can be NULL.
+ * @size buffer size [byte].
+ * @is_pinned pointer to store whether the bitmap is pinned.
+ *
+ * RETURN:
+ *   number of bits. 0 if the device has no dirty bitmap.
+ */
+u64 walb_dirty_bitmap_get(
+	struct walb_dirty_bitmap *dbmp, u8 *buf, size_t size, bool *is_pinned)
+{
+	size_t j;
+
+	*is_pinned = false;
+	if (!walb_dirty_bitmap_enabled(dbmp))
+		return 0;
+
+	size = min(size, get_bitmap_bytes(dbmp));
+	spin_lock(&dbmp->lock);
+	for (j = 0; j < size; j++)
+		buf[j] = dbmp->cur[j] | dbmp->prev[j];
+	*is_pinned = dbmp->is_pinned;
+	spin_unlock(&dbmp->lock);
+	return dbmp->n_bits;
+}
+
+/**
+ * Count dirty regions.
+ */
+u64 walb_dirty_bitmap_count(struct walb_dirty_bitmap *dbmp)
+{
+	size_t size, j;
+	u64 cnt = 0;
+
+	if (!walb_dirty_bitmap_enabled(dbmp))
+		return 0;
+
+	size = get_bitmap_bytes(dbmp);
+	spin_lock(&dbmp->lock);
+	for (j = 0; j < size; j++)
+		cnt += hweight8(dbmp->cur[j] | dbmp->prev[j]);
+	spin_unlock(&dbmp->lock);
+	return cnt;
+}
+
+MODULE_LICENSE("GPL");
@@ -0,0 +1,78 @@
+/**
+ * dirty_bitmap.h - Persistent dirty region bitmap.
+ */
+#ifndef WALB_DIRTY_BITMAP_H_KERNEL
+#define WALB_DIRTY_BITMAP_H_KERNEL
+
+#include "check_kernel.h"
+#include <linux/spinlock.h>
+#include "linux/walb/dirty_bitmap.h"
+
+struct walb_dev;
+
+/**
+ * Dirty region bitmap of a walb device.
+ *
+ * A bit is set when a write to the region is logged.
+ * Bits of writes older than epoch_lsid are in prev and the others in cur.
+ * When the oldest lsid passes epoch_lsid, the logs of prev are all extracted
+ * so prev is dropped, cur becomes prev and a new epoch begins.
+ * So (prev | cur) always covers the writes whose logs may not be extracted.
+ * The bitmap is pinned when logs are lost by overflow or reset-wal,
+ * and it never drops bits until unpinned.
+ */
+struct walb_dirty_bitmap
+{
+	/* Protects cur, prev, epoch_lsid, next_lsid and is_pinned. */
+	spinlock_t lock;
+
+	/* 0 if the device has no dirty bitmap. */
+	u64 n_bits;
+	u32 region_lb; /* [logical block] */
+	unsigned int region_shift;
+	u32 n_pb; /* [physical block] */
+	unsigned int pbs; /* physical block size [byte]. */
+
+	/* Bits (LSB first) of the size n_pb * n_bits_in_block / 8. */
+	u8 *cur;
+	u8 *prev;
+	u64 epoch_lsid;
+	/* Next to the largest lsid of the marked writes. */
+	u64 next_lsid;
+	bool is_pinned;
+
+	/*
+	 * The bitmap image on the log device.
+	 * Only blocks different from it are written at sync.
+	 * These are accessed only in walb_dirty_bitmap_sync()
+	 * under wdev->super_sync_mutex.
+	 */
+	u8 *image;
+	u8 *disk;
+	bool is_disk_pinned;
+	u64 disk_off; /* [physical block], INVALID_LSID if unknown. */
+};
+
+void walb_dirty_bitmap_init(struct walb_dirty_bitmap *dbmp);
+bool walb_dirty_bitmap_load(struct walb_dev *wdev);
+void walb_dirty_bitmap_destroy(struct walb_dirty_bitmap *dbmp);
+void walb_dirty_bitmap_mark(
+	struct walb_dirty_bitmap *dbmp, u64 pos, unsigned int len, u64 lsid);
+bool walb_dirty_bitmap_sync(
+	struct walb_dev *wdev, u64 oldest_lsid, u64 latest_lsid);
+void walb_dirty_bitmap_pin(struct walb_dirty_bitmap *dbmp);
+void walb_dirty_bitmap_unpin(struct walb_dirty_bitmap *dbmp, u64 latest_lsid);
+u64 walb_dirty_bitmap_get(
+	struct walb_dirty_bitmap *dbmp, u8 *buf, size_t size, bool *is_pinned);
+u64 walb_dirty_bitmap_count(struct walb_dirty_bitmap *dbmp);
+
+/**
+ * Check whether a walb device has a dirty bitmap.
+ */
+static inline bool walb_dirty_bitmap_enabled(
+	const struct walb_dirty_bitmap *dbmp)
+{
+	return dbmp->n_bits > 0;
+}
+
+#endif /* WALB_DIRTY_BITMAP_H_KERNEL */
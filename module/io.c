@@ -9,7 +9,10 @@
 #include <linux/ratelimit.h>
 #include <linux/printk.h>
 #include <linux/time.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/kmod.h>
+#include <linux/vmalloc.h>
 #include "linux/walb/logger.h"
 #include "kern.h"
 #include "io.h"
@@ -26,6 +29,8 @@
 #include "overlapped_io.h"
 #include "queue_util.h"
 #include "bio_set.h"
+#include "walb_trace.h"
+#include "wdev_util.h"
 
 /*******************************************************************************
  * Static data definition.
@@ -44,6 +49,11 @@ struct pack
 	/* zero_flush or logpack header IO. */
 	struct bio_entry header_bioe;
 
+	/* Flush IOs of the log devices of a striped log
+	   other than the one header_bioe goes to.
+	   Indexed by log device. */
+	struct bio_entry sub_flush_bioe[WALB_MAX_LDEVS];
+
 	struct walb_dev *wdev;
 
 	/* not invalid if the pack contains flush. */
@@ -61,6 +71,9 @@ struct pack
 
 	/* true if submittion failed. */
 	bool is_logpack_failed;
+
+	/* Why the pack has been closed. See IOCORE_PACK_CUT_XXX. */
+	unsigned int cut_reason;
 };
 
 static atomic_t n_users_of_pack_cache_ = ATOMIC_INIT(0);
@@ -88,6 +101,7 @@ static struct treemap_memory_manager mmgr_;
 /* pack related. */
 static struct pack* create_pack(gfp_t gfp_mask);
 static struct pack* create_writepack(gfp_t gfp_mask, unsigned int pbs, u64 logpack_lsid, struct walb_dev *wdev);
+static unsigned int decide_logpack_header_pb(struct walb_dev *wdev, u64 lsid);
 static void destroy_pack(struct pack *pack);
 static bool is_zero_flush_only(const struct pack *pack);
 static bool is_pack_size_too_large(
@@ -120,17 +134,17 @@ static bool create_logpack_list(
 static void submit_logpack_list(
 	struct walb_dev *wdev, struct list_head *wpack_list);
 static void logpack_calc_checksum(
-	struct walb_logpack_header *lhead,
-	unsigned int pbs, u32 salt, struct list_head *biow_list);
+	struct walb_logpack_header *lhead, unsigned int pbs,
+	u32 salt, unsigned int csum_type, struct list_head *biow_list);
 static void submit_logpack(
 	struct walb_logpack_header *logh,
 	struct list_head *biow_list, struct bio_entry *bioe,
-	unsigned int pbs, bool is_flush, struct block_device *ldev,
+	unsigned int pbs, bool is_flush, struct walb_dev *wdev,
 	u64 ring_buffer_off, u64 ring_buffer_size,
 	unsigned int chunk_sectors);
 static void logpack_submit_header(
 	struct walb_logpack_header *logh, struct bio_entry *bioe,
-	unsigned int pbs, bool is_flush, struct block_device *ldev,
+	unsigned int pbs, bool is_flush, struct walb_dev *wdev,
 	u64 ring_buffer_off, u64 ring_buffer_size,
 	unsigned int chunk_sectors);
 static void logpack_submit_bio_wrapper(
@@ -146,6 +160,9 @@ static void logpack_init_bio_entry(
 	unsigned int pbs, struct block_device *ldev,
 	u64 ldev_off_pb, unsigned int bio_off_lb);
 static void logpack_submit_flush(struct block_device *bdev, struct pack *pack);
+static void flush_sub_ldevs_for_logpack(
+	struct walb_dev *wdev, struct pack *wpack, unsigned int header_idx);
+static unsigned int get_ldev_idx_of_lsid(struct walb_dev *wdev, u64 lsid);
 static void gc_logpack_list(struct walb_dev *wdev, struct list_head *wpack_list);
 static void dequeue_and_gc_logpack_list(struct walb_dev *wdev);
 
@@ -191,6 +208,13 @@ static void wait_for_logpack_submit_queue_empty(struct walb_dev *wdev);
 static void wait_for_all_started_write_io_done(struct walb_dev *wdev);
 static void wait_for_all_pending_gc_done(struct walb_dev *wdev);
 static void force_flush_ldev(struct walb_dev *wdev);
+static bool is_prev_written_lsid_updated(
+	struct walb_dev *wdev, u64 prev_written_lsid);
+static bool is_written_lsid_updated(struct walb_dev *wdev, u64 written_lsid);
+static void account_ring_buffer_stall(
+	struct iocore_data *iocored, ktime_t begin);
+static void account_logpack(
+	struct iocore_data *iocored, struct pack *wpack, unsigned int pbs);
 static bool wait_for_log_permanent(struct walb_dev *wdev, u64 lsid);
 static void flush_all_wq(void);
 static void clear_working_flag(int working_bit, unsigned long *flag_p);
@@ -200,6 +224,15 @@ static void fail_and_destroy_bio_wrapper_list(
 static void update_flush_lsid_if_necessary(struct walb_dev *wdev, u64 lsid);
 static bool delete_bio_wrapper_from_pending_data(
 	struct walb_dev *wdev, struct bio_wrapper *biow);
+static unsigned int get_pending_len(struct bio_wrapper *biow);
+static unsigned int get_log_pb(struct bio_wrapper *biow, unsigned int pbs);
+
+/* Admission control. */
+static void admit_write_bio_wrapper_list(
+	struct walb_dev *wdev, struct list_head *biow_list);
+static void update_drain_rate(struct iocore_data *iocored, u64 now_ns);
+static bool update_admission_rate(
+	struct walb_dev *wdev, struct iocore_data *iocored, u64 now_ns);
 
 /* Stop/start queue for fast algorithm. */
 static bool should_stop_queue(
@@ -215,6 +248,18 @@ static void treemap_memory_manager_put(void);
 static bool pack_cache_get(void);
 static void pack_cache_put(void);
 
+/* For memory accounting. */
+static void iocore_mem_charge(struct walb_dev *wdev, struct bio_wrapper *biow,
+			unsigned int bytes);
+static void iocore_mem_uncharge(struct walb_dev *wdev, unsigned int bytes);
+
+/* For zero IOs. */
+static void set_zero_bio_wrapper(
+	struct walb_dev *wdev, struct bio_wrapper *biow);
+
+/* For log data compression. */
+static void iocore_compress(struct walb_dev *wdev, struct bio_wrapper *biow);
+
 /* For diskstats. */
 static void io_acct_start(struct bio_wrapper *biow);
 static void io_acct_end(struct bio_wrapper *biow);
@@ -235,6 +280,7 @@ static bool melt_detail(struct iocore_data *iocored, bool is_usr);
 static struct pack* create_pack(gfp_t gfp_mask)
 {
 	struct pack *pack;
+	unsigned int i;
 
 	pack = kmem_cache_alloc(pack_cache_, gfp_mask);
 	if (!pack) {
@@ -244,10 +290,13 @@ static struct pack* create_pack(gfp_t gfp_mask)
 	INIT_LIST_HEAD(&pack->list);
 	INIT_LIST_HEAD(&pack->biow_list);
 	bio_entry_clear(&pack->header_bioe);
+	for (i = 0; i < WALB_MAX_LDEVS; i++)
+		bio_entry_clear(&pack->sub_flush_bioe[i]);
 	pack->wdev = NULL;
 	pack->is_zero_flush_only = false;
 	pack->is_flush_header = false;
 	pack->is_fua_contained = false;
+	pack->cut_reason = IOCORE_PACK_CUT_END;
 	pack->is_logpack_failed = false;
 	pack->new_permanent_lsid = INVALID_LSID;
 
@@ -275,17 +324,22 @@ static struct pack* create_writepack(
 {
 	struct pack *pack;
 	struct walb_logpack_header *lhead;
+	const unsigned int n_pb = decide_logpack_header_pb(wdev, logpack_lsid);
 
 	ASSERT(logpack_lsid != INVALID_LSID);
 	pack = create_pack(gfp_mask);
 	if (!pack) { goto error0; }
 	pack->wdev = wdev;
-	pack->logpack_header_sector = sector_alloc(pbs, gfp_mask | __GFP_ZERO);
+	pack->logpack_header_sector = sector_alloc(
+		pbs * n_pb, gfp_mask | __GFP_ZERO);
 	if (!pack->logpack_header_sector) { goto error1; }
+	iocore_mem_charge(wdev, NULL, sizeof(*pack)
+			+ sizeof(struct sector_data) + pbs * n_pb);
 
 	lhead = get_logpack_header(pack->logpack_header_sector);
 	lhead->sector_type = SECTOR_TYPE_LOGPACK;
 	lhead->logpack_lsid = logpack_lsid;
+	lhead->n_header_pb = n_pb;
 	/* lhead->total_io_size = 0; */
 	/* lhead->n_records = 0; */
 	/* lhead->n_padding = 0; */
@@ -297,12 +351,46 @@ error0:
 	return NULL;
 }
 
+/**
+ * Decide size of the logpack header at an lsid [physical block].
+ *
+ * The header is written by one bio, so it must not wrap around
+ * the ring buffer nor cross a chunk boundary of the log device.
+ * Such packs use a smaller header.
+ *
+ * RETURN:
+ *   1 <= n <= wdev->logpack_header_pb.
+ */
+static unsigned int decide_logpack_header_pb(struct walb_dev *wdev, u64 lsid)
+{
+	const unsigned int pbs = wdev->physical_bs;
+	u64 n_pb = wdev->logpack_header_pb;
+	u64 rem;
+
+	if (n_pb <= 1)
+		return 1;
+
+	div64_u64_rem(lsid, wdev->ring_buffer_size, &rem);
+	n_pb = min_t(u64, n_pb, wdev->ring_buffer_size - rem);
+
+	if (wdev->ldev_chunk_sectors > 0) {
+		const u64 chunk_pb = wdev->ldev_chunk_sectors / n_lb_in_pb(pbs);
+		const u64 off_pb = get_offset_of_lsid(
+			lsid, wdev->ring_buffer_off, wdev->ring_buffer_size);
+		div64_u64_rem(off_pb, chunk_pb, &rem);
+		n_pb = min_t(u64, n_pb, chunk_pb - rem);
+	}
+	ASSERT(n_pb > 0);
+	return (unsigned int)n_pb;
+}
+
 /**
  * Destory a pack.
  */
 static void destroy_pack(struct pack *pack)
 {
 	struct bio_wrapper *biow, *biow_next;
+	unsigned int i;
 
 	if (!pack)
 		return;
@@ -312,10 +400,16 @@ static void destroy_pack(struct pack *pack)
 		destroy_bio_wrapper_dec((struct walb_dev *)biow->private_data, biow);
 	}
 	if (pack->logpack_header_sector) {
+		if (pack->wdev)
+			iocore_mem_uncharge(pack->wdev, sizeof(*pack)
+					+ sizeof(struct sector_data)
+					+ pack->logpack_header_sector->size);
 		sector_free(pack->logpack_header_sector);
 		pack->logpack_header_sector = NULL;
 	}
 	fin_bio_entry(&pack->header_bioe);
+	for (i = 0; i < WALB_MAX_LDEVS; i++)
+		fin_bio_entry(&pack->sub_flush_bioe[i]);
 
 #ifdef WALB_DEBUG
 	INIT_LIST_HEAD(&pack->biow_list);
@@ -377,10 +471,10 @@ static bool is_pack_size_too_large(
 		return false;
 	}
 
-	if (bio_wrapper_state_is_discard(biow))
+	if (bio_wrapper_state_is_payload_free(biow))
 		return false;
 
-	pb = (unsigned int)capacity_pb(pbs, biow->len);
+	pb = get_log_pb(biow, pbs);
 	return pb + lhead->total_io_size > max_logpack_pb;
 }
 
@@ -534,6 +628,9 @@ static void task_submit_logpack_list(struct work_struct *work)
 			continue;
 		}
 
+		/* Delay if there is too much pending data. */
+		admit_write_bio_wrapper_list(wdev, &biow_list);
+
 		/* Create and submit. */
 		if (!create_logpack_list(wdev, &biow_list, &wpack_list)) {
 			continue;
@@ -632,6 +729,8 @@ static void task_wait_and_gc_read_bio_wrapper(struct work_struct *work)
 	struct timespec end_ts;
 
 	wait_for_bio_wrapper_io(biow, true, true, &end_ts);
+	walb_lat_account(get_iocored_from_wdev(wdev)->lat, biow, false,
+			WALB_LAT_DATA_IO, biow->io_end_ns);
 	destroy_bio_wrapper_dec(wdev, biow);
 }
 
@@ -677,10 +776,7 @@ static void task_submit_bio_wrapper_list(struct work_struct *work)
 			n_io++;
 			lsid = biow->lsid;
 			ASSERT(biow->len > 0);
-			if (bio_wrapper_state_is_discard(biow))
-				pb = 0;
-			else
-				pb = capacity_pb(wdev->physical_bs, biow->len);
+			pb = get_log_pb(biow, wdev->physical_bs);
 			BIO_WRAPPER_CHANGE_STATE(biow);
 			if (n_io >= wdev->n_io_bulk) { break; }
 		}
@@ -739,6 +835,10 @@ static void task_submit_bio_wrapper_list(struct work_struct *work)
 				}
 			} else {
 				/* Delayed. */
+				atomic64_inc(&iocored->n_overlap_delay);
+				trace_walb_overlap_delay(
+					wdev_minor(wdev), biow->lsid,
+					biow->pos, biow->len, biow->n_overlapped);
 			}
 #else /* WALB_OVERLAPPED_SERIALIZE */
 			if (sort_data_io_) {
@@ -865,7 +965,8 @@ static bool create_logpack_list(
 		completed_lsid, flush_lsid,
 		written_lsid, prev_written_lsid, oldest_lsid;
 	unsigned long log_flush_jiffies;
-	bool ret, is_flush = false;
+	bool ret, is_flush = false, is_stalled = false;
+	ktime_t stall_begin;
 
 	ASSERT(wdev);
 	iocored = get_iocored_from_wdev(wdev);
@@ -961,31 +1062,57 @@ static bool create_logpack_list(
 	ASSERT(latest_lsid >= written_lsid);
 	ASSERT(written_lsid >= prev_written_lsid);
 	while (latest_lsid - prev_written_lsid > wdev->ring_buffer_size) {
+		if (!is_stalled) {
+			is_stalled = true;
+			stall_begin = ktime_get();
+		}
 		if (latest_lsid - written_lsid > wdev->ring_buffer_size) {
 			if (test_bit(WALB_STATE_READ_ONLY, &wdev->flags))
 				goto error;
-			WLOGw(wdev, "Ring buffer size is too small: sleep 100ms: "
+			WLOGw(wdev, "Ring buffer size is too small: wait for written lsid: "
 				"latest %" PRIu64 " written %" PRIu64 " prev_written %" PRIu64 "\n"
 				, latest_lsid, written_lsid, prev_written_lsid);
 
 			/* In order to avoid live lock of IOs waiting their logs to be permanent */
 			force_flush_ldev(wdev);
 
-			msleep(100);
+			/* gc_logpack_list() will wake up us.
+			   The timeout is to flush the log device again. */
+			wait_event_timeout(
+				iocored->ring_buffer_wq,
+				is_written_lsid_updated(wdev, written_lsid),
+				msecs_to_jiffies(100));
 		} else {
 			WLOGw(wdev, "Ring buffer size is too small: try to take checkpoint: "
 				"latest %" PRIu64 " written %" PRIu64 " prev_written %" PRIu64 "\n"
 				, latest_lsid, written_lsid, prev_written_lsid);
-			stop_checkpointing(&wdev->cpd);
-			if (!take_checkpoint(&wdev->cpd))
+			/* The superblock will be written by another task. */
+			walb_sync_super_block_async(wdev);
+			wait_event_timeout(
+				wdev->super_sync_wq,
+				is_prev_written_lsid_updated(wdev, prev_written_lsid),
+				msecs_to_jiffies(100));
+			if (test_bit(WALB_STATE_READ_ONLY, &wdev->flags))
 				goto error;
-			start_checkpointing(&wdev->cpd);
 		}
 		spin_lock(&wdev->lsid_lock);
 		prev_written_lsid = wdev->lsids.prev_written;
 		written_lsid = wdev->lsids.written;
 		spin_unlock(&wdev->lsid_lock);
 	}
+	if (is_stalled)
+		account_ring_buffer_stall(iocored, stall_begin);
+
+	if (trace_walb_create_logpack_enabled()) {
+		list_for_each_entry(wpack, wpack_list, list) {
+			struct walb_logpack_header *logh =
+				get_logpack_header(wpack->logpack_header_sector);
+			trace_walb_create_logpack(
+				wdev_minor(wdev), logh->logpack_lsid,
+				logh->n_records, logh->total_io_size,
+				wpack->is_flush_header);
+		}
+	}
 
 	/* Now the logpack can be submitted. */
 	return true;
@@ -1030,6 +1157,12 @@ static void submit_logpack_list(
 
 		ASSERT_SECTOR_DATA(wpack->logpack_header_sector);
 		logh = get_logpack_header(wpack->logpack_header_sector);
+		trace_walb_submit_logpack(
+			wdev_minor(wdev), logh->logpack_lsid,
+			logh->n_records, logh->total_io_size, is_flush);
+		account_logpack(iocored, wpack, wdev->physical_bs);
+		if (is_flush)
+			atomic64_inc(&iocored->n_log_flush);
 
 		if (wpack->is_zero_flush_only) {
 			ASSERT(logh->n_records == 0);
@@ -1038,15 +1171,27 @@ static void submit_logpack_list(
 				/* do nothing because only the first wpack should submit flush request. */
 				continue;
 			}
+			flush_sub_ldevs_for_logpack(wdev, wpack, 0);
 			logpack_submit_flush(wdev->ldev, wpack);
 		} else {
 			ASSERT(logh->n_records > 0);
+			atomic64_inc(&iocored->n_logpack);
+			atomic64_add(logh->n_records - logh->n_padding,
+				&iocored->n_log_record);
+			atomic64_add((u64)(get_logpack_header_pb(logh)
+					+ logh->total_io_size) * wdev->physical_bs,
+				&iocored->logged_bytes);
 			logpack_calc_checksum(logh, wdev->physical_bs,
-					wdev->log_checksum_salt, &wpack->biow_list);
+					wdev->log_checksum_salt,
+					wdev->log_csum_type, &wpack->biow_list);
+			if (is_flush)
+				flush_sub_ldevs_for_logpack(
+					wdev, wpack, get_ldev_idx_of_lsid(
+						wdev, logh->logpack_lsid));
 			submit_logpack(
 				logh, &wpack->biow_list, &wpack->header_bioe,
 				wdev->physical_bs, is_flush,
-				wdev->ldev, wdev->ring_buffer_off,
+				wdev, wdev->ring_buffer_off,
 				wdev->ring_buffer_size, wdev->ldev_chunk_sectors);
 		}
 	}
@@ -1057,13 +1202,16 @@ static void submit_logpack_list(
  * Set checksum of each bio and calc/set log header checksum.
  *
  * @logh log pack header.
- * @pbs physical sector size (allocated size as logh).
+ * @pbs physical sector size.
+ *   The header size is pbs * get_logpack_header_pb(logh).
+ * @salt checksum salt.
+ * @csum_type checksum type. WALB_CSUM_XXX.
  * @biow_list list of biow.
  *   checksum of each bio has already been calculated as biow->csum.
  */
 static void logpack_calc_checksum(
-	struct walb_logpack_header *logh,
-	unsigned int pbs, u32 salt, struct list_head *biow_list)
+	struct walb_logpack_header *logh, unsigned int pbs,
+	u32 salt, unsigned int csum_type, struct list_head *biow_list)
 {
 	int i;
 	struct bio_wrapper *biow;
@@ -1091,10 +1239,19 @@ static void logpack_calc_checksum(
 			ASSERT(bio_has_flush(biow->copied_bio));
 			continue;
 		}
+		if (bio_wrapper_state_is_zero(biow)) {
+			/* No data in the log. */
+			biow->csum = 0;
+			logh->record[i].checksum = 0;
+			i++;
+			continue;
+		}
 
+		/* The checksum is of the data in the log. */
 		biow->csum = bio_calc_checksum(
-			biow->copied_bio,
-			((struct walb_dev *)biow->private_data)->log_checksum_salt);
+			biow->compressed_bio ?: biow->copied_bio,
+			((struct walb_dev *)biow->private_data)->log_checksum_salt,
+			csum_type);
 		logh->record[i].checksum = biow->csum;
 		i++;
 	}
@@ -1108,8 +1265,8 @@ static void logpack_calc_checksum(
 	ASSERT(n_padding == logh->n_padding);
 	ASSERT(i == logh->n_records);
 	ASSERT(logh->checksum == 0);
-	logh->checksum = checksum((u8 *)logh, pbs, salt);
-	ASSERT(checksum((u8 *)logh, pbs, salt) == 0);
+	logh->checksum = calc_logpack_header_checksum(logh, pbs, salt, csum_type);
+	ASSERT(is_valid_logpack_header_with_checksum(logh, pbs, salt, csum_type));
 }
 
 /**
@@ -1120,7 +1277,7 @@ static void logpack_calc_checksum(
  * @bioe bio entry. submitted bio for logpack header will be set.
  * @pbs physical block size.
  * @is_flush true if the logpack header's REQ_FLUSH flag must be on.
- * @ldev log block device.
+ * @wdev walb device.
  * @ring_buffer_off ring buffer offset.
  * @ring_buffer_size ring buffer size.
  * @chunk_sectors chunk_sectors for bio alignment.
@@ -1131,7 +1288,7 @@ static void logpack_calc_checksum(
 static void submit_logpack(
 	struct walb_logpack_header *logh,
 	struct list_head *biow_list, struct bio_entry *bioe,
-	unsigned int pbs, bool is_flush, struct block_device *ldev,
+	unsigned int pbs, bool is_flush, struct walb_dev *wdev,
 	u64 ring_buffer_off, u64 ring_buffer_size,
 	unsigned int chunk_sectors)
 {
@@ -1142,7 +1299,7 @@ static void submit_logpack(
 
 	/* Submit logpack header block. */
 	logpack_submit_header(
-		logh, bioe, pbs, is_flush, ldev,
+		logh, bioe, pbs, is_flush, wdev,
 		ring_buffer_off, ring_buffer_size,
 		chunk_sectors);
 
@@ -1158,10 +1315,12 @@ static void submit_logpack(
 #ifdef WALB_PERFORMANCE_ANALYSIS
 		getnstimeofday(&biow->ts[WALB_TIME_W_LOG_SUBMITTED]);
 #endif
-		if (test_bit_u32(LOG_RECORD_DISCARD, &rec->flags)) {
+		walb_lat_account(
+			get_iocored_from_wdev(biow->private_data)->lat,
+			biow, true, WALB_LAT_QUEUE, ktime_get_ns());
+		if (is_payload_free_log_record(rec)) {
 			/* No need to execute IO to the log device. */
-			ASSERT(bio_wrapper_state_is_discard(biow));
-			ASSERT(bio_op(biow->bio) == REQ_OP_DISCARD);
+			ASSERT(bio_wrapper_state_is_payload_free(biow));
 			ASSERT(biow->len > 0);
 		} else if (biow->len == 0) {
 			/* Zero-sized IO will not be stored in logpack header.
@@ -1181,7 +1340,7 @@ static void submit_logpack(
 			BIO_WRAPPER_PRINT("log0", biow);
 			/* submit bio(s) for the biow. */
 			logpack_submit_bio_wrapper(
-				biow, rec->lsid, pbs, ldev, ring_buffer_off,
+				biow, rec->lsid, pbs, wdev->ldev, ring_buffer_off,
 				ring_buffer_size, chunk_sectors);
 		}
 		i++;
@@ -1189,57 +1348,64 @@ static void submit_logpack(
 }
 
 /**
- * Submit bio of header block.
+ * Submit bio of header block(s).
  *
  * @lhead logpack header data.
+ *   The header has get_logpack_header_pb(lhead) blocks
+ *   and it may be larger than a page.
  * @bioe bio_entry pointer.
  *     submitted lhead bio will be stored.
  * @pbs physical block size [bytes].
  * @is_flush if true, REQ_FLUSH must be added.
- * @ldev log device.
+ * @wdev walb device.
  * @ring_buffer_off ring buffer offset [physical blocks].
  * @ring_buffer_size ring buffer size [physical blocks].
  */
 static void logpack_submit_header(
 	struct walb_logpack_header *lhead, struct bio_entry *bioe,
-	unsigned int pbs, bool is_flush, struct block_device *ldev,
+	unsigned int pbs, bool is_flush, struct walb_dev *wdev,
 	u64 ring_buffer_off, u64 ring_buffer_size,
 	unsigned int chunk_sectors)
 {
 	struct bio *bio;
-	struct page *page;
 	u64 off_pb, off_lb;
+	const unsigned int size = pbs * get_logpack_header_pb(lhead);
+	const unsigned int nr_pages =
+		DIV_ROUND_UP(offset_in_page(lhead) + size, PAGE_SIZE);
+	unsigned int done;
 	int len;
-#ifdef WALB_DEBUG
-	struct page *page2;
-#endif
+
 	ASSERT(!bio_entry_exists(bioe));
 	ASSERT(pbs <= PAGE_SIZE);
 
 retry_bio:
-	bio = bio_alloc(GFP_NOIO, 1);
+	bio = bio_alloc(GFP_NOIO, nr_pages);
 	if (!bio) {
 		schedule();
 		goto retry_bio;
 	}
 
-	page = virt_to_page(lhead);
-#ifdef WALB_DEBUG
-	page2 = virt_to_page((unsigned long)lhead + pbs - 1);
-	ASSERT(page == page2);
-#endif
-	bio->bi_bdev = ldev;
+	bio->bi_bdev = wdev->ldev;
 	off_pb = get_offset_of_lsid(lhead->logpack_lsid, ring_buffer_off, ring_buffer_size);
 	off_lb = addr_lb(pbs, off_pb);
 	bio->bi_iter.bi_sector = off_lb;
 	bio_set_op_attrs(bio, REQ_OP_WRITE, is_flush ? REQ_PREFLUSH : 0);
-	len = bio_add_page(bio, page, pbs, offset_in_page(lhead));
-	ASSERT(len == pbs);
+	/* The header buffer is allocated by kmalloc()
+	   so it is physically contiguous. */
+	for (done = 0; done < size; done += len) {
+		void *buf = (u8 *)lhead + done;
+		const unsigned int off = offset_in_page(buf);
+
+		len = bio_add_page(bio, virt_to_page(buf),
+				min_t(unsigned int, size - done, PAGE_SIZE - off), off);
+		ASSERT(len > 0);
+	}
 
 	init_bio_entry(bioe, bio);
-	ASSERT((bio_entry_len(bioe) << 9) == pbs);
+	ASSERT((bio_entry_len(bioe) << 9) == size);
 
 	ASSERT(!should_split_bio_for_chunk(bioe->bio, chunk_sectors));
+	walb_remap_log_bio(wdev, bioe->bio);
 	generic_make_request(bioe->bio);
 }
 
@@ -1263,21 +1429,27 @@ static void logpack_submit_bio_wrapper(
 	const u64 ldev_off_pb = get_offset_of_lsid(lsid, ring_buffer_off, ring_buffer_size);
 	struct list_head tmp_list;
 	struct bio_list bio_list;
+	struct bio *bio;
 
 	INIT_LIST_HEAD(&tmp_list);
 	ASSERT(biow);
 	ASSERT(biow->copied_bio);
-	ASSERT(!bio_wrapper_state_is_discard(biow));
+	ASSERT(!bio_wrapper_state_is_payload_free(biow));
 	ASSERT(bio_op(biow->copied_bio) != REQ_OP_DISCARD);
 
 	bioe = &biow->cloned_bioe;
-	logpack_init_bio_entry(bioe, biow->copied_bio, pbs, ldev, ldev_off_pb, 0);
+	logpack_init_bio_entry(bioe, biow->compressed_bio ?: biow->copied_bio,
+			pbs, ldev, ldev_off_pb, 0);
 
 	/* split if required. */
 	bio_list = split_bio_for_chunk_never_giveup(
 		bioe->bio, chunk_sectors, GFP_NOIO);
 	/* No need to set biow->cloned_bio_list. */
 
+	/* Each split bio is inside a stripe of a striped log. */
+	bio_list_for_each(bio, &bio_list)
+		walb_remap_log_bio(biow->private_data, bio);
+
 	/* really submit */
 	LOG_("submit_lr: bioe %p pos %" PRIu64 " len %u\n"
 		, bioe, bioe->pos, bioe->len);
@@ -1349,6 +1521,41 @@ static void logpack_submit_flush(struct block_device *bdev, struct pack *pack)
 	ASSERT(bio_entry_exists(&pack->header_bioe));
 }
 
+/**
+ * Submit flush requests to the log devices of a striped log
+ * except the one the logpack header or the zero-flush request goes to.
+ * That one is flushed by the REQ_PREFLUSH of the request itself.
+ * The logpack becomes permanent when all of them have completed.
+ * See wait_for_logpack_header().
+ *
+ * @header_idx index of the log device of the header or zero-flush request.
+ */
+static void flush_sub_ldevs_for_logpack(
+	struct walb_dev *wdev, struct pack *wpack, unsigned int header_idx)
+{
+	unsigned int i;
+
+	for (i = 0; i < wdev->n_ldevs; i++) {
+		if (i == header_idx ||
+			!supports_flush_request_bdev(wdev->ldevs[i]))
+			continue;
+		while (!submit_flush(&wpack->sub_flush_bioe[i], wdev->ldevs[i]))
+			schedule();
+	}
+}
+
+/**
+ * Get the index of the log device where the log of an lsid is stored.
+ */
+static unsigned int get_ldev_idx_of_lsid(struct walb_dev *wdev, u64 lsid)
+{
+	u64 off_pb = get_offset_of_lsid(
+		lsid, wdev->ring_buffer_off, wdev->ring_buffer_size);
+
+	return map_striped_log_offset(
+		&off_pb, wdev->n_ldevs, wdev->log_stripe_pb);
+}
+
 /**
  * Gc logpack list.
  */
@@ -1400,6 +1607,9 @@ static void gc_logpack_list(struct walb_dev *wdev, struct list_head *wpack_list)
 	spin_lock(&wdev->lsid_lock);
 	wdev->lsids.written = written_lsid;
 	spin_unlock(&wdev->lsid_lock);
+
+	/* Wake up the log submitter waiting for ring buffer space. */
+	wake_up_all(&get_iocored_from_wdev(wdev)->ring_buffer_wq);
 }
 
 /**
@@ -1461,9 +1671,9 @@ static bool is_prepared_pack_valid(struct pack *pack)
 	CHECKd(pack->logpack_header_sector);
 
 	lhead = get_logpack_header(pack->logpack_header_sector);
-	pbs = pack->logpack_header_sector->size;
-	ASSERT_PBS(pbs);
 	CHECKd(lhead);
+	pbs = pack->logpack_header_sector->size / get_logpack_header_pb(lhead);
+	ASSERT_PBS(pbs);
 	CHECKd(is_valid_logpack_header(lhead));
 
 	CHECKd(!list_empty(&pack->biow_list));
@@ -1504,9 +1714,15 @@ static bool is_prepared_pack_valid(struct pack *pack)
 		CHECKd(biow->len == lrec->io_size);
 		if (test_bit_u32(LOG_RECORD_DISCARD, &lrec->flags)) {
 			CHECKd(bio_wrapper_state_is_discard(biow));
+		} else if (test_bit_u32(LOG_RECORD_ZERO, &lrec->flags)) {
+			CHECKd(bio_wrapper_state_is_zero(biow));
 		} else {
-			CHECKd(!bio_wrapper_state_is_discard(biow));
-			total_pb += capacity_pb(pbs, lrec->io_size);
+			CHECKd(!bio_wrapper_state_is_payload_free(biow));
+			CHECKd((test_bit_u32(LOG_RECORD_COMPRESSED, &lrec->flags) != 0)
+				== (biow->compressed_bio != NULL));
+			CHECKd(get_log_record_data_pb(lrec, pbs)
+				== get_log_pb(biow, pbs));
+			total_pb += get_log_record_data_pb(lrec, pbs);
 		}
 		i++;
 	}
@@ -1561,6 +1777,7 @@ error:
 static struct iocore_data* create_iocore_data(gfp_t gfp_mask)
 {
 	struct iocore_data *iocored;
+	int i;
 
 	iocored = kmalloc(sizeof(struct iocore_data), gfp_mask);
 	if (!iocored) {
@@ -1594,6 +1811,13 @@ static struct iocore_data* create_iocore_data(gfp_t gfp_mask)
 	/* Log flush time. */
 	iocored->log_flush_jiffies = jiffies;
 
+	/* Ring buffer stall. */
+	init_waitqueue_head(&iocored->ring_buffer_wq);
+	atomic_set(&iocored->n_rb_stall, 0);
+	atomic64_set(&iocored->rb_stall_ms, 0);
+	for (i = 0; i < IOCORE_RB_STALL_HIST_SIZE; i++)
+		atomic_set(&iocored->rb_stall_hist[i], 0);
+
 #ifdef WALB_OVERLAPPED_SERIALIZE
 	spin_lock_init(&iocored->overlapped_data_lock);
 	iocored->overlapped_data = multimap_create(gfp_mask, &mmgr_);
@@ -1618,6 +1842,66 @@ static struct iocore_data* create_iocore_data(gfp_t gfp_mask)
 	iocored->queue_restart_jiffies = jiffies;
 	iocored->max_sectors_in_pending = 0;
 
+	/* Admission control. */
+	iocored->n_drained_sectors = 0;
+	iocored->drain_sampled_sectors = 0;
+	iocored->drain_sampled_ns = ktime_get_ns();
+	iocored->drain_rate = 0;
+	token_bucket_init(&iocored->admission_tb, 0, 0, iocored->drain_sampled_ns);
+	atomic_set(&iocored->n_admission_delay, 0);
+	atomic64_set(&iocored->admission_delay_ms, 0);
+	init_waitqueue_head(&iocored->admission_wq);
+
+	/* Memory accounting. */
+	atomic64_set(&iocored->mem_bytes, 0);
+	iocored->max_mem_bytes_seen = 0;
+
+	/* Latency statistics. */
+	iocored->lat = walb_lat_alloc();
+	if (!iocored->lat) {
+		LOGe("latency histogram allocation failure.\n");
+		goto error2;
+	}
+
+	/* Cumulative statistics. */
+	iocored->io_count = alloc_percpu(struct iocore_io_count);
+	if (!iocored->io_count) {
+		LOGe("io_count allocation failure.\n");
+		goto error3;
+	}
+	atomic64_set(&iocored->logged_bytes, 0);
+	atomic64_set(&iocored->n_logpack, 0);
+	atomic64_set(&iocored->n_log_record, 0);
+	atomic64_set(&iocored->n_log_flush, 0);
+	atomic64_set(&iocored->n_log_flush_force, 0);
+	atomic64_set(&iocored->n_log_flush_fua, 0);
+	atomic64_set(&iocored->n_overlap_delay, 0);
+	iocored->max_pending_sectors_seen = 0;
+	atomic64_set(&iocored->n_queue_stop, 0);
+	atomic64_set(&iocored->queue_stop_ms, 0);
+	iocored->queue_stop_ns = 0;
+	for (i = 0; i < IOCORE_PACK_CUT_MAX; i++)
+		atomic_set(&iocored->pack_cut[i], 0);
+	for (i = 0; i < IOCORE_PACK_REC_HIST_SIZE; i++)
+		atomic_set(&iocored->pack_rec_hist[i], 0);
+	for (i = 0; i < IOCORE_PACK_UTIL_HIST_SIZE; i++)
+		atomic_set(&iocored->pack_util_hist[i], 0);
+	for (i = 0; i < IOCORE_PACK_SIZE_HIST_SIZE; i++)
+		atomic_set(&iocored->pack_size_hist[i], 0);
+	atomic_set(&iocored->n_padded_pack, 0);
+	atomic64_set(&iocored->padding_pb, 0);
+
+	/* Log data compression. */
+	iocored->compress_ws = alloc_percpu(void *);
+	if (!iocored->compress_ws) {
+		LOGe("compress_ws allocation failure.\n");
+		goto error4;
+	}
+	mutex_init(&iocored->compress_mutex);
+	iocored->is_compress_ready = false;
+	atomic64_set(&iocored->n_compressed_record, 0);
+	atomic64_set(&iocored->compress_saved_pb, 0);
+
 #ifdef WALB_DEBUG
 	atomic_set(&iocored->n_flush_io, 0);
 	atomic_set(&iocored->n_flush_logpack, 0);
@@ -1627,6 +1911,10 @@ static struct iocore_data* create_iocore_data(gfp_t gfp_mask)
 #endif
 	return iocored;
 
+error4:
+	free_percpu(iocored->io_count);
+error3:
+	walb_lat_free(iocored->lat);
 error2:
 	multimap_destroy(iocored->pending_data);
 
@@ -1644,8 +1932,15 @@ error0:
  */
 static void destroy_iocore_data(struct iocore_data *iocored)
 {
+	int cpu;
+
 	ASSERT(iocored);
 
+	for_each_possible_cpu(cpu)
+		vfree(*per_cpu_ptr(iocored->compress_ws, cpu));
+	free_percpu(iocored->compress_ws);
+	free_percpu(iocored->io_count);
+	walb_lat_free(iocored->lat);
 	multimap_destroy(iocored->pending_data);
 #ifdef WALB_OVERLAPPED_SERIALIZE
 	multimap_destroy(iocored->overlapped_data);
@@ -1760,21 +2055,31 @@ static bool writepack_add_bio_wrapper(
 
 	ASSERT(pack);
 	ASSERT(pack->logpack_header_sector);
-	ASSERT(pbs == pack->logpack_header_sector->size);
 	lhead = get_logpack_header(pack->logpack_header_sector);
+	ASSERT(pbs * get_logpack_header_pb(lhead)
+		== pack->logpack_header_sector->size);
 	ASSERT(*latest_lsidp == lhead->logpack_lsid);
 
 	if (is_zero_flush_only(pack)) {
+		pack->cut_reason = IOCORE_PACK_CUT_ZERO_FLUSH;
 		goto newpack;
 	}
-	if (lhead->n_records > 0 &&
-		(bio_has_flush(bio) ||
-			is_pack_size_too_large(lhead, pbs, max_logpack_pb, biow))) {
+	if (lhead->n_records > 0 && bio_has_flush(bio)) {
 		/* Flush request must be the first of the pack. */
+		pack->cut_reason = IOCORE_PACK_CUT_FLUSH;
+		goto newpack;
+	}
+	if (lhead->n_records > 0 &&
+		is_pack_size_too_large(lhead, pbs, max_logpack_pb, biow)) {
+		pack->cut_reason = IOCORE_PACK_CUT_SIZE;
 		goto newpack;
 	}
-	if (!walb_logpack_header_add_bio(lhead, bio, pbs, ring_buffer_size)) {
+	if (!walb_logpack_header_add_bio(
+			lhead, bio, pbs, ring_buffer_size,
+			bio_wrapper_state_is_zero(biow),
+			biow->compressed_bio ? get_log_pb(biow, pbs) : 0)) {
 		/* logpack header capacity full so create a new pack. */
+		pack->cut_reason = IOCORE_PACK_CUT_FULL;
 		goto newpack;
 	}
 	update_biow_lsid(lhead, biow);
@@ -1791,12 +2096,17 @@ newpack:
 	if (!pack) { goto error0; }
 	*wpackp = pack;
 	lhead = get_logpack_header(pack->logpack_header_sector);
-	ret = walb_logpack_header_add_bio(lhead, bio, pbs, ring_buffer_size);
+	ret = walb_logpack_header_add_bio(
+		lhead, bio, pbs, ring_buffer_size,
+		bio_wrapper_state_is_zero(biow),
+		biow->compressed_bio ? get_log_pb(biow, pbs) : 0);
 	ASSERT(ret);
 	update_biow_lsid(lhead, biow);
 fin:
 	/* The request is just added to the pack. */
 	list_add_tail(&biow->list, &pack->biow_list);
+	walb_dirty_bitmap_mark(
+		&wdev->dirty_bitmap, biow->pos, biow->len, biow->lsid);
 	if (bio_has_flush(bio) && !(bio->bi_opf & REQ_FUA)) {
 		*is_flushp = true;
 
@@ -1890,14 +2200,29 @@ static void writepack_check_and_set_zeroflush(struct pack *wpack, bool *is_flush
 
 static bool wait_for_logpack_header(struct pack *wpack)
 {
-	bool success;
+	bool success = true;
 	struct bio_entry *bioe = &wpack->header_bioe;
+	unsigned int i;
+
+	/* Flush requests of the other log devices of a striped log. */
+	for (i = 0; i < WALB_MAX_LDEVS; i++) {
+		struct bio_entry *fbioe = &wpack->sub_flush_bioe[i];
+		if (!bio_entry_exists(fbioe))
+			continue;
+		wait_for_bio_entry(fbioe, completion_timeo_ms_, wdev_minor(wpack->wdev));
+		if (fbioe->status != BLK_STS_OK) {
+			WLOGe(wpack->wdev, "log device %u flush failed.\n", i);
+			success = false;
+		}
+		fin_bio_entry(fbioe);
+	}
 
 	/* bioe->bio may be null when the flush request is not really required. */
-	if (!bio_entry_exists(bioe)) return true;
+	if (!bio_entry_exists(bioe)) return success;
 
 	wait_for_bio_entry(bioe, completion_timeo_ms_, wdev_minor(wpack->wdev));
-	success = (bioe->status == BLK_STS_OK);
+	if (bioe->status != BLK_STS_OK)
+		success = false;
 	fin_bio_entry(bioe);
 	return success;
 }
@@ -1930,6 +2255,17 @@ static void wait_for_logpack_and_submit_datapack(
 	/* Wait for logpack header or flush IO. */
 	if (!wait_for_logpack_header(wpack))
 		is_failed = true;
+	if (!is_failed) {
+		const struct walb_logpack_header *logh =
+			get_logpack_header(wpack->logpack_header_sector);
+		/* Zero-flush-only logpacks are not written. */
+		if (logh->n_records > 0)
+			walb_log_index_add(&wdev->log_index, logh);
+	}
+	trace_walb_end_logpack(
+		wdev_minor(wdev),
+		get_logpack_header(wpack->logpack_header_sector)->logpack_lsid,
+		is_failed);
 
 	/* Update permanent_lsid if necessary. */
 	if (!is_failed && pack_header_should_flush(wpack)) {
@@ -1942,6 +2278,9 @@ static void wait_for_logpack_and_submit_datapack(
 			LOG_("log_flush_completed_header\n");
 		}
 		spin_unlock(&wdev->lsid_lock);
+		trace_walb_update_permanent_lsid(
+			wdev_minor(wdev), wpack->new_permanent_lsid);
+		wake_up_all(&wdev->permanent_wq);
 		if (should_notice)
 			walb_sysfs_notify(wdev, "lsids");
 	}
@@ -1964,6 +2303,10 @@ static void wait_for_logpack_and_submit_datapack(
 		biow->ts[WALB_TIME_W_LOG_COMPLETED] = end_ts;
 		getnstimeofday(&biow->ts[WALB_TIME_W_LOG_END]);
 #endif
+		walb_lat_account(iocored->lat, biow, true,
+				WALB_LAT_LOG_IO, biow->io_end_ns);
+		walb_lat_account(iocored->lat, biow, true,
+				WALB_LAT_LOG_END, ktime_get_ns());
 		if (biow->len == 0) {
 			/* Zero-flush. */
 			ASSERT(wpack->is_zero_flush_only);
@@ -2001,49 +2344,44 @@ static void wait_for_logpack_and_submit_datapack(
 			spin_lock(&iocored->pending_data_lock);
 			LOG_("pending_sectors %u\n", iocored->pending_sectors);
 			is_stop_queue = should_stop_queue(wdev, biow);
+			iocored->pending_sectors += get_pending_len(biow);
 			if (is_discard) {
-				/* Discard IO does not have buffer of biow->len bytes.
-				   We consider its metadata only. */
-				iocored->pending_sectors++;
 				is_pending_insert_succeeded = true;
 			} else {
-				iocored->pending_sectors += biow->len;
 				is_pending_insert_succeeded =
 					pending_insert_and_delete_fully_overwritten(
 						iocored->pending_data,
 						&iocored->max_sectors_in_pending,
 						biow, GFP_ATOMIC);
 			}
+			if (iocored->pending_sectors > iocored->max_pending_sectors_seen)
+				iocored->max_pending_sectors_seen = iocored->pending_sectors;
 			spin_unlock(&iocored->pending_data_lock);
 			if (!is_pending_insert_succeeded) {
 				spin_lock(&iocored->pending_data_lock);
-				if (bio_wrapper_state_is_discard(biow)) {
-					iocored->pending_sectors--;
-				} else {
-					iocored->pending_sectors -= biow->len;
-				}
+				iocored->pending_sectors -= get_pending_len(biow);
 				spin_unlock(&iocored->pending_data_lock);
 				schedule();
 				goto retry_insert_pending;
 			}
 
 			/* Check pending data size and stop the queue if needed. */
-			if (is_stop_queue && !test_and_set_bit(IOCORE_STATE_IS_QUEUE_STOPPED, &iocored->flags))
+			if (is_stop_queue && !test_and_set_bit(IOCORE_STATE_IS_QUEUE_STOPPED, &iocored->flags)) {
 				freeze_detail(iocored, false);
+				trace_walb_queue_stop(wdev_minor(wdev),
+						READ_ONCE(iocored->pending_sectors));
+			}
 
 			/* We must flush here for REQ_FUA request before calling bio_endio().
 			   because WalB must flush all the previous logpacks and
 			   the logpack header and all the previous IOs and itself in the same logpack
 			   in order to make the IO be permanent in the log device. */
 			if (biow->copied_bio->bi_opf & REQ_FUA) {
-				u32 pb;
-				if (bio_wrapper_state_is_discard(biow))
-					pb = 0;
-				else
-					pb = capacity_pb(wdev->physical_bs, biow->len);
+				const u32 pb = get_log_pb(biow, wdev->physical_bs);
 				spin_lock(&wdev->lsid_lock);
 				wdev->lsids.completed = biow->lsid + pb;
 				spin_unlock(&wdev->lsid_lock);
+				atomic64_inc(&iocored->n_log_flush_fua);
 				force_flush_ldev(wdev);
 			}
 
@@ -2113,6 +2451,10 @@ static void wait_for_write_bio_wrapper(
 #ifdef WALB_PERFORMANCE_ANALYSIS
 	biow->ts[WALB_TIME_W_DATA_COMPLETED] = end_ts;
 #endif
+	walb_lat_account(iocored->lat, biow, true,
+			WALB_LAT_DATA_IO, biow->io_end_ns);
+	trace_walb_end_data(wdev_minor(wdev), biow->lsid, biow->pos, biow->len,
+			blk_status_to_errno(biow->status));
 
 #ifdef WALB_DEBUG
 	ASSERT(bio_wrapper_state_is_submitted(biow));
@@ -2162,6 +2504,8 @@ static void wait_for_write_bio_wrapper(
 		if (melt_detail(iocored, false))
 			dispatch_submit_log_task(wdev);
 		clear_bit(IOCORE_STATE_IS_QUEUE_STOPPED, &iocored->flags);
+		trace_walb_queue_start(wdev_minor(wdev),
+				READ_ONCE(iocored->pending_sectors));
 	}
 
 	/* Put related bio(s) and free resources. */
@@ -2203,8 +2547,11 @@ static void wait_for_bio_wrapper_io(struct bio_wrapper *biow, bool is_endio, boo
 	if (bio_entry_exists(bioe)) {
 		wait_for_bio_entry(bioe, completion_timeo_ms_, wdev_minor(wdev));
 		biow->status = bioe->status;
-	} else
-		ASSERT(biow->len == 0 || bio_wrapper_state_is_discard(biow));
+		biow->io_end_ns = bioe->end_ns;
+	} else {
+		ASSERT(biow->len == 0 || bio_wrapper_state_is_payload_free(biow));
+		biow->io_end_ns = ktime_get_ns();
+	}
 
 #ifdef WALB_PERFORMANCE_ANALYSIS
 	*end_ts = bioe->end_ts;
@@ -2263,6 +2610,11 @@ static void submit_write_bio_wrapper(struct bio_wrapper *biow, bool is_plugging)
 #ifdef WALB_PERFORMANCE_ANALYSIS
 	getnstimeofday(&biow->ts[WALB_TIME_W_DATA_SUBMITTED]);
 #endif
+	walb_lat_account(get_iocored_from_wdev(biow->private_data)->lat,
+			biow, true, WALB_LAT_DATA_SUBMIT, ktime_get_ns());
+	trace_walb_submit_data(
+		wdev_minor((struct walb_dev *)biow->private_data),
+		biow->lsid, biow->pos, biow->len, 0);
 	/* Submit all related bio(s). */
 	if (is_plugging)
 		blk_start_plug(&plug);
@@ -2285,8 +2637,11 @@ static void cancel_write_bio_wrapper(struct walb_dev *wdev, struct bio_wrapper *
 #endif
 
 	starts_queue = delete_bio_wrapper_from_pending_data(wdev, biow);
-	if (starts_queue && melt_detail(iocored, false))
+	if (starts_queue && melt_detail(iocored, false)) {
 		dispatch_submit_log_task(wdev);
+		trace_walb_queue_start(wdev_minor(wdev),
+				READ_ONCE(iocored->pending_sectors));
+	}
 
 	/* Put related bio(s) and free resources. */
 	if (bio_entry_exists(&biow->cloned_bioe)) {
@@ -2341,6 +2696,8 @@ static void submit_read_bio_wrapper(
 #ifdef WALB_PERFORMANCE_ANALYSIS
 	getnstimeofday(&biow->ts[WALB_TIME_R_SUBMITTED]);
 #endif
+	walb_lat_account(iocored->lat, biow, false,
+			WALB_LAT_QUEUE, ktime_get_ns());
 	LOG_("submit_lr: bioe %p pos %" PRIu64 " len %u\n"
 		, bioe, bioe->pos, bioe->len);
 	BIO_WRAPPER_PRINT_LS("read1", biow, bio_list_size(bio_list));
@@ -2537,7 +2894,7 @@ static void force_flush_ldev(struct walb_dev *wdev)
 	/* Execute a flush request. */
 	if (supports_flush_request_bdev(wdev->ldev)) {
 		err = blkdev_issue_flush(wdev->ldev, GFP_NOIO, NULL);
-		if (err) {
+		if (err || !walb_flush_sub_ldevs(wdev)) {
 			WLOGe(wdev, "log device flush failed. try to be read-only mode\n");
 			set_bit(WALB_STATE_READ_ONLY, &wdev->flags);
 		}
@@ -2546,6 +2903,7 @@ static void force_flush_ldev(struct walb_dev *wdev)
 #ifdef WALB_DEBUG
 	atomic_inc(&get_iocored_from_wdev(wdev)->n_flush_force);
 #endif
+	atomic64_inc(&get_iocored_from_wdev(wdev)->n_log_flush_force);
 
 	/* Update permanent_lsid. */
 	spin_lock(&wdev->lsid_lock);
@@ -2557,10 +2915,112 @@ static void force_flush_ldev(struct walb_dev *wdev)
 	}
 	ASSERT(lsid_set_is_valid(&wdev->lsids));
 	spin_unlock(&wdev->lsid_lock);
+	trace_walb_update_permanent_lsid(wdev_minor(wdev), new_permanent_lsid);
+	wake_up_all(&wdev->permanent_wq);
 	if (should_notice)
 		walb_sysfs_notify(wdev, "lsids");
 }
 
+/**
+ * Check whether prev_written_lsid has been updated or not.
+ * This is the condition to wait for super_sync_wq.
+ *
+ * RETURN:
+ *   true if prev_written_lsid has been changed or wdev became read-only.
+ */
+static bool is_prev_written_lsid_updated(
+	struct walb_dev *wdev, u64 prev_written_lsid)
+{
+	bool ret;
+
+	if (test_bit(WALB_STATE_READ_ONLY, &wdev->flags))
+		return true;
+
+	spin_lock(&wdev->lsid_lock);
+	ret = wdev->lsids.prev_written != prev_written_lsid;
+	spin_unlock(&wdev->lsid_lock);
+	return ret;
+}
+
+/**
+ * Check whether written_lsid has been updated or not.
+ * This is the condition to wait for iocored->ring_buffer_wq.
+ *
+ * RETURN:
+ *   true if written_lsid has been changed or wdev became read-only.
+ */
+static bool is_written_lsid_updated(struct walb_dev *wdev, u64 written_lsid)
+{
+	bool ret;
+
+	if (test_bit(WALB_STATE_READ_ONLY, &wdev->flags))
+		return true;
+
+	spin_lock(&wdev->lsid_lock);
+	ret = wdev->lsids.written != written_lsid;
+	spin_unlock(&wdev->lsid_lock);
+	return ret;
+}
+
+/**
+ * Account a stall waiting for ring buffer space.
+ *
+ * @iocored iocore data.
+ * @begin time when the stall began.
+ */
+static void account_ring_buffer_stall(
+	struct iocore_data *iocored, ktime_t begin)
+{
+	const u64 ms = div_u64(ktime_us_delta(ktime_get(), begin), 1000);
+	const int idx = min_t(int, fls64(ms), IOCORE_RB_STALL_HIST_SIZE - 1);
+
+	atomic_inc(&iocored->n_rb_stall);
+	atomic64_add(ms, &iocored->rb_stall_ms);
+	atomic_inc(&iocored->rb_stall_hist[idx]);
+}
+
+/**
+ * Account a logpack to the logpack efficiency statistics.
+ * Called by the submit log task just before submitting the logpack.
+ */
+static void account_logpack(
+	struct iocore_data *iocored, struct pack *wpack, unsigned int pbs)
+{
+	struct walb_logpack_header *logh =
+		get_logpack_header(wpack->logpack_header_sector);
+	const unsigned int n_header_pb = get_logpack_header_pb(logh);
+	const unsigned int max_n_rec = max_n_log_record_in_header(pbs, n_header_pb);
+	const unsigned int reason = wpack->is_zero_flush_only
+		? IOCORE_PACK_CUT_ZERO_FLUSH : wpack->cut_reason;
+	u64 padding_pb = 0;
+	unsigned int i;
+
+	ASSERT(reason < IOCORE_PACK_CUT_MAX);
+	atomic_inc(&iocored->pack_cut[reason]);
+	if (wpack->is_zero_flush_only)
+		return;
+
+	i = min_t(unsigned int, fls(logh->n_records),
+		IOCORE_PACK_REC_HIST_SIZE - 1);
+	atomic_inc(&iocored->pack_rec_hist[i]);
+	i = min_t(unsigned int, logh->n_records * IOCORE_PACK_UTIL_HIST_SIZE / max_n_rec,
+		IOCORE_PACK_UTIL_HIST_SIZE - 1);
+	atomic_inc(&iocored->pack_util_hist[i]);
+	i = min_t(unsigned int, fls(n_header_pb + logh->total_io_size),
+		IOCORE_PACK_SIZE_HIST_SIZE - 1);
+	atomic_inc(&iocored->pack_size_hist[i]);
+
+	if (logh->n_padding == 0)
+		return;
+	for (i = 0; i < logh->n_records; i++) {
+		struct walb_log_record *rec = &logh->record[i];
+		if (test_bit_u32(LOG_RECORD_PADDING, &rec->flags))
+			padding_pb += capacity_pb(pbs, rec->io_size);
+	}
+	atomic_inc(&iocored->n_padded_pack);
+	atomic64_add(padding_pb, &iocored->padding_pb);
+}
+
 /**
  * Wait for all logs permanent which lsid <= specified 'lsid'.
  *
@@ -2702,6 +3162,33 @@ static void update_flush_lsid_if_necessary(struct walb_dev *wdev, u64 flush_lsid
        }
 }
 
+/**
+ * Size of a bio wrapper counted as pending data [logical block].
+ * IOs without buffer of biow->len bytes,
+ * discard and zero IOs with write-zeroes,
+ * are counted as their metadata only.
+ */
+static unsigned int get_pending_len(struct bio_wrapper *biow)
+{
+	ASSERT(biow->copied_bio);
+
+	if (biow->len == 0 || bio_has_data(biow->copied_bio))
+		return biow->len;
+	return 1;
+}
+
+/**
+ * Size of the data of a write bio wrapper in the log [physical block].
+ */
+static unsigned int get_log_pb(struct bio_wrapper *biow, unsigned int pbs)
+{
+	if (bio_wrapper_state_is_payload_free(biow))
+		return 0;
+	if (biow->compressed_bio)
+		return biow->compressed_bio->bi_iter.bi_size / pbs;
+	return (unsigned int)capacity_pb(pbs, biow->len);
+}
+
 /**
  * RETURN:
  *   should_start_queue() return value.
@@ -2714,20 +3201,183 @@ static bool delete_bio_wrapper_from_pending_data(
 
 	spin_lock(&iocored->pending_data_lock);
 	starts_queue = should_start_queue(wdev, biow);
-	if (bio_wrapper_state_is_discard(biow)) {
-		iocored->pending_sectors--;
-	} else {
-		iocored->pending_sectors -= biow->len;
-		if (!bio_wrapper_state_is_overwritten(biow)) {
-			pending_delete(iocored->pending_data,
-				&iocored->max_sectors_in_pending, biow);
-		}
+	iocored->pending_sectors -= get_pending_len(biow);
+	iocored->n_drained_sectors += get_pending_len(biow);
+	if (!bio_wrapper_state_is_discard(biow) &&
+		!bio_wrapper_state_is_overwritten(biow)) {
+		pending_delete(iocored->pending_data,
+			&iocored->max_sectors_in_pending, biow);
 	}
 	spin_unlock(&iocored->pending_data_lock);
 
+	if (wdev->admission_control)
+		wake_up(&iocored->admission_wq);
 	return starts_queue;
 }
 
+/**
+ * Delay write IOs before consuming log space
+ * if pending data is too much for the data device.
+ *
+ * The admission rate is decided by update_admission_rate().
+ * Each bio wrapper list consumes tokens of its size at once,
+ * and waits until the token debt is paid back.
+ * The rate is updated whenever pending data drains,
+ * so it waits on admission_wq woken up by the data IO completions
+ * rather than polling.
+ * The delay is limited by queue_stop_timeout_jiffies.
+ *
+ * @wdev walb device.
+ * @biow_list bio wrapper list to be logged.
+ *
+ * CONTEXT:
+ *   Called from task_submit_logpack_list() only.
+ */
+static void admit_write_bio_wrapper_list(
+	struct walb_dev *wdev, struct list_head *biow_list)
+{
+	struct iocore_data *iocored = get_iocored_from_wdev(wdev);
+	struct token_bucket *tb = &iocored->admission_tb;
+	struct bio_wrapper *biow;
+	u64 sectors = 0, now_ns, wait_ns, drained;
+	unsigned long timeout_jiffies;
+	ktime_t begin;
+	bool is_delayed = false;
+
+	if (!wdev->admission_control)
+		return;
+
+	list_for_each_entry(biow, biow_list, list)
+		sectors += get_pending_len(biow);
+
+	begin = ktime_get();
+	now_ns = ktime_to_ns(begin);
+	if (!update_admission_rate(wdev, iocored, now_ns))
+		return;
+	token_bucket_consume(tb, sectors);
+	timeout_jiffies = jiffies + wdev->queue_stop_timeout_jiffies;
+	while ((wait_ns = token_bucket_wait_ns(tb)) > 0) {
+		if (test_bit(WALB_STATE_READ_ONLY, &wdev->flags))
+			break;
+		if (time_is_before_jiffies(timeout_jiffies)) {
+			WLOGw(wdev, "admission control timeout.\n");
+			token_bucket_fill(tb, ktime_get_ns());
+			break;
+		}
+		is_delayed = true;
+		/* A torn read only causes a spurious wakeup. */
+		drained = READ_ONCE(iocored->n_drained_sectors);
+		wait_event_timeout(iocored->admission_wq,
+				READ_ONCE(iocored->n_drained_sectors) != drained,
+				nsecs_to_jiffies(wait_ns) + 1);
+		if (!update_admission_rate(wdev, iocored, ktime_get_ns()))
+			break;
+	}
+	if (is_delayed) {
+		atomic_inc(&iocored->n_admission_delay);
+		atomic64_add(div_u64(ktime_us_delta(ktime_get(), begin), 1000),
+			&iocored->admission_delay_ms);
+	}
+}
+
+/**
+ * Sample the drain rate of the data device.
+ *
+ * @iocored iocore data.
+ * @now_ns current time [ns].
+ */
+static void update_drain_rate(struct iocore_data *iocored, u64 now_ns)
+{
+	u64 drained, elapsed, sample;
+
+	elapsed = now_ns - iocored->drain_sampled_ns;
+	if (elapsed < IOCORE_DRAIN_SAMPLE_MS * NSEC_PER_MSEC)
+		return;
+
+	spin_lock(&iocored->pending_data_lock);
+	drained = iocored->n_drained_sectors;
+	spin_unlock(&iocored->pending_data_lock);
+
+	sample = div64_u64((drained - iocored->drain_sampled_sectors) * NSEC_PER_SEC,
+			elapsed);
+	/* Exponential moving average with weight 1/4. */
+	if (iocored->drain_rate == 0)
+		iocored->drain_rate = sample;
+	else
+		iocored->drain_rate = (iocored->drain_rate * 3 + sample) / 4;
+	iocored->drain_sampled_sectors = drained;
+	iocored->drain_sampled_ns = now_ns;
+}
+
+/**
+ * Get the amount of pending data for admission control
+ * and queue stop/restart [logical block].
+ *
+ * If mem_limit_mb is set, memory usage is scaled so that
+ * reaching the limit is equivalent to reaching max_pending_sectors,
+ * and the larger one is used.
+ *
+ * CONTEXT:
+ *   pending_data_lock must be held.
+ */
+static u64 get_pending_pressure(
+	struct walb_dev *wdev, struct iocore_data *iocored)
+{
+	const u64 limit = (u64)wdev->mem_limit_mb * 1024 * 1024;
+	u64 mem;
+
+	if (limit == 0)
+		return iocored->pending_sectors;
+
+	mem = div64_u64((u64)atomic64_read(&iocored->mem_bytes)
+			* wdev->max_pending_sectors, limit);
+	return max_t(u64, iocored->pending_sectors, mem);
+}
+
+/**
+ * Update the admission rate and refill tokens.
+ *
+ * Let p be pending_sectors (see get_pending_pressure()),
+ * lo be min_pending_sectors, and hi be max_pending_sectors.
+ *   p <= lo:     no limitation (the bucket is filled).
+ *   lo < p < hi: rate = drain_rate * 2 * (hi - p) / (hi - lo),
+ *                not less than IOCORE_ADMISSION_MIN_RATE.
+ *   hi <= p:     rate = 0.
+ * So pending_sectors will converge around (lo + hi) / 2.
+ *
+ * RETURN:
+ *   false if there is no limitation now.
+ */
+static bool update_admission_rate(
+	struct walb_dev *wdev, struct iocore_data *iocored, u64 now_ns)
+{
+	const u64 lo = wdev->min_pending_sectors;
+	const u64 hi = wdev->max_pending_sectors;
+	const u64 burst = wdev->admission_burst_sectors;
+	struct token_bucket *tb = &iocored->admission_tb;
+	u64 pending, rate;
+
+	update_drain_rate(iocored, now_ns);
+
+	spin_lock(&iocored->pending_data_lock);
+	pending = get_pending_pressure(wdev, iocored);
+	spin_unlock(&iocored->pending_data_lock);
+
+	if (pending <= lo || hi <= lo) {
+		token_bucket_set(tb, 0, burst, now_ns);
+		token_bucket_fill(tb, now_ns);
+		return false;
+	}
+	if (pending >= hi) {
+		rate = 0;
+	} else {
+		rate = div64_u64(iocored->drain_rate * 2 * (hi - pending), hi - lo);
+		rate = max_t(u64, rate, IOCORE_ADMISSION_MIN_RATE);
+	}
+	token_bucket_set(tb, rate, burst, now_ns);
+	return true;
+}
+
 /**
  * Check whether walb should stop the queue
  * due to too much pending data.
@@ -2749,7 +3399,11 @@ static bool should_stop_queue(
 	if (test_bit(IOCORE_STATE_IS_QUEUE_STOPPED, &iocored->flags))
 		return false;
 
-	should_stop = iocored->pending_sectors + biow->len
+	/* Admission control will delay write IOs instead. */
+	if (wdev->admission_control)
+		return false;
+
+	should_stop = get_pending_pressure(wdev, iocored) + get_pending_len(biow)
 		> wdev->max_pending_sectors;
 
 	if (should_stop) {
@@ -2774,6 +3428,7 @@ static bool should_start_queue(
 	bool is_size;
 	bool is_timeout;
 	struct iocore_data *iocored;
+	u64 pending;
 
 	ASSERT(wdev);
 	ASSERT(biow);
@@ -2783,9 +3438,9 @@ static bool should_start_queue(
 	if (!test_bit(IOCORE_STATE_IS_QUEUE_STOPPED, &iocored->flags))
 		return false;
 
-	if (iocored->pending_sectors >= biow->len)
-		is_size = iocored->pending_sectors - biow->len
-			< wdev->min_pending_sectors;
+	pending = get_pending_pressure(wdev, iocored);
+	if (pending >= biow->len)
+		is_size = pending - biow->len < wdev->min_pending_sectors;
 	else
 		is_size = true;
 
@@ -2881,6 +3536,9 @@ static void io_acct_end(struct bio_wrapper *biow)
 	unsigned long duration = jiffies - biow->start_time;
 	unsigned long duration_ms = jiffies_to_msecs(duration);
 
+	walb_lat_add(get_iocored_from_wdev(wdev)->lat, rw == WRITE,
+		WALB_LAT_TOTAL, ktime_get_ns() - biow->begin_ns);
+
 	cpu = part_stat_lock();
 	part_stat_add(cpu, part0, ticks[rw], duration);
 	part_round_stats(cpu, part0);
@@ -2926,22 +3584,35 @@ static void set_frozen(struct iocore_data *iocored, bool is_usr, bool value)
                *p = value;
 }
 
+/**
+ * Freeze the logpack submit queue.
+ * The queue stop statistics count both pending-limit stops and user freezes.
+ */
 static void freeze_detail(struct iocore_data *iocored, bool is_usr)
 {
        spin_lock(&iocored->logpack_submit_queue_lock);
+       if (!is_frozen(iocored)) {
+               iocored->queue_stop_ns = ktime_get_ns();
+               atomic64_inc(&iocored->n_queue_stop);
+       }
        set_frozen(iocored, is_usr, true);
        spin_unlock(&iocored->logpack_submit_queue_lock);
 }
 
 static bool melt_detail(struct iocore_data *iocored, bool is_usr)
 {
-       bool melted;
+       bool was_frozen, melted;
 
        spin_lock(&iocored->logpack_submit_queue_lock);
+       was_frozen = is_frozen(iocored);
        set_frozen(iocored, is_usr, false);
        melted = !is_frozen(iocored);
-       if (melted)
+       if (melted) {
+               if (was_frozen)
+                       atomic64_add(div_u64(ktime_get_ns() - iocored->queue_stop_ns,
+                                               NSEC_PER_MSEC), &iocored->queue_stop_ms);
                make_frozen_queue_empty(iocored);
+       }
 
        spin_unlock(&iocored->logpack_submit_queue_lock);
 
@@ -3123,6 +3794,7 @@ void iocore_make_request(struct walb_dev *wdev, struct bio *bio)
 		break;
 	case REQ_OP_WRITE:
 	case REQ_OP_DISCARD:
+	case REQ_OP_WRITE_ZEROES:
 	case REQ_OP_FLUSH:
 		is_write = true;
 		break;
@@ -3140,6 +3812,24 @@ void iocore_make_request(struct walb_dev *wdev, struct bio *bio)
 		return;
 	}
 	iocored = get_iocored_from_wdev(wdev);
+	trace_walb_make_request(wdev_minor(wdev), bio_op(bio),
+				bio_begin_sector(bio), bio_sectors(bio));
+	switch (bio_op(bio)) {
+	case REQ_OP_READ:
+		this_cpu_inc(iocored->io_count->n_read);
+		break;
+	case REQ_OP_WRITE:
+	case REQ_OP_WRITE_ZEROES:
+		this_cpu_inc(iocored->io_count->n_write);
+		break;
+	case REQ_OP_DISCARD:
+		this_cpu_inc(iocored->io_count->n_discard);
+		break;
+	default:
+		break;
+	}
+	if (bio_has_flush(bio))
+		this_cpu_inc(iocored->io_count->n_flush);
 
 	/* Check whether read-only mode. */
 	if (is_write && test_bit(WALB_STATE_READ_ONLY, &wdev->flags)) {
@@ -3147,6 +3837,11 @@ void iocore_make_request(struct walb_dev *wdev, struct bio *bio)
 		return;
 	}
 
+	/* Throttle before consuming any resource including log space.
+	   Only data of normal writes are counted as bandwidth. */
+	walb_qos_throttle(&wdev->qos, is_write,
+			bio_has_data(bio) ? bio_sectors(bio) : 0);
+
 	/* Create bio wrapper. */
 	biow = alloc_bio_wrapper_inc(wdev, GFP_NOIO);
 	if (!biow) {
@@ -3156,6 +3851,9 @@ void iocore_make_request(struct walb_dev *wdev, struct bio *bio)
 	}
 	init_bio_wrapper(biow, bio);
 	biow->private_data = wdev;
+	biow->begin_ns = ktime_get_ns();
+	biow->stage_ns = biow->begin_ns;
+	iocore_mem_charge(wdev, biow, sizeof(*biow));
 
 	/* IO accounting for diskstats. */
 	io_acct_start(biow);
@@ -3170,6 +3868,15 @@ void iocore_make_request(struct walb_dev *wdev, struct bio *bio)
 		biow->copied_bio = bio_deep_clone(bio, GFP_NOIO);
 		if (!biow->copied_bio)
 			goto error0;
+		/* Zero data need not to be stored in the log. */
+		if (bio_op(bio) == REQ_OP_WRITE_ZEROES ||
+			(bio_op(bio) == REQ_OP_WRITE &&
+				bio_is_zero_filled(biow->copied_bio)))
+			set_zero_bio_wrapper(wdev, biow);
+		iocore_mem_charge(wdev, biow, IOCORE_MEM_WRITE_BYTES(biow));
+		if (READ_ONCE(wdev->compress) &&
+			!bio_wrapper_state_is_payload_free(biow))
+			iocore_compress(wdev, biow);
 
 		/* Push into queue and invoke submit task. */
 		if (push_into_lpack_submit_queue(biow))
@@ -3203,6 +3910,16 @@ void iocore_log_make_request(struct walb_dev *wdev, struct bio *bio)
 		bio_io_error(bio);
 		return;
 	}
+	if (wdev->n_ldevs > 1) {
+		/* Split the bio at stripe boundaries of the striped log. */
+		struct bio_list bio_list = split_bio_for_chunk_never_giveup(
+			bio, addr_lb(wdev->physical_bs, wdev->log_stripe_pb),
+			GFP_NOIO);
+		bio_list_for_each(bio, &bio_list)
+			walb_remap_log_bio(wdev, bio);
+		submit_all_bio_list(&bio_list);
+		return;
+	}
 	bio->bi_bdev = wdev->ldev;
 	generic_make_request(bio);
 }
@@ -3216,6 +3933,55 @@ void iocore_flush(struct walb_dev *wdev)
 	flush_all_wq();
 }
 
+/**
+ * Get iocore statistics.
+ * The fields of lsids and log space are not touched.
+ */
+void iocore_get_status(struct walb_dev *wdev, struct walb_status *st)
+{
+	struct iocore_data *iocored = get_iocored_from_wdev(wdev);
+	struct walb_qos *qos = &wdev->qos;
+	int cpu;
+
+	st->n_read = 0;
+	st->n_write = 0;
+	st->n_discard = 0;
+	st->n_flush = 0;
+	st->n_zero_write = 0;
+	for_each_possible_cpu(cpu) {
+		const struct iocore_io_count *c = per_cpu_ptr(iocored->io_count, cpu);
+		st->n_read += c->n_read;
+		st->n_write += c->n_write;
+		st->n_discard += c->n_discard;
+		st->n_flush += c->n_flush;
+		st->n_zero_write += c->n_zero_write;
+	}
+
+	st->logged_bytes = atomic64_read(&iocored->logged_bytes);
+	st->n_logpack = atomic64_read(&iocored->n_logpack);
+	st->n_log_record = atomic64_read(&iocored->n_log_record);
+	st->n_log_flush = atomic64_read(&iocored->n_log_flush);
+	st->n_log_flush_force = atomic64_read(&iocored->n_log_flush_force);
+	st->n_log_flush_fua = atomic64_read(&iocored->n_log_flush_fua);
+	st->n_overlap_delay = atomic64_read(&iocored->n_overlap_delay);
+
+	spin_lock(&iocored->pending_data_lock);
+	st->pending_sectors = iocored->pending_sectors;
+	st->max_pending_sectors_seen = iocored->max_pending_sectors_seen;
+	spin_unlock(&iocored->pending_data_lock);
+
+	st->n_queue_stop = atomic64_read(&iocored->n_queue_stop);
+	st->queue_stop_ms = atomic64_read(&iocored->queue_stop_ms);
+	st->n_rb_stall = atomic_read(&iocored->n_rb_stall);
+	st->rb_stall_ms = atomic64_read(&iocored->rb_stall_ms);
+	st->n_admission_delay = atomic_read(&iocored->n_admission_delay);
+	st->admission_delay_ms = atomic64_read(&iocored->admission_delay_ms);
+	st->n_qos_throttled = atomic_read(&qos->n_throttled[WALB_QOS_READ])
+		+ atomic_read(&qos->n_throttled[WALB_QOS_WRITE]);
+	st->qos_throttled_ms = atomic64_read(&qos->throttled_ms[WALB_QOS_READ])
+		+ atomic64_read(&qos->throttled_ms[WALB_QOS_WRITE]);
+}
+
 /**
  * Wait for all pending IO(s) done.
  */
@@ -3280,6 +4046,7 @@ void destroy_bio_wrapper_dec(
 	ASSERT(biow);
 
 	started = bio_wrapper_state_is_started(biow);
+	iocore_mem_uncharge(wdev, biow->mem_bytes);
 	destroy_bio_wrapper(biow);
 
 	atomic_dec(&iocored->n_pending_bio);
@@ -3288,6 +4055,171 @@ void destroy_bio_wrapper_dec(
 	}
 }
 
+/**
+ * Account memory to a device.
+ *
+ * @biow the bytes will be released with the bio wrapper
+ *   by destroy_bio_wrapper_dec(). NULL if the caller releases them
+ *   by iocore_mem_uncharge().
+ */
+static void iocore_mem_charge(struct walb_dev *wdev, struct bio_wrapper *biow,
+			unsigned int bytes)
+{
+	struct iocore_data *iocored = get_iocored_from_wdev(wdev);
+	u64 mem;
+
+	ASSERT(iocored);
+	if (biow)
+		biow->mem_bytes += bytes;
+	mem = atomic64_add_return(bytes, &iocored->mem_bytes);
+	if (mem > iocored->max_mem_bytes_seen)
+		iocored->max_mem_bytes_seen = mem;
+}
+
+static void iocore_mem_uncharge(struct walb_dev *wdev, unsigned int bytes)
+{
+	struct iocore_data *iocored = get_iocored_from_wdev(wdev);
+
+	ASSERT(iocored);
+	atomic64_sub(bytes, &iocored->mem_bytes);
+}
+
+/**
+ * Mark a write bio wrapper to be logged as a zero record.
+ * A write-zeroes biow is already without data.
+ * For a write biow of zero data, if the data device supports
+ * REQ_OP_WRITE_ZEROES, biow->copied_bio is replaced with
+ * a write-zeroes bio without data, else the copied data are kept
+ * and written to the data device as they are.
+ *
+ * CONTEXT:
+ *   non-atomic. Call this before charging the memory of copied_bio.
+ */
+static void set_zero_bio_wrapper(
+	struct walb_dev *wdev, struct bio_wrapper *biow)
+{
+	struct bio *bio = biow->copied_bio;
+	struct bio *zero_bio;
+
+	ASSERT(bio);
+	set_bit(BIO_WRAPPER_ZERO, &biow->flags);
+	this_cpu_inc(get_iocored_from_wdev(wdev)->io_count->n_zero_write);
+
+	if (!bio_has_data(bio) || !bdev_write_zeroes_sectors(wdev->ddev))
+		return;
+
+	zero_bio = bio_alloc_with_pages(0, bio->bi_bdev, GFP_NOIO);
+	if (!zero_bio)
+		return; /* Keep the copied data. */
+	zero_bio->bi_opf = (bio->bi_opf & ~REQ_OP_MASK) | REQ_OP_WRITE_ZEROES;
+	zero_bio->bi_iter.bi_sector = bio->bi_iter.bi_sector;
+	zero_bio->bi_iter.bi_size = bio->bi_iter.bi_size;
+	bio_put_with_pages(bio);
+	biow->copied_bio = zero_bio;
+}
+
+/**
+ * Compress the data of a write bio wrapper for the log.
+ * If the LZ4-compressed data with their u32 size prefix
+ * are smaller than the original data in physical blocks,
+ * biow->compressed_bio is set and will be written to the log device
+ * instead of biow->copied_bio, which is still used for the data device.
+ * Otherwise, or on any resource shortage, nothing is changed.
+ *
+ * The workspace of the current cpu is used with preemption disabled,
+ * so IOs larger than IOCORE_COMPRESS_MAX_BYTES are not compressed.
+ *
+ * CONTEXT:
+ *   non-atomic. Call this after charging the memory of copied_bio.
+ */
+static void iocore_compress(struct walb_dev *wdev, struct bio_wrapper *biow)
+{
+	struct iocore_data *iocored = get_iocored_from_wdev(wdev);
+	const unsigned int pbs = wdev->physical_bs;
+	const unsigned int orig_pb = capacity_pb(pbs, biow->len);
+	const unsigned int size = biow->len << 9;
+	struct bio *bio = biow->copied_bio;
+	struct bio *cbio = NULL;
+	u8 *ws, *src, *dst;
+	u32 clen;
+	int ret;
+	unsigned int cpb;
+
+	ASSERT(bio);
+	if (!smp_load_acquire(&iocored->is_compress_ready))
+		return;
+	if (size > IOCORE_COMPRESS_MAX_BYTES || orig_pb < 2)
+		return;
+	ASSERT(bio_has_data(bio));
+	ASSERT(bio->bi_iter.bi_size == size);
+
+	ws = *get_cpu_ptr(iocored->compress_ws);
+	src = ws + LZ4_MEM_COMPRESS;
+	dst = src + IOCORE_COMPRESS_MAX_BYTES;
+	bio_copy_to_buf(src, bio);
+	ret = LZ4_compress_default(
+		(const char *)src, (char *)dst + sizeof(u32), size,
+		LZ4_COMPRESSBOUND(size), ws);
+	if (ret <= 0)
+		goto fin;
+	clen = ret;
+	cpb = capacity_pb(pbs, DIV_ROUND_UP(sizeof(u32) + clen, LOGICAL_BLOCK_SIZE));
+	if (cpb >= orig_pb)
+		goto fin;
+	*(u32 *)dst = clen;
+	memset(dst + sizeof(u32) + clen, 0, cpb * pbs - sizeof(u32) - clen);
+
+	cbio = bio_alloc_with_pages(cpb * pbs, bio->bi_bdev, GFP_NOWAIT | __GFP_NOWARN);
+	if (!cbio)
+		goto fin;
+	bio_copy_from_buf(cbio, dst);
+	cbio->bi_opf = bio->bi_opf;
+	cbio->bi_iter.bi_sector = bio->bi_iter.bi_sector;
+fin:
+	put_cpu_ptr(iocored->compress_ws);
+	if (!cbio)
+		return;
+
+	biow->compressed_bio = cbio;
+	iocore_mem_charge(wdev, biow, sizeof(struct bio) + cbio->bi_vcnt * PAGE_SIZE);
+	atomic64_inc(&iocored->n_compressed_record);
+	atomic64_add(orig_pb - cpb, &iocored->compress_saved_pb);
+}
+
+/**
+ * Allocate the compression workspaces of all the cpus if not yet.
+ *
+ * RETURN:
+ *   0 in success, or -ENOMEM.
+ * CONTEXT:
+ *   non-atomic.
+ */
+int iocore_compress_prepare(struct walb_dev *wdev)
+{
+	struct iocore_data *iocored = get_iocored_from_wdev(wdev);
+	int cpu;
+	int err = 0;
+
+	mutex_lock(&iocored->compress_mutex);
+	if (iocored->is_compress_ready)
+		goto fin;
+	for_each_possible_cpu(cpu) {
+		void **wsp = per_cpu_ptr(iocored->compress_ws, cpu);
+		if (*wsp)
+			continue;
+		*wsp = vmalloc(IOCORE_COMPRESS_WS_BYTES);
+		if (!*wsp) {
+			WLOGe(wdev, "compression workspace allocation failure.\n");
+			err = -ENOMEM;
+			goto fin;
+		}
+	}
+	smp_store_release(&iocored->is_compress_ready, true);
+fin:
+	mutex_unlock(&iocored->compress_mutex);
+	return err;
+}
+
 /**
  * Make request.
  */
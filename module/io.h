@@ -12,10 +12,14 @@
 #include <linux/blkdev.h>
 #include <linux/list.h>
 #include <linux/version.h>
+#include <linux/mutex.h>
+#include <linux/lz4.h>
 #include "kern.h"
 #include "bio_wrapper.h"
 #include "worker.h"
 #include "treemap.h"
+#include "token_bucket.h"
+#include "latency.h"
 
 /**
  * iocored->flags bit.
@@ -31,6 +35,90 @@ enum {
 	IOCORE_STATE_IS_QUEUE_STOPPED,
 };
 
+/**
+ * Number of buckets of the ring buffer stall time histogram.
+ * Bucket 0 counts stalls shorter than 1ms and
+ * bucket i (i > 0) counts stalls in [2^(i-1), 2^i) ms.
+ * The last bucket also counts longer stalls.
+ */
+#define IOCORE_RB_STALL_HIST_SIZE 16
+
+/**
+ * For admission control.
+ * The drain rate of the data device is sampled
+ * every IOCORE_DRAIN_SAMPLE_MS at most.
+ * The admission rate is not less than IOCORE_ADMISSION_MIN_RATE
+ * [logical block per second] unless pending_sectors reaches max_pending_sectors.
+ */
+#define IOCORE_DRAIN_SAMPLE_MS 100
+#define IOCORE_ADMISSION_MIN_RATE (1024 * 1024 / LOGICAL_BLOCK_SIZE)
+
+/**
+ * Estimated memory for a write bio wrapper
+ * in addition to the wrapper itself [byte]:
+ * the copied bio with its pages and tree nodes of pending_data
+ * (and overlapped_data).
+ */
+#define IOCORE_MEM_WRITE_BYTES(biow)					\
+	(sizeof(struct bio) + (biow)->copied_bio->bi_vcnt * PAGE_SIZE	\
+		+ 2 * (sizeof(struct tree_node)				\
+			+ sizeof(struct tree_cell_head)			\
+			+ sizeof(struct tree_cell)))
+
+/**
+ * Why a logpack has been closed.
+ */
+enum {
+	/* The end of a bulk of write IOs. */
+	IOCORE_PACK_CUT_END = 0,
+	/* The next IO has a flush request. */
+	IOCORE_PACK_CUT_FLUSH,
+	/* The pack would exceed max_logpack_pb. */
+	IOCORE_PACK_CUT_SIZE,
+	/* The header has no space for the next record
+	   (including padding for ring buffer wrap). */
+	IOCORE_PACK_CUT_FULL,
+	/* The pack contains only a zero-size flush. */
+	IOCORE_PACK_CUT_ZERO_FLUSH,
+	IOCORE_PACK_CUT_MAX,
+};
+
+/**
+ * Logpack histograms.
+ * Records per pack: bucket 0 for 0 and bucket i for [2^(i-1), 2^i).
+ * Header utilization: bucket i for [10i, 10(i+1)) percent of
+ * max_n_log_record_in_header() of the pack. 100 percent goes to the last bucket.
+ * Pack size including its header [physical block]: same as records.
+ * The last bucket also counts larger values.
+ */
+#define IOCORE_PACK_REC_HIST_SIZE 10
+#define IOCORE_PACK_UTIL_HIST_SIZE 10
+#define IOCORE_PACK_SIZE_HIST_SIZE 16
+
+/**
+ * Per-cpu counters of accepted IOs. See struct walb_status.
+ */
+struct iocore_io_count
+{
+	u64 n_read;
+	u64 n_write;
+	u64 n_discard;
+	u64 n_flush;
+	u64 n_zero_write;
+};
+
+/**
+ * Log data compression. See iocore_compress().
+ * Write IOs up to IOCORE_COMPRESS_MAX_BYTES are compressed.
+ * Each cpu has its own workspace of IOCORE_COMPRESS_WS_BYTES
+ * that consists of LZ4 working memory, a source buffer
+ * and a destination buffer with a u32 size prefix.
+ */
+#define IOCORE_COMPRESS_MAX_BYTES (64 << 10)
+#define IOCORE_COMPRESS_WS_BYTES					\
+	(LZ4_MEM_COMPRESS + IOCORE_COMPRESS_MAX_BYTES			\
+		+ sizeof(u32) + LZ4_COMPRESSBOUND(IOCORE_COMPRESS_MAX_BYTES))
+
 /**
  * (struct walb_dev *)->private_data.
  */
@@ -124,9 +212,96 @@ struct iocore_data
 	/* For queue stopped timeout check. */
 	unsigned long queue_restart_jiffies;
 
+	/*
+	 * For admission control. See admit_write_bio_wrapper_list().
+	 * n_drained_sectors is protected by pending_data_lock,
+	 * and the others are accessed by the submit log task only.
+	 * drain_rate [logical block per second].
+	 */
+	u64 n_drained_sectors;
+	u64 drain_sampled_sectors;
+	u64 drain_sampled_ns;
+	u64 drain_rate;
+	struct token_bucket admission_tb;
+	atomic_t n_admission_delay;
+	atomic64_t admission_delay_ms;
+	/* Woken up when write IOs are deleted from pending data. */
+	wait_queue_head_t admission_wq;
+
+	/*
+	 * Estimated memory used by in-flight IOs [byte].
+	 * Bio wrappers, copied bio pages, pending data tree nodes
+	 * and logpack headers are counted. See iocore_mem_charge().
+	 * max_mem_bytes_seen is updated racily.
+	 */
+	atomic64_t mem_bytes;
+	u64 max_mem_bytes_seen;
+
 	/* To check that we should flush log device. */
 	unsigned long log_flush_jiffies;
 
+	/* Woken up when lsids.written is updated by gc. */
+	wait_queue_head_t ring_buffer_wq;
+
+	/*
+	 * Statistics of stalls waiting for ring buffer space.
+	 * n_rb_stall: number of stalls.
+	 * rb_stall_ms: total stall time [ms].
+	 * rb_stall_hist: histogram of stall time. See IOCORE_RB_STALL_HIST_SIZE.
+	 */
+	atomic_t n_rb_stall;
+	atomic64_t rb_stall_ms;
+	atomic_t rb_stall_hist[IOCORE_RB_STALL_HIST_SIZE];
+
+	/* Per-cpu latency histograms of pipeline stages. */
+	struct walb_lat_hist __percpu *lat;
+
+	/*
+	 * Cumulative statistics. See struct walb_status.
+	 * max_pending_sectors_seen is protected by pending_data_lock.
+	 * queue_stop_ns is the time when the logpack submit queue was frozen
+	 * and is protected by logpack_submit_queue_lock.
+	 */
+	struct iocore_io_count __percpu *io_count;
+	atomic64_t logged_bytes;
+	atomic64_t n_logpack;
+	atomic64_t n_log_record;
+	atomic64_t n_log_flush;
+	atomic64_t n_log_flush_force;
+	atomic64_t n_log_flush_fua;
+	atomic64_t n_overlap_delay;
+	unsigned int max_pending_sectors_seen;
+	atomic64_t n_queue_stop;
+	atomic64_t queue_stop_ms;
+	u64 queue_stop_ns;
+
+	/*
+	 * Logpack efficiency statistics.
+	 * They are updated by the submit log task only.
+	 * n_padded_pack and padding_pb are for padding records
+	 * at ring buffer wrap.
+	 */
+	atomic_t pack_cut[IOCORE_PACK_CUT_MAX];
+	atomic_t pack_rec_hist[IOCORE_PACK_REC_HIST_SIZE];
+	atomic_t pack_util_hist[IOCORE_PACK_UTIL_HIST_SIZE];
+	atomic_t pack_size_hist[IOCORE_PACK_SIZE_HIST_SIZE];
+	atomic_t n_padded_pack;
+	atomic64_t padding_pb;
+
+	/*
+	 * Log data compression.
+	 * compress_ws is a per-cpu pointer to a workspace.
+	 * The workspaces are allocated by iocore_compress_prepare()
+	 * under compress_mutex and published by setting is_compress_ready.
+	 * n_compressed_record: number of compressed records.
+	 * compress_saved_pb: log space saved by compression [physical block].
+	 */
+	void * __percpu *compress_ws;
+	struct mutex compress_mutex;
+	bool is_compress_ready;
+	atomic64_t n_compressed_record;
+	atomic64_t compress_saved_pb;
+
 #ifdef WALB_DEBUG
 	atomic_t n_flush_io;
 	atomic_t n_flush_logpack;
@@ -161,6 +336,8 @@ void iocore_melt(struct walb_dev *wdev);
 void iocore_make_request(struct walb_dev *wdev, struct bio *bio);
 void iocore_log_make_request(struct walb_dev *wdev, struct bio *bio);
 void iocore_flush(struct walb_dev *wdev);
+void iocore_get_status(struct walb_dev *wdev, struct walb_status *st);
+int iocore_compress_prepare(struct walb_dev *wdev);
 
 /* Iocore utilities. */
 void wait_for_all_pending_io_done(struct walb_dev *wdev);
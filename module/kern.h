@@ -14,6 +14,7 @@
 #include <linux/kernel.h>
 #include <linux/blkdev.h>
 #include <linux/mutex.h>
+#include <linux/wait.h>
 
 #include "linux/walb/common.h"
 #include "linux/walb/print.h"
@@ -23,6 +24,9 @@
 #include "linux/walb/sector.h"
 #include "linux/walb/ioctl.h"
 #include "checkpoint.h"
+#include "qos.h"
+#include "dirty_bitmap.h"
+#include "log_index.h"
 
 /**
  * Walb device major.
@@ -64,6 +68,21 @@ extern unsigned int io_latency_threshold_ms_;
  */
 extern unsigned int checkpoint_threshold_ms_;
 
+/**
+ * Non-zero if the checkpoint interval is adapted to the log usage.
+ */
+extern unsigned int checkpoint_adaptive_;
+
+/**
+ * Number of logpack headers kept in memory for each device.
+ */
+extern unsigned int log_index_size_;
+
+/*
+ * Default bucket size of admission control [KiB].
+ */
+#define WALB_DEFAULT_ADMISSION_BURST_KB (4 * 1024)
+
 /*
  * Minor number and partition management.
  */
@@ -153,6 +172,16 @@ struct walb_dev
 	struct block_device *ldev; /* log device */
 	struct block_device *ddev; /* data device */
 
+	/*
+	 * Log devices of a striped log.
+	 * ldevs[0] is ldev and n_ldevs is 1 for non-striped logs.
+	 * Log IOs are addressed in the log address space
+	 * and remapped to the devices by walb_remap_log_bio().
+	 */
+	struct block_device *ldevs[WALB_MAX_LDEVS];
+	unsigned int n_ldevs;
+	u32 log_stripe_pb; /* [physical block] */
+
 	/*
 	 * chunk sectors [logical block].
 	 * if chunk_sectors > 0:
@@ -181,11 +210,22 @@ struct walb_dev
 	   This is used for logpack header and log data. */
 	u32 log_checksum_salt;
 
+	/* Checksum type of logpack headers and log data.
+	   WALB_CSUM_XXX decided by the super sector format flags. */
+	unsigned int log_csum_type;
+
+	/* Size of logpack headers [physical block].
+	   Copied from the super sector. */
+	unsigned int logpack_header_pb;
+
 	/* Lsids and its lock.
 	   Each variable must be accessed with lsid_lock held. */
 	spinlock_t lsid_lock;
 	struct lsid_set lsids;
 
+	/* Log readers wait for lsids.permanent to be updated. */
+	wait_queue_head_t permanent_wq;
+
 	/*
 	 * For wrapper device.
 	 */
@@ -205,6 +245,18 @@ struct walb_dev
 	 */
 	struct checkpoint_data cpd;
 
+	/*
+	 * For superblock sync.
+	 * super_sync_mutex serializes superblock writes
+	 *   so that one of the two super sector slots is always intact.
+	 * super_sync_work runs walb_sync_super_block() asynchronously.
+	 *   Requests during its execution are coalesced into the next run.
+	 * super_sync_wq is woken up whenever lsids.prev_written may be updated.
+	 */
+	struct mutex super_sync_mutex;
+	struct work_struct super_sync_work;
+	wait_queue_head_t super_sync_wq;
+
 	/* Maximum logpack size [physical block].
 	   This will be used for logpack size
 	   not to be too long
@@ -227,9 +279,55 @@ struct walb_dev
 	   we can restart the queue. */
 	unsigned int min_pending_sectors;
 
-	/* queue stopped period must not exceed this value. */
+	/* queue stopped period must not exceed this value.
+	   This is also the maximum delay of admission control. */
 	unsigned int queue_stop_timeout_jiffies;
 
+	/*
+	 * Admission control for write IOs.
+	 * If admission_control is non-zero, write IOs are delayed smoothly
+	 * according to the drain rate of the data device and pending_sectors
+	 * instead of stopping the queue at max_pending_sectors.
+	 * admission_burst_sectors is the bucket size [logical block].
+	 * These can be changed through sysfs.
+	 */
+	unsigned int admission_control;
+	unsigned int admission_burst_sectors;
+
+	/*
+	 * Memory limit of in-flight IOs [MiB]. 0 means unlimited.
+	 * Memory usage is counted as pending data for admission control
+	 * and queue stop so that reaching this limit is equivalent to
+	 * reaching max_pending_sectors.
+	 * This can be changed through sysfs.
+	 */
+	unsigned int mem_limit_mb;
+
+	/*
+	 * If non-zero, the data of write IOs are LZ4-compressed in the log
+	 * when it saves log space. See iocore_compress().
+	 * This can be changed through sysfs.
+	 */
+	unsigned int compress;
+
+	/*
+	 * Per-device IOPS/bandwidth limits.
+	 * These can be changed through sysfs or ioctl.
+	 */
+	struct walb_qos qos;
+
+	/*
+	 * Dirty region bitmap for backup after log overflow.
+	 * It is written with the superblock.
+	 */
+	struct walb_dirty_bitmap dirty_bitmap;
+
+	/*
+	 * Recent logpack headers for log extractors.
+	 * The size is decided by log_index_size module parameter.
+	 */
+	struct walb_log_index log_index;
+
 	/* If you prefer small response to large throughput,
 	   set n_pack_bulk smaller. */
 	unsigned int n_pack_bulk;
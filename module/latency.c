@@ -0,0 +1,78 @@
+/**
+ * latency.c - Per-stage IO latency histograms.
+ *
+ * (C) 2013, Cybozu Labs, Inc.
+ */
+#include "check_kernel.h"
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include "linux/walb/common.h"
+#include "latency.h"
+
+/* Stage names to show. */
+static const char *lat_stage_str_[WALB_LAT_MAX] = {
+	"queue",
+	"log_io",
+	"log_end",
+	"data_submit",
+	"data_io",
+	"total",
+};
+
+/**
+ * Allocate per-cpu latency histograms.
+ *
+ * RETURN:
+ *   NULL in failure.
+ */
+struct walb_lat_hist __percpu *walb_lat_alloc(void)
+{
+	return alloc_percpu(struct walb_lat_hist);
+}
+
+void walb_lat_free(struct walb_lat_hist __percpu *lat)
+{
+	free_percpu(lat);
+}
+
+/**
+ * Print histograms summed up over all cpus.
+ * Each line is a stage name followed by the counts of the buckets.
+ * Stages not passed through are omitted.
+ *
+ * RETURN:
+ *   printed size.
+ */
+ssize_t walb_lat_sprint(
+	struct walb_lat_hist __percpu *lat, bool is_write,
+	char *buf, size_t size)
+{
+	unsigned long sum[WALB_LAT_HIST_SIZE];
+	unsigned int stage, i;
+	int cpu;
+	size_t len = 0;
+
+	for (stage = 0; stage < WALB_LAT_MAX; stage++) {
+		if (!is_write &&
+			(stage == WALB_LAT_LOG_IO ||
+				stage == WALB_LAT_LOG_END ||
+				stage == WALB_LAT_DATA_SUBMIT))
+			continue;
+
+		memset(sum, 0, sizeof(sum));
+		for_each_possible_cpu(cpu) {
+			const struct walb_lat_hist *h = per_cpu_ptr(lat, cpu);
+			for (i = 0; i < WALB_LAT_HIST_SIZE; i++)
+				sum[i] += h->count[is_write][stage][i];
+		}
+
+		len += scnprintf(buf + len, size - len, "%s", lat_stage_str_[stage]);
+		for (i = 0; i < WALB_LAT_HIST_SIZE; i++)
+			len += scnprintf(buf + len, size - len, " %lu", sum[i]);
+		len += scnprintf(buf + len, size - len, "\n");
+	}
+	return len;
+}
+
+MODULE_LICENSE("GPL");
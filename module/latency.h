@@ -0,0 +1,82 @@
+/**
+ * latency.h - Per-stage IO latency histograms.
+ */
+#ifndef WALB_LATENCY_H_KERNEL
+#define WALB_LATENCY_H_KERNEL
+
+#include "check_kernel.h"
+#include <linux/percpu.h>
+#include <linux/bitops.h>
+#include <linux/math64.h>
+#include <linux/time.h>
+#include "bio_wrapper.h"
+
+/**
+ * Pipeline stages.
+ *
+ * Write: QUEUE -> LOG_IO -> LOG_END -> DATA_SUBMIT -> DATA_IO.
+ * Read: QUEUE -> DATA_IO.
+ * TOTAL is the time until the IO is completed to the upper layer.
+ * Write IOs are completed just after LOG_END.
+ */
+enum {
+	WALB_LAT_QUEUE = 0, /* make_request to log (read: data) submit. */
+	WALB_LAT_LOG_IO, /* log submit to log IO completion. */
+	WALB_LAT_LOG_END, /* log IO completion to its handling. */
+	WALB_LAT_DATA_SUBMIT, /* log handling to data submit. */
+	WALB_LAT_DATA_IO, /* data submit to data IO completion. */
+	WALB_LAT_TOTAL,
+	WALB_LAT_MAX,
+};
+
+/**
+ * Number of buckets of a latency histogram.
+ * Bucket 0 counts latencies shorter than 1us and
+ * bucket i (i > 0) counts latencies in [2^(i-1), 2^i) us.
+ * The last bucket also counts longer latencies.
+ */
+#define WALB_LAT_HIST_SIZE 24
+
+/**
+ * Latency histograms of a device on a cpu.
+ * Indexed by [is_write][stage][bucket].
+ */
+struct walb_lat_hist
+{
+	unsigned long count[2][WALB_LAT_MAX][WALB_LAT_HIST_SIZE];
+};
+
+/**
+ * Add a latency to the histogram of the current cpu.
+ */
+static inline void walb_lat_add(
+	struct walb_lat_hist __percpu *lat, bool is_write,
+	unsigned int stage, u64 delta_ns)
+{
+	const u64 us = div_u64(delta_ns, NSEC_PER_USEC);
+	const unsigned int i = min_t(unsigned int, fls64(us), WALB_LAT_HIST_SIZE - 1);
+
+	this_cpu_inc(lat->count[is_write][stage][i]);
+}
+
+/**
+ * Account the stage of a bio wrapper that ended at now_ns,
+ * and start the next stage.
+ */
+static inline void walb_lat_account(
+	struct walb_lat_hist __percpu *lat, struct bio_wrapper *biow,
+	bool is_write, unsigned int stage, u64 now_ns)
+{
+	if (now_ns < biow->stage_ns)
+		now_ns = biow->stage_ns;
+	walb_lat_add(lat, is_write, stage, now_ns - biow->stage_ns);
+	biow->stage_ns = now_ns;
+}
+
+struct walb_lat_hist __percpu *walb_lat_alloc(void);
+void walb_lat_free(struct walb_lat_hist __percpu *lat);
+ssize_t walb_lat_sprint(
+	struct walb_lat_hist __percpu *lat, bool is_write,
+	char *buf, size_t size);
+
+#endif /* WALB_LATENCY_H_KERNEL */
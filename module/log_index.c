@@ -0,0 +1,274 @@
+/**
+ * log_index.c - In-memory index of recent logpack headers.
+ */
+#include "check_kernel.h"
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/sched/mm.h>
+#include "linux/walb/logger.h"
+#include "log_index.h"
+
+/*******************************************************************************
+ * Static functions prototype.
+ *******************************************************************************/
+
+static size_t get_entry_size(const struct walb_logpack_header *logh);
+static struct walb_logpack_header *get_entry(
+	const struct walb_log_index *idx, unsigned int i);
+static struct walb_logpack_header *pop_entry(struct walb_log_index *idx);
+static void clear_entries(struct walb_log_index *idx);
+static bool search_entry(
+	const struct walb_log_index *idx, u64 lsid, unsigned int *ip);
+
+/*******************************************************************************
+ * Static functions definition.
+ *******************************************************************************/
+
+/**
+ * Size of a header and its records [byte].
+ */
+static size_t get_entry_size(const struct walb_logpack_header *logh)
+{
+	return sizeof(*logh) + sizeof(struct walb_log_record) * logh->n_records;
+}
+
+/**
+ * Get the i-th oldest entry.
+ */
+static struct walb_logpack_header *get_entry(
+	const struct walb_log_index *idx, unsigned int i)
+{
+	ASSERT(i < idx->n);
+	return idx->ary[(idx->head + i) % idx->n_max];
+}
+
+/**
+ * Remove the oldest entry.
+ * idx->lock must be held.
+ *
+ * RETURN:
+ *   the entry to be freed by the caller, or NULL if empty.
+ */
+static struct walb_logpack_header *pop_entry(struct walb_log_index *idx)
+{
+	struct walb_logpack_header *ent;
+
+	if (idx->n == 0)
+		return NULL;
+	ent = idx->ary[idx->head];
+	idx->head = (idx->head + 1) % idx->n_max;
+	idx->n--;
+	return ent;
+}
+
+/**
+ * Free all the entries.
+ * Entries may be vmalloc()ed, so they are freed without idx->lock.
+ * The rest stay contiguous while readers see them.
+ */
+static void clear_entries(struct walb_log_index *idx)
+{
+	struct walb_logpack_header *ent;
+
+	for (;;) {
+		spin_lock(&idx->lock);
+		ent = pop_entry(idx);
+		spin_unlock(&idx->lock);
+		if (!ent)
+			break;
+		kvfree(ent);
+	}
+}
+
+/**
+ * Search the entry of an lsid with binary search.
+ * idx->lock must be held.
+ *
+ * @ip found entry index will be set.
+ *   It will be idx->n if lsid is idx->next_lsid.
+ *
+ * RETURN:
+ *   true if found, or false.
+ */
+static bool search_entry(
+	const struct walb_log_index *idx, u64 lsid, unsigned int *ip)
+{
+	unsigned int lo = 0, hi = idx->n;
+
+	if (lsid == idx->next_lsid) {
+		*ip = idx->n;
+		return true;
+	}
+	if (idx->n == 0 || lsid < get_entry(idx, 0)->logpack_lsid)
+		return false;
+	while (lo < hi) {
+		const unsigned int mid = lo + (hi - lo) / 2;
+		const u64 mid_lsid = get_entry(idx, mid)->logpack_lsid;
+
+		if (mid_lsid == lsid) {
+			*ip = mid;
+			return true;
+		}
+		if (mid_lsid < lsid)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return false;
+}
+
+/*******************************************************************************
+ * Global functions definition.
+ *******************************************************************************/
+
+/**
+ * Initialize a log index.
+ *
+ * @n_max number of entries. 0 means disabled.
+ *
+ * RETURN:
+ *   true in success, or false.
+ */
+bool walb_log_index_init(struct walb_log_index *idx, unsigned int n_max)
+{
+	spin_lock_init(&idx->lock);
+	idx->ary = NULL;
+	idx->n_max = 0;
+	idx->head = 0;
+	idx->n = 0;
+	idx->next_lsid = INVALID_LSID;
+	if (n_max == 0)
+		return true;
+
+	idx->ary = kcalloc(n_max, sizeof(*idx->ary), GFP_KERNEL);
+	if (!idx->ary) {
+		LOGe("log index allocation failed (%u entries).\n", n_max);
+		return false;
+	}
+	idx->n_max = n_max;
+	return true;
+}
+
+/**
+ * Destroy a log index.
+ */
+void walb_log_index_destroy(struct walb_log_index *idx)
+{
+	if (!idx->ary)
+		return;
+	clear_entries(idx);
+	kfree(idx->ary);
+	idx->ary = NULL;
+	idx->n_max = 0;
+}
+
+/**
+ * Add a logpack header that has been written.
+ * This must be called in lsid order by one task at a time.
+ * If the header does not follow the latest entry,
+ * for example after reset-wal, the older entries are dropped.
+ *
+ * CONTEXT:
+ *   Non-IRQ. Sleepable. The allocation does not start IOs.
+ */
+void walb_log_index_add(
+	struct walb_log_index *idx, const struct walb_logpack_header *logh)
+{
+	const size_t size = get_entry_size(logh);
+	struct walb_logpack_header *ent, *old = NULL;
+	unsigned int noio_flags;
+	bool is_contiguous;
+
+	if (idx->n_max == 0)
+		return;
+
+	/* The index loses contiguity if the allocation fails. */
+	noio_flags = memalloc_noio_save();
+	ent = kvmalloc(size, GFP_KERNEL);
+	memalloc_noio_restore(noio_flags);
+	if (ent)
+		memcpy(ent, logh, size);
+
+	spin_lock(&idx->lock);
+	is_contiguous = ent && idx->next_lsid == logh->logpack_lsid;
+	if (!is_contiguous)
+		idx->next_lsid = INVALID_LSID;
+	spin_unlock(&idx->lock);
+	if (!is_contiguous)
+		clear_entries(idx);
+	if (!ent)
+		return;
+
+	spin_lock(&idx->lock);
+	if (idx->n == idx->n_max)
+		old = pop_entry(idx);
+	idx->ary[(idx->head + idx->n) % idx->n_max] = ent;
+	idx->n++;
+	idx->next_lsid = logh->logpack_lsid
+		+ get_logpack_header_pb(logh) + logh->total_io_size;
+	spin_unlock(&idx->lock);
+	kvfree(old);
+}
+
+/**
+ * Drop all the entries.
+ */
+void walb_log_index_clear(struct walb_log_index *idx)
+{
+	spin_lock(&idx->lock);
+	idx->next_lsid = INVALID_LSID;
+	spin_unlock(&idx->lock);
+	clear_entries(idx);
+}
+
+/**
+ * Get headers of contiguous logpacks from an lsid.
+ *
+ * @lsid0 lsid of the first logpack.
+ * @lsid1 logpacks which end after lsid1 are not got.
+ * @buf buffer to store the header blocks as they are in the log device.
+ * @size buffer size [byte].
+ * @pbs physical block size.
+ * @next_lsidp lsid next to the last logpack got will be set.
+ *
+ * RETURN:
+ *   number of headers got, or -1 if lsid0 is not in the index.
+ */
+int walb_log_index_get(
+	struct walb_log_index *idx, u64 lsid0, u64 lsid1,
+	u8 *buf, size_t size, unsigned int pbs, u64 *next_lsidp)
+{
+	unsigned int i;
+	u64 lsid = lsid0;
+	size_t off = 0;
+	int n = 0;
+
+	spin_lock(&idx->lock);
+	if (!search_entry(idx, lsid0, &i)) {
+		spin_unlock(&idx->lock);
+		return -1;
+	}
+	for (; i < idx->n; i++) {
+		const struct walb_logpack_header *logh = get_entry(idx, i);
+		const size_t header_size = get_logpack_header_pb(logh) * pbs;
+		const u64 next_lsid = lsid + get_logpack_header_pb(logh)
+			+ logh->total_io_size;
+
+		ASSERT(logh->logpack_lsid == lsid);
+		if (next_lsid > lsid1 || off + header_size > size)
+			break;
+		memset(buf + off, 0, header_size);
+		memcpy(buf + off, logh, get_entry_size(logh));
+		off += header_size;
+		lsid = next_lsid;
+		n++;
+	}
+	spin_unlock(&idx->lock);
+
+	*next_lsidp = lsid;
+	return n;
+}
+
+MODULE_LICENSE("GPL");
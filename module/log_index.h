@@ -0,0 +1,42 @@
+/**
+ * log_index.h - In-memory index of recent logpack headers.
+ */
+#ifndef WALB_LOG_INDEX_H_KERNEL
+#define WALB_LOG_INDEX_H_KERNEL
+
+#include "check_kernel.h"
+#include <linux/spinlock.h>
+#include "linux/walb/log_record.h"
+
+/**
+ * Ring buffer of recent logpack headers.
+ *
+ * Headers are added in lsid order when they have been written,
+ * so the entries are always contiguous logpacks.
+ * The oldest entry is dropped when the ring is full.
+ * Each entry has the header and its records only,
+ * and the zero-filled rest of the header blocks is restored at read.
+ */
+struct walb_log_index
+{
+	spinlock_t lock;
+
+	/* Ring buffer of n_max entries. NULL if disabled. */
+	struct walb_logpack_header **ary;
+	unsigned int n_max;
+
+	unsigned int head; /* index of the oldest entry. */
+	unsigned int n; /* number of entries. */
+	u64 next_lsid; /* lsid next to the latest entry. */
+};
+
+bool walb_log_index_init(struct walb_log_index *idx, unsigned int n_max);
+void walb_log_index_destroy(struct walb_log_index *idx);
+void walb_log_index_add(
+	struct walb_log_index *idx, const struct walb_logpack_header *logh);
+void walb_log_index_clear(struct walb_log_index *idx);
+int walb_log_index_get(
+	struct walb_log_index *idx, u64 lsid0, u64 lsid1,
+	u8 *buf, size_t size, unsigned int pbs, u64 *next_lsidp);
+
+#endif /* WALB_LOG_INDEX_H_KERNEL */
@@ -25,12 +25,14 @@ void walb_logpack_header_print(
 		"n_records: %u\n"
 		"n_padding: %u\n"
 		"total_io_size: %u\n"
+		"n_header_pb: %u\n"
 		"logpack_lsid: %"PRIu64"\n",
 		level,
 		lhead->checksum,
 		lhead->n_records,
 		lhead->n_padding,
 		lhead->total_io_size,
+		get_logpack_header_pb(lhead),
 		lhead->logpack_lsid);
 	for (i = 0; i < lhead->n_records; i++) {
 		printk("%srecord %d\n"
@@ -40,6 +42,9 @@ void walb_logpack_header_print(
 			"  is_exist: %u\n"
 			"  is_padding: %u\n"
 			"  is_discard: %u\n"
+			"  is_zero: %u\n"
+			"  is_compressed: %u\n"
+			"  compressed_pb: %u\n"
 			"  offset: %"PRIu64"\n"
 			"  io_size: %u\n",
 			level, i,
@@ -49,6 +54,9 @@ void walb_logpack_header_print(
 			test_bit_u32(LOG_RECORD_EXIST, &lhead->record[i].flags),
 			test_bit_u32(LOG_RECORD_PADDING, &lhead->record[i].flags),
 			test_bit_u32(LOG_RECORD_DISCARD, &lhead->record[i].flags),
+			test_bit_u32(LOG_RECORD_ZERO, &lhead->record[i].flags),
+			test_bit_u32(LOG_RECORD_COMPRESSED, &lhead->record[i].flags),
+			lhead->record[i].compressed_pb,
 			lhead->record[i].offset,
 			lhead->record[i].io_size);
 		printk("%slogpack lsid: %llu\n", level,
@@ -62,15 +70,21 @@ void walb_logpack_header_print(
  * Do not validate checksum.
  *
  * REQ_DISCARD is supported.
+ * A discard or zero bio is added as a record without data in the log.
  *
  * @lhead log pack header.
  *   lhead->logpack_lsid must be set correctly.
  *   lhead->sector_type must be set correctly.
+ *   lhead->n_header_pb must be set correctly
+ *   and the header buffer must have the size.
  * @logpack_lsid lsid of the log pack.
  * @bio bio to add. must be write and its size >= 0.
  *	size == 0 is permitted with flush requests only.
  * @pbs physical block size.
  * @ring_buffer_size ring buffer size [physical block]
+ * @is_zero true if the bio must be logged as a zero record.
+ * @compressed_pb log data size of the compressed bio [physical block],
+ *   or 0 if the bio is not compressed.
  *
  * RETURN:
  *   true in success, or false (you must create new logpack for the bio).
@@ -78,15 +92,18 @@ void walb_logpack_header_print(
 bool walb_logpack_header_add_bio(
 	struct walb_logpack_header *lhead,
 	const struct bio *bio,
-	unsigned int pbs, u64 ring_buffer_size)
+	unsigned int pbs, u64 ring_buffer_size,
+	bool is_zero, unsigned int compressed_pb)
 {
 	u64 logpack_lsid;
 	u64 bio_lsid;
 	unsigned int bio_lb, bio_pb;
 	u64 padding_pb;
 	unsigned int max_n_rec;
+	unsigned int n_header_pb;
+	unsigned int max_total_io_size;
 	int idx;
-	bool is_discard;
+	bool is_discard, is_payload_free;
 	UNUSED const char no_more_bio_msg[] = "no more bio can not be added.\n";
 
 	ASSERT(lhead);
@@ -97,7 +114,10 @@ bool walb_logpack_header_add_bio(
 	ASSERT(ring_buffer_size > 0);
 
 	logpack_lsid = lhead->logpack_lsid;
-	max_n_rec = max_n_log_record_in_sector(pbs);
+	n_header_pb = get_logpack_header_pb(lhead);
+	max_n_rec = max_n_log_record_in_header(pbs, n_header_pb);
+	/* lsid_local of each record must fit in u16. */
+	max_total_io_size = MAX_TOTAL_IO_SIZE_IN_LOGPACK_HEADER - (n_header_pb - 1);
 	idx = lhead->n_records;
 
 	ASSERT(lhead->n_records <= max_n_rec);
@@ -106,7 +126,7 @@ bool walb_logpack_header_add_bio(
 		return false;
 	}
 
-	bio_lsid = logpack_lsid + 1 + lhead->total_io_size;
+	bio_lsid = logpack_lsid + n_header_pb + lhead->total_io_size;
 	bio_lb = bio_sectors(bio);
 	if (bio_lb == 0) {
 		/* Only flush requests can have zero-size. */
@@ -116,9 +136,10 @@ bool walb_logpack_header_add_bio(
 		return true;
 	}
 	ASSERT(0 < bio_lb);
-	bio_pb = capacity_pb(pbs, bio_lb);
+	bio_pb = compressed_pb ? compressed_pb : capacity_pb(pbs, bio_lb);
 	is_discard = bio_op(bio) == REQ_OP_DISCARD;
-	if (!is_discard)
+	is_payload_free = is_discard || is_zero;
+	if (!is_payload_free)
 		ASSERT(bio_lb <= WALB_MAX_NORMAL_IO_SECTORS);
 
 	/* Padding check. */
@@ -127,13 +148,12 @@ bool walb_logpack_header_add_bio(
 		div64_u64_rem(bio_lsid, ring_buffer_size, &rem);
 		padding_pb = ring_buffer_size - rem;
 	}
-	if (!is_discard && padding_pb < bio_pb) {
+	if (!is_payload_free && padding_pb < bio_pb) {
 		/* Log of this request will cross the end of ring buffer.
 		   So padding is required. */
 		u64 cap_lb;
 
-		if (lhead->total_io_size + padding_pb
-			> MAX_TOTAL_IO_SIZE_IN_LOGPACK_HEADER) {
+		if (lhead->total_io_size + padding_pb > max_total_io_size) {
 			LOG_(no_more_bio_msg);
 			return false;
 		}
@@ -154,7 +174,7 @@ bool walb_logpack_header_add_bio(
 
 		bio_lsid += padding_pb;
 		idx++;
-		ASSERT(bio_lsid == logpack_lsid + 1 + lhead->total_io_size);
+		ASSERT(bio_lsid == logpack_lsid + n_header_pb + lhead->total_io_size);
 
 		if (lhead->n_records == max_n_rec) {
 			/* The last record is padding. */
@@ -163,9 +183,8 @@ bool walb_logpack_header_add_bio(
 		}
 	}
 
-	if (!is_discard &&
-		lhead->total_io_size + bio_pb
-		> MAX_TOTAL_IO_SIZE_IN_LOGPACK_HEADER) {
+	if (!is_payload_free &&
+		lhead->total_io_size + bio_pb > max_total_io_size) {
 		LOG_(no_more_bio_msg);
 		return false;
 	}
@@ -178,11 +197,22 @@ bool walb_logpack_header_add_bio(
 	lhead->record[idx].offset = (u64)bio->bi_iter.bi_sector;
 	lhead->record[idx].io_size = (u32)bio_lb;
 	lhead->n_records++;
+	clear_bit_u32(LOG_RECORD_DISCARD, &lhead->record[idx].flags);
+	clear_bit_u32(LOG_RECORD_ZERO, &lhead->record[idx].flags);
+	clear_bit_u32(LOG_RECORD_COMPRESSED, &lhead->record[idx].flags);
+	lhead->record[idx].compressed_pb = 0;
 	if (is_discard) {
 		set_bit_u32(LOG_RECORD_DISCARD, &lhead->record[idx].flags);
 		/* lhead->total_io_size will not be added. */
+	} else if (is_zero) {
+		set_bit_u32(LOG_RECORD_ZERO, &lhead->record[idx].flags);
+		/* lhead->total_io_size will not be added. */
 	} else {
-		clear_bit_u32(LOG_RECORD_DISCARD, &lhead->record[idx].flags);
+		if (compressed_pb) {
+			set_bit_u32(LOG_RECORD_COMPRESSED,
+				&lhead->record[idx].flags);
+			lhead->record[idx].compressed_pb = (u16)compressed_pb;
+		}
 		lhead->total_io_size += bio_pb;
 	}
 	return true;
@@ -27,6 +27,7 @@ void walb_logpack_header_print(
 bool walb_logpack_header_add_bio(
 	struct walb_logpack_header *lhead,
 	const struct bio *bio,
-	unsigned int pbs, u64 ring_buffer_size);
+	unsigned int pbs, u64 ring_buffer_size,
+	bool is_zero, unsigned int compressed_pb);
 
 #endif /* WALB_LOGPACK_H_KERNEL */
@@ -0,0 +1,183 @@
+/**
+ * qos.c - Per-device IOPS/bandwidth limits.
+ *
+ * (C) 2013, Cybozu Labs, Inc.
+ */
+#include "check_kernel.h"
+
+#include <linux/module.h>
+#include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include "linux/walb/common.h"
+#include "linux/walb/block_size.h"
+#include "qos.h"
+
+/*******************************************************************************
+ * Static functions prototype.
+ *******************************************************************************/
+
+static u64 calc_burst(u64 rate, u32 burst_ms);
+static void set_bucket(
+	struct token_bucket *tb, u64 old_rate, u64 rate, u32 burst_ms, u64 now_ns);
+static bool is_limited(struct walb_qos *qos, int rw);
+
+/*******************************************************************************
+ * Static functions definition.
+ *******************************************************************************/
+
+/**
+ * Bucket size for a rate.
+ *
+ * @rate tokens per second.
+ * @burst_ms burst period [ms].
+ *
+ * RETURN:
+ *   bucket size, at least 1.
+ */
+static u64 calc_burst(u64 rate, u32 burst_ms)
+{
+	return max_t(u64, div_u64(rate * burst_ms, MSEC_PER_SEC), 1);
+}
+
+/**
+ * Apply a new rate to a bucket.
+ * A bucket that has just been enabled starts full.
+ */
+static void set_bucket(
+	struct token_bucket *tb, u64 old_rate, u64 rate, u32 burst_ms, u64 now_ns)
+{
+	const u64 burst = calc_burst(rate, burst_ms);
+
+	if (old_rate == 0)
+		token_bucket_init(tb, rate, burst, now_ns);
+	else
+		token_bucket_set(tb, rate, burst, now_ns);
+}
+
+/**
+ * Check whether any limit is set for a direction.
+ * Locking is not required because a stale value just delays
+ * the effect of the change a little.
+ */
+static bool is_limited(struct walb_qos *qos, int rw)
+{
+	return READ_ONCE(qos->iops[rw]) != 0 || READ_ONCE(qos->bps[rw]) != 0;
+}
+
+/*******************************************************************************
+ * Global functions definition.
+ *******************************************************************************/
+
+/**
+ * Initialize QoS data. Nothing is limited.
+ */
+void walb_qos_init(struct walb_qos *qos)
+{
+	int rw;
+
+	spin_lock_init(&qos->lock);
+	qos->burst_ms = WALB_QOS_DEFAULT_BURST_MS;
+	for (rw = 0; rw < 2; rw++) {
+		qos->iops[rw] = 0;
+		qos->bps[rw] = 0;
+		token_bucket_init(&qos->io_tb[rw], 0, 1, 0);
+		token_bucket_init(&qos->lb_tb[rw], 0, 1, 0);
+		atomic_set(&qos->n_throttled[rw], 0);
+		atomic64_set(&qos->throttled_ms[rw], 0);
+	}
+}
+
+/**
+ * Get current limits.
+ */
+void walb_qos_get(struct walb_qos *qos, struct walb_qos_param *param)
+{
+	memset(param, 0, sizeof(*param));
+	spin_lock(&qos->lock);
+	param->read_iops = qos->iops[WALB_QOS_READ];
+	param->write_iops = qos->iops[WALB_QOS_WRITE];
+	param->read_bps = qos->bps[WALB_QOS_READ];
+	param->write_bps = qos->bps[WALB_QOS_WRITE];
+	param->burst_ms = qos->burst_ms;
+	spin_unlock(&qos->lock);
+}
+
+/**
+ * Set limits.
+ *
+ * @param must be valid (see is_walb_qos_param_valid()).
+ */
+void walb_qos_set(struct walb_qos *qos, const struct walb_qos_param *param)
+{
+	const u64 now_ns = ktime_get_ns();
+	const u64 iops[2] = { param->read_iops, param->write_iops };
+	const u64 bps[2] = { param->read_bps, param->write_bps };
+	int rw;
+
+	ASSERT(is_walb_qos_param_valid(param));
+
+	spin_lock(&qos->lock);
+	qos->burst_ms = param->burst_ms;
+	for (rw = 0; rw < 2; rw++) {
+		set_bucket(&qos->io_tb[rw], qos->iops[rw], iops[rw],
+			param->burst_ms, now_ns);
+		set_bucket(&qos->lb_tb[rw],
+			qos->bps[rw] / LOGICAL_BLOCK_SIZE,
+			bps[rw] / LOGICAL_BLOCK_SIZE,
+			param->burst_ms, now_ns);
+		WRITE_ONCE(qos->iops[rw], iops[rw]);
+		WRITE_ONCE(qos->bps[rw], bps[rw]);
+	}
+	spin_unlock(&qos->lock);
+}
+
+/**
+ * Throttle an IO according to the limits.
+ *
+ * Tokens are consumed before waiting,
+ * so IOs are admitted roughly in arrival order.
+ * This may sleep.
+ *
+ * @qos QoS data.
+ * @is_write true for write, discard and flush IOs.
+ * @n_lb IO size [logical block]. 0 for flush and discard.
+ */
+void walb_qos_throttle(struct walb_qos *qos, bool is_write, unsigned int n_lb)
+{
+	const int rw = is_write ? WALB_QOS_WRITE : WALB_QOS_READ;
+	u64 now_ns, wait_ns = 0;
+	unsigned long wait_us;
+
+	if (!is_limited(qos, rw))
+		return;
+
+	now_ns = ktime_get_ns();
+	spin_lock(&qos->lock);
+	if (qos->iops[rw]) {
+		token_bucket_refill(&qos->io_tb[rw], now_ns);
+		token_bucket_consume(&qos->io_tb[rw], 1);
+		wait_ns = token_bucket_wait_ns(&qos->io_tb[rw]);
+	}
+	if (qos->bps[rw] && n_lb > 0) {
+		token_bucket_refill(&qos->lb_tb[rw], now_ns);
+		token_bucket_consume(&qos->lb_tb[rw], n_lb);
+		wait_ns = max(wait_ns, token_bucket_wait_ns(&qos->lb_tb[rw]));
+	}
+	spin_unlock(&qos->lock);
+
+	if (wait_ns == 0)
+		return;
+
+	/* Rates are never 0 while limited, so wait_ns is finite.
+	   msleep() would overshoot by a jiffy or more, so use a hrtimer. */
+	ASSERT(wait_ns != U64_MAX);
+	wait_us = DIV_ROUND_UP_ULL(wait_ns, NSEC_PER_USEC);
+	usleep_range(wait_us, wait_us + wait_us / 16 + 1);
+
+	atomic_inc(&qos->n_throttled[rw]);
+	atomic64_add(div_u64(ktime_get_ns() - now_ns, NSEC_PER_MSEC),
+		&qos->throttled_ms[rw]);
+}
+
+MODULE_LICENSE("GPL");
@@ -0,0 +1,47 @@
+/**
+ * qos.h - Per-device IOPS/bandwidth limits.
+ */
+#ifndef WALB_QOS_H_KERNEL
+#define WALB_QOS_H_KERNEL
+
+#include "check_kernel.h"
+#include <linux/spinlock.h>
+#include <linux/atomic.h>
+#include "linux/walb/ioctl.h"
+#include "token_bucket.h"
+
+/* Index of direction. */
+#define WALB_QOS_READ 0
+#define WALB_QOS_WRITE 1
+
+/* Default burst period [ms]. */
+#define WALB_QOS_DEFAULT_BURST_MS 100
+
+/**
+ * QoS data for a walb device.
+ */
+struct walb_qos
+{
+	/* Protects limits and buckets. */
+	spinlock_t lock;
+
+	/* Limits indexed by WALB_QOS_READ/WRITE. 0 means unlimited. */
+	u64 iops[2]; /* [IO/sec] */
+	u64 bps[2]; /* [byte/sec] */
+	u32 burst_ms;
+
+	/* Token buckets. Tokens are IOs and logical blocks respectively. */
+	struct token_bucket io_tb[2];
+	struct token_bucket lb_tb[2];
+
+	/* Statistics. */
+	atomic_t n_throttled[2];
+	atomic64_t throttled_ms[2];
+};
+
+void walb_qos_init(struct walb_qos *qos);
+void walb_qos_get(struct walb_qos *qos, struct walb_qos_param *param);
+void walb_qos_set(struct walb_qos *qos, const struct walb_qos_param *param);
+void walb_qos_throttle(struct walb_qos *qos, bool is_write, unsigned int n_lb);
+
+#endif /* WALB_QOS_H_KERNEL */
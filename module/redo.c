@@ -6,6 +6,8 @@
  */
 #include <linux/module.h>
 #include <linux/delay.h>
+#include <linux/vmalloc.h>
+#include <linux/lz4.h>
 #include "linux/walb/logger.h"
 #include "kern.h"
 #include "io.h"
@@ -17,6 +19,7 @@
 #include "super.h"
 #include "overlapped_io.h"
 #include "redo.h"
+#include "wdev_util.h"
 
 /*******************************************************************************
  * Static data definition.
@@ -70,6 +73,9 @@ static bool prepare_data_bio_for_redo(
 	u64 pos, unsigned int len);
 static struct bio_wrapper* create_discard_bio_wrapper_for_redo(
 	struct walb_dev *wdev, u64 pos, unsigned int len);
+static struct bio_wrapper* create_zero_bio_wrapper_for_redo(
+	struct walb_dev *wdev, u64 pos, unsigned int len);
+static unsigned int get_max_zero_io_len_for_redo(struct walb_dev *wdev);
 static void destroy_bio_wrapper_for_redo(
 	struct walb_dev *wdev, struct bio_wrapper* biow);
 static void bio_end_io_for_redo(struct bio *bio);
@@ -80,6 +86,9 @@ static void wait_for_all_gc_tasks_for_redo(struct redo_data *gc_rd);
 static unsigned int get_bio_wrapper_from_read_queue(
 	struct redo_data *read_rd, struct list_head *biow_list,
 	unsigned int n);
+static bool gather_logpack_header_for_redo(
+	struct worker_data *read_wd, struct redo_data *read_rd,
+	struct bio_wrapper *logh_biow, unsigned int n_pb);
 static struct bio_wrapper* get_logpack_header_for_redo(
 	struct worker_data *read_wd, struct redo_data *read_rd,
 	u64 written_lsid);
@@ -90,6 +99,10 @@ static bool redo_logpack(
 	bool *should_terminate);
 static u32 calc_checksum_for_redo(
 	unsigned int n_lb, unsigned int pbs, u32 salt,
+	unsigned int csum_type, struct list_head *biow_list);
+static bool decompress_data_for_redo(
+	struct walb_dev *wdev,
+	struct walb_log_record *rec,
 	struct list_head *biow_list);
 static void create_data_io_for_redo(
 	struct walb_dev *wdev,
@@ -99,6 +112,10 @@ static void create_discard_data_io_for_redo(
 	struct walb_dev *wdev,
 	struct walb_log_record *rec,
 	struct list_head *biow_list);
+static void create_zero_data_io_for_redo(
+	struct walb_dev *wdev,
+	struct walb_log_record *rec,
+	struct list_head *biow_list);
 static void submit_data_bio_for_redo(
 	UNUSED struct walb_dev *wdev, struct bio_wrapper *biow);
 
@@ -310,6 +327,7 @@ static void run_gc_log_in_redo(void *data)
  * @wdev walb device (log device will be used for target).
  * @lsid target lsid to read.
  * @sectd sector data. if NULL then newly allocated.
+ *   Its size can be multiple physical blocks for logpack headers.
  *
  * RETURN:
  *   bio wrapper in success, or false.
@@ -321,6 +339,7 @@ static struct bio_wrapper* create_log_bio_wrapper_for_redo(
 	struct bio_wrapper *biow;
 	const unsigned int pbs = wdev->physical_bs;
 	u64 off_lb, off_pb;
+	unsigned int done;
 	int bytes;
 	bool is_sectd_alloc = false;
 
@@ -331,7 +350,9 @@ static struct bio_wrapper* create_log_bio_wrapper_for_redo(
 		sectd = sector_alloc(pbs, GFP_NOIO);
 		if (!sectd) { goto error0; }
 	}
-	bio = bio_alloc(GFP_NOIO, 1);
+	ASSERT(sectd->size % pbs == 0);
+	bio = bio_alloc(GFP_NOIO, DIV_ROUND_UP(
+			offset_in_page(sectd->data) + sectd->size, PAGE_SIZE));
 	if (!bio) { goto error1; }
 	biow = alloc_bio_wrapper_inc(wdev, GFP_NOIO);
 	if (!biow) { goto error2; }
@@ -344,13 +365,21 @@ static struct bio_wrapper* create_log_bio_wrapper_for_redo(
 	bio_set_op_attrs(bio, REQ_OP_READ, 0);
 	bio->bi_end_io = bio_end_io_for_redo;
 	bio->bi_private = biow;
-	bytes = bio_add_page(bio, virt_to_page(sectd->data),
-			pbs, offset_in_page(sectd->data));
-	ASSERT(bytes == pbs);
-	ASSERT((bio_sectors(bio) << 9) == pbs);
+	for (done = 0; done < sectd->size; done += bytes) {
+		void *buf = (u8 *)sectd->data + done;
+		const unsigned int off = offset_in_page(buf);
+
+		bytes = bio_add_page(bio, virt_to_page(buf),
+				min_t(unsigned int, sectd->size - done,
+					PAGE_SIZE - off), off);
+		ASSERT(bytes > 0);
+	}
+	ASSERT((bio_sectors(bio) << 9) == sectd->size);
 
 	init_bio_wrapper(biow, bio);
 	biow->private_data = sectd;
+	/* biow->pos is kept in the log address space. */
+	walb_remap_log_bio(wdev, bio);
 
 	return biow;
 #if 0
@@ -450,6 +479,81 @@ error0:
 	return NULL;
 }
 
+/**
+ * Create zero bio wrapper for redo.
+ * A write-zeroes bio is used if the data device supports it,
+ * else a write bio of the zero page.
+ *
+ * @wdev walb device.
+ * @pos IO position [logical block].
+ * @len IO size [logical block].
+ *   It must be up to get_max_zero_io_len_for_redo().
+ *
+ * RETURN:
+ *   Created bio_wrapper data in success, or NULL.
+ */
+static struct bio_wrapper* create_zero_bio_wrapper_for_redo(
+	struct walb_dev *wdev, u64 pos, unsigned int len)
+{
+	struct bio *bio;
+	struct bio_wrapper *biow;
+	const bool use_write_zeroes = bdev_write_zeroes_sectors(wdev->ddev) > 0;
+	const unsigned int nr_pages = use_write_zeroes ? 1
+		: DIV_ROUND_UP(len << 9, PAGE_SIZE);
+	unsigned int i, remaining;
+
+	ASSERT(nr_pages <= BIO_MAX_PAGES);
+	bio = bio_alloc(GFP_NOIO, nr_pages);
+	if (!bio) { goto error0; }
+
+	bio->bi_bdev = wdev->ddev;
+	bio->bi_iter.bi_sector = pos;
+	if (use_write_zeroes) {
+		bio->bi_iter.bi_size = len << 9;
+		bio_set_op_attrs(bio, REQ_OP_WRITE_ZEROES, 0);
+	} else {
+		remaining = len << 9;
+		for (i = 0; i < nr_pages; i++) {
+			const unsigned int bytes = min_t(unsigned int, remaining, PAGE_SIZE);
+			if (bio_add_page(bio, ZERO_PAGE(0), bytes, 0) != bytes)
+				goto error1;
+			remaining -= bytes;
+		}
+		bio_set_op_attrs(bio, REQ_OP_WRITE, 0);
+	}
+
+	/* The wrapper is allocated after the bio is built
+	   so that it is initialized in all the error paths. */
+	biow = alloc_bio_wrapper_inc(wdev, GFP_NOIO);
+	if (!biow) { goto error1; }
+	bio->bi_end_io = bio_end_io_for_redo;
+	bio->bi_private = biow;
+
+	init_bio_wrapper(biow, bio);
+	set_bit(BIO_WRAPPER_ZERO, &biow->flags);
+	ASSERT(!biow->private_data);
+	return biow;
+error1:
+	bio_put(bio);
+error0:
+	return NULL;
+}
+
+/**
+ * Max size of a zero bio wrapper for redo [logical block].
+ */
+static unsigned int get_max_zero_io_len_for_redo(struct walb_dev *wdev)
+{
+	unsigned int len;
+
+	if (bdev_write_zeroes_sectors(wdev->ddev) > 0)
+		len = UINT_MAX >> 9;
+	else
+		len = BIO_MAX_PAGES << (PAGE_SHIFT - 9);
+	/* Keep each IO aligned to the physical block. */
+	return len / n_lb_in_pb(wdev->physical_bs) * n_lb_in_pb(wdev->physical_bs);
+}
+
 /**
  * Destroy bio wrapper created by create_bio_wrapper_for_redo().
  */
@@ -485,7 +589,7 @@ static void bio_end_io_for_redo(struct bio *bio)
 
 	LOG_("pos %" PRIu64 "\n", (u64)biow->pos);
 #ifdef WALB_DEBUG
-	if (bio_wrapper_state_is_discard(biow)) {
+	if (bio_wrapper_state_is_payload_free(biow)) {
 		ASSERT(!biow->private_data);
 	} else {
 		ASSERT(biow->private_data); /* sector data */
@@ -610,6 +714,68 @@ static unsigned int get_bio_wrapper_from_read_queue(
 	return n_biow;
 }
 
+/**
+ * Gather the remaining blocks of a multi-block logpack header.
+ *
+ * @logh_biow biow of the first header block, already completed.
+ *   Its private_data will be replaced by the whole header.
+ * @n_pb header size [physical block].
+ *
+ * RETURN:
+ *   true in success, or false due to IO error or memory allocation failure.
+ */
+static bool gather_logpack_header_for_redo(
+	struct worker_data *read_wd, struct redo_data *read_rd,
+	struct bio_wrapper *logh_biow, unsigned int n_pb)
+{
+	struct walb_dev *wdev = read_rd->wdev;
+	const unsigned int pbs = wdev->physical_bs;
+	struct sector_data *sectd0 = logh_biow->private_data;
+	struct sector_data *sectd;
+	struct list_head biow_list;
+	struct bio_wrapper *biow, *biow_next;
+	unsigned int n = 0, i = 1;
+	bool ret = true;
+
+	ASSERT(n_pb > 1);
+	INIT_LIST_HEAD(&biow_list);
+retry:
+	n += get_bio_wrapper_from_read_queue(
+		read_rd, &biow_list, n_pb - 1 - n);
+	if (n < n_pb - 1) {
+		wakeup_worker(read_wd);
+		schedule();
+		goto retry;
+	}
+
+	sectd = sector_alloc(pbs * n_pb, GFP_NOIO);
+	if (sectd)
+		memcpy(sectd->data, sectd0->data, pbs);
+	else
+		ret = false;
+
+	list_for_each_entry_safe(biow, biow_next, &biow_list, list) {
+		wait_for_completion(&biow->done);
+		if (biow->status)
+			ret = false;
+		if (ret) {
+			const struct sector_data *tmp = biow->private_data;
+			memcpy((u8 *)sectd->data + pbs * i, tmp->data, pbs);
+		}
+		i++;
+		list_del(&biow->list);
+		destroy_bio_wrapper_for_redo(wdev, biow);
+	}
+	if (!ret) {
+		if (sectd)
+			sector_free(sectd);
+		return false;
+	}
+	sector_free(sectd0);
+	logh_biow->private_data = sectd;
+	return true;
+}
+
 /**
  * Get logpack header biow.
  *
@@ -623,7 +789,7 @@ static struct bio_wrapper* get_logpack_header_for_redo(
 	struct worker_data *read_wd, struct redo_data *read_rd,
 	u64 written_lsid)
 {
-	unsigned int n;
+	unsigned int n, n_pb;
 	struct list_head biow_list;
 	struct bio_wrapper *biow;
 	struct sector_data *sectd;
@@ -650,14 +816,27 @@ retry:
 	sectd = biow->private_data;
 	ASSERT_SECTOR_DATA(sectd);
 	logh = get_logpack_header_const(sectd);
+	if (!is_valid_logpack_header(logh)
+		|| logh->logpack_lsid != written_lsid)
+		goto invalid;
+
+	/* The header may continue over the following blocks. */
+	n_pb = get_logpack_header_pb(logh);
+	if (n_pb > 1) {
+		if (!gather_logpack_header_for_redo(read_wd, read_rd, biow, n_pb))
+			goto invalid;
+		sectd = biow->private_data;
+		logh = get_logpack_header_const(sectd);
+	}
+
 	if (is_valid_logpack_header_with_checksum(
-			logh, sectd->size, read_rd->wdev->log_checksum_salt)
-		&& logh->logpack_lsid == written_lsid) {
+			logh, read_rd->wdev->physical_bs,
+			read_rd->wdev->log_checksum_salt,
+			read_rd->wdev->log_csum_type))
 		return biow;
-	} else {
-		destroy_bio_wrapper_for_redo(read_rd->wdev, biow);
-		return NULL;
-	}
+invalid:
+	destroy_bio_wrapper_for_redo(read_rd->wdev, biow);
+	return NULL;
 }
 
 /**
@@ -736,8 +915,12 @@ retry1:
 		struct walb_log_record *rec = &logh->record[i];
 		const bool is_discard =
 			test_bit_u32(LOG_RECORD_DISCARD, &rec->flags);
+		const bool is_zero =
+			test_bit_u32(LOG_RECORD_ZERO, &rec->flags);
 		const bool is_padding =
 			test_bit_u32(LOG_RECORD_PADDING, &rec->flags);
+		const bool is_compressed =
+			test_bit_u32(LOG_RECORD_COMPRESSED, &rec->flags);
 		unsigned int n_lb = rec->io_size;
 
 		ASSERT(test_bit_u32(LOG_RECORD_EXIST, &rec->flags));
@@ -747,7 +930,11 @@ retry1:
 			/* zero-sized IO. */
 			continue;
 		}
-		n_pb = capacity_pb(pbs, n_lb);
+		n_pb = get_log_record_data_pb(rec, pbs);
+		if (!is_padding)
+			walb_dirty_bitmap_mark(
+				&wdev->dirty_bitmap, rec->offset, n_lb,
+				rec->lsid);
 
 		if (is_discard) {
 			if (blk_queue_discard(bdev_get_queue(wdev->ddev))) {
@@ -758,6 +945,11 @@ retry1:
 			}
 			continue;
 		}
+		if (is_zero) {
+			create_zero_data_io_for_redo(
+				wdev, rec, &biow_list_ready);
+			continue;
+		}
 
 		/*
 		 * Normal IO.
@@ -789,15 +981,24 @@ retry1:
 			continue;
 		}
 
-		/* Validate checksum. */
+		/* Validate checksum of the data in the log. */
 		csum = calc_checksum_for_redo(
-			rec->io_size, pbs,
-			wdev->log_checksum_salt, &biow_list_io);
+			is_compressed ? n_pb * n_lb_in_pb(pbs) : rec->io_size,
+			pbs, wdev->log_checksum_salt, wdev->log_csum_type,
+			&biow_list_io);
 		if (csum != rec->checksum) {
 			is_valid = false;
 			invalid_idx = i;
 			break;
 		}
+		if (is_compressed &&
+			!decompress_data_for_redo(wdev, rec, &biow_list_io)) {
+			WLOGe(wdev, "broken compressed data at lsid %" PRIu64 "\n",
+				rec->lsid);
+			is_valid = false;
+			invalid_idx = i;
+			break;
+		}
 
 		/* Create data bio. */
 		create_data_io_for_redo(wdev, rec, &biow_list_io);
@@ -829,7 +1030,7 @@ retry1:
 	 */
 	if (is_valid) {
 		ASSERT(list_empty(&biow_list_pack));
-		*written_lsid_p = logh->logpack_lsid + 1 + logh->total_io_size;
+		*written_lsid_p = get_next_lsid_unsafe(logh);
 		*should_terminate = false;
 		retb = true;
 		goto fin;
@@ -859,18 +1060,14 @@ retry1:
 	logh->n_padding = 0;
 	for (i = 0; i < logh->n_records; i++) {
 		struct walb_log_record *rec = &logh->record[i];
-		if (!test_bit_u32(LOG_RECORD_DISCARD, &rec->flags)) {
-			logh->total_io_size += capacity_pb(
-				pbs, rec->io_size);
-		}
+		logh->total_io_size += get_log_record_data_pb(rec, pbs);
 		if (test_bit_u32(LOG_RECORD_PADDING, &rec->flags)) {
 			logh->n_padding++;
 		}
 	}
 	ASSERT(logh->total_io_size > 0);
-	logh->checksum = 0;
-	logh->checksum = checksum(
-		(const u8 *)logh, pbs, wdev->log_checksum_salt);
+	logh->checksum = calc_logpack_header_checksum(
+		logh, pbs, wdev->log_checksum_salt, wdev->log_csum_type);
 	/* Try to overwrite the last logpack header block. */
 	logh_biow->private_data = NULL;
 	destroy_bio_wrapper_for_redo(wdev, logh_biow);
@@ -889,7 +1086,7 @@ retry2:
 		retb = false;
 		goto fin;
 	}
-	*written_lsid_p = logh->logpack_lsid + 1 + logh->total_io_size;
+	*written_lsid_p = get_next_lsid_unsafe(logh);
 	*should_terminate = true;
 	retb = true;
 
@@ -913,6 +1110,7 @@ fin:
  * @n_lb io size [logical block].
  * @pbs physical block size [bytes].
  * @salt checksum salt.
+ * @csum_type checksum type. WALB_CSUM_XXX.
  * @biow_list biow list where each biow size is pbs.
  *
  * RETURN:
@@ -920,10 +1118,10 @@ fin:
  */
 static u32 calc_checksum_for_redo(
 	unsigned int n_lb, unsigned int pbs, u32 salt,
-	struct list_head *biow_list)
+	unsigned int csum_type, struct list_head *biow_list)
 {
 	struct bio_wrapper *biow;
-	u32 csum = salt;
+	u32 csum = walb_csum_init(csum_type, salt);
 
 	ASSERT(n_lb > 0);
 	ASSERT_PBS(pbs);
@@ -938,12 +1136,105 @@ static u32 calc_checksum_for_redo(
 		ASSERT(biow->len == n_lb_in_pb(pbs));
 		ASSERT(n_lb > 0);
 
-		csum = checksum_partial(
-			csum, sectd->data, len * LOGICAL_BLOCK_SIZE);
+		csum = walb_csum_partial(
+			csum_type, csum, sectd->data, len * LOGICAL_BLOCK_SIZE);
 		n_lb -= len;
 	}
 	ASSERT(n_lb == 0);
-	return checksum_finish(csum);
+	return walb_csum_finish(csum_type, csum);
+}
+
+/**
+ * Decompress the data of a compressed log record for redo.
+ *
+ * @wdev walb device.
+ * @rec log record (must be compressed).
+ * @biow_list biow list of the compressed data
+ *   where each biow->private_data is sector data of a physical block.
+ *   They will be replaced with biow(s) of the decompressed data
+ *   in the same form, which create_data_io_for_redo() accepts.
+ *
+ * RETURN:
+ *   true in success, or false if the compressed data are broken.
+ */
+static bool decompress_data_for_redo(
+	struct walb_dev *wdev,
+	struct walb_log_record *rec,
+	struct list_head *biow_list)
+{
+	const unsigned int pbs = wdev->physical_bs;
+	const unsigned int in_size = rec->compressed_pb * pbs;
+	const unsigned int out_pb = capacity_pb(pbs, rec->io_size);
+	const unsigned int size = rec->io_size << 9;
+	struct bio_wrapper *biow, *biow_next;
+	struct sector_data *sectd;
+	struct list_head new_list;
+	unsigned int off, i;
+	u8 *in, *out;
+	u32 clen;
+	bool ret = false;
+
+	ASSERT(test_bit_u32(LOG_RECORD_COMPRESSED, &rec->flags));
+	INIT_LIST_HEAD(&new_list);
+
+retry_alloc:
+	in = vmalloc(in_size);
+	out = vmalloc(out_pb * pbs);
+	if (!in || !out) {
+		vfree(in);
+		vfree(out);
+		schedule();
+		goto retry_alloc;
+	}
+
+	off = 0;
+	list_for_each_entry(biow, biow_list, list) {
+		sectd = biow->private_data;
+		ASSERT_SECTOR_DATA(sectd);
+		ASSERT(sectd->size == pbs);
+		memcpy(in + off, sectd->data, pbs);
+		off += pbs;
+	}
+	ASSERT(off == in_size);
+
+	clen = *(u32 *)in;
+	if (clen > in_size - sizeof(u32))
+		goto fin;
+	if (LZ4_decompress_safe((const char *)in + sizeof(u32), (char *)out,
+					clen, size) != (int)size)
+		goto fin;
+	memset(out + size, 0, out_pb * pbs - size);
+
+	for (i = 0; i < out_pb; i++) {
+	retry_biow:
+		biow = alloc_bio_wrapper_inc(wdev, GFP_NOIO);
+		if (!biow) {
+			schedule();
+			goto retry_biow;
+		}
+		init_bio_wrapper(biow, NULL);
+	retry_sectd:
+		sectd = sector_alloc(pbs, GFP_NOIO);
+		if (!sectd) {
+			schedule();
+			goto retry_sectd;
+		}
+		memcpy(sectd->data, out + i * pbs, pbs);
+		biow->private_data = sectd;
+		biow->len = n_lb_in_pb(pbs);
+		list_add_tail(&biow->list, &new_list);
+	}
+
+	list_for_each_entry_safe(biow, biow_next, biow_list, list) {
+		list_del(&biow->list);
+		destroy_bio_wrapper_for_redo(wdev, biow);
+	}
+	list_splice_tail(&new_list, biow_list);
+	ret = true;
+fin:
+	vfree(in);
+	vfree(out);
+	return ret;
 }
 
 /**
@@ -970,7 +1261,7 @@ static void create_data_io_for_redo(
 	ASSERT_PBS(pbs);
 	ASSERT(biow_list);
 	ASSERT(!list_empty(biow_list));
-	ASSERT(!test_bit_u32(LOG_RECORD_DISCARD, &rec->flags));
+	ASSERT(!is_payload_free_log_record(rec));
 
 	off = rec->offset;
 	n_lb = rec->io_size;
@@ -1029,6 +1320,41 @@ retry:
 	list_add_tail(&biow->list, biow_list);
 }
 
+/**
+ * Create zero data io for redo.
+ *
+ * @wdev walb device.
+ * @rec log record (must be zero)
+ * @biow_list biow list
+ *   created bio wrapper(s) will be added to the tail.
+ */
+static void create_zero_data_io_for_redo(
+	struct walb_dev *wdev,
+	struct walb_log_record *rec,
+	struct list_head *biow_list)
+{
+	struct bio_wrapper *biow;
+	const unsigned int max_len = get_max_zero_io_len_for_redo(wdev);
+	u64 pos = rec->offset;
+	unsigned int remaining = rec->io_size;
+
+	ASSERT(rec);
+	ASSERT(test_bit_u32(LOG_RECORD_ZERO, &rec->flags));
+
+	while (remaining > 0) {
+		const unsigned int len = min(remaining, max_len);
+	retry:
+		biow = create_zero_bio_wrapper_for_redo(wdev, pos, len);
+		if (!biow) {
+			schedule();
+			goto retry;
+		}
+		list_add_tail(&biow->list, biow_list);
+		pos += len;
+		remaining -= len;
+	}
+}
+
 /**
  * Submit data bio for redo.
  *
@@ -108,6 +108,7 @@ void walb_print_super_sector(struct walb_super_sector *lsuper0)
 		"oldest_lsid %llu\n"
 		"written_lsid %llu\n"
 		"device_size %llu\n"
+		"generation %llu\n"
 		"----------\n",
 		lsuper0->checksum,
 		lsuper0->logical_bs,
@@ -118,78 +119,141 @@ void walb_print_super_sector(struct walb_super_sector *lsuper0)
 		lsuper0->ring_buffer_size,
 		lsuper0->oldest_lsid,
 		lsuper0->written_lsid,
-		lsuper0->device_size);
+		lsuper0->device_size,
+		lsuper0->generation);
 #endif
 }
 
 /**
- * Read super sector.
- * Currently only super sector 0 will be read.
+ * Validate a super sector image.
  *
- * @ldev walb log device.
- * @lsuper sector data to be overwritten by read data.
+ * @lsuper super sector data.
  *
- * @return true in success, or false.
+ * @return true if valid, or false.
  */
-bool walb_read_super_sector(
-	struct block_device *ldev, struct sector_data *lsuper)
+static bool is_valid_super_sector_image(struct sector_data *lsuper)
 {
-	u64 off0;
-	struct walb_super_sector *sect;
-	unsigned int pbs;
-
-	LOGd("walb_read_super_sector begin\n");
-
-	ASSERT_SECTOR_DATA(lsuper);
-	pbs = lsuper->size;
-	sect = get_super_sector(lsuper);
-
-	/* Really read. */
-	off0 = get_super_sector0_offset(pbs);
-	/* off1 = get_super_sector1_offset(wdev->physical_bs, 0); */
-	if (!sector_io(REQ_OP_READ, 0, ldev, off0, lsuper)) {
-		LOGe("read super sector0 failed\n");
-		goto error0;
-	}
+	struct walb_super_sector *sect = get_super_sector(lsuper);
 
-	/* Validate checksum. */
-	if (checksum((u8 *)sect, lsuper->size, 0) != 0) {
+	/* Validate checksum.
+	   The checksum type is decided by the format flags. */
+	if (calc_super_sector_checksum(sect, lsuper->size) != sect->checksum) {
 		LOGe("walb_read_super_sector: checksum check failed.\n");
-		goto error0;
+		return false;
 	}
 
 	/* Validate sector type */
 	if (sect->sector_type != SECTOR_TYPE_SUPER) {
 		LOGe("walb_read_super_sector: sector type check failed.\n");
-		goto error0;
+		return false;
 	}
 
 	/* Validate version number. */
-	if (sect->version != WALB_LOG_VERSION) {
+	if (!is_valid_log_version(sect->version)) {
 		LOGe("walb version mismatch: superblock: %u module %u\n",
 			sect->version, WALB_LOG_VERSION);
-		goto error0;
+		return false;
+	}
+
+	/* Validate logpack header size. */
+	if (sect->logpack_header_pb >
+		get_max_logpack_header_pb(sect->physical_bs)) {
+		LOGe("logpack_header_pb is too large: %u\n",
+			sect->logpack_header_pb);
+		return false;
 	}
 
 	/* Validate name structure. */
 	if (strnlen(sect->name, DISK_NAME_LEN) >= DISK_NAME_LEN) {
 		LOGe("superblock device name is not terminated by 0.\n");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Read a super sector slot and validate it.
+ *
+ * @ldev walb log device.
+ * @slot 0 or 1.
+ * @lsuper sector data to be overwritten by read data.
+ *
+ * @return true if the slot is read and valid, or false.
+ */
+static bool read_super_sector_slot(
+	struct block_device *ldev, unsigned int slot,
+	struct sector_data *lsuper)
+{
+	const u64 off = get_super_sector_offset(lsuper->size, slot);
+
+	if (!sector_io(REQ_OP_READ, 0, ldev, off, lsuper)) {
+		LOGe("read super sector%u failed\n", slot);
+		return false;
+	}
+	return is_valid_super_sector_image(lsuper);
+}
+
+/**
+ * Read super sector.
+ * Both super sector 0 and 1 will be read and
+ * the valid one with the larger generation will be chosen.
+ *
+ * @ldev walb log device.
+ * @lsuper sector data to be overwritten by read data.
+ *
+ * @return true in success, or false.
+ */
+bool walb_read_super_sector(
+	struct block_device *ldev, struct sector_data *lsuper)
+{
+	struct sector_data *lsuper1;
+	bool valid0, valid1;
+	int slot;
+
+	LOGd("walb_read_super_sector begin\n");
+
+	ASSERT_SECTOR_DATA(lsuper);
+	lsuper1 = sector_alloc(lsuper->size, GFP_NOIO);
+	if (!lsuper1) {
+		LOGe("sector_alloc failed.\n");
 		goto error0;
 	}
 
+	/* Really read. */
+	valid0 = read_super_sector_slot(ldev, 0, lsuper);
+	valid1 = read_super_sector_slot(ldev, 1, lsuper1);
+
+	slot = choose_latest_super_sector(
+		valid0, get_super_sector(lsuper)->generation,
+		valid1, get_super_sector(lsuper1)->generation);
+	if (slot < 0) {
+		LOGe("both super sectors are invalid.\n");
+		goto error1;
+	}
+	if (slot == 1)
+		sector_copy(lsuper, lsuper1);
+	if (!valid0 || !valid1)
+		LOGw("super sector%d is invalid. use super sector%d.\n",
+			1 - slot, slot);
+	sector_free(lsuper1);
+
 #ifdef WALB_DEBUG
-	walb_print_super_sector(sect);
+	walb_print_super_sector(get_super_sector(lsuper));
 #endif
 
 	LOGd("walb_read_super_sector end\n");
 	return true;
+error1:
+	sector_free(lsuper1);
 error0:
 	return false;
 }
 
 /**
  * Write super sector.
- * Currently only super sector 0 will be written. (super sector 1 is not.)
+ * The slot (super sector 0 or 1) is decided by its generation,
+ * so the caller must increment the generation before calling this
+ * not to overwrite the latest valid one.
  *
  * @ldev log block device.
  * @lsuper super sector to write.
@@ -199,9 +263,9 @@ error0:
 bool walb_write_super_sector(
 	struct block_device *ldev, struct sector_data *lsuper)
 {
-	u64 off0;
+	u64 off;
 	struct walb_super_sector *sect;
-	unsigned int pbs;
+	unsigned int pbs, slot;
 
 	LOG_("walb_write_super_sector begin\n");
 
@@ -214,15 +278,14 @@ bool walb_write_super_sector(
 	/* Set sector_type. */
 	sect->sector_type = SECTOR_TYPE_SUPER;
 
-	/* Generate checksum.
-	   zero-clear before calculating checksum. */
-	sect->checksum = 0;
-	sect->checksum = checksum((u8 *)sect, pbs, 0);
+	/* Generate checksum. */
+	sect->checksum = calc_super_sector_checksum(sect, pbs);
 
 	/* Really write. */
-	off0 = get_super_sector0_offset(pbs);
-	if (!sector_io(REQ_OP_WRITE, REQ_PREFLUSH | REQ_FUA, ldev, off0, lsuper)) {
-		LOGe("write super sector0 failed\n");
+	slot = get_super_sector_slot(sect->generation);
+	off = get_super_sector_offset(pbs, slot);
+	if (!sector_io(REQ_OP_WRITE, REQ_PREFLUSH | REQ_FUA, ldev, off, lsuper)) {
+		LOGe("write super sector%u failed\n", slot);
 		return false;
 	}
 
@@ -11,9 +11,54 @@
 #include "super.h"
 #include "queue_util.h"
 
+/*******************************************************************************
+ * Static functions prototype.
+ *******************************************************************************/
+
+static void task_sync_super_block(struct work_struct *work);
+
+/*******************************************************************************
+ * Static functions definition.
+ *******************************************************************************/
+
+/**
+ * Superblock sync task.
+ *
+ * The work item is never executed concurrently with itself,
+ * and queue_work() during its execution makes it run again,
+ * so requests are coalesced.
+ */
+static void task_sync_super_block(struct work_struct *work)
+{
+	struct walb_dev *wdev =
+		container_of(work, struct walb_dev, super_sync_work);
+
+	if (!walb_sync_super_block(wdev))
+		WLOGe(wdev, "superblock sync failed.\n");
+}
+
+/*******************************************************************************
+ * Global functions definition.
+ *******************************************************************************/
+
+/**
+ * Initialize superblock sync data.
+ */
+void walb_init_super_sync(struct walb_dev *wdev)
+{
+	ASSERT(wdev);
+
+	mutex_init(&wdev->super_sync_mutex);
+	INIT_WORK(&wdev->super_sync_work, task_sync_super_block);
+	init_waitqueue_head(&wdev->super_sync_wq);
+}
+
 /**
  * Sync down super block.
  *
+ * The super sector is written to the slot next to the latest one,
+ * so the latest one is kept intact even if this fails or crashes.
+ *
  * This always fails if read-only flag is set.
  * This will set read-only flag if write/flush IOs failed.
  *
@@ -22,7 +67,7 @@
  */
 bool walb_sync_super_block(struct walb_dev *wdev)
 {
-	u64 written_lsid, oldest_lsid;
+	u64 written_lsid, oldest_lsid, latest_lsid, prev_oldest_lsid;
 	struct sector_data *lsuper_tmp;
 	struct walb_super_sector *sect;
 	u64 device_size;
@@ -38,10 +83,13 @@ bool walb_sync_super_block(struct walb_dev *wdev)
 	if (!lsuper_tmp)
 		goto error0;
 
+	mutex_lock(&wdev->super_sync_mutex);
+
 	/* Get written/oldest lsid. */
 	spin_lock(&wdev->lsid_lock);
 	written_lsid = wdev->lsids.written;
 	oldest_lsid = wdev->lsids.oldest;
+	latest_lsid = wdev->lsids.latest;
 	spin_unlock(&wdev->lsid_lock);
 
 	/* device size. */
@@ -54,10 +102,12 @@ bool walb_sync_super_block(struct walb_dev *wdev)
 	ASSERT_SECTOR_DATA(wdev->lsuper0);
 	ASSERT(is_same_size_sector(wdev->lsuper0, lsuper_tmp));
 	sect = get_super_sector(wdev->lsuper0);
+	prev_oldest_lsid = sect->oldest_lsid;
 	sect->oldest_lsid = oldest_lsid;
 	sect->written_lsid = written_lsid;
 	sect->device_size = device_size;
 	sect->log_checksum_salt = wdev->log_checksum_salt;
+	sect->generation++;
 	sector_copy(lsuper_tmp, wdev->lsuper0);
 	spin_unlock(&wdev->lsuper0_lock);
 
@@ -69,28 +119,65 @@ bool walb_sync_super_block(struct walb_dev *wdev)
 		}
 	}
 
+	/* Write the dirty bitmap, which is flushed with the superblock.
+	   Bits are dropped only for logs older than the oldest lsid
+	   of the superblock already written. */
+	if (!walb_dirty_bitmap_sync(wdev, prev_oldest_lsid, latest_lsid)) {
+		WLOGe(wdev, "dirty bitmap sync failed.\n");
+		goto error1;
+	}
+
 	/* Write and flush superblock in the log device. */
 	if (!walb_write_super_sector(wdev->ldev, lsuper_tmp)) {
 		WLOGe(wdev, "write and flush super block failed.\n");
 		goto error1;
 	}
 
-	sector_free(lsuper_tmp);
-
 	/* Update previously written lsid. */
 	spin_lock(&wdev->lsid_lock);
 	wdev->lsids.prev_written = written_lsid;
 	spin_unlock(&wdev->lsid_lock);
 
+	mutex_unlock(&wdev->super_sync_mutex);
+	sector_free(lsuper_tmp);
+	wake_up_all(&wdev->super_sync_wq);
 	return true;
 
 error1:
 	set_bit(WALB_STATE_READ_ONLY, &wdev->flags);
+	mutex_unlock(&wdev->super_sync_mutex);
 	sector_free(lsuper_tmp);
+	wake_up_all(&wdev->super_sync_wq);
 error0:
 	return false;
 }
 
+/**
+ * Request to sync down super block asynchronously.
+ *
+ * This never blocks.
+ * Wait for wdev->super_sync_wq to know lsids.prev_written is updated.
+ */
+void walb_sync_super_block_async(struct walb_dev *wdev)
+{
+	ASSERT(wdev);
+
+	if (test_bit(WALB_STATE_READ_ONLY, &wdev->flags))
+		return;
+
+	queue_work(wq_misc_, &wdev->super_sync_work);
+}
+
+/**
+ * Wait for the asynchronous superblock sync to be done.
+ */
+void walb_flush_super_sync(struct walb_dev *wdev)
+{
+	ASSERT(wdev);
+
+	flush_work(&wdev->super_sync_work);
+}
+
 /**
  * Finalize super block.
  *
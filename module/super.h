@@ -8,7 +8,10 @@
 
 #include "kern.h"
 
+void walb_init_super_sync(struct walb_dev *wdev);
 bool walb_sync_super_block(struct walb_dev *wdev);
+void walb_sync_super_block_async(struct walb_dev *wdev);
+void walb_flush_super_sync(struct walb_dev *wdev);
 bool walb_finalize_super_block(struct walb_dev *wdev, bool is_superblock_sync);
 
 #endif /* WALB_SUPER_H_KERNEL */
@@ -9,6 +9,7 @@
 #include "kern.h"
 #include "io.h"
 #include "wdev_util.h"
+#include "linux/walb/log_record.h"
 
 /*******************************************************************************
  * Utiltities.
@@ -22,6 +23,47 @@ static inline struct walb_dev *get_wdev_from_kobj(struct kobject *kobj)
 	return container_of(kobj, struct walb_dev, kobj);
 }
 
+/**
+ * Show a field of QoS limits.
+ *
+ * @offset offset of the u64 field in struct walb_qos_param.
+ */
+static ssize_t show_qos_param(struct walb_dev *wdev, char *buf, size_t offset)
+{
+	struct walb_qos_param param;
+	u64 val;
+
+	walb_qos_get(&wdev->qos, &param);
+	/* The struct is packed so the field may not be aligned. */
+	memcpy(&val, (u8 *)&param + offset, sizeof(val));
+	return snprintf(buf, PAGE_SIZE, "%" PRIu64 "\n", val);
+}
+
+/**
+ * Store a field of QoS limits.
+ *
+ * @offset offset of the u64 field in struct walb_qos_param.
+ */
+static ssize_t store_qos_param(
+	struct walb_dev *wdev, const char *buf, size_t count, size_t offset)
+{
+	struct walb_qos_param param;
+	u64 val;
+	int err;
+
+	err = kstrtoull(buf, 10, &val);
+	if (err)
+		return err;
+
+	walb_qos_get(&wdev->qos, &param);
+	memcpy((u8 *)&param + offset, &val, sizeof(val));
+	if (!is_walb_qos_param_valid(&param))
+		return -EINVAL;
+
+	walb_qos_set(&wdev->qos, &param);
+	return count;
+}
+
 /*******************************************************************************
  * Funtions to show attributes.
  *******************************************************************************/
@@ -38,6 +80,20 @@ static ssize_t walb_attr_show_ddev(struct walb_dev *wdev, char *buf)
 	return sprintf(buf, "%u:%u\n", MAJOR(ddevt), MINOR(ddevt));
 }
 
+static ssize_t walb_attr_show_ldevs(struct walb_dev *wdev, char *buf)
+{
+	ssize_t len = 0;
+	unsigned int i;
+
+	for (i = 0; i < wdev->n_ldevs; i++) {
+		const dev_t devt = wdev->ldevs[i]->bd_dev;
+		len += sprintf(buf + len, "%s%u:%u", i == 0 ? "" : " ",
+			MAJOR(devt), MINOR(devt));
+	}
+	len += sprintf(buf + len, "\n");
+	return len;
+}
+
 static ssize_t walb_attr_show_lsids(struct walb_dev *wdev, char *buf)
 {
 	struct lsid_set lsids;
@@ -143,6 +199,360 @@ static ssize_t walb_attr_show_support_discard(struct walb_dev *wdev, char *buf)
 	return snprintf(buf, PAGE_SIZE, "%d\n", wdev->support_discard ? 1 : 0);
 }
 
+static ssize_t walb_attr_show_checkpoint_interval(struct walb_dev *wdev, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n",
+			get_effective_checkpoint_interval(&wdev->cpd));
+}
+
+static ssize_t walb_attr_show_ring_buffer_stall(struct walb_dev *wdev, char *buf)
+{
+	struct iocore_data *iocored = get_iocored_from_wdev(wdev);
+	ssize_t len;
+	int i;
+
+	if (!iocored)
+		return 0;
+
+	len = snprintf(buf, PAGE_SIZE,
+		"count    %d\n"
+		"total_ms %lld\n"
+		, atomic_read(&iocored->n_rb_stall)
+		, (long long)atomic64_read(&iocored->rb_stall_ms));
+	/* Each line is the lower bound [ms] and the count of the bucket. */
+	for (i = 0; i < IOCORE_RB_STALL_HIST_SIZE; i++) {
+		len += snprintf(buf + len, PAGE_SIZE - len, "%u %d\n"
+				, i == 0 ? 0 : 1U << (i - 1)
+				, atomic_read(&iocored->rb_stall_hist[i]));
+	}
+	return len;
+}
+
+static ssize_t walb_attr_show_admission(struct walb_dev *wdev, char *buf)
+{
+	struct iocore_data *iocored = get_iocored_from_wdev(wdev);
+
+	if (!iocored)
+		return 0;
+
+	return snprintf(buf, PAGE_SIZE,
+		"drain_rate_kb %" PRIu64 "\n"
+		"rate_kb       %" PRIu64 "\n"
+		"n_delayed     %d\n"
+		"delayed_ms    %lld\n"
+		, iocored->drain_rate * LOGICAL_BLOCK_SIZE / 1024
+		, iocored->admission_tb.rate * LOGICAL_BLOCK_SIZE / 1024
+		, atomic_read(&iocored->n_admission_delay)
+		, (long long)atomic64_read(&iocored->admission_delay_ms));
+}
+
+static ssize_t walb_attr_show_latency_read(struct walb_dev *wdev, char *buf)
+{
+	struct iocore_data *iocored = get_iocored_from_wdev(wdev);
+
+	if (!iocored)
+		return 0;
+
+	return walb_lat_sprint(iocored->lat, false, buf, PAGE_SIZE);
+}
+
+static ssize_t walb_attr_show_latency_write(struct walb_dev *wdev, char *buf)
+{
+	struct iocore_data *iocored = get_iocored_from_wdev(wdev);
+
+	if (!iocored)
+		return 0;
+
+	return walb_lat_sprint(iocored->lat, true, buf, PAGE_SIZE);
+}
+
+static ssize_t sprint_hist(
+	char *buf, size_t size, const char *name, const atomic_t *hist, int n)
+{
+	ssize_t len;
+	int i;
+
+	len = scnprintf(buf, size, "%s", name);
+	for (i = 0; i < n; i++)
+		len += scnprintf(buf + len, size - len, " %d", atomic_read(&hist[i]));
+	len += scnprintf(buf + len, size - len, "\n");
+	return len;
+}
+
+static ssize_t walb_attr_show_logpack(struct walb_dev *wdev, char *buf)
+{
+	struct iocore_data *iocored = get_iocored_from_wdev(wdev);
+	ssize_t len;
+
+	if (!iocored)
+		return 0;
+
+	len = scnprintf(buf, PAGE_SIZE,
+		"cut_end        %d\n"
+		"cut_flush      %d\n"
+		"cut_size       %d\n"
+		"cut_full       %d\n"
+		"zero_flush     %d\n"
+		"n_padded_pack  %d\n"
+		"padding_pb     %lld\n"
+		"header_pb      %u\n"
+		"max_n_records  %u\n"
+		"n_compressed   %lld\n"
+		"compress_saved_pb %lld\n"
+		, atomic_read(&iocored->pack_cut[IOCORE_PACK_CUT_END])
+		, atomic_read(&iocored->pack_cut[IOCORE_PACK_CUT_FLUSH])
+		, atomic_read(&iocored->pack_cut[IOCORE_PACK_CUT_SIZE])
+		, atomic_read(&iocored->pack_cut[IOCORE_PACK_CUT_FULL])
+		, atomic_read(&iocored->pack_cut[IOCORE_PACK_CUT_ZERO_FLUSH])
+		, atomic_read(&iocored->n_padded_pack)
+		, (long long)atomic64_read(&iocored->padding_pb)
+		, wdev->logpack_header_pb
+		, max_n_log_record_in_header(
+			wdev->physical_bs, wdev->logpack_header_pb)
+		, (long long)atomic64_read(&iocored->n_compressed_record)
+		, (long long)atomic64_read(&iocored->compress_saved_pb));
+	len += sprint_hist(buf + len, PAGE_SIZE - len, "records",
+			iocored->pack_rec_hist, IOCORE_PACK_REC_HIST_SIZE);
+	len += sprint_hist(buf + len, PAGE_SIZE - len, "utilization",
+			iocored->pack_util_hist, IOCORE_PACK_UTIL_HIST_SIZE);
+	len += sprint_hist(buf + len, PAGE_SIZE - len, "size_pb",
+			iocored->pack_size_hist, IOCORE_PACK_SIZE_HIST_SIZE);
+	return len;
+}
+
+static ssize_t walb_attr_show_admission_control(struct walb_dev *wdev, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", wdev->admission_control);
+}
+
+static ssize_t walb_attr_show_admission_burst_kb(struct walb_dev *wdev, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n",
+			wdev->admission_burst_sectors * LOGICAL_BLOCK_SIZE / 1024);
+}
+
+static ssize_t walb_attr_show_mem(struct walb_dev *wdev, char *buf)
+{
+	struct iocore_data *iocored = get_iocored_from_wdev(wdev);
+
+	if (!iocored)
+		return 0;
+
+	return snprintf(buf, PAGE_SIZE,
+		"mem_kb        %lld\n"
+		"max_mem_kb    %" PRIu64 "\n"
+		"limit_kb      %u\n"
+		, (long long)atomic64_read(&iocored->mem_bytes) / 1024
+		, iocored->max_mem_bytes_seen / 1024
+		, wdev->mem_limit_mb * 1024);
+}
+
+static ssize_t walb_attr_show_mem_limit_mb(struct walb_dev *wdev, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", wdev->mem_limit_mb);
+}
+
+static ssize_t walb_attr_show_compress(struct walb_dev *wdev, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", wdev->compress);
+}
+
+static ssize_t walb_attr_show_qos(struct walb_dev *wdev, char *buf)
+{
+	struct walb_qos *qos = &wdev->qos;
+
+	return snprintf(buf, PAGE_SIZE,
+		"read_throttled      %d\n"
+		"read_throttled_ms   %lld\n"
+		"write_throttled     %d\n"
+		"write_throttled_ms  %lld\n"
+		, atomic_read(&qos->n_throttled[WALB_QOS_READ])
+		, (long long)atomic64_read(&qos->throttled_ms[WALB_QOS_READ])
+		, atomic_read(&qos->n_throttled[WALB_QOS_WRITE])
+		, (long long)atomic64_read(&qos->throttled_ms[WALB_QOS_WRITE]));
+}
+
+static ssize_t walb_attr_show_qos_read_iops(struct walb_dev *wdev, char *buf)
+{
+	return show_qos_param(wdev, buf,
+			offsetof(struct walb_qos_param, read_iops));
+}
+
+static ssize_t walb_attr_show_qos_write_iops(struct walb_dev *wdev, char *buf)
+{
+	return show_qos_param(wdev, buf,
+			offsetof(struct walb_qos_param, write_iops));
+}
+
+static ssize_t walb_attr_show_qos_read_bps(struct walb_dev *wdev, char *buf)
+{
+	return show_qos_param(wdev, buf,
+			offsetof(struct walb_qos_param, read_bps));
+}
+
+static ssize_t walb_attr_show_qos_write_bps(struct walb_dev *wdev, char *buf)
+{
+	return show_qos_param(wdev, buf,
+			offsetof(struct walb_qos_param, write_bps));
+}
+
+static ssize_t walb_attr_show_qos_burst_ms(struct walb_dev *wdev, char *buf)
+{
+	struct walb_qos_param param;
+
+	walb_qos_get(&wdev->qos, &param);
+	return snprintf(buf, PAGE_SIZE, "%u\n", param.burst_ms);
+}
+
+static ssize_t walb_attr_show_dirty_bitmap(struct walb_dev *wdev, char *buf)
+{
+	struct walb_dirty_bitmap *dbmp = &wdev->dirty_bitmap;
+	bool is_pinned;
+	u64 epoch_lsid;
+
+	spin_lock(&dbmp->lock);
+	is_pinned = dbmp->is_pinned;
+	epoch_lsid = dbmp->epoch_lsid;
+	spin_unlock(&dbmp->lock);
+
+	return snprintf(buf, PAGE_SIZE,
+		"n_bits      %" PRIu64 "\n"
+		"region_kb   %u\n"
+		"dirty       %" PRIu64 "\n"
+		"pinned      %d\n"
+		"epoch_lsid  %" PRIu64 "\n"
+		, dbmp->n_bits
+		, dbmp->region_lb * LOGICAL_BLOCK_SIZE / 1024
+		, walb_dirty_bitmap_count(dbmp)
+		, is_pinned
+		, epoch_lsid);
+}
+
+/*******************************************************************************
+ * Funtions to store attributes.
+ *******************************************************************************/
+
+static ssize_t walb_attr_store_admission_control(
+	struct walb_dev *wdev, const char *buf, size_t count)
+{
+	unsigned int val;
+	int err;
+
+	err = kstrtouint(buf, 10, &val);
+	if (err)
+		return err;
+	if (val > 1)
+		return -EINVAL;
+
+	wdev->admission_control = val;
+	WLOGi(wdev, "admission_control was set to %u\n", val);
+	return count;
+}
+
+static ssize_t walb_attr_store_admission_burst_kb(
+	struct walb_dev *wdev, const char *buf, size_t count)
+{
+	unsigned int val;
+	int err;
+
+	err = kstrtouint(buf, 10, &val);
+	if (err)
+		return err;
+	if (val == 0 || val > UINT_MAX / (1024 / LOGICAL_BLOCK_SIZE))
+		return -EINVAL;
+
+	wdev->admission_burst_sectors = val * (1024 / LOGICAL_BLOCK_SIZE);
+	WLOGi(wdev, "admission_burst_kb was set to %u\n", val);
+	return count;
+}
+
+static ssize_t walb_attr_store_mem_limit_mb(
+	struct walb_dev *wdev, const char *buf, size_t count)
+{
+	unsigned int val;
+	int err;
+
+	err = kstrtouint(buf, 10, &val);
+	if (err)
+		return err;
+	if (val > UINT_MAX / 1024)
+		return -EINVAL;
+
+	wdev->mem_limit_mb = val;
+	WLOGi(wdev, "mem_limit_mb was set to %u\n", val);
+	return count;
+}
+
+static ssize_t walb_attr_store_compress(
+	struct walb_dev *wdev, const char *buf, size_t count)
+{
+	unsigned int val;
+	int err;
+
+	err = kstrtouint(buf, 10, &val);
+	if (err)
+		return err;
+	if (val > 1)
+		return -EINVAL;
+	if (val) {
+		err = iocore_compress_prepare(wdev);
+		if (err)
+			return err;
+	}
+
+	WRITE_ONCE(wdev->compress, val);
+	WLOGi(wdev, "compress was set to %u\n", val);
+	return count;
+}
+
+static ssize_t walb_attr_store_qos_read_iops(
+	struct walb_dev *wdev, const char *buf, size_t count)
+{
+	return store_qos_param(wdev, buf, count,
+			offsetof(struct walb_qos_param, read_iops));
+}
+
+static ssize_t walb_attr_store_qos_write_iops(
+	struct walb_dev *wdev, const char *buf, size_t count)
+{
+	return store_qos_param(wdev, buf, count,
+			offsetof(struct walb_qos_param, write_iops));
+}
+
+static ssize_t walb_attr_store_qos_read_bps(
+	struct walb_dev *wdev, const char *buf, size_t count)
+{
+	return store_qos_param(wdev, buf, count,
+			offsetof(struct walb_qos_param, read_bps));
+}
+
+static ssize_t walb_attr_store_qos_write_bps(
+	struct walb_dev *wdev, const char *buf, size_t count)
+{
+	return store_qos_param(wdev, buf, count,
+			offsetof(struct walb_qos_param, write_bps));
+}
+
+static ssize_t walb_attr_store_qos_burst_ms(
+	struct walb_dev *wdev, const char *buf, size_t count)
+{
+	struct walb_qos_param param;
+	unsigned int val;
+	int err;
+
+	err = kstrtouint(buf, 10, &val);
+	if (err)
+		return err;
+
+	walb_qos_get(&wdev->qos, &param);
+	param.burst_ms = val;
+	if (!is_walb_qos_param_valid(&param))
+		return -EINVAL;
+
+	walb_qos_set(&wdev->qos, &param);
+	return count;
+}
+
 /*******************************************************************************
  * Ops and attributes definition.
  *******************************************************************************/
@@ -150,7 +560,7 @@ static ssize_t walb_attr_show_support_discard(struct walb_dev *wdev, char *buf)
 struct walb_sysfs_attr {
 	struct attribute attr;
 	ssize_t (*show)(struct walb_dev *, char *);
-	ssize_t (*store)(struct walb_dev *, char *);
+	ssize_t (*store)(struct walb_dev *, const char *, size_t);
 };
 
 static ssize_t walb_attr_show(
@@ -165,16 +575,38 @@ static ssize_t walb_attr_show(
 	return wattr->show(wdev, buf);
 }
 
+static ssize_t walb_attr_store(
+	struct kobject *kobj, struct attribute *attr,
+	const char *buf, size_t count)
+{
+	struct walb_sysfs_attr *wattr = container_of(attr, struct walb_sysfs_attr, attr);
+	struct walb_dev *wdev = get_wdev_from_kobj(kobj);
+
+	if (!wdev)
+		return -EINVAL;
+	if (!wattr->store)
+		return -EIO;
+
+	return wattr->store(wdev, buf, count);
+}
+
 static const struct sysfs_ops walb_sysfs_ops = {
 	.show = walb_attr_show,
+	.store = walb_attr_store,
 };
 
 #define DECLARE_WALB_SYSFS_ATTR(name)					\
 	struct walb_sysfs_attr walb_attr_##name =				\
 		__ATTR(name, S_IRUGO, walb_attr_show_##name, NULL)
 
+#define DECLARE_WALB_SYSFS_ATTR_RW(name)				\
+	struct walb_sysfs_attr walb_attr_##name =				\
+		__ATTR(name, S_IRUGO | S_IWUSR,					\
+			walb_attr_show_##name, walb_attr_store_##name)
+
 static DECLARE_WALB_SYSFS_ATTR(ldev);
 static DECLARE_WALB_SYSFS_ATTR(ddev);
+static DECLARE_WALB_SYSFS_ATTR(ldevs);
 static DECLARE_WALB_SYSFS_ATTR(lsids);
 static DECLARE_WALB_SYSFS_ATTR(name);
 static DECLARE_WALB_SYSFS_ATTR(uuid);
@@ -184,10 +616,29 @@ static DECLARE_WALB_SYSFS_ATTR(status);
 static DECLARE_WALB_SYSFS_ATTR(support_flush);
 static DECLARE_WALB_SYSFS_ATTR(support_fua);
 static DECLARE_WALB_SYSFS_ATTR(support_discard);
+static DECLARE_WALB_SYSFS_ATTR(checkpoint_interval);
+static DECLARE_WALB_SYSFS_ATTR(ring_buffer_stall);
+static DECLARE_WALB_SYSFS_ATTR(admission);
+static DECLARE_WALB_SYSFS_ATTR_RW(admission_control);
+static DECLARE_WALB_SYSFS_ATTR_RW(admission_burst_kb);
+static DECLARE_WALB_SYSFS_ATTR(latency_read);
+static DECLARE_WALB_SYSFS_ATTR(latency_write);
+static DECLARE_WALB_SYSFS_ATTR(logpack);
+static DECLARE_WALB_SYSFS_ATTR(mem);
+static DECLARE_WALB_SYSFS_ATTR_RW(mem_limit_mb);
+static DECLARE_WALB_SYSFS_ATTR_RW(compress);
+static DECLARE_WALB_SYSFS_ATTR(qos);
+static DECLARE_WALB_SYSFS_ATTR_RW(qos_read_iops);
+static DECLARE_WALB_SYSFS_ATTR_RW(qos_write_iops);
+static DECLARE_WALB_SYSFS_ATTR_RW(qos_read_bps);
+static DECLARE_WALB_SYSFS_ATTR_RW(qos_write_bps);
+static DECLARE_WALB_SYSFS_ATTR_RW(qos_burst_ms);
+static DECLARE_WALB_SYSFS_ATTR(dirty_bitmap);
 
 static struct attribute *walb_attrs[] = {
 	&walb_attr_ldev.attr,
 	&walb_attr_ddev.attr,
+	&walb_attr_ldevs.attr,
 	&walb_attr_lsids.attr,
 	&walb_attr_name.attr,
 	&walb_attr_uuid.attr,
@@ -197,6 +648,24 @@ static struct attribute *walb_attrs[] = {
 	&walb_attr_support_flush.attr,
 	&walb_attr_support_fua.attr,
 	&walb_attr_support_discard.attr,
+	&walb_attr_checkpoint_interval.attr,
+	&walb_attr_ring_buffer_stall.attr,
+	&walb_attr_admission.attr,
+	&walb_attr_admission_control.attr,
+	&walb_attr_admission_burst_kb.attr,
+	&walb_attr_latency_read.attr,
+	&walb_attr_latency_write.attr,
+	&walb_attr_logpack.attr,
+	&walb_attr_mem.attr,
+	&walb_attr_mem_limit_mb.attr,
+	&walb_attr_compress.attr,
+	&walb_attr_qos.attr,
+	&walb_attr_qos_read_iops.attr,
+	&walb_attr_qos_write_iops.attr,
+	&walb_attr_qos_read_bps.attr,
+	&walb_attr_qos_write_bps.attr,
+	&walb_attr_qos_burst_ms.attr,
+	&walb_attr_dirty_bitmap.attr,
 	NULL,
 };
 
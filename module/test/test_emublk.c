@@ -0,0 +1,489 @@
+/**
+ * test_emublk.c - RAM-backed block devices with emulated performance.
+ *
+ * Devices /dev/emublk0, 1, ... are created at load time.
+ * Data are stored in memory pages allocated on demand.
+ * Each IO is completed by a hrtimer after the emulated service time
+ * so that walb can be benchmarked on top of them deterministically
+ * without special hardware.
+ *
+ * Service time model of a device:
+ *   Transfer of IOs is serialized with bandwidth bw_kbs (0: unlimited),
+ *   then an IO completes read_latency_us or write_latency_us later.
+ *   A flush request and a FUA write add flush_latency_us.
+ *
+ * Usage:
+ *   insmod test-emublk-mod.ko n_devices=2 size_mb=1024 write_latency_us=100 \
+ *     bw_kbs=204800 flush_latency_us=2000 fua=0 chunk_sectors=256
+ *   Parameters of latency and bandwidth can be changed at runtime via
+ *   /sys/module/test_emublk_mod/parameters/.
+ *
+ * Copyright(C) 2013, Cybozu Labs, Inc.
+ */
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/init.h>
+#include <linux/blkdev.h>
+#include <linux/genhd.h>
+#include <linux/bio.h>
+#include <linux/highmem.h>
+#include <linux/radix-tree.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/delay.h>
+#include <linux/slab.h>
+#include "linux/walb/common.h"
+#include "linux/walb/logger.h"
+#include "linux/walb/block_size.h"
+#include "build_date.h"
+
+/*******************************************************************************
+ * Module parameters.
+ *******************************************************************************/
+
+static unsigned int n_devices_ = 1;
+module_param_named(n_devices, n_devices_, uint, S_IRUGO);
+
+static unsigned int size_mb_ = 64;
+module_param_named(size_mb, size_mb_, uint, S_IRUGO);
+
+static unsigned int pbs_ = 512;
+module_param_named(pbs, pbs_, uint, S_IRUGO);
+
+/* Per-IO read latency [us]. */
+static unsigned int read_latency_us_ = 0;
+module_param_named(read_latency_us, read_latency_us_, uint, S_IRUGO | S_IWUSR);
+
+/* Per-IO write latency [us]. */
+static unsigned int write_latency_us_ = 0;
+module_param_named(write_latency_us, write_latency_us_, uint, S_IRUGO | S_IWUSR);
+
+/* Bandwidth cap of each device [KiB/s]. 0 means unlimited. */
+static unsigned int bw_kbs_ = 0;
+module_param_named(bw_kbs, bw_kbs_, uint, S_IRUGO | S_IWUSR);
+
+/* Latency of flush requests and FUA writes [us]. */
+static unsigned int flush_latency_us_ = 0;
+module_param_named(flush_latency_us, flush_latency_us_, uint, S_IRUGO | S_IWUSR);
+
+/* 1 to support REQ_FUA, or the block layer emulates it with a post-flush. */
+static unsigned int fua_ = 1;
+module_param_named(fua, fua_, uint, S_IRUGO);
+
+/* Chunk size [logical block]. 0 means no chunk boundary. */
+static unsigned int chunk_sectors_ = 0;
+module_param_named(chunk_sectors, chunk_sectors_, uint, S_IRUGO);
+
+/*******************************************************************************
+ * Data definitions.
+ *******************************************************************************/
+
+#define EMUBLK_NAME "emublk"
+#define EMUBLK_MAX_DEVICES 16
+#define PAGE_SECTORS_SHIFT (PAGE_SHIFT - 9)
+#define PAGE_SECTORS (1 << PAGE_SECTORS_SHIFT)
+
+struct emublk_dev
+{
+	unsigned int index;
+	u64 capacity; /* [logical block]. */
+	struct request_queue *queue;
+	struct gendisk *gd;
+
+	/* Data pages indexed by page offset. Protected by lock. */
+	struct radix_tree_root pages;
+	spinlock_t lock;
+
+	/* The time when the previous transfer ends [ns]. Protected by lock. */
+	u64 bw_end_ns;
+
+	/* Number of IOs waiting for their completion timers. */
+	atomic_t n_pending;
+};
+
+/* An IO waiting for its completion. */
+struct emublk_io
+{
+	struct hrtimer timer;
+	struct bio *bio;
+	struct emublk_dev *edev;
+};
+
+static int emublk_major_ = 0;
+static struct emublk_dev *edevs_[EMUBLK_MAX_DEVICES];
+static struct kmem_cache *emublk_io_cache_ = NULL;
+
+static const struct block_device_operations emublk_ops = {
+	.owner = THIS_MODULE,
+};
+
+/*******************************************************************************
+ * Static functions prototype.
+ *******************************************************************************/
+
+static struct page *get_page_for_sector(
+	struct emublk_dev *edev, u64 sector, bool is_alloc);
+static void copy_bvec(
+	struct emublk_dev *edev, struct bio_vec *bvec, u64 sector, bool is_write);
+static void zero_sectors(struct emublk_dev *edev, u64 sector, unsigned int n_sectors);
+static u64 calc_complete_ns(struct emublk_dev *edev, struct bio *bio);
+static enum hrtimer_restart emublk_complete_io(struct hrtimer *timer);
+static blk_qc_t emublk_make_request(struct request_queue *q, struct bio *bio);
+static struct emublk_dev *create_emublk_dev(unsigned int index);
+static void destroy_emublk_dev(struct emublk_dev *edev);
+static void free_pages_all(struct emublk_dev *edev);
+
+/*******************************************************************************
+ * Static functions definition.
+ *******************************************************************************/
+
+/**
+ * Get the page containing a sector.
+ *
+ * @is_alloc allocate the page if it does not exist.
+ *
+ * RETURN:
+ *   NULL if the page does not exist or allocation failed.
+ */
+static struct page *get_page_for_sector(
+	struct emublk_dev *edev, u64 sector, bool is_alloc)
+{
+	const pgoff_t idx = sector >> PAGE_SECTORS_SHIFT;
+	struct page *page;
+
+	rcu_read_lock();
+	page = radix_tree_lookup(&edev->pages, idx);
+	rcu_read_unlock();
+	if (page || !is_alloc)
+		return page;
+
+	page = alloc_page(GFP_NOIO | __GFP_ZERO);
+	if (!page)
+		return NULL;
+	if (radix_tree_preload(GFP_NOIO)) {
+		__free_page(page);
+		return NULL;
+	}
+	page->index = idx;
+	spin_lock(&edev->lock);
+	if (radix_tree_insert(&edev->pages, idx, page)) {
+		/* Another IO has inserted the page. */
+		__free_page(page);
+		page = radix_tree_lookup(&edev->pages, idx);
+	}
+	spin_unlock(&edev->lock);
+	radix_tree_preload_end();
+	return page;
+}
+
+/**
+ * Copy data of a bio_vec from/to the device pages.
+ * A page that has never been written reads zero.
+ */
+static void copy_bvec(
+	struct emublk_dev *edev, struct bio_vec *bvec, u64 sector, bool is_write)
+{
+	u8 *buf = kmap_atomic(bvec->bv_page) + bvec->bv_offset;
+	unsigned int done = 0;
+
+	while (done < bvec->bv_len) {
+		const unsigned int off = (sector & (PAGE_SECTORS - 1)) << 9;
+		const unsigned int len = min_t(unsigned int,
+			PAGE_SIZE - off, bvec->bv_len - done);
+		/* Pages to write have been allocated before kmap_atomic(). */
+		struct page *page = get_page_for_sector(edev, sector, false);
+
+		if (is_write) {
+			if (page)
+				memcpy(page_address(page) + off, buf + done, len);
+		} else {
+			if (page)
+				memcpy(buf + done, page_address(page) + off, len);
+			else
+				memset(buf + done, 0, len);
+		}
+		done += len;
+		sector += len >> 9;
+	}
+	kunmap_atomic(buf - bvec->bv_offset);
+}
+
+/**
+ * Fill sectors with zero for discard requests.
+ * Pages are not freed because other IOs may be accessing them.
+ */
+static void zero_sectors(struct emublk_dev *edev, u64 sector, unsigned int n_sectors)
+{
+	while (n_sectors > 0) {
+		const unsigned int off = (sector & (PAGE_SECTORS - 1)) << 9;
+		const unsigned int n = min_t(unsigned int,
+			(PAGE_SIZE - off) >> 9, n_sectors);
+		struct page *page = get_page_for_sector(edev, sector, false);
+
+		if (page)
+			memset(page_address(page) + off, 0, n << 9);
+		sector += n;
+		n_sectors -= n;
+	}
+}
+
+/**
+ * Decide the completion time of a bio by the service time model.
+ *
+ * RETURN:
+ *   completion time [ns] based on ktime_get_ns().
+ */
+static u64 calc_complete_ns(struct emublk_dev *edev, struct bio *bio)
+{
+	const unsigned int bw_kbs = READ_ONCE(bw_kbs_);
+	const bool is_write = op_is_write(bio_op(bio));
+	u64 now_ns = ktime_get_ns();
+	u64 latency_us;
+
+	if (bw_kbs > 0 && bio_op(bio) != REQ_OP_DISCARD && bio_sectors(bio) > 0) {
+		const u64 xfer_ns = div_u64(
+			(u64)bio_sectors(bio) * 512 * NSEC_PER_SEC, bw_kbs * 1024ULL);
+		spin_lock(&edev->lock);
+		edev->bw_end_ns = max(edev->bw_end_ns, now_ns) + xfer_ns;
+		now_ns = edev->bw_end_ns;
+		spin_unlock(&edev->lock);
+	}
+
+	latency_us = is_write ? READ_ONCE(write_latency_us_) : READ_ONCE(read_latency_us_);
+	if (bio->bi_opf & (REQ_PREFLUSH | REQ_FUA) || bio_op(bio) == REQ_OP_FLUSH)
+		latency_us += READ_ONCE(flush_latency_us_);
+	return now_ns + latency_us * NSEC_PER_USEC;
+}
+
+static enum hrtimer_restart emublk_complete_io(struct hrtimer *timer)
+{
+	struct emublk_io *eio = container_of(timer, struct emublk_io, timer);
+	struct emublk_dev *edev = eio->edev;
+
+	bio_endio(eio->bio);
+	kmem_cache_free(emublk_io_cache_, eio);
+	atomic_dec(&edev->n_pending);
+	return HRTIMER_NORESTART;
+}
+
+static blk_qc_t emublk_make_request(struct request_queue *q, struct bio *bio)
+{
+	struct emublk_dev *edev = q->queuedata;
+	const u64 sector = bio->bi_iter.bi_sector;
+	const bool is_write = op_is_write(bio_op(bio));
+	struct bvec_iter iter;
+	struct bio_vec bvec;
+	struct emublk_io *eio;
+	u64 complete_ns;
+
+	if (sector + bio_sectors(bio) > edev->capacity)
+		goto error;
+
+	switch (bio_op(bio)) {
+	case REQ_OP_READ:
+	case REQ_OP_WRITE:
+		break;
+	case REQ_OP_FLUSH:
+		goto fin;
+	case REQ_OP_DISCARD:
+		zero_sectors(edev, sector, bio_sectors(bio));
+		goto fin;
+	default:
+		goto error;
+	}
+
+	if (is_write) {
+		/* Allocate all the pages first to avoid partial writes. */
+		u64 s;
+		for (s = sector; s < sector + bio_sectors(bio); s += PAGE_SECTORS) {
+			if (!get_page_for_sector(edev, s, true))
+				goto error;
+		}
+		if (bio_sectors(bio) > 0 &&
+			!get_page_for_sector(edev, sector + bio_sectors(bio) - 1, true))
+			goto error;
+	}
+	iter = bio->bi_iter;
+	bio_for_each_segment(bvec, bio, iter) {
+		copy_bvec(edev, &bvec, iter.bi_sector, is_write);
+	}
+
+fin:
+	complete_ns = calc_complete_ns(edev, bio);
+	if (complete_ns <= ktime_get_ns()) {
+		bio_endio(bio);
+		return BLK_QC_T_NONE;
+	}
+	eio = kmem_cache_alloc(emublk_io_cache_, GFP_NOIO);
+	if (!eio) {
+		/* Give up emulation of the service time. */
+		bio_endio(bio);
+		return BLK_QC_T_NONE;
+	}
+	eio->bio = bio;
+	eio->edev = edev;
+	atomic_inc(&edev->n_pending);
+	hrtimer_init(&eio->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	eio->timer.function = emublk_complete_io;
+	hrtimer_start(&eio->timer, ns_to_ktime(complete_ns), HRTIMER_MODE_ABS);
+	return BLK_QC_T_NONE;
+
+error:
+	bio_io_error(bio);
+	return BLK_QC_T_NONE;
+}
+
+/**
+ * Free all the data pages.
+ * The device must not be accessed any more.
+ */
+static void free_pages_all(struct emublk_dev *edev)
+{
+	struct page *pages[16];
+	pgoff_t idx = 0;
+	unsigned int i, n;
+
+	do {
+		n = radix_tree_gang_lookup(
+			&edev->pages, (void **)pages, idx, ARRAY_SIZE(pages));
+		for (i = 0; i < n; i++) {
+			idx = pages[i]->index;
+			radix_tree_delete(&edev->pages, idx);
+			__free_page(pages[i]);
+		}
+		idx++;
+	} while (n == ARRAY_SIZE(pages));
+}
+
+/**
+ * Create a device and add its disk.
+ *
+ * RETURN:
+ *   NULL in failure.
+ */
+static struct emublk_dev *create_emublk_dev(unsigned int index)
+{
+	struct emublk_dev *edev;
+	struct request_queue *q;
+
+	edev = kzalloc(sizeof(*edev), GFP_KERNEL);
+	if (!edev)
+		goto error0;
+	edev->index = index;
+	edev->capacity = (u64)size_mb_ << (20 - 9);
+	INIT_RADIX_TREE(&edev->pages, GFP_ATOMIC);
+	spin_lock_init(&edev->lock);
+	atomic_set(&edev->n_pending, 0);
+
+	q = blk_alloc_queue(GFP_KERNEL);
+	if (!q)
+		goto error1;
+	edev->queue = q;
+	blk_queue_make_request(q, emublk_make_request);
+	q->queuedata = edev;
+	blk_queue_logical_block_size(q, LOGICAL_BLOCK_SIZE);
+	blk_queue_physical_block_size(q, pbs_);
+	blk_queue_io_min(q, pbs_);
+	blk_queue_max_hw_sectors(q, 1024);
+	if (chunk_sectors_ > 0)
+		blk_queue_chunk_sectors(q, chunk_sectors_);
+	blk_queue_write_cache(q, true, fua_ != 0);
+	q->limits.discard_granularity = PAGE_SIZE;
+	blk_queue_max_discard_sectors(q, UINT_MAX);
+	queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, q);
+	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, q);
+
+	edev->gd = alloc_disk(1);
+	if (!edev->gd)
+		goto error2;
+	edev->gd->major = emublk_major_;
+	edev->gd->first_minor = index;
+	edev->gd->fops = &emublk_ops;
+	edev->gd->queue = q;
+	edev->gd->private_data = edev;
+	snprintf(edev->gd->disk_name, DISK_NAME_LEN, "%s%u", EMUBLK_NAME, index);
+	set_capacity(edev->gd, edev->capacity);
+	add_disk(edev->gd);
+	return edev;
+
+error2:
+	blk_cleanup_queue(q);
+error1:
+	kfree(edev);
+error0:
+	return NULL;
+}
+
+static void destroy_emublk_dev(struct emublk_dev *edev)
+{
+	del_gendisk(edev->gd);
+	put_disk(edev->gd);
+	blk_cleanup_queue(edev->queue);
+	/* IOs must have been completed before the device is released. */
+	while (atomic_read(&edev->n_pending) > 0)
+		msleep(1);
+	free_pages_all(edev);
+	kfree(edev);
+}
+
+/*******************************************************************************
+ * Init/exit.
+ *******************************************************************************/
+
+static void emublk_exit(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < EMUBLK_MAX_DEVICES; i++) {
+		if (edevs_[i]) {
+			destroy_emublk_dev(edevs_[i]);
+			edevs_[i] = NULL;
+		}
+	}
+	if (emublk_major_ > 0)
+		unregister_blkdev(emublk_major_, EMUBLK_NAME);
+	if (emublk_io_cache_)
+		kmem_cache_destroy(emublk_io_cache_);
+}
+
+static int __init emublk_init(void)
+{
+	unsigned int i;
+
+	LOGi("BUILD_DATE %s\n", BUILD_DATE);
+
+	if (n_devices_ == 0 || n_devices_ > EMUBLK_MAX_DEVICES ||
+		size_mb_ == 0 || !is_valid_pbs(pbs_)) {
+		LOGe("invalid parameters.\n");
+		return -EINVAL;
+	}
+
+	emublk_io_cache_ = kmem_cache_create(
+		"emublk_io_cache", sizeof(struct emublk_io), 0, 0, NULL);
+	if (!emublk_io_cache_)
+		goto error;
+	emublk_major_ = register_blkdev(0, EMUBLK_NAME);
+	if (emublk_major_ <= 0)
+		goto error;
+	for (i = 0; i < n_devices_; i++) {
+		edevs_[i] = create_emublk_dev(i);
+		if (!edevs_[i])
+			goto error;
+	}
+	return 0;
+
+error:
+	emublk_exit();
+	return -ENOMEM;
+}
+
+static void __exit emublk_exit_module(void)
+{
+	emublk_exit();
+}
+
+module_init(emublk_init);
+module_exit(emublk_exit_module);
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("RAM-backed block devices with emulated performance.");
+MODULE_ALIAS("test_emublk");
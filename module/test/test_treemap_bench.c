@@ -0,0 +1,581 @@
+/**
+ * test_treemap_bench.c - Benchmark of treemap and pending/overlapped data.
+ *
+ * Measure throughput and latency of the data structures in the IO hot path:
+ *   map and multimap: add, lookup, cursor search and delete.
+ *   pending data: pending_insert, pending_check_and_copy, pending_delete.
+ *   overlapped data: overlapped_check_and_insert, overlapped_delete_and_notify.
+ * The set sizes are 1k, 10k, 100k and 1M items up to max_items.
+ * IO sizes follow a mixed distribution from 4KiB to 512KiB
+ * at 4KiB-aligned random positions in a dev_size_mb device.
+ *
+ * Usage:
+ *   insmod test-treemap-bench-mod.ko max_items=1000000 n_ops=100000
+ *   Results are printed to the kernel log, one line for each operation.
+ *   The module always fails to load after the benchmark.
+ *   1M items of pending data require about 1GiB memory.
+ *
+ * Each operation is timed individually with ktime_get_ns(),
+ * whose overhead (tens of ns) is included.
+ *
+ * Copyright(C) 2013, Cybozu Labs, Inc.
+ */
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/init.h>
+#include <linux/random.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <linux/math64.h>
+
+#include "linux/walb/walb.h"
+#include "linux/walb/logger.h"
+#include "treemap.h"
+#include "bio_entry.h"
+#include "bio_wrapper.h"
+#include "bio_set.h"
+#include "bio_util.h"
+#include "pending_io.h"
+#include "overlapped_io.h"
+
+static unsigned int max_items_ = 100000;
+module_param_named(max_items, max_items_, uint, S_IRUGO);
+
+static unsigned int n_ops_ = 100000;
+module_param_named(n_ops, n_ops_, uint, S_IRUGO);
+
+static unsigned int dev_size_mb_ = 4096;
+module_param_named(dev_size_mb, dev_size_mb_, uint, S_IRUGO);
+
+static const unsigned int n_items_list_[] = { 1000, 10000, 100000, 1000000 };
+
+static struct treemap_memory_manager mmgr_;
+
+/*******************************************************************************
+ * Result.
+ *******************************************************************************/
+
+#define RESULT_HIST_SIZE 64
+
+struct bench_result
+{
+	u64 n_ops;
+	u64 total_ns;
+	u64 max_ns;
+	unsigned int hist[RESULT_HIST_SIZE]; /* log2 of ns. */
+};
+
+static void result_init(struct bench_result *res)
+{
+	memset(res, 0, sizeof(*res));
+}
+
+static void result_add(struct bench_result *res, u64 begin_ns)
+{
+	const u64 ns = ktime_get_ns() - begin_ns;
+
+	res->n_ops++;
+	res->total_ns += ns;
+	if (res->max_ns < ns)
+		res->max_ns = ns;
+	res->hist[min_t(unsigned int, fls64(ns), RESULT_HIST_SIZE - 1)]++;
+}
+
+/**
+ * Upper bound of a percentile [ns] from the log2 histogram.
+ */
+static u64 result_percentile(const struct bench_result *res, unsigned int pct)
+{
+	const u64 target = div_u64(res->n_ops * pct + 99, 100);
+	u64 sum = 0;
+	unsigned int i;
+
+	for (i = 0; i < RESULT_HIST_SIZE; i++) {
+		sum += res->hist[i];
+		if (sum >= target && sum > 0)
+			return min_t(u64, 1ULL << i, res->max_ns);
+	}
+	return res->max_ns;
+}
+
+static void result_print(
+	const char *name, unsigned int n_items, const struct bench_result *res)
+{
+	const u64 avg_ns = res->n_ops ? div64_u64(res->total_ns, res->n_ops) : 0;
+	const u64 ops_per_sec = res->total_ns
+		? div64_u64(res->n_ops * NSEC_PER_SEC, res->total_ns) : 0;
+
+	LOGn("%-28s items %7u ops %8llu ops/s %9llu avg_ns %6llu"
+		" p50_ns %6llu p99_ns %7llu max_ns %8llu\n"
+		, name, n_items
+		, (unsigned long long)res->n_ops
+		, (unsigned long long)ops_per_sec
+		, (unsigned long long)avg_ns
+		, (unsigned long long)result_percentile(res, 50)
+		, (unsigned long long)result_percentile(res, 99)
+		, (unsigned long long)res->max_ns);
+}
+
+/*******************************************************************************
+ * Workload.
+ *******************************************************************************/
+
+/**
+ * Unique keys in pseudo-random order.
+ * An odd multiplier is a bijection modulo 2^40.
+ */
+static u64 key_of(unsigned int i)
+{
+	return ((u64)i * 2654435761ULL) & ((1ULL << 40) - 1);
+}
+
+static u64 rand_key(void)
+{
+	return (((u64)prandom_u32() << 32) | prandom_u32()) & ((1ULL << 40) - 1);
+}
+
+/**
+ * IO size [logical block] of a mixed workload.
+ */
+static unsigned int rand_io_sectors(void)
+{
+	const unsigned int r = prandom_u32() % 100;
+
+	if (r < 50) return 8;
+	if (r < 70) return 16;
+	if (r < 82) return 32;
+	if (r < 90) return 64;
+	if (r < 96) return 128;
+	if (r < 99) return 256;
+	return 1024;
+}
+
+/**
+ * 4KiB-aligned IO position [logical block].
+ */
+static u64 rand_io_pos(unsigned int sectors)
+{
+	const u64 dev_sectors = (u64)dev_size_mb_ << (20 - 9);
+	const u64 n_slots = ((dev_sectors - sectors) >> 3) + 1;
+	u64 slot;
+
+	div64_u64_rem(((u64)prandom_u32() << 32) | prandom_u32(), n_slots, &slot);
+	return slot << 3;
+}
+
+/*******************************************************************************
+ * Map and multimap.
+ *******************************************************************************/
+
+static bool bench_map(unsigned int n_items)
+{
+	struct map *map;
+	struct map_cursor cur;
+	struct bench_result res;
+	unsigned int i;
+	u64 t;
+
+	map = map_create(GFP_KERNEL, &mmgr_);
+	if (!map)
+		return false;
+
+	result_init(&res);
+	for (i = 0; i < n_items; i++) {
+		t = ktime_get_ns();
+		if (map_add(map, key_of(i), i + 1, GFP_KERNEL))
+			goto error;
+		result_add(&res, t);
+	}
+	result_print("map_add", n_items, &res);
+
+	result_init(&res);
+	for (i = 0; i < n_ops_; i++) {
+		const u64 key = key_of(prandom_u32() % n_items);
+		t = ktime_get_ns();
+		map_lookup(map, key);
+		result_add(&res, t);
+	}
+	result_print("map_lookup", n_items, &res);
+
+	map_cursor_init(map, &cur);
+	result_init(&res);
+	for (i = 0; i < n_ops_; i++) {
+		const u64 key = rand_key();
+		t = ktime_get_ns();
+		map_cursor_search(&cur, key, MAP_SEARCH_GE);
+		result_add(&res, t);
+	}
+	result_print("map_cursor_search", n_items, &res);
+
+	result_init(&res);
+	for (i = 0; i < n_items; i++) {
+		t = ktime_get_ns();
+		map_del(map, key_of(i));
+		result_add(&res, t);
+	}
+	result_print("map_del", n_items, &res);
+
+	map_destroy(map);
+	return true;
+error:
+	map_destroy(map);
+	return false;
+}
+
+/* Four values for a key in average. */
+#define MULTIMAP_VALS_PER_KEY 4
+
+static bool bench_multimap(unsigned int n_items)
+{
+	struct multimap *mmap;
+	struct multimap_cursor cur;
+	struct bench_result res;
+	unsigned int i;
+	u64 t;
+
+	mmap = multimap_create(GFP_KERNEL, &mmgr_);
+	if (!mmap)
+		return false;
+
+	result_init(&res);
+	for (i = 0; i < n_items; i++) {
+		t = ktime_get_ns();
+		if (multimap_add(mmap, key_of(i / MULTIMAP_VALS_PER_KEY), i + 1, GFP_KERNEL))
+			goto error;
+		result_add(&res, t);
+	}
+	result_print("multimap_add", n_items, &res);
+
+	result_init(&res);
+	for (i = 0; i < n_ops_; i++) {
+		const u64 key = key_of(prandom_u32() % n_items / MULTIMAP_VALS_PER_KEY);
+		t = ktime_get_ns();
+		multimap_lookup_any(mmap, key);
+		result_add(&res, t);
+	}
+	result_print("multimap_lookup_any", n_items, &res);
+
+	multimap_cursor_init(mmap, &cur);
+	result_init(&res);
+	for (i = 0; i < n_ops_; i++) {
+		const u64 key = rand_key();
+		t = ktime_get_ns();
+		multimap_cursor_search(&cur, key, MAP_SEARCH_GE, 0);
+		result_add(&res, t);
+	}
+	result_print("multimap_cursor_search", n_items, &res);
+
+	result_init(&res);
+	for (i = 0; i < n_items; i++) {
+		t = ktime_get_ns();
+		multimap_del(mmap, key_of(i / MULTIMAP_VALS_PER_KEY), i + 1);
+		result_add(&res, t);
+	}
+	result_print("multimap_del", n_items, &res);
+
+	multimap_destroy(mmap);
+	return true;
+error:
+	multimap_destroy(mmap);
+	return false;
+}
+
+/*******************************************************************************
+ * Pending and overlapped data.
+ *******************************************************************************/
+
+/**
+ * Create write bio wrappers with random positions and sizes.
+ * All their bios share a page to save memory.
+ *
+ * RETURN:
+ *   NULL in failure.
+ */
+static struct bio_wrapper *create_write_biows(unsigned int n, struct page *page)
+{
+	struct bio_wrapper *biows;
+	unsigned int i;
+
+	biows = vzalloc(sizeof(*biows) * n);
+	if (!biows)
+		return NULL;
+	for (i = 0; i < n; i++) {
+		struct bio_wrapper *biow = &biows[i];
+		const unsigned int sectors = rand_io_sectors();
+		unsigned int remaining = sectors << 9;
+		struct bio *bio;
+
+		bio = bio_alloc(GFP_KERNEL, DIV_ROUND_UP(remaining, PAGE_SIZE));
+		if (!bio)
+			goto error;
+		bio->bi_opf = REQ_OP_WRITE;
+		bio->bi_iter.bi_sector = rand_io_pos(sectors);
+		while (remaining > 0) {
+			const unsigned int len = min_t(unsigned int, remaining, PAGE_SIZE);
+			bio_add_page(bio, page, len, 0);
+			remaining -= len;
+		}
+		init_bio_wrapper(biow, bio);
+		init_bio_entry(&biow->cloned_bioe, bio);
+		biow->copied_bio = bio;
+		biow->lsid = i;
+		cond_resched();
+	}
+	return biows;
+error:
+	while (i > 0) {
+		i--;
+		bio_put(biows[i].bio);
+	}
+	vfree(biows);
+	return NULL;
+}
+
+static void destroy_write_biows(struct bio_wrapper *biows, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		bio_put(biows[i].bio);
+	vfree(biows);
+}
+
+static void bench_end_io(struct bio *bio)
+{
+	/* The bio will be put by the caller. */
+}
+
+/**
+ * Check a read IO against pending data like submit_read_bio_wrapper().
+ */
+static bool check_and_copy_read(
+	struct multimap *pending_data, unsigned int max_sectors,
+	struct bio_wrapper *biow, struct bench_result *res)
+{
+	const unsigned int sectors = rand_io_sectors();
+	struct bio *bio, *clone;
+	bool ret;
+	u64 t;
+
+	bio = bio_alloc_with_pages(sectors << 9, NULL, GFP_KERNEL);
+	if (!bio)
+		return false;
+	bio->bi_opf = REQ_OP_READ;
+	bio->bi_iter.bi_sector = rand_io_pos(sectors);
+	init_bio_wrapper(biow, bio);
+	if (!init_bio_entry_by_clone(&biow->cloned_bioe, bio, NULL, GFP_KERNEL)) {
+		bio_put_with_pages(bio);
+		return false;
+	}
+	biow->cloned_bioe.bio->bi_end_io = bench_end_io;
+	bio_list_add(&biow->cloned_bio_list, biow->cloned_bioe.bio);
+
+	t = ktime_get_ns();
+	ret = pending_check_and_copy(pending_data, max_sectors, biow, GFP_ATOMIC);
+	result_add(res, t);
+
+	/* Complete bios not to be copied instead of submitting them. */
+	while ((clone = bio_list_pop(&biow->cloned_bio_list)))
+		bio_endio(clone);
+	fin_bio_entry(&biow->cloned_bioe);
+	bio_put_with_pages(bio);
+	return ret;
+}
+
+static bool bench_pending(unsigned int n_items, struct page *page)
+{
+	struct multimap *pending_data;
+	struct bio_wrapper *biows, *rbiow;
+	struct bench_result res;
+	unsigned int i, max_sectors = 0;
+	bool ret = false;
+	u64 t;
+
+	pending_data = multimap_create(GFP_KERNEL, &mmgr_);
+	if (!pending_data)
+		goto error0;
+	biows = create_write_biows(n_items, page);
+	if (!biows)
+		goto error1;
+	rbiow = kmalloc(sizeof(*rbiow), GFP_KERNEL);
+	if (!rbiow)
+		goto error2;
+
+	result_init(&res);
+	for (i = 0; i < n_items; i++) {
+		t = ktime_get_ns();
+		if (!pending_insert(pending_data, &max_sectors, &biows[i], GFP_ATOMIC))
+			goto error3;
+		result_add(&res, t);
+	}
+	result_print("pending_insert", n_items, &res);
+
+	result_init(&res);
+	for (i = 0; i < n_ops_; i++) {
+		if (!check_and_copy_read(pending_data, max_sectors, rbiow, &res))
+			goto error3;
+		cond_resched();
+	}
+	result_print("pending_check_and_copy", n_items, &res);
+
+	result_init(&res);
+	for (i = 0; i < n_items; i++) {
+		t = ktime_get_ns();
+		pending_delete(pending_data, &max_sectors, &biows[i]);
+		result_add(&res, t);
+	}
+	result_print("pending_delete", n_items, &res);
+	ret = true;
+
+error3:
+	kfree(rbiow);
+error2:
+	multimap_empty(pending_data);
+	destroy_write_biows(biows, n_items);
+error1:
+	multimap_destroy(pending_data);
+error0:
+	return ret;
+}
+
+#ifdef WALB_OVERLAPPED_SERIALIZE
+static bool bench_overlapped(unsigned int n_items, struct page *page)
+{
+	struct multimap *overlapped_data;
+	struct bio_wrapper *biows;
+	struct bench_result res;
+	struct list_head should_submit_list;
+	unsigned int i, max_sectors = 0;
+#ifdef WALB_DEBUG
+	u64 in_id = 0, out_id = 0;
+#endif
+	bool ret = false;
+	u64 t;
+
+	overlapped_data = multimap_create(GFP_KERNEL, &mmgr_);
+	if (!overlapped_data)
+		goto error0;
+	biows = create_write_biows(n_items, page);
+	if (!biows)
+		goto error1;
+
+	result_init(&res);
+	for (i = 0; i < n_items; i++) {
+		t = ktime_get_ns();
+		if (!overlapped_check_and_insert(
+				overlapped_data, &max_sectors, &biows[i], GFP_ATOMIC
+#ifdef WALB_DEBUG
+				, &in_id
+#endif
+				))
+			goto error2;
+		result_add(&res, t);
+	}
+	result_print("overlapped_check_and_insert", n_items, &res);
+
+	/* Complete in the insertion order. */
+	result_init(&res);
+	for (i = 0; i < n_items; i++) {
+		INIT_LIST_HEAD(&should_submit_list);
+		t = ktime_get_ns();
+		overlapped_delete_and_notify(
+			overlapped_data, &max_sectors, &should_submit_list, &biows[i]
+#ifdef WALB_DEBUG
+			, &out_id
+#endif
+			);
+		result_add(&res, t);
+	}
+	result_print("overlapped_delete_and_notify", n_items, &res);
+	ret = true;
+
+error2:
+	multimap_empty(overlapped_data);
+	destroy_write_biows(biows, n_items);
+error1:
+	multimap_destroy(overlapped_data);
+error0:
+	return ret;
+}
+#endif
+
+/*******************************************************************************
+ * Init/exit.
+ *******************************************************************************/
+
+static bool run_all(void)
+{
+	struct page *page;
+	unsigned int i;
+	bool ret = true;
+
+	page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+	if (!page)
+		return false;
+
+	for (i = 0; i < ARRAY_SIZE(n_items_list_) && ret; i++) {
+		const unsigned int n_items = n_items_list_[i];
+
+		if (n_items > max_items_)
+			break;
+		ret = bench_map(n_items) &&
+			bench_multimap(n_items) &&
+			bench_pending(n_items, page)
+#ifdef WALB_OVERLAPPED_SERIALIZE
+			&& bench_overlapped(n_items, page)
+#endif
+			;
+	}
+	__free_page(page);
+	return ret;
+}
+
+static int __init test_init(void)
+{
+	LOGn("treemap benchmark begin: max_items %u n_ops %u dev_size_mb %u\n"
+		, max_items_, n_ops_, dev_size_mb_);
+	/* The largest IO (512KiB) fits in a 1MiB device. */
+	if (n_ops_ == 0 || dev_size_mb_ == 0) {
+		LOGe("invalid parameters.\n");
+		return -EINVAL;
+	}
+
+	if (!walb_bio_set_init())
+		goto error0;
+	if (!bio_entry_init())
+		goto error1;
+	if (!bio_wrapper_init())
+		goto error2;
+	if (!initialize_treemap_memory_manager(
+			&mmgr_, 1,
+			"test_bench_node_cache",
+			"test_bench_cell_head_cache",
+			"test_bench_cell_cache"))
+		goto error3;
+
+	if (run_all())
+		LOGn("treemap benchmark end.\n");
+	else
+		LOGe("treemap benchmark failed.\n");
+
+	finalize_treemap_memory_manager(&mmgr_);
+error3:
+	bio_wrapper_exit();
+error2:
+	bio_entry_exit();
+error1:
+	walb_bio_set_exit();
+error0:
+	return -1;
+}
+
+static void test_exit(void)
+{
+}
+
+module_init(test_init);
+module_exit(test_exit);
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Benchmark of treemap and pending data");
+MODULE_ALIAS("test_treemap_bench");
@@ -0,0 +1,109 @@
+/**
+ * token_bucket.h - Token bucket for admission control and throttling.
+ */
+#ifndef WALB_TOKEN_BUCKET_H_KERNEL
+#define WALB_TOKEN_BUCKET_H_KERNEL
+
+#include "check_kernel.h"
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/time.h>
+
+/**
+ * Token bucket.
+ *
+ * Tokens may become negative after consumption,
+ * which means the consumer must wait for token_bucket_wait_ns().
+ * Then a large request is never starved by small ones.
+ *
+ * Locking is the caller's responsibility.
+ */
+struct token_bucket
+{
+	s64 tokens; /* current tokens. */
+	u64 burst; /* maximum tokens. */
+	u64 rate; /* refill rate [tokens per second]. */
+	u64 last_ns; /* last refill time [ns]. */
+};
+
+/* Elapsed time longer than this is cut at refill. */
+#define TOKEN_BUCKET_MAX_ELAPSED_NS (10ULL * NSEC_PER_SEC)
+
+/**
+ * Initialize a token bucket. It will be full.
+ */
+static inline void token_bucket_init(
+	struct token_bucket *tb, u64 rate, u64 burst, u64 now_ns)
+{
+	tb->tokens = (s64)burst;
+	tb->burst = burst;
+	tb->rate = rate;
+	tb->last_ns = now_ns;
+}
+
+/**
+ * Refill tokens.
+ */
+static inline void token_bucket_refill(struct token_bucket *tb, u64 now_ns)
+{
+	u64 elapsed;
+
+	if (now_ns <= tb->last_ns)
+		return;
+
+	elapsed = min_t(u64, now_ns - tb->last_ns, TOKEN_BUCKET_MAX_ELAPSED_NS);
+	tb->tokens += (s64)div64_u64(tb->rate * elapsed, NSEC_PER_SEC);
+	if (tb->tokens > (s64)tb->burst)
+		tb->tokens = (s64)tb->burst;
+	tb->last_ns = now_ns;
+}
+
+/**
+ * Change the rate and burst.
+ * Tokens are refilled with the old rate before the change.
+ */
+static inline void token_bucket_set(
+	struct token_bucket *tb, u64 rate, u64 burst, u64 now_ns)
+{
+	token_bucket_refill(tb, now_ns);
+	tb->rate = rate;
+	tb->burst = burst;
+	if (tb->tokens > (s64)burst)
+		tb->tokens = (s64)burst;
+}
+
+/**
+ * Fill the bucket.
+ */
+static inline void token_bucket_fill(struct token_bucket *tb, u64 now_ns)
+{
+	tb->tokens = (s64)tb->burst;
+	tb->last_ns = now_ns;
+}
+
+/**
+ * Consume tokens. This always succeeds.
+ */
+static inline void token_bucket_consume(struct token_bucket *tb, u64 n)
+{
+	tb->tokens -= (s64)n;
+}
+
+/**
+ * Time to wait for the tokens to become non-negative.
+ *
+ * RETURN:
+ *   0 if there is no debt,
+ *   U64_MAX if the rate is 0 and there is debt,
+ *   or the time to wait [ns].
+ */
+static inline u64 token_bucket_wait_ns(const struct token_bucket *tb)
+{
+	if (tb->tokens >= 0)
+		return 0;
+	if (tb->rate == 0)
+		return U64_MAX;
+	return div64_u64((u64)(-tb->tokens) * NSEC_PER_SEC, tb->rate);
+}
+
+#endif /* WALB_TOKEN_BUCKET_H_KERNEL */
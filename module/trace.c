@@ -0,0 +1,12 @@
+/**
+ * trace.c - Tracepoint definitions of walb.
+ *
+ * (C) 2013, Cybozu Labs, Inc.
+ */
+#include "check_kernel.h"
+#include <linux/module.h>
+
+#define CREATE_TRACE_POINTS
+#include "walb_trace.h"
+
+MODULE_LICENSE("GPL");
@@ -24,6 +24,7 @@
 #include <linux/rwsem.h>
 #include <linux/version.h>
 #include <linux/delay.h>
+#include <linux/gcd.h>
 #include <asm/atomic.h>
 
 #include "kern.h"
@@ -113,6 +114,26 @@ unsigned int checkpoint_threshold_ms_ = 10000;
 module_param_named(checkpoint_threshold_ms, checkpoint_threshold_ms_,
 		   uint, S_IRUGO|S_IWUSR);
 
+/**
+ * Set non-zero to adapt the checkpoint interval to the log usage.
+ * The checkpoint interval of each device will be the upper limit
+ * while the log is being filled, and it will be lengthened
+ * up to WALB_CHECKPOINT_IDLE_FACTOR times while the device is idle.
+ */
+unsigned int checkpoint_adaptive_ = 0;
+module_param_named(checkpoint_adaptive, checkpoint_adaptive_,
+		   uint, S_IRUGO|S_IWUSR);
+
+/**
+ * Number of recent logpack headers kept in memory for each device.
+ * Log extractors can get them with WALB_IOCTL_GET_LOGPACK_HEADERS
+ * instead of reading them from the log device one by one.
+ * 0 means disabled. This is used at device creation.
+ */
+unsigned int log_index_size_ = 1024;
+module_param_named(log_index_size, log_index_size_,
+		   uint, S_IRUGO|S_IWUSR);
+
 
 /*******************************************************************************
  * Shared data definition.
@@ -162,6 +183,10 @@ static void walblog_finalize_device(struct walb_dev *wdev);
 
 static int walb_ldev_initialize(struct walb_dev *wdev);
 static void walb_ldev_finalize(struct walb_dev *wdev, bool is_sync);
+static bool walb_open_sub_ldevs(
+	struct walb_dev *wdev, const struct walb_super_sector *super,
+	const struct walb_start_param *param);
+static void walb_close_sub_ldevs(struct walb_dev *wdev);
 
 /* Register/unregister. */
 static void walb_register_device(struct walb_dev *wdev);
@@ -411,6 +436,7 @@ static int walb_prepare_device(
 	struct walb_dev *wdev, unsigned int minor, const char *name)
 {
 	struct request_queue *lq, *dq;
+	unsigned int i;
 
 	/* Using bio interface */
 	wdev->queue = blk_alloc_queue(GFP_KERNEL);
@@ -427,6 +453,8 @@ static int walb_prepare_device(
 	dq = bdev_get_queue(wdev->ddev);
 	blk_queue_stack_limits(wdev->queue, lq);
 	blk_queue_stack_limits(wdev->queue, dq);
+	for (i = 1; i < wdev->n_ldevs; i++)
+		blk_queue_stack_limits(wdev->queue, bdev_get_queue(wdev->ldevs[i]));
 #if 0
 	print_queue_limits(KERN_NOTICE, "lq", &lq->limits);
 	print_queue_limits(KERN_NOTICE, "dq", &dq->limits);
@@ -506,6 +534,7 @@ static int walblog_prepare_device(struct walb_dev *wdev,
 				unsigned int minor, const char* name)
 {
 	struct request_queue *lq;
+	unsigned int i;
 
 	wdev->log_queue = blk_alloc_queue(GFP_KERNEL);
 	if (!wdev->log_queue)
@@ -520,6 +549,8 @@ static int walblog_prepare_device(struct walb_dev *wdev,
 	blk_queue_logical_block_size(wdev->log_queue, LOGICAL_BLOCK_SIZE);
 	blk_queue_physical_block_size(wdev->log_queue, wdev->physical_bs);
 	blk_queue_stack_limits(wdev->log_queue, lq);
+	for (i = 1; i < wdev->n_ldevs; i++)
+		blk_queue_stack_limits(wdev->log_queue, bdev_get_queue(wdev->ldevs[i]));
 
 	/* Allocate a gendisk and set parameters. */
 	wdev->log_gd = alloc_disk(1);
@@ -567,7 +598,7 @@ static void walblog_finalize_device(struct walb_dev *wdev)
  *
  * Read log device metadata
  *    (currently snapshot metadata is not loaded.
- *     super sector0 only...)
+ *     the latest one of super sector0 and 1 only...)
  *
  * @wdev walb device struct.
  * @return 0 in success, or -1.
@@ -595,6 +626,8 @@ static int walb_ldev_initialize(struct walb_dev *wdev)
 		LOGe("walb_ldev_init: read super sector failed.\n");
 		goto error2;
 	}
+	/* Write to the other slot not to overwrite the latest one. */
+	get_super_sector(wdev->lsuper0)->generation++;
 	if (!walb_write_super_sector(wdev->ldev, wdev->lsuper0)) {
 		LOGe("walb_ldev_init: write super sector failed.\n");
 		goto error2;
@@ -638,12 +671,99 @@ static void walb_ldev_finalize(struct walb_dev *wdev, bool is_sync)
 	ASSERT(wdev);
 	ASSERT(wdev->lsuper0);
 
+	walb_flush_super_sync(wdev);
 	if (!walb_finalize_super_block(wdev, sync_superblock_ && is_sync))
 		WLOGe(wdev, "finalize super block failed.\n");
 
+	walb_dirty_bitmap_destroy(&wdev->dirty_bitmap);
+	walb_log_index_destroy(&wdev->log_index);
 	sector_free(wdev->lsuper0);
 }
 
+/**
+ * Open the other log devices of a striped log.
+ * wdev->ldev and its super sector must have been loaded.
+ *
+ * RETURN:
+ *   true in success, or false.
+ *   Opened devices are left in wdev->ldevs[] even in failure
+ *   so call walb_close_sub_ldevs() to release them.
+ */
+static bool walb_open_sub_ldevs(
+	struct walb_dev *wdev, const struct walb_super_sector *super,
+	const struct walb_start_param *param)
+{
+	const unsigned int pbs = wdev->physical_bs;
+	const unsigned int n_ldevs = get_n_ldevs_of_super(super);
+	const u64 ring_off = get_ring_buffer_offset_2(super);
+	const u64 log_end = get_log_end_offset_2(super);
+	u64 dev_size = wdev->ldev_size;
+	u64 log_pb;
+	unsigned int i;
+
+	if (param->n_sub_ldevs + 1 != n_ldevs) {
+		LOGe("number of log devices must be %u but %u.\n",
+			n_ldevs, param->n_sub_ldevs + 1);
+		return false;
+	}
+	if (n_ldevs == 1)
+		return true;
+	if (super->log_stripe_pb < ring_off) {
+		LOGe("stripe size %u must not be less than "
+			"ring buffer offset %llu.\n",
+			super->log_stripe_pb, ring_off);
+		return false;
+	}
+	wdev->log_stripe_pb = super->log_stripe_pb;
+
+	for (i = 1; i < n_ldevs; i++) {
+		const dev_t devt = MKDEV(param->sub_lmajor[i - 1],
+					param->sub_lminor[i - 1]);
+		if (walb_lock_bdev(&wdev->ldevs[i], devt) != 0) {
+			LOGe("walb_lock_bdev failed (%u:%u for log %u)\n",
+				MAJOR(devt), MINOR(devt), i);
+			return false;
+		}
+		wdev->n_ldevs = i + 1;
+		if (bdev_logical_block_size(wdev->ldevs[i]) != LOGICAL_BLOCK_SIZE ||
+			bdev_physical_block_size(wdev->ldevs[i]) != pbs) {
+			LOGe("Sector size of all log devices must be same.\n");
+			return false;
+		}
+		dev_size = min_t(u64, dev_size, wdev->ldevs[i]->bd_part->nr_sects);
+		LOGi("log disk %u (%u:%u) size %llu\n",
+			i, MAJOR(devt), MINOR(devt),
+			(u64)wdev->ldevs[i]->bd_part->nr_sects);
+	}
+
+	log_pb = get_striped_log_size(
+		div_u64(dev_size, n_lb_in_pb(pbs)), n_ldevs, super->log_stripe_pb);
+	if (log_pb < log_end) {
+		LOGe("log devices are too small (%llu < %llu).\n",
+			log_pb, log_end);
+		return false;
+	}
+	wdev->ldev_size = addr_lb(pbs, log_end);
+	LOGi("striped log: n_ldevs %u stripe_pb %u size %llu\n",
+		n_ldevs, wdev->log_stripe_pb, wdev->ldev_size);
+	return true;
+}
+
+/**
+ * Release the other log devices of a striped log.
+ */
+static void walb_close_sub_ldevs(struct walb_dev *wdev)
+{
+	unsigned int i;
+
+	for (i = 1; i < wdev->n_ldevs; i++) {
+		if (wdev->ldevs[i])
+			walb_unlock_bdev(wdev->ldevs[i]);
+		wdev->ldevs[i] = NULL;
+	}
+	wdev->n_ldevs = 1;
+}
+
 /**
  * Register walb block device.
  */
@@ -827,11 +947,14 @@ struct walb_dev* prepare_wdev(
 		goto out;
 	}
 	spin_lock_init(&wdev->lsid_lock);
+	init_waitqueue_head(&wdev->permanent_wq);
 	spin_lock_init(&wdev->lsuper0_lock);
 	spin_lock_init(&wdev->size_lock);
 	wdev->flags = 0;
 	mutex_init(&wdev->freeze_lock);
 	wdev->freeze_state = FRZ_MELTED;
+	walb_init_super_sync(wdev);
+	walb_dirty_bitmap_init(&wdev->dirty_bitmap);
 
 	/*
 	 * Open underlying log device.
@@ -841,6 +964,8 @@ struct walb_dev* prepare_wdev(
 			MAJOR(ldevt), MINOR(ldevt));
 		goto out_free;
 	}
+	wdev->ldevs[0] = wdev->ldev;
+	wdev->n_ldevs = 1;
 	wdev->ldev_size = wdev->ldev->bd_part->nr_sects;
 	ldev_lbs = bdev_logical_block_size(wdev->ldev);
 	ldev_pbs = bdev_physical_block_size(wdev->ldev);
@@ -883,6 +1008,12 @@ struct walb_dev* prepare_wdev(
 	ASSERT(super);
 	init_checkpointing(&wdev->cpd);
 
+	/* Open the other log devices if striped. */
+	if (!walb_open_sub_ldevs(wdev, super, param)) {
+		LOGe("open striped log devices failed.\n");
+		goto out_ldev_init;
+	}
+
 	/* Set lsids. */
 	spin_lock(&wdev->lsid_lock);
 	wdev->lsids.oldest = super->oldest_lsid;
@@ -897,11 +1028,22 @@ struct walb_dev* prepare_wdev(
 	wdev->ring_buffer_size = super->ring_buffer_size;
 	wdev->ring_buffer_off = get_ring_buffer_offset_2(super);
 	wdev->log_checksum_salt = super->log_checksum_salt;
+	wdev->log_csum_type = get_csum_type_of_super(super);
+	if (wdev->log_csum_type == WALB_CSUM_CRC32C)
+		LOGi("log checksum: crc32c.\n");
+	wdev->logpack_header_pb = get_logpack_header_pb_of_super(super);
 	wdev->size = super->device_size;
 	if (wdev->size > wdev->ddev_size) {
 		LOGe("device size > underlying data device size.\n");
 		goto out_ldev_init;
 	}
+	if (!walb_dirty_bitmap_load(wdev)) {
+		LOGe("load dirty bitmap failed.\n");
+		goto out_ldev_init;
+	}
+	if (!walb_log_index_init(&wdev->log_index, log_index_size_)) {
+		goto out_ldev_init;
+	}
 
 	/* Set parameters. */
 	wdev->max_logpack_pb =
@@ -927,12 +1069,28 @@ struct walb_dev* prepare_wdev(
 	if (param->n_pack_bulk > 0) { wdev->n_pack_bulk = param->n_pack_bulk; }
 	wdev->n_io_bulk = 1024; /* default value. */
 	if (param->n_io_bulk > 0) { wdev->n_io_bulk = param->n_io_bulk; }
+	wdev->admission_control = 1;
+	wdev->admission_burst_sectors =
+		WALB_DEFAULT_ADMISSION_BURST_KB * 1024 / LOGICAL_BLOCK_SIZE;
+	wdev->mem_limit_mb = 0; /* unlimited. */
+	wdev->compress = 0;
+	walb_qos_init(&wdev->qos);
 
 	lq = bdev_get_queue(wdev->ldev);
 	dq = bdev_get_queue(wdev->ddev);
 	/* Set chunk size. */
 	set_chunk_sectors(&wdev->ldev_chunk_sectors, wdev->physical_bs, lq);
 	set_chunk_sectors(&wdev->ddev_chunk_sectors, wdev->physical_bs, dq);
+	if (wdev->n_ldevs > 1) {
+		/* Log IOs must not cross stripe boundaries. */
+		const unsigned int stripe_lb =
+			addr_lb(wdev->physical_bs, wdev->log_stripe_pb);
+		if (wdev->ldev_chunk_sectors == 0)
+			wdev->ldev_chunk_sectors = stripe_lb;
+		else
+			wdev->ldev_chunk_sectors =
+				gcd(wdev->ldev_chunk_sectors, stripe_lb);
+	}
 
 	LOGi("max_logpack_pb: %u "
 		"log_flush_interval_jiffies: %u "
@@ -1035,6 +1193,7 @@ out_ddev:
 		walb_unlock_bdev(wdev->ddev);
 	}
 out_ldev:
+	walb_close_sub_ldevs(wdev);
 	if (wdev->ldev) {
 		walb_unlock_bdev(wdev->ldev);
 	}
@@ -1061,6 +1220,7 @@ void finalize_wdev(struct walb_dev *wdev)
 
 	if (wdev->ddev)
 		walb_unlock_bdev(wdev->ddev);
+	walb_close_sub_ldevs(wdev);
 	if (wdev->ldev)
 		walb_unlock_bdev(wdev->ldev);
 
@@ -0,0 +1,240 @@
+/**
+ * walb_trace.h - Tracepoints of walb.
+ *
+ * Use them through perf or bpftrace like this:
+ *   perf record -e 'walb:*' -a
+ * Tracepoints cost almost nothing while they are disabled.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM walb
+
+#if !defined(WALB_TRACE_H_KERNEL) || defined(TRACE_HEADER_MULTI_READ)
+#define WALB_TRACE_H_KERNEL
+
+#include <linux/tracepoint.h>
+#include <linux/types.h>
+
+/**
+ * An IO has been accepted by iocore_make_request().
+ */
+TRACE_EVENT(walb_make_request,
+	TP_PROTO(unsigned int minor, unsigned int op, u64 pos, unsigned int len),
+	TP_ARGS(minor, op, pos, len),
+	TP_STRUCT__entry(
+		__field(unsigned int, minor)
+		__field(unsigned int, op)
+		__field(u64, pos)
+		__field(unsigned int, len)
+	),
+	TP_fast_assign(
+		__entry->minor = minor;
+		__entry->op = op;
+		__entry->pos = pos;
+		__entry->len = len;
+	),
+	TP_printk("minor %u op %u pos %llu len %u",
+		__entry->minor, __entry->op,
+		(unsigned long long)__entry->pos, __entry->len)
+);
+
+/**
+ * Logpack events.
+ */
+DECLARE_EVENT_CLASS(walb_logpack,
+	TP_PROTO(unsigned int minor, u64 lsid, unsigned int n_records,
+		unsigned int total_io_size, bool is_flush),
+	TP_ARGS(minor, lsid, n_records, total_io_size, is_flush),
+	TP_STRUCT__entry(
+		__field(unsigned int, minor)
+		__field(u64, lsid)
+		__field(unsigned int, n_records)
+		__field(unsigned int, total_io_size)
+		__field(bool, is_flush)
+	),
+	TP_fast_assign(
+		__entry->minor = minor;
+		__entry->lsid = lsid;
+		__entry->n_records = n_records;
+		__entry->total_io_size = total_io_size;
+		__entry->is_flush = is_flush;
+	),
+	TP_printk("minor %u lsid %llu n_records %u total_io_size %u flush %d",
+		__entry->minor, (unsigned long long)__entry->lsid,
+		__entry->n_records, __entry->total_io_size, __entry->is_flush)
+);
+
+/* A logpack has been created and its lsid has been decided. */
+DEFINE_EVENT(walb_logpack, walb_create_logpack,
+	TP_PROTO(unsigned int minor, u64 lsid, unsigned int n_records,
+		unsigned int total_io_size, bool is_flush),
+	TP_ARGS(minor, lsid, n_records, total_io_size, is_flush)
+);
+
+/* A logpack has been submitted to the log device. */
+DEFINE_EVENT(walb_logpack, walb_submit_logpack,
+	TP_PROTO(unsigned int minor, u64 lsid, unsigned int n_records,
+		unsigned int total_io_size, bool is_flush),
+	TP_ARGS(minor, lsid, n_records, total_io_size, is_flush)
+);
+
+/**
+ * The header IO of a logpack has been completed.
+ */
+TRACE_EVENT(walb_end_logpack,
+	TP_PROTO(unsigned int minor, u64 lsid, bool is_failed),
+	TP_ARGS(minor, lsid, is_failed),
+	TP_STRUCT__entry(
+		__field(unsigned int, minor)
+		__field(u64, lsid)
+		__field(bool, is_failed)
+	),
+	TP_fast_assign(
+		__entry->minor = minor;
+		__entry->lsid = lsid;
+		__entry->is_failed = is_failed;
+	),
+	TP_printk("minor %u lsid %llu failed %d",
+		__entry->minor, (unsigned long long)__entry->lsid,
+		__entry->is_failed)
+);
+
+/**
+ * lsids.permanent has been updated.
+ */
+TRACE_EVENT(walb_update_permanent_lsid,
+	TP_PROTO(unsigned int minor, u64 lsid),
+	TP_ARGS(minor, lsid),
+	TP_STRUCT__entry(
+		__field(unsigned int, minor)
+		__field(u64, lsid)
+	),
+	TP_fast_assign(
+		__entry->minor = minor;
+		__entry->lsid = lsid;
+	),
+	TP_printk("minor %u lsid %llu",
+		__entry->minor, (unsigned long long)__entry->lsid)
+);
+
+/**
+ * Data IO events.
+ */
+DECLARE_EVENT_CLASS(walb_data,
+	TP_PROTO(unsigned int minor, u64 lsid, u64 pos, unsigned int len, int status),
+	TP_ARGS(minor, lsid, pos, len, status),
+	TP_STRUCT__entry(
+		__field(unsigned int, minor)
+		__field(u64, lsid)
+		__field(u64, pos)
+		__field(unsigned int, len)
+		__field(int, status)
+	),
+	TP_fast_assign(
+		__entry->minor = minor;
+		__entry->lsid = lsid;
+		__entry->pos = pos;
+		__entry->len = len;
+		__entry->status = status;
+	),
+	TP_printk("minor %u lsid %llu pos %llu len %u status %d",
+		__entry->minor, (unsigned long long)__entry->lsid,
+		(unsigned long long)__entry->pos, __entry->len, __entry->status)
+);
+
+/* A write IO has been submitted to the data device. */
+DEFINE_EVENT(walb_data, walb_submit_data,
+	TP_PROTO(unsigned int minor, u64 lsid, u64 pos, unsigned int len, int status),
+	TP_ARGS(minor, lsid, pos, len, status)
+);
+
+/* A write IO to the data device has been completed. */
+DEFINE_EVENT(walb_data, walb_end_data,
+	TP_PROTO(unsigned int minor, u64 lsid, u64 pos, unsigned int len, int status),
+	TP_ARGS(minor, lsid, pos, len, status)
+);
+
+/**
+ * Submission of a write IO to the data device has been delayed
+ * due to overlapped IOs in flight.
+ */
+TRACE_EVENT(walb_overlap_delay,
+	TP_PROTO(unsigned int minor, u64 lsid, u64 pos, unsigned int len,
+		int n_overlapped),
+	TP_ARGS(minor, lsid, pos, len, n_overlapped),
+	TP_STRUCT__entry(
+		__field(unsigned int, minor)
+		__field(u64, lsid)
+		__field(u64, pos)
+		__field(unsigned int, len)
+		__field(int, n_overlapped)
+	),
+	TP_fast_assign(
+		__entry->minor = minor;
+		__entry->lsid = lsid;
+		__entry->pos = pos;
+		__entry->len = len;
+		__entry->n_overlapped = n_overlapped;
+	),
+	TP_printk("minor %u lsid %llu pos %llu len %u n_overlapped %d",
+		__entry->minor, (unsigned long long)__entry->lsid,
+		(unsigned long long)__entry->pos, __entry->len,
+		__entry->n_overlapped)
+);
+
+/**
+ * Queue events due to pending data size.
+ */
+DECLARE_EVENT_CLASS(walb_queue,
+	TP_PROTO(unsigned int minor, unsigned int pending_sectors),
+	TP_ARGS(minor, pending_sectors),
+	TP_STRUCT__entry(
+		__field(unsigned int, minor)
+		__field(unsigned int, pending_sectors)
+	),
+	TP_fast_assign(
+		__entry->minor = minor;
+		__entry->pending_sectors = pending_sectors;
+	),
+	TP_printk("minor %u pending_sectors %u",
+		__entry->minor, __entry->pending_sectors)
+);
+
+DEFINE_EVENT(walb_queue, walb_queue_stop,
+	TP_PROTO(unsigned int minor, unsigned int pending_sectors),
+	TP_ARGS(minor, pending_sectors)
+);
+
+DEFINE_EVENT(walb_queue, walb_queue_start,
+	TP_PROTO(unsigned int minor, unsigned int pending_sectors),
+	TP_ARGS(minor, pending_sectors)
+);
+
+/**
+ * A checkpoint has been taken.
+ */
+TRACE_EVENT(walb_checkpoint,
+	TP_PROTO(unsigned int minor, u64 written_lsid, bool is_skipped),
+	TP_ARGS(minor, written_lsid, is_skipped),
+	TP_STRUCT__entry(
+		__field(unsigned int, minor)
+		__field(u64, written_lsid)
+		__field(bool, is_skipped)
+	),
+	TP_fast_assign(
+		__entry->minor = minor;
+		__entry->written_lsid = written_lsid;
+		__entry->is_skipped = is_skipped;
+	),
+	TP_printk("minor %u written_lsid %llu skipped %d",
+		__entry->minor, (unsigned long long)__entry->written_lsid,
+		__entry->is_skipped)
+);
+
+#endif /* WALB_TRACE_H_KERNEL */
+
+/* This part must be outside protection. */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE walb_trace
+#include <trace/define_trace.h>
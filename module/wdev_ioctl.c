@@ -27,7 +27,7 @@ static void melt_for_reset_wal(struct walb_dev *wdev);
 /* Ioctl details. */
 static int ioctl_wdev_get_oldest_lsid(struct walb_dev *wdev, struct walb_ctl *ctl);
 static int ioctl_wdev_set_oldest_lsid(struct walb_dev *wdev, struct walb_ctl *ctl);
-static int ioctl_wdev_status(struct walb_dev *wdev, struct walb_ctl *ctl); /* NYI */
+static int ioctl_wdev_status(struct walb_dev *wdev, struct walb_ctl *ctl);
 static int ioctl_wdev_take_checkpoint(struct walb_dev *wdev, struct walb_ctl *ctl);
 static int ioctl_wdev_get_checkpoint_interval(struct walb_dev *wdev, struct walb_ctl *ctl);
 static int ioctl_wdev_set_checkpoint_interval(struct walb_dev *wdev, struct walb_ctl *ctl);
@@ -43,6 +43,17 @@ static int ioctl_wdev_is_log_overflow(struct walb_dev *wdev, struct walb_ctl *ct
 static int ioctl_wdev_freeze(struct walb_dev *wdev, struct walb_ctl *ctl);
 static int ioctl_wdev_is_frozen(struct walb_dev *wdev, struct walb_ctl *ctl);
 static int ioctl_wdev_melt(struct walb_dev *wdev, struct walb_ctl *ctl);
+static int ioctl_wdev_get_qos(struct walb_dev *wdev, struct walb_ctl *ctl);
+static int ioctl_wdev_set_qos(struct walb_dev *wdev, struct walb_ctl *ctl);
+static int ioctl_wdev_get_dirty_bitmap(struct walb_dev *wdev, struct walb_ctl *ctl);
+static int ioctl_wdev_unpin_dirty_bitmap(struct walb_dev *wdev, struct walb_ctl *ctl);
+static int ioctl_wdev_read_log(struct walb_dev *wdev, struct walb_ctl *ctl);
+static int ioctl_wdev_get_logpack_headers(struct walb_dev *wdev, struct walb_ctl *ctl);
+
+/* For read-log. */
+static bool read_log_of_lsid(
+	struct walb_dev *wdev, u64 lsid, unsigned int n_pb, u8 *buf);
+static bool is_log_readable(struct walb_dev *wdev, u64 lsid0, u64 lsid1);
 
 /*******************************************************************************
  * Static functions definition.
@@ -155,8 +166,36 @@ static int ioctl_wdev_set_oldest_lsid(struct walb_dev *wdev, struct walb_ctl *ct
  */
 static int ioctl_wdev_status(struct walb_dev *wdev, struct walb_ctl *ctl)
 {
-	LOGw("WALB_IOCTL_STATUS is not supported currently.\n");
-	return -EFAULT;
+	struct walb_status st;
+	struct lsid_set lsids;
+	size_t size;
+
+	LOG_("WALB_IOCTL_STATUS\n");
+	ASSERT(ctl->command == WALB_IOCTL_STATUS);
+
+	if (ctl->k2u.buf_size < WALB_STATUS_HEADER_SIZE) {
+		WLOGe(wdev, "ctl->k2u.buf_size is too small.\n");
+		return -EFAULT;
+	}
+	size = min_t(size_t, ctl->k2u.buf_size, sizeof(st));
+
+	memset(&st, 0, sizeof(st));
+	st.version = WALB_STATUS_VERSION;
+	st.size = size;
+	iocore_get_status(wdev, &st);
+
+	spin_lock(&wdev->lsid_lock);
+	lsids = wdev->lsids;
+	spin_unlock(&wdev->lsid_lock);
+	st.latest_lsid = lsids.latest;
+	st.permanent_lsid = lsids.permanent;
+	st.written_lsid = lsids.written;
+	st.oldest_lsid = lsids.oldest;
+	st.log_capacity = walb_get_log_capacity(wdev);
+	st.log_usage = walb_get_log_usage(wdev);
+
+	memcpy(ctl->k2u.kbuf, &st, size);
+	return 0;
 }
 
 /**
@@ -420,7 +459,10 @@ static int ioctl_wdev_clear_log(struct walb_dev *wdev, struct walb_ctl *ctl)
 
 	/* Get old/new log device size. */
 	old_ldev_size = wdev->ldev_size;
-	new_ldev_size = wdev->ldev->bd_part->nr_sects;
+	if (wdev->n_ldevs > 1)
+		new_ldev_size = old_ldev_size; /* striped log is not resized. */
+	else
+		new_ldev_size = wdev->ldev->bd_part->nr_sects;
 
 	if (old_ldev_size > new_ldev_size) {
 		WLOGe(wdev, "Log device shrink not supported.\n");
@@ -442,6 +484,10 @@ static int ioctl_wdev_clear_log(struct walb_dev *wdev, struct walb_ctl *ctl)
 	wdev->lsids.oldest = 0;
 	spin_unlock(&wdev->lsid_lock);
 
+	/* The logs are lost so the dirty regions must be kept. */
+	walb_dirty_bitmap_pin(&wdev->dirty_bitmap);
+	walb_log_index_clear(&wdev->log_index);
+
 	/* Grow the walblog device. */
 	if (old_ldev_size < new_ldev_size) {
 		WLOGi(wdev, "Detect log device size change.\n");
@@ -458,10 +504,12 @@ static int ioctl_wdev_clear_log(struct walb_dev *wdev, struct walb_ctl *ctl)
 			, old_ldev_size, new_ldev_size);
 		wdev->ldev_size = new_ldev_size;
 
-		/* Recalculate ring buffer size. */
+		/* Recalculate ring buffer size.
+		   The dirty bitmap moves to the new end. */
 		wdev->ring_buffer_size =
 			addr_pb(pbs, new_ldev_size)
-			- get_ring_buffer_offset(pbs);
+			- get_ring_buffer_offset(pbs)
+			- wdev->dirty_bitmap.n_pb;
 	}
 
 	/* Generate new uuid and salt. */
@@ -599,6 +647,279 @@ static int ioctl_wdev_melt(struct walb_dev *wdev, struct walb_ctl *ctl)
 	return melt_if_frozen(wdev, true) ? 0 : -EFAULT;
 }
 
+/**
+ * Get QoS limits.
+ *
+ * @wdev walb dev.
+ * @ctl ioctl data.
+ * RETURN:
+ *   0 in success, or -EFAULT.
+ */
+static int ioctl_wdev_get_qos(struct walb_dev *wdev, struct walb_ctl *ctl)
+{
+	LOG_("WALB_IOCTL_GET_QOS\n");
+	ASSERT(ctl->command == WALB_IOCTL_GET_QOS);
+
+	if (ctl->k2u.buf_size != sizeof(struct walb_qos_param)) {
+		WLOGe(wdev, "ctl->k2u.buf_size is invalid.\n");
+		return -EFAULT;
+	}
+	walb_qos_get(&wdev->qos, (struct walb_qos_param *)ctl->k2u.kbuf);
+	return 0;
+}
+
+/**
+ * Set QoS limits.
+ *
+ * @wdev walb dev.
+ * @ctl ioctl data.
+ * RETURN:
+ *   0 in success, or -EFAULT.
+ */
+static int ioctl_wdev_set_qos(struct walb_dev *wdev, struct walb_ctl *ctl)
+{
+	const struct walb_qos_param *param;
+
+	LOG_("WALB_IOCTL_SET_QOS\n");
+	ASSERT(ctl->command == WALB_IOCTL_SET_QOS);
+
+	if (ctl->u2k.buf_size != sizeof(struct walb_qos_param)) {
+		WLOGe(wdev, "ctl->u2k.buf_size is invalid.\n");
+		return -EFAULT;
+	}
+	param = (const struct walb_qos_param *)ctl->u2k.kbuf;
+	if (!is_walb_qos_param_valid(param)) {
+		WLOGe(wdev, "walb_qos_param is not valid.\n");
+		return -EFAULT;
+	}
+	walb_qos_set(&wdev->qos, param);
+
+	WLOGi(wdev, "qos was set: read_iops %" PRIu64 " write_iops %" PRIu64
+		" read_bps %" PRIu64 " write_bps %" PRIu64 " burst_ms %u\n"
+		, param->read_iops, param->write_iops
+		, param->read_bps, param->write_bps, param->burst_ms);
+	return 0;
+}
+
+static int ioctl_wdev_get_dirty_bitmap(struct walb_dev *wdev, struct walb_ctl *ctl)
+{
+	bool is_pinned;
+
+	LOG_("WALB_IOCTL_GET_DIRTY_BITMAP\n");
+	ASSERT(ctl->command == WALB_IOCTL_GET_DIRTY_BITMAP);
+
+	ctl->val_u64 = walb_dirty_bitmap_get(
+		&wdev->dirty_bitmap, (u8 *)ctl->k2u.kbuf,
+		ctl->k2u.buf_size, &is_pinned);
+	ctl->val_u32 = wdev->dirty_bitmap.region_lb;
+	ctl->val_int = is_pinned;
+	return 0;
+}
+
+static int ioctl_wdev_unpin_dirty_bitmap(struct walb_dev *wdev, struct walb_ctl *ctl)
+{
+	u64 latest_lsid;
+
+	LOG_("WALB_IOCTL_UNPIN_DIRTY_BITMAP\n");
+	ASSERT(ctl->command == WALB_IOCTL_UNPIN_DIRTY_BITMAP);
+
+	if (!walb_dirty_bitmap_enabled(&wdev->dirty_bitmap)) {
+		WLOGe(wdev, "The device has no dirty bitmap.\n");
+		return -EFAULT;
+	}
+	spin_lock(&wdev->lsid_lock);
+	latest_lsid = wdev->lsids.latest;
+	spin_unlock(&wdev->lsid_lock);
+
+	walb_dirty_bitmap_unpin(&wdev->dirty_bitmap, latest_lsid);
+	WLOGi(wdev, "dirty bitmap was unpinned at lsid %" PRIu64 "\n"
+		, latest_lsid);
+	return 0;
+}
+
+/**
+ * Read log blocks of an lsid range.
+ * The range may wrap around the ring buffer.
+ */
+static bool read_log_of_lsid(
+	struct walb_dev *wdev, u64 lsid, unsigned int n_pb, u8 *buf)
+{
+	const unsigned int pbs = wdev->physical_bs;
+	u64 off, ring_end;
+
+	while (n_pb > 0) {
+		unsigned int pb;
+
+		spin_lock(&wdev->lsuper0_lock);
+		off = get_offset_of_lsid_2(get_super_sector(wdev->lsuper0), lsid);
+		ring_end = get_ring_buffer_offset_2(get_super_sector(wdev->lsuper0))
+			+ get_super_sector(wdev->lsuper0)->ring_buffer_size;
+		spin_unlock(&wdev->lsuper0_lock);
+
+		pb = min_t(u64, n_pb, ring_end - off);
+		if (!walb_read_log_pb(wdev, off, pb, buf))
+			return false;
+		lsid += pb;
+		n_pb -= pb;
+		buf += pb * pbs;
+	}
+	return true;
+}
+
+/**
+ * Check the logs of [lsid0, lsid1) are still in the ring buffer.
+ */
+static bool is_log_readable(struct walb_dev *wdev, u64 lsid0, u64 lsid1)
+{
+	struct lsid_set lsids;
+
+	spin_lock(&wdev->lsid_lock);
+	lsids = wdev->lsids;
+	spin_unlock(&wdev->lsid_lock);
+
+	return lsids.oldest <= lsid0 && lsid1 <= lsids.permanent &&
+		!test_bit(WALB_STATE_OVERFLOW, &wdev->flags);
+}
+
+/**
+ * Read logpacks from an lsid.
+ * This waits for a new permanent log at most the given timeout
+ * so log extractors need neither polling nor header-by-header reads.
+ */
+static int ioctl_wdev_read_log(struct walb_dev *wdev, struct walb_ctl *ctl)
+{
+	const unsigned int pbs = wdev->physical_bs;
+	const unsigned long timeout = msecs_to_jiffies(ctl->val_u32);
+	const unsigned int buf_pb = ctl->k2u.buf_size / pbs;
+	u8 *buf = (u8 *)ctl->k2u.kbuf;
+	u64 begin_lsid, end_lsid, lsid, permanent_lsid;
+	unsigned int n_pb = 0, n_packs = 0;
+	int ret = 0;
+
+	LOG_("WALB_IOCTL_READ_LOG\n");
+	ASSERT(ctl->command == WALB_IOCTL_READ_LOG);
+
+	ctl->val_int = 0;
+	ctl->val_u32 = 0;
+	if (!get_lsid_range_from_ctl(&begin_lsid, &end_lsid, ctl))
+		return -EFAULT;
+	lsid = begin_lsid;
+	if (buf_pb == 0 || ctl->k2u.buf_size % pbs != 0) {
+		WLOGe(wdev, "buffer size %zu is not a multiple of %u.\n"
+			, ctl->k2u.buf_size, pbs);
+		return -EFAULT;
+	}
+	if (timeout > 0) {
+		wait_event_interruptible_timeout(
+			wdev->permanent_wq,
+			get_permanent_lsid(wdev) > begin_lsid ||
+			test_bit(WALB_STATE_READ_ONLY, &wdev->flags),
+			timeout);
+	}
+	permanent_lsid = get_permanent_lsid(wdev);
+	if (!is_log_readable(wdev, begin_lsid, begin_lsid)) {
+		WLOGe(wdev, "lsid %" PRIu64 " is out of range.\n", begin_lsid);
+		return -EFAULT;
+	}
+
+	while (lsid < permanent_lsid && n_pb < buf_pb) {
+		struct walb_logpack_header *logh =
+			(struct walb_logpack_header *)(buf + n_pb * pbs);
+		unsigned int header_pb, pack_pb;
+
+		/* The first header block tells the logpack size. */
+		if (!read_log_of_lsid(wdev, lsid, 1, (u8 *)logh))
+			return -EFAULT;
+		if (!is_valid_logpack_header(logh) || logh->logpack_lsid != lsid) {
+			WLOGe(wdev, "invalid logpack header at lsid %" PRIu64 ".\n"
+				, lsid);
+			ret = -EFAULT;
+			break;
+		}
+		header_pb = get_logpack_header_pb(logh);
+		pack_pb = header_pb + logh->total_io_size;
+		if (header_pb > wdev->logpack_header_pb ||
+			lsid + pack_pb > permanent_lsid) {
+			WLOGe(wdev, "invalid logpack size at lsid %" PRIu64 ".\n"
+				, lsid);
+			ret = -EFAULT;
+			break;
+		}
+		if (lsid + pack_pb > end_lsid) {
+			ctl->val_u32 = pack_pb;
+			break;
+		}
+		if (n_pb + pack_pb > buf_pb) {
+			ctl->val_u32 = pack_pb;
+			if (n_packs == 0)
+				ret = -ENOSPC;
+			break;
+		}
+		if (!read_log_of_lsid(wdev, lsid + 1, pack_pb - 1,
+					(u8 *)logh + pbs)) {
+			ret = -EFAULT;
+			break;
+		}
+		if (!is_valid_logpack_header_with_checksum(
+				logh, pbs, wdev->log_checksum_salt,
+				wdev->log_csum_type)) {
+			WLOGe(wdev, "logpack header checksum is invalid"
+				" at lsid %" PRIu64 ".\n", lsid);
+			ret = -EFAULT;
+			break;
+		}
+		n_pb += pack_pb;
+		n_packs++;
+		lsid += pack_pb;
+	}
+
+	/* The ring buffer may have been overwritten during the read. */
+	if (!is_log_readable(wdev, begin_lsid, lsid)) {
+		WLOGe(wdev, "logs from lsid %" PRIu64 " were lost.\n"
+			, begin_lsid);
+		return -EFAULT;
+	}
+	ctl->val_u64 = lsid;
+	ctl->val_int = n_packs;
+	return n_packs > 0 ? 0 : ret;
+}
+
+static int ioctl_wdev_get_logpack_headers(struct walb_dev *wdev, struct walb_ctl *ctl)
+{
+	const unsigned int pbs = wdev->physical_bs;
+	u64 lsid0, lsid1, next_lsid;
+	struct lsid_set lsids;
+	int n;
+
+	LOG_("WALB_IOCTL_GET_LOGPACK_HEADERS\n");
+	ASSERT(ctl->command == WALB_IOCTL_GET_LOGPACK_HEADERS);
+
+	ctl->val_int = 0;
+	if (!get_lsid_range_from_ctl(&lsid0, &lsid1, ctl))
+		return -EFAULT;
+	if (ctl->k2u.buf_size == 0 || ctl->k2u.buf_size % pbs != 0) {
+		WLOGe(wdev, "buffer size %zu is not a multiple of %u.\n"
+			, ctl->k2u.buf_size, pbs);
+		return -EFAULT;
+	}
+	spin_lock(&wdev->lsid_lock);
+	lsids = wdev->lsids;
+	spin_unlock(&wdev->lsid_lock);
+	if (lsid0 < lsids.oldest || lsids.permanent < lsid0) {
+		WLOGe(wdev, "lsid %" PRIu64 " is out of range.\n", lsid0);
+		return -EFAULT;
+	}
+
+	n = walb_log_index_get(
+		&wdev->log_index, lsid0, min(lsid1, lsids.permanent),
+		(u8 *)ctl->k2u.kbuf, ctl->k2u.buf_size, pbs, &next_lsid);
+	if (n < 0)
+		return -ENOENT;
+	ctl->val_u64 = next_lsid;
+	ctl->val_int = n;
+	return 0;
+}
+
 /*******************************************************************************
  * Global functions.
  *******************************************************************************/
@@ -676,6 +997,24 @@ int walb_dispatch_ioctl_wdev(struct walb_dev *wdev, void __user *userctl)
 	case WALB_IOCTL_IS_FROZEN:
 		ret = ioctl_wdev_is_frozen(wdev, ctl);
 		break;
+	case WALB_IOCTL_GET_QOS:
+		ret = ioctl_wdev_get_qos(wdev, ctl);
+		break;
+	case WALB_IOCTL_SET_QOS:
+		ret = ioctl_wdev_set_qos(wdev, ctl);
+		break;
+	case WALB_IOCTL_GET_DIRTY_BITMAP:
+		ret = ioctl_wdev_get_dirty_bitmap(wdev, ctl);
+		break;
+	case WALB_IOCTL_UNPIN_DIRTY_BITMAP:
+		ret = ioctl_wdev_unpin_dirty_bitmap(wdev, ctl);
+		break;
+	case WALB_IOCTL_READ_LOG:
+		ret = ioctl_wdev_read_log(wdev, ctl);
+		break;
+	case WALB_IOCTL_GET_LOGPACK_HEADERS:
+		ret = ioctl_wdev_get_logpack_headers(wdev, ctl);
+		break;
 	default:
 		WLOGw(wdev, "WALB_IOCTL_WDEV %d is not supported.\n"
 			, ctl->command);
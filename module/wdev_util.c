@@ -7,6 +7,8 @@
 #include <linux/module.h>
 #include <linux/version.h>
 #include <linux/hdreg.h>
+#include <linux/vmalloc.h>
+#include <linux/highmem.h>
 #include "linux/walb/logger.h"
 #include "wdev_util.h"
 #include "kern.h"
@@ -14,6 +16,7 @@
 #include "io.h"
 #include "sector_io.h"
 #include "queue_util.h"
+#include "bio_util.h"
 
 /**
  * Check logpack of the given lsid exists.
@@ -24,40 +27,70 @@
  */
 int walb_check_lsid_valid(struct walb_dev *wdev, u64 lsid)
 {
-	struct sector_data *sect;
+	const unsigned int pbs = wdev->physical_bs;
+	struct sector_data *sect, *sect1;
 	struct walb_logpack_header *logh;
-	u64 off;
+	struct block_device *ldev;
+	unsigned int i, n_pb;
+	u64 off, dev_off;
 
 	ASSERT(wdev);
 
-	sect = sector_alloc(wdev->physical_bs, GFP_NOIO);
+	sect = sector_alloc(pbs * wdev->logpack_header_pb, GFP_NOIO);
 	if (!sect) {
 		WLOGe(wdev, "alloc sector failed.\n");
 		goto error0;
 	}
-	ASSERT(is_same_size_sector(sect, wdev->lsuper0));
+	sect1 = sector_alloc(pbs, GFP_NOIO);
+	if (!sect1) {
+		WLOGe(wdev, "alloc sector failed.\n");
+		goto error1;
+	}
+	ASSERT(is_same_size_sector(sect1, wdev->lsuper0));
 	logh = get_logpack_header(sect);
 
 	spin_lock(&wdev->lsuper0_lock);
 	off = get_offset_of_lsid_2(get_super_sector(wdev->lsuper0), lsid);
 	spin_unlock(&wdev->lsuper0_lock);
-	if (!sector_io(REQ_OP_READ, 0, wdev->ldev, off, sect)) {
+	dev_off = off;
+	ldev = walb_map_log_pb(wdev, &dev_off);
+	if (!sector_io(REQ_OP_READ, 0, ldev, dev_off, sect1)) {
 		WLOGe(wdev, "read sector failed.\n");
-		goto error1;
+		goto error2;
+	}
+	memcpy(sect->data, sect1->data, pbs);
+
+	/* Check lsid. */
+	if (!is_valid_logpack_header(logh) || logh->logpack_lsid != lsid)
+		goto error2;
+
+	/* Read the remaining header blocks.
+	   A header never wraps around the ring buffer. */
+	n_pb = get_logpack_header_pb(logh);
+	if (n_pb > wdev->logpack_header_pb)
+		goto error2;
+	for (i = 1; i < n_pb; i++) {
+		dev_off = off + i;
+		ldev = walb_map_log_pb(wdev, &dev_off);
+		if (!sector_io(REQ_OP_READ, 0, ldev, dev_off, sect1)) {
+			WLOGe(wdev, "read sector failed.\n");
+			goto error2;
+		}
+		memcpy((u8 *)sect->data + pbs * i, sect1->data, pbs);
 	}
 
 	/* Check valid logpack header. */
 	if (!is_valid_logpack_header_with_checksum(
-			logh, wdev->physical_bs, wdev->log_checksum_salt))
-		goto error1;
-
-	/* Check lsid. */
-	if (logh->logpack_lsid != lsid)
-		goto error1;
+			logh, pbs, wdev->log_checksum_salt,
+			wdev->log_csum_type))
+		goto error2;
 
+	sector_free(sect1);
 	sector_free(sect);
 	return 1;
 
+error2:
+	sector_free(sect1);
 error1:
 	sector_free(sect);
 error0:
@@ -182,18 +215,24 @@ void walb_decide_flush_support(struct walb_dev *wdev)
 	struct request_queue *q;
 	const struct request_queue *lq, *dq;
 	bool lq_flush, dq_flush, lq_fua, dq_fua;
+	unsigned int i;
 	ASSERT(wdev);
 
 	/* Get queues. */
 	q = wdev->queue;
 	ASSERT(q);
-	lq = bdev_get_queue(wdev->ldev);
 	dq = bdev_get_queue(wdev->ddev);
 
-	/* Get flush/fua flags. */
-	lq_flush = is_queue_flush_enabled(lq);
+	/* Get flush/fua flags.
+	   All the log devices of a striped log must support them. */
+	lq_flush = true;
+	lq_fua = true;
+	for (i = 0; i < wdev->n_ldevs; i++) {
+		lq = bdev_get_queue(wdev->ldevs[i]);
+		lq_flush = lq_flush && is_queue_flush_enabled(lq);
+		lq_fua = lq_fua && is_queue_fua_enabled(lq);
+	}
 	dq_flush = is_queue_flush_enabled(dq);
-	lq_fua = is_queue_fua_enabled(lq);
 	dq_fua = is_queue_fua_enabled(dq);
 
 	WLOGi(wdev, "flush/fua flags: log_device %d/%d data_device %d/%d\n"
@@ -246,10 +285,21 @@ void walb_write_same_support(struct walb_dev *wdev)
 		, blk_queue_get_max_sectors(wdev->queue, REQ_OP_WRITE_SAME));
 }
 
+/**
+ * Support REQ_OP_WRITE_ZEROES if the data device supports it.
+ * Write-zeroes IOs are logged as zero records without data
+ * and passed down to the data device.
+ */
 void walb_write_zeroes_support(struct walb_dev *wdev)
 {
-	WLOGi(wdev, "Do not supports REQ_WRITE_ZEROES.\n");
-	blk_queue_max_write_zeroes_sectors(wdev->queue, 0);
+	const unsigned int sectors = bdev_write_zeroes_sectors(wdev->ddev);
+
+	if (sectors > 0) {
+		WLOGi(wdev, "Supports REQ_WRITE_ZEROES.\n");
+	} else {
+		WLOGi(wdev, "Do not supports REQ_WRITE_ZEROES.\n");
+	}
+	blk_queue_max_write_zeroes_sectors(wdev->queue, sectors);
 	WLOGd(wdev, "max_write_zeroes_sectors: %u\n"
 		, blk_queue_get_max_sectors(wdev->queue, REQ_OP_WRITE_ZEROES));
 }
@@ -303,6 +353,7 @@ bool invalidate_lsid(struct walb_dev *wdev, u64 lsid)
 {
 	struct sector_data *zero_sector;
 	struct walb_super_sector *super;
+	struct block_device *ldev;
 	u64 off;
 	bool ret;
 
@@ -320,7 +371,8 @@ bool invalidate_lsid(struct walb_dev *wdev, u64 lsid)
 	off = get_offset_of_lsid_2(super, lsid);
 	spin_unlock(&wdev->lsuper0_lock);
 
-	ret = sector_io(REQ_OP_WRITE, 0, wdev->ldev, off, zero_sector);
+	ldev = walb_map_log_pb(wdev, &off);
+	ret = sector_io(REQ_OP_WRITE, 0, ldev, off, zero_sector);
 	if (!ret) {
 		WLOGe(wdev, "sector write failed. to be read-only mode.\n");
 		set_bit(WALB_STATE_READ_ONLY, &wdev->flags);
@@ -606,6 +658,141 @@ void print_queue_limits(
 		);
 }
 
+/**
+ * Map an offset in the log address space to a log device.
+ *
+ * @off_pb offset in the log address space [physical block].
+ *   It will be the offset in the returned log device.
+ *
+ * RETURN:
+ *   log device.
+ */
+struct block_device *walb_map_log_pb(struct walb_dev *wdev, u64 *off_pb)
+{
+	return wdev->ldevs[map_striped_log_offset(
+			off_pb, wdev->n_ldevs, wdev->log_stripe_pb)];
+}
+
+/**
+ * Remap a bio in the log address space to a log device.
+ * The bio must not cross a stripe boundary.
+ */
+void walb_remap_log_bio(struct walb_dev *wdev, struct bio *bio)
+{
+	const u64 stripe_lb = addr_lb(wdev->physical_bs, wdev->log_stripe_pb);
+	u64 off_lb = bio->bi_iter.bi_sector;
+	unsigned int idx;
+
+	if (wdev->n_ldevs <= 1) {
+		bio->bi_bdev = wdev->ldev;
+		return;
+	}
+	ASSERT(!should_split_bio_for_chunk(bio, stripe_lb));
+	idx = map_striped_log_offset(&off_lb, wdev->n_ldevs, stripe_lb);
+	bio->bi_bdev = wdev->ldevs[idx];
+	bio->bi_iter.bi_sector = off_lb;
+}
+
+/**
+ * Get the page of a kmalloc()ed or vmalloc()ed buffer.
+ */
+static struct page *get_page_of_buf(const void *buf)
+{
+	if (is_vmalloc_addr(buf))
+		return vmalloc_to_page(buf);
+	return virt_to_page(buf);
+}
+
+/**
+ * Read blocks in the log address space.
+ * Large bios are built directly on the buffer, split at stripe boundaries.
+ *
+ * @off_pb offset in the log address space [physical block].
+ * @n_pb number of blocks to read.
+ * @buf buffer of n_pb * physical_bs bytes.
+ *   It may be kvmalloc()ed.
+ *
+ * RETURN:
+ *   true in success, or false.
+ */
+bool walb_read_log_pb(
+	struct walb_dev *wdev, u64 off_pb, unsigned int n_pb, u8 *buf)
+{
+	const unsigned int pbs = wdev->physical_bs;
+	const unsigned int max_pb = (BIO_MAX_PAGES - 1) * PAGE_SIZE / pbs;
+
+	while (n_pb > 0) {
+		struct bio *bio;
+		unsigned int pb = min(n_pb, max_pb);
+		unsigned int bytes;
+		u8 *buf0 = buf;
+		int err;
+
+		if (wdev->n_ldevs > 1) {
+			u64 rem;
+			div64_u64_rem(off_pb, wdev->log_stripe_pb, &rem);
+			pb = min_t(u64, pb, wdev->log_stripe_pb - rem);
+		}
+		bio = bio_alloc(GFP_NOIO, DIV_ROUND_UP(
+				offset_in_page(buf) + pb * pbs, PAGE_SIZE));
+		if (!bio) {
+			WLOGe(wdev, "bio_alloc failed.\n");
+			return false;
+		}
+		bio_set_op_attrs(bio, REQ_OP_READ, 0);
+		bio->bi_iter.bi_sector = addr_lb(pbs, off_pb);
+		bytes = pb * pbs;
+		while (bytes > 0) {
+			const unsigned int len = min_t(
+				unsigned int, bytes,
+				PAGE_SIZE - offset_in_page(buf));
+			if (bio_add_page(bio, get_page_of_buf(buf), len,
+						offset_in_page(buf)) != len) {
+				WLOGe(wdev, "bio_add_page failed.\n");
+				bio_put(bio);
+				return false;
+			}
+			buf += len;
+			bytes -= len;
+		}
+		walb_remap_log_bio(wdev, bio);
+		err = submit_bio_wait(bio);
+		bio_put(bio);
+		if (err) {
+			WLOGe(wdev, "log read failed with error %d.\n", err);
+			return false;
+		}
+		if (is_vmalloc_addr(buf0))
+			invalidate_kernel_vmap_range(buf0, pb * pbs);
+		off_pb += pb;
+		n_pb -= pb;
+	}
+	return true;
+}
+
+/**
+ * Flush the log devices of a striped log except the first one.
+ * The first one is flushed by the caller.
+ *
+ * RETURN:
+ *   true in success, or false.
+ */
+bool walb_flush_sub_ldevs(struct walb_dev *wdev)
+{
+	unsigned int i;
+	bool ret = true;
+
+	for (i = 1; i < wdev->n_ldevs; i++) {
+		if (!supports_flush_request_bdev(wdev->ldevs[i]))
+			continue;
+		if (blkdev_issue_flush(wdev->ldevs[i], GFP_NOIO, NULL)) {
+			WLOGe(wdev, "log device %u flush failed.\n", i);
+			ret = false;
+		}
+	}
+	return ret;
+}
+
 /**
  * Get log usage.
  *
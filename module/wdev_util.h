@@ -68,6 +68,11 @@ void set_chunk_sectors(
 void print_queue_limits(
 	const char *level, const char *msg,
 	const struct queue_limits *limits);
+struct block_device *walb_map_log_pb(struct walb_dev *wdev, u64 *off_pb);
+void walb_remap_log_bio(struct walb_dev *wdev, struct bio *bio);
+bool walb_read_log_pb(
+	struct walb_dev *wdev, u64 off_pb, unsigned int n_pb, u8 *buf);
+bool walb_flush_sub_ldevs(struct walb_dev *wdev);
 u64 walb_get_log_usage(struct walb_dev *wdev);
 u64 walb_get_log_capacity(struct walb_dev *wdev);
 
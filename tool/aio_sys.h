@@ -0,0 +1,37 @@
+/**
+ * Kernel native AIO system call wrappers.
+ * They are used instead of libaio to avoid the dependency.
+ *
+ * Copyright(C) 2013, Cybozu Labs, Inc.
+ * @license 3-clause BSD, GPL version 2 or later.
+ */
+#ifndef WALB_AIO_SYS_USER_H
+#define WALB_AIO_SYS_USER_H
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/aio_abi.h>
+
+static inline int sys_io_setup(unsigned int nr, aio_context_t *ctxp)
+{
+	return syscall(__NR_io_setup, nr, ctxp);
+}
+
+static inline int sys_io_destroy(aio_context_t ctx)
+{
+	return syscall(__NR_io_destroy, ctx);
+}
+
+static inline int sys_io_submit(aio_context_t ctx, long nr, struct iocb **iocbpp)
+{
+	return syscall(__NR_io_submit, ctx, nr, iocbpp);
+}
+
+static inline int sys_io_getevents(
+	aio_context_t ctx, long min_nr, long nr, struct io_event *events,
+	struct timespec *timeout)
+{
+	return syscall(__NR_io_getevents, ctx, min_nr, nr, events, timeout);
+}
+
+#endif /* WALB_AIO_SYS_USER_H */
@@ -0,0 +1,627 @@
+/**
+ * Multi-threaded block device benchmark.
+ *
+ * Drive a walb device (or its underlying devices for baseline)
+ * with O_DIRECT IOs and report IOPS, bandwidth and latency percentiles
+ * in JSON.
+ * Each thread keeps queue-depth IOs in flight with kernel native AIO
+ * (io_setup/io_submit/io_getevents) without libaio.
+ *
+ * Copyright(C) 2013, Cybozu Labs, Inc.
+ * @license 3-clause BSD, GPL version 2 or later.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <linux/fs.h>
+
+#include "linux/walb/common.h"
+#include "linux/walb/logger.h"
+#include "util.h"
+#include "io_stat.h"
+#include "aio_sys.h"
+#include "version.h"
+
+/*******************************************************************************
+ * Statistics.
+ *******************************************************************************/
+
+enum {
+	STAT_READ = 0,
+	STAT_WRITE,
+	STAT_FSYNC,
+	STAT_MAX,
+};
+
+static const char *stat_name_[STAT_MAX] = {
+	"read", "write", "fsync",
+};
+
+/*******************************************************************************
+ * Configuration.
+ *******************************************************************************/
+
+struct bench_config
+{
+	const char *dev_path;
+	unsigned int n_threads;
+	unsigned int qd; /* queue depth per thread. */
+	unsigned int bs; /* IO size [byte]. */
+	unsigned int read_pct; /* percentage of read IOs. */
+	bool is_random;
+	unsigned int fsync_interval; /* fdatasync() every N writes per thread. */
+	unsigned int fua_interval; /* every N-th write is FUA. */
+	unsigned int hot_pct; /* percentage of writes to the hot set. */
+	u64 hot_size; /* hot set size from the beginning of the range [byte]. */
+	u64 offset; /* target range [byte]. */
+	u64 size;
+	unsigned int runtime_sec;
+	u64 n_ios; /* max number of IOs per thread. 0 means unlimited. */
+	unsigned int seed;
+};
+
+enum {
+	OPT_THREADS = 1,
+	OPT_QD,
+	OPT_BS,
+	OPT_READ_PCT,
+	OPT_RANDOM,
+	OPT_FSYNC,
+	OPT_FUA,
+	OPT_HOT_PCT,
+	OPT_HOT_SIZE,
+	OPT_OFFSET,
+	OPT_SIZE,
+	OPT_RUNTIME,
+	OPT_COUNT,
+	OPT_SEED,
+	OPT_HELP,
+};
+
+static void show_help(void)
+{
+	printf("Usage: bench [OPTIONS] BLOCK_DEVICE\n"
+		"OPTIONS:\n"
+		"  --threads N     number of threads. (default: 1)\n"
+		"  --qd N          queue depth per thread. (default: 1)\n"
+		"  --bs SIZE       IO size. (default: 4k)\n"
+		"  --read_pct N    percentage of read IOs. (default: 0)\n"
+		"  --random        random access instead of sequential.\n"
+		"  --fsync N       fdatasync() every N writes per thread. (default: 0)\n"
+		"  --fua N         every N-th write is issued with FUA. (default: 0)\n"
+		"  --hot_pct N     percentage of writes to the hot set. (default: 0)\n"
+		"  --hot_size SIZE hot set size at the beginning of the range.\n"
+		"  --offset SIZE   beginning of the target range. (default: 0)\n"
+		"  --size SIZE     size of the target range. (default: whole device)\n"
+		"  --runtime SEC   run period. (default: 10)\n"
+		"  --count N       max number of IOs per thread. (default: 0: unlimited)\n"
+		"  --seed N        random seed. (default: 0)\n"
+		"SIZE accepts k, m and g suffixes.\n"
+		"Results are printed to stdout in JSON.\n"
+		"CAUSION: write IOs destroy the contents of the device.\n");
+}
+
+static void init_config(struct bench_config *cfg)
+{
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->n_threads = 1;
+	cfg->qd = 1;
+	cfg->bs = 4096;
+	cfg->runtime_sec = 10;
+}
+
+/**
+ * Parse a size string with an optional k/m/g suffix.
+ *
+ * RETURN:
+ *   true in success.
+ */
+static bool parse_size(const char *str, u64 *sizep)
+{
+	char *end;
+	u64 size;
+
+	errno = 0;
+	size = strtoull(str, &end, 10);
+	if (errno || end == str)
+		return false;
+	switch (*end) {
+	case 'g': case 'G':
+		size *= 1024;
+		/* fall through */
+	case 'm': case 'M':
+		size *= 1024;
+		/* fall through */
+	case 'k': case 'K':
+		size *= 1024;
+		end++;
+		break;
+	default:
+		break;
+	}
+	if (*end != '\0')
+		return false;
+	*sizep = size;
+	return true;
+}
+
+static bool parse_uint(const char *str, unsigned int *valp)
+{
+	char *end;
+	unsigned long val;
+
+	errno = 0;
+	val = strtoul(str, &end, 10);
+	if (errno || end == str || *end != '\0' || val > UINT_MAX)
+		return false;
+	*valp = val;
+	return true;
+}
+
+/**
+ * RETURN:
+ *   true in success.
+ */
+static bool parse_opt(int argc, char *const argv[], struct bench_config *cfg)
+{
+	u64 size;
+
+	while (1) {
+		int option_index = 0;
+		bool ret = true;
+		static const struct option long_options[] = {
+			{"threads", 1, 0, OPT_THREADS},
+			{"qd", 1, 0, OPT_QD},
+			{"bs", 1, 0, OPT_BS},
+			{"read_pct", 1, 0, OPT_READ_PCT},
+			{"random", 0, 0, OPT_RANDOM},
+			{"fsync", 1, 0, OPT_FSYNC},
+			{"fua", 1, 0, OPT_FUA},
+			{"hot_pct", 1, 0, OPT_HOT_PCT},
+			{"hot_size", 1, 0, OPT_HOT_SIZE},
+			{"offset", 1, 0, OPT_OFFSET},
+			{"size", 1, 0, OPT_SIZE},
+			{"runtime", 1, 0, OPT_RUNTIME},
+			{"count", 1, 0, OPT_COUNT},
+			{"seed", 1, 0, OPT_SEED},
+			{"help", 0, 0, OPT_HELP},
+			{0, 0, 0, 0}
+		};
+
+		int c = getopt_long(argc, argv, "", long_options, &option_index);
+		if (c == -1)
+			break;
+		switch (c) {
+		case OPT_THREADS:
+			ret = parse_uint(optarg, &cfg->n_threads);
+			break;
+		case OPT_QD:
+			ret = parse_uint(optarg, &cfg->qd);
+			break;
+		case OPT_BS:
+			ret = parse_size(optarg, &size) && size <= UINT_MAX;
+			cfg->bs = size;
+			break;
+		case OPT_READ_PCT:
+			ret = parse_uint(optarg, &cfg->read_pct);
+			break;
+		case OPT_RANDOM:
+			cfg->is_random = true;
+			break;
+		case OPT_FSYNC:
+			ret = parse_uint(optarg, &cfg->fsync_interval);
+			break;
+		case OPT_FUA:
+			ret = parse_uint(optarg, &cfg->fua_interval);
+			break;
+		case OPT_HOT_PCT:
+			ret = parse_uint(optarg, &cfg->hot_pct);
+			break;
+		case OPT_HOT_SIZE:
+			ret = parse_size(optarg, &cfg->hot_size);
+			break;
+		case OPT_OFFSET:
+			ret = parse_size(optarg, &cfg->offset);
+			break;
+		case OPT_SIZE:
+			ret = parse_size(optarg, &cfg->size);
+			break;
+		case OPT_RUNTIME:
+			ret = parse_uint(optarg, &cfg->runtime_sec);
+			break;
+		case OPT_COUNT:
+			ret = parse_size(optarg, &cfg->n_ios);
+			break;
+		case OPT_SEED:
+			ret = parse_uint(optarg, &cfg->seed);
+			break;
+		case OPT_HELP:
+		default:
+			return false;
+		}
+		if (!ret) {
+			LOGe("invalid argument: %s\n", optarg);
+			return false;
+		}
+	}
+	if (optind != argc - 1) {
+		LOGe("specify a block device.\n");
+		return false;
+	}
+	cfg->dev_path = argv[optind];
+	return true;
+}
+
+/**
+ * Check the config against the device.
+ * cfg->size will be set if it is 0.
+ *
+ * RETURN:
+ *   true if the config is valid.
+ */
+static bool check_config(struct bench_config *cfg, const struct bdev_info *info)
+{
+	if (cfg->n_threads == 0 || cfg->qd == 0) {
+		LOGe("threads and qd must be positive.\n");
+		return false;
+	}
+	if (cfg->bs == 0 || cfg->bs % info->lbs != 0) {
+		LOGe("bs must be a multiple of the logical block size %u.\n", info->lbs);
+		return false;
+	}
+	if (cfg->offset % cfg->bs != 0) {
+		LOGe("offset must be a multiple of bs.\n");
+		return false;
+	}
+	if (cfg->read_pct > 100 || cfg->hot_pct > 100) {
+		LOGe("read_pct and hot_pct must be <= 100.\n");
+		return false;
+	}
+	if (cfg->offset >= info->size) {
+		LOGe("offset exceeds the device size.\n");
+		return false;
+	}
+	if (cfg->size == 0 || cfg->offset + cfg->size > info->size)
+		cfg->size = info->size - cfg->offset;
+	if (cfg->size < cfg->bs) {
+		LOGe("the target range is smaller than bs.\n");
+		return false;
+	}
+	if (cfg->hot_pct > 0 && (cfg->hot_size < cfg->bs || cfg->hot_size > cfg->size)) {
+		LOGe("hot_size must be in [bs, size].\n");
+		return false;
+	}
+	if (cfg->runtime_sec == 0 && cfg->n_ios == 0) {
+		LOGe("runtime or count must be positive.\n");
+		return false;
+	}
+	return true;
+}
+
+/*******************************************************************************
+ * Worker threads.
+ *******************************************************************************/
+
+struct io_slot
+{
+	struct iocb iocb;
+	u8 *buf;
+	bool is_write;
+	u64 begin_ns;
+};
+
+struct bench_thread
+{
+	pthread_t th;
+	unsigned int id;
+	const struct bench_config *cfg;
+	int fd;
+	u64 rand_state;
+	u64 seq_pos; /* next block for sequential access. */
+	u64 n_submitted;
+	u64 n_writes; /* issued write IOs. */
+	struct io_stat stat[STAT_MAX];
+	bool is_failed;
+};
+
+/**
+ * xorshift64*. Deterministic for a seed, so runs are reproducible.
+ */
+static u64 rand_next(struct bench_thread *bt)
+{
+	u64 x = bt->rand_state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	bt->rand_state = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * Decide the next IO and prepare its iocb.
+ */
+static void prepare_io(struct bench_thread *bt, struct io_slot *slot)
+{
+	const struct bench_config *cfg = bt->cfg;
+	const u64 n_blocks = cfg->size / cfg->bs;
+	u64 block;
+
+	slot->is_write = rand_next(bt) % 100 >= cfg->read_pct;
+	if (slot->is_write && cfg->hot_pct > 0 && rand_next(bt) % 100 < cfg->hot_pct) {
+		block = rand_next(bt) % (cfg->hot_size / cfg->bs);
+	} else if (cfg->is_random) {
+		block = rand_next(bt) % n_blocks;
+	} else {
+		block = bt->seq_pos;
+		bt->seq_pos = (bt->seq_pos + 1) % n_blocks;
+	}
+
+	memset(&slot->iocb, 0, sizeof(slot->iocb));
+	slot->iocb.aio_data = (u64)(uintptr_t)slot;
+	slot->iocb.aio_fildes = bt->fd;
+	slot->iocb.aio_buf = (u64)(uintptr_t)slot->buf;
+	slot->iocb.aio_nbytes = cfg->bs;
+	slot->iocb.aio_offset = cfg->offset + block * cfg->bs;
+	if (slot->is_write) {
+		bt->n_writes++;
+		slot->iocb.aio_lio_opcode = IOCB_CMD_PWRITE;
+		/* Make each block unique. */
+		*(u64 *)slot->buf = rand_next(bt);
+		if (cfg->fua_interval > 0 && bt->n_writes % cfg->fua_interval == 0)
+			slot->iocb.aio_rw_flags = RWF_DSYNC;
+	} else {
+		slot->iocb.aio_lio_opcode = IOCB_CMD_PREAD;
+	}
+}
+
+static bool submit_io(struct bench_thread *bt, aio_context_t ctx, struct io_slot *slot)
+{
+	struct iocb *iocbp = &slot->iocb;
+
+	prepare_io(bt, slot);
+	slot->begin_ns = get_ns();
+	if (sys_io_submit(ctx, 1, &iocbp) != 1) {
+		LOGe("io_submit failed: %s\n", strerror(errno));
+		return false;
+	}
+	bt->n_submitted++;
+	return true;
+}
+
+static bool do_fsync(struct bench_thread *bt)
+{
+	const u64 begin_ns = get_ns();
+
+	if (fdatasync(bt->fd)) {
+		LOGe("fdatasync failed: %s\n", strerror(errno));
+		return false;
+	}
+	io_stat_add(&bt->stat[STAT_FSYNC], 0, get_ns() - begin_ns);
+	return true;
+}
+
+/**
+ * RETURN:
+ *   true if the thread should not issue more IOs now.
+ */
+static bool should_stop_issue(
+	const struct bench_thread *bt, u64 n_writes_synced, bool is_end)
+{
+	const struct bench_config *cfg = bt->cfg;
+
+	if (is_end)
+		return true;
+	if (cfg->n_ios > 0 && bt->n_submitted >= cfg->n_ios)
+		return true;
+	/* Wait for in-flight IOs to be drained before fdatasync(). */
+	return cfg->fsync_interval > 0 &&
+		bt->n_writes - n_writes_synced >= cfg->fsync_interval;
+}
+
+static void *worker(void *arg)
+{
+	struct bench_thread *bt = arg;
+	const struct bench_config *cfg = bt->cfg;
+	const u64 end_ns = cfg->runtime_sec > 0
+		? get_ns() + cfg->runtime_sec * 1000000000ULL : UINT64_MAX;
+	struct io_slot *slots;
+	struct io_slot **free_slots;
+	struct io_event *events;
+	aio_context_t ctx = 0;
+	unsigned int i, n_free = 0;
+	u64 n_writes_synced = 0;
+	bool is_end = false;
+
+	slots = calloc(cfg->qd, sizeof(*slots));
+	free_slots = calloc(cfg->qd, sizeof(*free_slots));
+	events = calloc(cfg->qd, sizeof(*events));
+	if (!slots || !free_slots || !events) {
+		LOGe("memory allocation failed.\n");
+		goto error0;
+	}
+	for (i = 0; i < cfg->qd; i++) {
+		if (posix_memalign((void **)&slots[i].buf, 4096, cfg->bs)) {
+			LOGe("memory allocation failed.\n");
+			goto error1;
+		}
+		memset(slots[i].buf, 0, cfg->bs);
+		free_slots[n_free++] = &slots[i];
+	}
+	if (sys_io_setup(cfg->qd, &ctx)) {
+		LOGe("io_setup failed: %s\n", strerror(errno));
+		goto error1;
+	}
+
+	while (true) {
+		int n, j;
+		u64 now_ns;
+
+		while (n_free > 0 && !should_stop_issue(bt, n_writes_synced, is_end)) {
+			if (!submit_io(bt, ctx, free_slots[--n_free]))
+				goto error2;
+		}
+		if (n_free == cfg->qd) {
+			/* No IO is in flight, so it is the end or a fsync point. */
+			if (is_end || (cfg->n_ios > 0 && bt->n_submitted >= cfg->n_ios))
+				break;
+			if (!do_fsync(bt))
+				goto error2;
+			n_writes_synced = bt->n_writes;
+			continue;
+		}
+
+		n = sys_io_getevents(ctx, 1, cfg->qd, events, NULL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			LOGe("io_getevents failed: %s\n", strerror(errno));
+			goto error2;
+		}
+		now_ns = get_ns();
+		if (now_ns >= end_ns)
+			is_end = true;
+		for (j = 0; j < n; j++) {
+			struct io_slot *slot = (struct io_slot *)(uintptr_t)events[j].data;
+
+			if (events[j].res != (s64)cfg->bs) {
+				LOGe("IO failed: offset %llu res %lld\n",
+					(unsigned long long)slot->iocb.aio_offset,
+					(long long)events[j].res);
+				goto error2;
+			}
+			io_stat_add(&bt->stat[slot->is_write ? STAT_WRITE : STAT_READ],
+				cfg->bs, now_ns - slot->begin_ns);
+			free_slots[n_free++] = slot;
+		}
+	}
+
+	sys_io_destroy(ctx);
+	for (i = 0; i < cfg->qd; i++)
+		free(slots[i].buf);
+	free(events);
+	free(free_slots);
+	free(slots);
+	return NULL;
+
+error2:
+	sys_io_destroy(ctx);
+error1:
+	for (i = 0; i < cfg->qd; i++)
+		free(slots[i].buf);
+error0:
+	free(events);
+	free(free_slots);
+	free(slots);
+	bt->is_failed = true;
+	return NULL;
+}
+
+/*******************************************************************************
+ * Report.
+ *******************************************************************************/
+
+static void print_report(const struct bench_config *cfg,
+		const struct io_stat *stat, double elapsed_sec)
+{
+	unsigned int i;
+
+	printf("{\n"
+		"  \"version\": \"%s\",\n"
+		"  \"device\": \"%s\",\n"
+		"  \"config\": {\"threads\": %u, \"qd\": %u, \"bs\": %u, "
+		"\"read_pct\": %u, \"random\": %d, \"fsync\": %u, \"fua\": %u, "
+		"\"hot_pct\": %u, \"hot_size\": %llu, \"offset\": %llu, "
+		"\"size\": %llu, \"runtime\": %u, \"count\": %llu, \"seed\": %u},\n"
+		"  \"elapsed_sec\": %.3f,\n"
+		, WALB_VERSION_STR, cfg->dev_path
+		, cfg->n_threads, cfg->qd, cfg->bs
+		, cfg->read_pct, cfg->is_random, cfg->fsync_interval, cfg->fua_interval
+		, cfg->hot_pct, (unsigned long long)cfg->hot_size
+		, (unsigned long long)cfg->offset
+		, (unsigned long long)cfg->size, cfg->runtime_sec
+		, (unsigned long long)cfg->n_ios, cfg->seed
+		, elapsed_sec);
+	for (i = 0; i < STAT_MAX; i++)
+		io_stat_print_json(stat_name_[i], &stat[i], elapsed_sec, i == STAT_MAX - 1);
+	printf("}\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_config cfg;
+	struct bdev_info info;
+	struct bench_thread *bts;
+	struct io_stat *stat;
+	u64 begin_ns;
+	unsigned int i;
+	int fd;
+	bool is_failed = false;
+
+	init_config(&cfg);
+	if (!parse_opt(argc, argv, &cfg)) {
+		show_help();
+		return 1;
+	}
+	if (!open_bdev_and_get_info(cfg.dev_path, &info, &fd,
+			(cfg.read_pct == 100 ? O_RDONLY : O_RDWR) | O_DIRECT))
+		return 1;
+	if (!check_config(&cfg, &info))
+		goto error0;
+
+	bts = calloc(cfg.n_threads, sizeof(*bts));
+	stat = calloc(STAT_MAX, sizeof(*stat));
+	if (!bts || !stat) {
+		LOGe("memory allocation failed.\n");
+		goto error1;
+	}
+
+	begin_ns = get_ns();
+	for (i = 0; i < cfg.n_threads; i++) {
+		struct bench_thread *bt = &bts[i];
+
+		bt->id = i;
+		bt->cfg = &cfg;
+		bt->fd = fd;
+		/* Non-zero state derived from the seed and the thread id. */
+		bt->rand_state = ((u64)cfg.seed << 32) + i + 1;
+		bt->seq_pos = cfg.size / cfg.bs * i / cfg.n_threads;
+		if (pthread_create(&bt->th, NULL, worker, bt)) {
+			LOGe("pthread_create failed.\n");
+			cfg.n_threads = i;
+			is_failed = true;
+			break;
+		}
+	}
+	for (i = 0; i < cfg.n_threads; i++) {
+		unsigned int j;
+
+		pthread_join(bts[i].th, NULL);
+		is_failed |= bts[i].is_failed;
+		for (j = 0; j < STAT_MAX; j++)
+			io_stat_merge(&stat[j], &bts[i].stat[j]);
+	}
+	if (is_failed)
+		goto error1;
+
+	print_report(&cfg, stat, (get_ns() - begin_ns) / 1e9);
+	free(stat);
+	free(bts);
+	close(fd);
+	return 0;
+
+error1:
+	free(stat);
+	free(bts);
+error0:
+	close(fd);
+	return 1;
+}
+
+/* end of file. */
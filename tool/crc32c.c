@@ -0,0 +1,72 @@
+/**
+ * CRC32C (Castagnoli) for userland tools.
+ * SSE4.2 crc32 instructions are used if the cpu supports them.
+ *
+ * Copyright(C) 2013, Cybozu Labs, Inc.
+ * @license 3-clause BSD, GPL version 2 or later.
+ */
+#include "linux/walb/checksum.h"
+
+/* Reflected polynomial of CRC32C. */
+#define CRC32C_POLY 0x82f63b78
+
+static u32 crc32c_table_[256];
+static bool is_crc32c_table_ready_ = false;
+
+static void init_crc32c_table(void)
+{
+	u32 i, j;
+
+	for (i = 0; i < 256; i++) {
+		u32 crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLY : 0);
+		crc32c_table_[i] = crc;
+	}
+	is_crc32c_table_ready_ = true;
+}
+
+static u32 crc32c_sw(u32 crc, const u8 *p, unsigned int size)
+{
+	if (!is_crc32c_table_ready_)
+		init_crc32c_table();
+	while (size-- > 0)
+		crc = crc32c_table_[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("sse4.2")))
+static u32 crc32c_hw(u32 crc, const u8 *p, unsigned int size)
+{
+	u64 crc64 = crc;
+
+	while (size >= sizeof(u64)) {
+		u64 v;
+		memcpy(&v, p, sizeof(v));
+		crc64 = __builtin_ia32_crc32di(crc64, v);
+		p += sizeof(u64);
+		size -= sizeof(u64);
+	}
+	crc = (u32)crc64;
+	while (size-- > 0)
+		crc = __builtin_ia32_crc32qi(crc, *p++);
+	return crc;
+}
+
+u32 crc32c(u32 crc, const void *data, unsigned int size)
+{
+	static int has_sse42_ = -1;
+
+	if (has_sse42_ < 0)
+		has_sse42_ = __builtin_cpu_supports("sse4.2");
+	if (has_sse42_)
+		return crc32c_hw(crc, (const u8 *)data, size);
+	return crc32c_sw(crc, (const u8 *)data, size);
+}
+#else
+u32 crc32c(u32 crc, const void *data, unsigned int size)
+{
+	return crc32c_sw(crc, (const u8 *)data, size);
+}
+#endif
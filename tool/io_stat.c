@@ -0,0 +1,99 @@
+/**
+ * IO statistics with latency histogram for benchmark tools.
+ *
+ * Copyright(C) 2013, Cybozu Labs, Inc.
+ * @license 3-clause BSD, GPL version 2 or later.
+ */
+#include <stdio.h>
+
+#include "io_stat.h"
+
+static unsigned int lat_to_idx(u64 ns)
+{
+	unsigned int shift;
+
+	if (ns < LAT_SUB)
+		return ns;
+	shift = 63 - __builtin_clzll(ns) - LAT_SUB_BITS;
+	return (shift + 1) * LAT_SUB + ((ns >> shift) & (LAT_SUB - 1));
+}
+
+/**
+ * The lower bound of a bucket [ns].
+ */
+static u64 idx_to_lat(unsigned int idx)
+{
+	const unsigned int group = idx / LAT_SUB;
+	const u64 sub = idx % LAT_SUB;
+
+	if (group == 0)
+		return sub;
+	return (LAT_SUB + sub) << (group - 1);
+}
+
+void io_stat_add(struct io_stat *st, u64 bytes, u64 lat_ns)
+{
+	st->n_ios++;
+	st->bytes += bytes;
+	st->lat_sum_ns += lat_ns;
+	if (st->lat_max_ns < lat_ns)
+		st->lat_max_ns = lat_ns;
+	st->hist[lat_to_idx(lat_ns)]++;
+}
+
+void io_stat_merge(struct io_stat *dst, const struct io_stat *src)
+{
+	unsigned int i;
+
+	dst->n_ios += src->n_ios;
+	dst->bytes += src->bytes;
+	dst->lat_sum_ns += src->lat_sum_ns;
+	if (dst->lat_max_ns < src->lat_max_ns)
+		dst->lat_max_ns = src->lat_max_ns;
+	for (i = 0; i < LAT_HIST_SIZE; i++)
+		dst->hist[i] += src->hist[i];
+}
+
+/**
+ * Get a percentile of latency [ns].
+ *
+ * @permil percentile in 1/1000. 999 for p99.9.
+ */
+u64 io_stat_percentile(const struct io_stat *st, unsigned int permil)
+{
+	const u64 target = (st->n_ios * permil + 999) / 1000;
+	u64 sum = 0;
+	unsigned int i;
+
+	if (st->n_ios == 0)
+		return 0;
+	for (i = 0; i < LAT_HIST_SIZE; i++) {
+		sum += st->hist[i];
+		if (sum >= target && sum > 0)
+			return get_min_value(idx_to_lat(i), st->lat_max_ns);
+	}
+	return st->lat_max_ns;
+}
+
+/**
+ * Print a statistics as a JSON member with two-space indent.
+ */
+void io_stat_print_json(const char *name, const struct io_stat *st,
+		double elapsed_sec, bool is_last)
+{
+	printf("  \"%s\": {\"ios\": %llu, \"bytes\": %llu, "
+		"\"iops\": %.1f, \"bw_bps\": %.1f, "
+		"\"lat_ns\": {\"avg\": %llu, \"p50\": %llu, \"p99\": %llu, "
+		"\"p999\": %llu, \"max\": %llu}}%s\n"
+		, name
+		, (unsigned long long)st->n_ios
+		, (unsigned long long)st->bytes
+		, st->n_ios / elapsed_sec
+		, st->bytes / elapsed_sec
+		, (unsigned long long)io_stat_avg(st)
+		, (unsigned long long)io_stat_percentile(st, 500)
+		, (unsigned long long)io_stat_percentile(st, 990)
+		, (unsigned long long)io_stat_percentile(st, 999)
+		, (unsigned long long)st->lat_max_ns
+		, is_last ? "" : ",");
+}
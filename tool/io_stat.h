@@ -0,0 +1,63 @@
+/**
+ * IO statistics with latency histogram for benchmark tools.
+ *
+ * Copyright(C) 2013, Cybozu Labs, Inc.
+ * @license 3-clause BSD, GPL version 2 or later.
+ */
+#ifndef WALB_IO_STAT_USER_H
+#define WALB_IO_STAT_USER_H
+
+#include <time.h>
+
+#include "linux/walb/common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Log-linear histogram of latencies [ns].
+ * Values less than LAT_SUB are counted exactly and
+ * each power-of-2 range above is split into LAT_SUB buckets,
+ * so the relative error is less than 1/LAT_SUB.
+ */
+#define LAT_SUB_BITS 4
+#define LAT_SUB (1U << LAT_SUB_BITS)
+#define LAT_HIST_SIZE ((64 - LAT_SUB_BITS + 1) * LAT_SUB)
+
+struct io_stat
+{
+	u64 n_ios;
+	u64 bytes;
+	u64 lat_sum_ns;
+	u64 lat_max_ns;
+	u64 hist[LAT_HIST_SIZE];
+};
+
+void io_stat_add(struct io_stat *st, u64 bytes, u64 lat_ns);
+void io_stat_merge(struct io_stat *dst, const struct io_stat *src);
+u64 io_stat_percentile(const struct io_stat *st, unsigned int permil);
+void io_stat_print_json(const char *name, const struct io_stat *st,
+		double elapsed_sec, bool is_last);
+
+static inline u64 io_stat_avg(const struct io_stat *st)
+{
+	return st->n_ios ? st->lat_sum_ns / st->n_ios : 0;
+}
+
+/**
+ * Monotonic clock for latencies [ns].
+ */
+static inline u64 get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WALB_IO_STAT_USER_H */
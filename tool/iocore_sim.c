@@ -0,0 +1,842 @@
+/**
+ * Userland simulator of the walb iocore write/read pipeline.
+ *
+ * The kernel sources treemap.c, pending_io.c and overlapped_io.c
+ * are compiled against the kernel shim (kshim/) and driven by a
+ * single-threaded event loop that emulates the log and data devices in memory:
+ *
+ *   write: pending insert -> log IO -> overlapped check and insert
+ *          -> data IO (completed in random order)
+ *          -> overlapped delete and notify -> pending delete.
+ *          The last two steps are done in the order of the overlapped
+ *          insertion as the kernel waits for the data IOs in order.
+ *   read:  pending check and copy -> read the rest from the data device.
+ *
+ * Every sector holds the lsid of the write that wrote it,
+ * so each read and the final data device image are verified against
+ * the expected image like sim/consistency does.
+ * CPU time spent in the kernel functions is reported per call in JSON.
+ *
+ * Copyright(C) 2013, Cybozu Labs, Inc.
+ * @license 3-clause BSD, GPL version 2 or later.
+ */
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <limits.h>
+
+#include "linux/walb/common.h"
+#include "linux/walb/logger.h"
+#include "treemap.h"
+#include "bio_wrapper.h"
+#include "pending_io.h"
+#include "overlapped_io.h"
+#include "version.h"
+
+#ifndef WALB_OVERLAPPED_SERIALIZE
+#error iocore_sim requires WALB_OVERLAPPED_SERIALIZE.
+#endif
+
+unsigned long kshim_n_warn = 0;
+
+/*******************************************************************************
+ * Configuration.
+ *******************************************************************************/
+
+struct sim_config
+{
+	const char *trace_path; /* NULL means synthetic IOs. */
+	u64 dev_size; /* [logical block]. */
+	unsigned int max_len; /* max IO size [logical block]. */
+	unsigned int read_pct; /* percentage of read IOs. */
+	unsigned int log_qd; /* max number of log IOs in flight. */
+	unsigned int data_qd; /* max number of data IOs in flight. */
+	u64 n_ios; /* number of synthetic IOs. */
+	unsigned int seed;
+};
+
+enum {
+	OPT_TRACE = 1,
+	OPT_SIZE,
+	OPT_MAX_LEN,
+	OPT_READ_PCT,
+	OPT_LOG_QD,
+	OPT_DATA_QD,
+	OPT_COUNT,
+	OPT_SEED,
+	OPT_HELP,
+};
+
+static void show_help(void)
+{
+	printf("Usage: iocore_sim [OPTIONS]\n"
+		"OPTIONS:\n"
+		"  --trace FILE    replay IOs in FILE instead of synthetic IOs.\n"
+		"                  Each line is 'R POS LEN' or 'W POS LEN'\n"
+		"                  in logical blocks. '#' starts a comment.\n"
+		"  --size N        device size [logical block]. (default: 65536)\n"
+		"  --max_len N     max synthetic IO size [logical block]. (default: 64)\n"
+		"  --read_pct N    percentage of synthetic read IOs. (default: 30)\n"
+		"  --log_qd N      max log IOs in flight. (default: 32)\n"
+		"  --data_qd N     max data IOs in flight. (default: 64)\n"
+		"  --count N       number of synthetic IOs. (default: 100000)\n"
+		"  --seed N        random seed. (default: 0)\n"
+		"Results are printed to stdout in JSON.\n"
+		"The exit status is non-zero if an inconsistency is detected.\n");
+}
+
+static void init_config(struct sim_config *cfg)
+{
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->dev_size = 65536;
+	cfg->max_len = 64;
+	cfg->read_pct = 30;
+	cfg->log_qd = 32;
+	cfg->data_qd = 64;
+	cfg->n_ios = 100000;
+}
+
+static bool parse_u64(const char *str, u64 *valp)
+{
+	char *end;
+
+	errno = 0;
+	*valp = strtoull(str, &end, 10);
+	return !errno && end != str && *end == '\0';
+}
+
+static bool parse_uint(const char *str, unsigned int *valp)
+{
+	u64 val;
+
+	if (!parse_u64(str, &val) || val > UINT_MAX)
+		return false;
+	*valp = val;
+	return true;
+}
+
+/**
+ * RETURN:
+ *   true in success.
+ */
+static bool parse_opt(int argc, char *const argv[], struct sim_config *cfg)
+{
+	while (1) {
+		int option_index = 0;
+		bool ret = true;
+		static const struct option long_options[] = {
+			{"trace", 1, 0, OPT_TRACE},
+			{"size", 1, 0, OPT_SIZE},
+			{"max_len", 1, 0, OPT_MAX_LEN},
+			{"read_pct", 1, 0, OPT_READ_PCT},
+			{"log_qd", 1, 0, OPT_LOG_QD},
+			{"data_qd", 1, 0, OPT_DATA_QD},
+			{"count", 1, 0, OPT_COUNT},
+			{"seed", 1, 0, OPT_SEED},
+			{"help", 0, 0, OPT_HELP},
+			{0, 0, 0, 0}
+		};
+
+		int c = getopt_long(argc, argv, "", long_options, &option_index);
+		if (c == -1)
+			break;
+		switch (c) {
+		case OPT_TRACE:
+			cfg->trace_path = optarg;
+			break;
+		case OPT_SIZE:
+			ret = parse_u64(optarg, &cfg->dev_size);
+			break;
+		case OPT_MAX_LEN:
+			ret = parse_uint(optarg, &cfg->max_len);
+			break;
+		case OPT_READ_PCT:
+			ret = parse_uint(optarg, &cfg->read_pct);
+			break;
+		case OPT_LOG_QD:
+			ret = parse_uint(optarg, &cfg->log_qd);
+			break;
+		case OPT_DATA_QD:
+			ret = parse_uint(optarg, &cfg->data_qd);
+			break;
+		case OPT_COUNT:
+			ret = parse_u64(optarg, &cfg->n_ios);
+			break;
+		case OPT_SEED:
+			ret = parse_uint(optarg, &cfg->seed);
+			break;
+		case OPT_HELP:
+		default:
+			return false;
+		}
+		if (!ret) {
+			LOGe("invalid argument: %s\n", optarg);
+			return false;
+		}
+	}
+	if (optind != argc) {
+		LOGe("too many arguments.\n");
+		return false;
+	}
+	if (cfg->dev_size == 0 || cfg->max_len == 0 || cfg->max_len > cfg->dev_size) {
+		LOGe("max_len must be in [1, size].\n");
+		return false;
+	}
+	if (cfg->read_pct > 100) {
+		LOGe("read_pct must be <= 100.\n");
+		return false;
+	}
+	if (cfg->log_qd == 0 || cfg->data_qd == 0) {
+		LOGe("log_qd and data_qd must be positive.\n");
+		return false;
+	}
+	return true;
+}
+
+/*******************************************************************************
+ * Simulated IOs and the mock block layer.
+ *******************************************************************************/
+
+/**
+ * An IO with its contents.
+ * Each element of buf is the lsid of the write IO which wrote the block.
+ */
+struct sim_io
+{
+	struct bio_wrapper biow;
+	struct bio bio;
+	u64 *buf;
+	bool *copied; /* for read IOs. */
+	bool is_done; /* data IO of a write has completed. */
+};
+
+static struct sim_io *alloc_sim_io(bool is_write, u64 pos, unsigned int len)
+{
+	struct sim_io *sio = calloc(1, sizeof(*sio));
+
+	if (!sio)
+		return NULL;
+	sio->buf = calloc(len, sizeof(u64));
+	sio->copied = is_write ? NULL : calloc(len, sizeof(bool));
+	if (!sio->buf || (!is_write && !sio->copied)) {
+		free(sio->buf);
+		free(sio);
+		return NULL;
+	}
+	sio->bio.bi_opf = is_write ? REQ_OP_WRITE : REQ_OP_READ;
+	sio->bio.bi_iter.bi_sector = pos;
+	sio->bio.bi_iter.bi_size = len << 9;
+	init_bio_wrapper(&sio->biow, &sio->bio);
+	if (is_write)
+		sio->biow.copied_bio = &sio->bio;
+	sio->biow.private_data = sio;
+	return sio;
+}
+
+static void free_sim_io(struct sim_io *sio)
+{
+	free(sio->copied);
+	free(sio->buf);
+	free(sio);
+}
+
+void init_bio_wrapper(struct bio_wrapper *biow, struct bio *bio)
+{
+	memset(biow, 0, sizeof(*biow));
+	INIT_LIST_HEAD(&biow->list);
+	INIT_LIST_HEAD(&biow->list2);
+	INIT_LIST_HEAD(&biow->list3);
+	INIT_LIST_HEAD(&biow->list4);
+	biow->bio = bio;
+	biow->pos = bio->bi_iter.bi_sector;
+	biow->len = bio_sectors(bio);
+	init_completion(&biow->done);
+	biow->n_overlapped = -1;
+}
+
+/**
+ * Copy the overlapped area of a pending write to a read.
+ */
+bool bio_wrapper_copy_overlapped(
+	struct bio_wrapper *dst, struct bio_wrapper *src, gfp_t gfp_mask)
+{
+	struct sim_io *dsio = dst->private_data;
+	struct sim_io *ssio = src->private_data;
+	const u64 begin = get_max_value(dst->pos, src->pos);
+	const u64 end = get_min_value(dst->pos + dst->len, src->pos + src->len);
+	u64 pos;
+
+	for (pos = begin; pos < end; pos++) {
+		dsio->buf[pos - dst->pos] = ssio->buf[pos - src->pos];
+		dsio->copied[pos - dst->pos] = true;
+	}
+	return true;
+}
+
+void bio_wrapper_endio_copied(struct bio_wrapper *biow)
+{
+	/* Nothing to do because the uncopied area is read afterward. */
+}
+
+void print_bio_wrapper(const char *level, const struct bio_wrapper *biow)
+{
+	printk("%sbiow %p pos %" PRIu64 " len %u lsid %" PRIu64 "\n"
+		, level, biow, (u64)biow->pos, biow->len, biow->lsid);
+}
+
+/*******************************************************************************
+ * Simulator.
+ *******************************************************************************/
+
+enum {
+	FN_PENDING_INSERT = 0,
+	FN_PENDING_CHECK_AND_COPY,
+	FN_PENDING_DELETE,
+	FN_OVERLAPPED_CHECK_AND_INSERT,
+	FN_OVERLAPPED_DELETE_AND_NOTIFY,
+	FN_MAX,
+};
+
+static const char *fn_name_[FN_MAX] = {
+	"pending_insert_and_delete_fully_overwritten",
+	"pending_check_and_copy",
+	"pending_delete",
+	"overlapped_check_and_insert",
+	"overlapped_delete_and_notify",
+};
+
+struct fn_stat
+{
+	u64 n_calls;
+	u64 ns;
+};
+
+struct sim
+{
+	const struct sim_config *cfg;
+	u64 rand_state;
+
+	u64 *ddev; /* data device image. */
+	u64 *expected; /* image that reads must see. */
+	u64 next_lsid;
+
+	struct treemap_memory_manager mmgr;
+	struct multimap *pending_data;
+	unsigned int max_sectors_in_pending;
+	unsigned int pending_sectors;
+	unsigned int max_pending_sectors_seen;
+	struct multimap *overlapped_data;
+	unsigned int max_sectors_in_overlapped;
+#ifdef WALB_DEBUG
+	u64 overlapped_in_id;
+	u64 overlapped_out_id;
+#endif
+
+	struct list_head log_list; /* log IOs in flight in lsid order. */
+	unsigned int n_log_inflight;
+	struct sim_io **data_inflight; /* data IOs in flight. */
+	unsigned int n_data_inflight;
+	unsigned int data_inflight_cap;
+	/* writes whose log IOs have completed in the overlapped insertion order. */
+	struct list_head wait_list;
+
+	/* Statistics. */
+	u64 n_read;
+	u64 n_write;
+	u64 n_read_copied; /* reads that copied pending data. */
+	u64 n_overlap_delay;
+	u64 n_overwritten;
+	u64 n_mismatch;
+	struct fn_stat fn_stat[FN_MAX];
+};
+
+static u64 get_ns(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * CLOCK_MONOTONIC is much cheaper than CLOCK_PROCESS_CPUTIME_ID
+ * and the simulator never sleeps, so it is used for each call.
+ */
+#define SIM_CALL(sim, fn, expr) ({					\
+			const u64 __begin = get_ns(CLOCK_MONOTONIC);	\
+			typeof(expr) __ret = (expr);			\
+			(sim)->fn_stat[fn].ns +=			\
+				get_ns(CLOCK_MONOTONIC) - __begin;	\
+			(sim)->fn_stat[fn].n_calls++;			\
+			__ret;						\
+		})
+
+/**
+ * xorshift64*. Deterministic for a seed, so runs are reproducible.
+ */
+static u64 rand_next(struct sim *sim)
+{
+	u64 x = sim->rand_state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	sim->rand_state = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+static bool init_sim(struct sim *sim, const struct sim_config *cfg)
+{
+	memset(sim, 0, sizeof(*sim));
+	sim->cfg = cfg;
+	sim->rand_state = ((u64)cfg->seed << 32) + 1;
+	sim->next_lsid = 1;
+	INIT_LIST_HEAD(&sim->log_list);
+	INIT_LIST_HEAD(&sim->wait_list);
+
+	sim->ddev = calloc(cfg->dev_size, sizeof(u64));
+	sim->expected = calloc(cfg->dev_size, sizeof(u64));
+	sim->data_inflight_cap = 16;
+	sim->data_inflight = malloc(sizeof(struct sim_io *) * sim->data_inflight_cap);
+	if (!sim->ddev || !sim->expected || !sim->data_inflight) {
+		LOGe("memory allocation failed.\n");
+		goto error0;
+	}
+	if (!initialize_treemap_memory_manager_kmalloc(&sim->mmgr, 1)) {
+		LOGe("memory manager initialization failed.\n");
+		goto error0;
+	}
+	sim->pending_data = multimap_create(GFP_KERNEL, &sim->mmgr);
+	sim->overlapped_data = multimap_create(GFP_KERNEL, &sim->mmgr);
+	if (!sim->pending_data || !sim->overlapped_data) {
+		LOGe("multimap_create failed.\n");
+		goto error1;
+	}
+	return true;
+
+error1:
+	if (sim->overlapped_data)
+		multimap_destroy(sim->overlapped_data);
+	if (sim->pending_data)
+		multimap_destroy(sim->pending_data);
+	finalize_treemap_memory_manager(&sim->mmgr);
+error0:
+	free(sim->data_inflight);
+	free(sim->expected);
+	free(sim->ddev);
+	return false;
+}
+
+static void exit_sim(struct sim *sim)
+{
+	ASSERT(list_empty(&sim->log_list));
+	ASSERT(sim->n_data_inflight == 0);
+	ASSERT(list_empty(&sim->wait_list));
+
+	multimap_destroy(sim->overlapped_data);
+	multimap_destroy(sim->pending_data);
+	finalize_treemap_memory_manager(&sim->mmgr);
+	free(sim->data_inflight);
+	free(sim->expected);
+	free(sim->ddev);
+}
+
+static bool push_data_inflight(struct sim *sim, struct sim_io *sio)
+{
+	if (sim->n_data_inflight == sim->data_inflight_cap) {
+		const unsigned int cap = sim->data_inflight_cap * 2;
+		struct sim_io **p = realloc(sim->data_inflight, sizeof(*p) * cap);
+		if (!p) {
+			LOGe("memory allocation failed.\n");
+			return false;
+		}
+		sim->data_inflight = p;
+		sim->data_inflight_cap = cap;
+	}
+	sim->data_inflight[sim->n_data_inflight++] = sio;
+	return true;
+}
+
+/**
+ * Accept a write IO: assign lsid, insert it to pending data
+ * and submit its log IO.
+ */
+static bool issue_write(struct sim *sim, u64 pos, unsigned int len)
+{
+	struct sim_io *sio = alloc_sim_io(true, pos, len);
+	struct bio_wrapper *biow;
+	unsigned int i;
+
+	if (!sio) {
+		LOGe("memory allocation failed.\n");
+		return false;
+	}
+	biow = &sio->biow;
+	biow->lsid = sim->next_lsid++;
+	for (i = 0; i < len; i++) {
+		sio->buf[i] = biow->lsid;
+		sim->expected[pos + i] = biow->lsid;
+	}
+
+	sim->pending_sectors += len;
+	if (sim->pending_sectors > sim->max_pending_sectors_seen)
+		sim->max_pending_sectors_seen = sim->pending_sectors;
+	if (!SIM_CALL(sim, FN_PENDING_INSERT,
+			pending_insert_and_delete_fully_overwritten(
+				sim->pending_data, &sim->max_sectors_in_pending,
+				biow, GFP_NOIO))) {
+		free_sim_io(sio);
+		return false;
+	}
+	list_add_tail(&biow->list, &sim->log_list);
+	sim->n_log_inflight++;
+	sim->n_write++;
+	return true;
+}
+
+/**
+ * Complete the oldest log IOs and submit their data IOs
+ * unless they are delayed due to overlapped data IOs in flight.
+ */
+static bool complete_log(struct sim *sim, unsigned int n)
+{
+	while (n > 0 && !list_empty(&sim->log_list)) {
+		struct bio_wrapper *biow =
+			list_first_entry(&sim->log_list, struct bio_wrapper, list);
+
+		list_del(&biow->list);
+		sim->n_log_inflight--;
+		n--;
+		if (!SIM_CALL(sim, FN_OVERLAPPED_CHECK_AND_INSERT,
+				overlapped_check_and_insert(
+					sim->overlapped_data,
+					&sim->max_sectors_in_overlapped,
+					biow, GFP_NOIO
+#ifdef WALB_DEBUG
+					, &sim->overlapped_in_id
+#endif
+					))) {
+			return false;
+		}
+		list_add_tail(&biow->list, &sim->wait_list);
+		if (bio_wrapper_state_is_delayed(biow)) {
+			sim->n_overlap_delay++;
+			continue;
+		}
+		if (!push_data_inflight(sim, biow->private_data))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Finish a write whose data IO has completed
+ * like wait_for_write_bio_wrapper().
+ */
+static bool finish_write(struct sim *sim, struct sim_io *sio)
+{
+	struct bio_wrapper *biow = &sio->biow;
+	struct bio_wrapper *biow_tmp, *biow_next;
+	struct list_head should_submit_list;
+
+	INIT_LIST_HEAD(&should_submit_list);
+	SIM_CALL(sim, FN_OVERLAPPED_DELETE_AND_NOTIFY,
+		overlapped_delete_and_notify(
+			sim->overlapped_data, &sim->max_sectors_in_overlapped,
+			&should_submit_list, biow
+#ifdef WALB_DEBUG
+			, &sim->overlapped_out_id
+#endif
+			));
+	list_for_each_entry_safe(biow_tmp, biow_next, &should_submit_list, list4) {
+		list_del(&biow_tmp->list4);
+		if (!push_data_inflight(sim, biow_tmp->private_data))
+			return false;
+	}
+
+	sim->pending_sectors -= biow->len;
+	if (bio_wrapper_state_is_overwritten(biow)) {
+		sim->n_overwritten++;
+	} else {
+		SIM_CALL(sim, FN_PENDING_DELETE,
+			(pending_delete(sim->pending_data,
+					&sim->max_sectors_in_pending, biow), 0));
+	}
+	free_sim_io(sio);
+	return true;
+}
+
+/**
+ * Complete a data IO in flight at random.
+ * The writes are finished in order from the oldest one
+ * as far as their data IOs have completed.
+ */
+static bool complete_data(struct sim *sim)
+{
+	const unsigned int idx = rand_next(sim) % sim->n_data_inflight;
+	struct sim_io *sio = sim->data_inflight[idx];
+	struct bio_wrapper *biow = &sio->biow;
+	unsigned int i;
+
+	sim->data_inflight[idx] = sim->data_inflight[--sim->n_data_inflight];
+	for (i = 0; i < biow->len; i++)
+		sim->ddev[biow->pos + i] = sio->buf[i];
+	sio->is_done = true;
+
+	while (!list_empty(&sim->wait_list)) {
+		biow = list_first_entry(&sim->wait_list, struct bio_wrapper, list);
+		sio = biow->private_data;
+		if (!sio->is_done)
+			break;
+		list_del(&biow->list);
+		if (!finish_write(sim, sio))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Read IO: copy pending data first then read the rest from the data device.
+ * The result must be the same as the expected image.
+ */
+static bool issue_read(struct sim *sim, u64 pos, unsigned int len)
+{
+	struct sim_io *sio = alloc_sim_io(false, pos, len);
+	bool is_copied = false;
+	unsigned int i;
+
+	if (!sio) {
+		LOGe("memory allocation failed.\n");
+		return false;
+	}
+	if (!SIM_CALL(sim, FN_PENDING_CHECK_AND_COPY,
+			pending_check_and_copy(
+				sim->pending_data, sim->max_sectors_in_pending,
+				&sio->biow, GFP_NOIO))) {
+		free_sim_io(sio);
+		return false;
+	}
+	for (i = 0; i < len; i++) {
+		if (sio->copied[i])
+			is_copied = true;
+		else
+			sio->buf[i] = sim->ddev[pos + i];
+		if (sio->buf[i] != sim->expected[pos + i]) {
+			if (sim->n_mismatch < 10) {
+				LOGe("read mismatch: pos %" PRIu64 " got lsid %" PRIu64
+					" expected lsid %" PRIu64 "\n"
+					, pos + i, sio->buf[i], sim->expected[pos + i]);
+			}
+			sim->n_mismatch++;
+		}
+	}
+	if (is_copied)
+		sim->n_read_copied++;
+	sim->n_read++;
+	free_sim_io(sio);
+	return true;
+}
+
+/**
+ * Let the simulated devices make progress.
+ * Each device completes an IO with probability 1/2 for each new IO,
+ * which is less than the arrival rate, so the queues are almost full.
+ * Queue depths are kept.
+ */
+static bool progress(struct sim *sim)
+{
+	const struct sim_config *cfg = sim->cfg;
+	unsigned int n;
+
+	n = rand_next(sim) % 2;
+	if (sim->n_log_inflight >= cfg->log_qd)
+		n = get_max_value(n, sim->n_log_inflight - cfg->log_qd + 1);
+	if (!complete_log(sim, n))
+		return false;
+
+	n = rand_next(sim) % 2;
+	while (sim->n_data_inflight > 0 &&
+		(n > 0 || sim->n_data_inflight >= cfg->data_qd)) {
+		if (!complete_data(sim))
+			return false;
+		if (n > 0)
+			n--;
+	}
+	return true;
+}
+
+static bool drain(struct sim *sim)
+{
+	while (sim->n_log_inflight > 0 || sim->n_data_inflight > 0) {
+		if (!complete_log(sim, sim->n_log_inflight))
+			return false;
+		while (sim->n_data_inflight > 0) {
+			if (!complete_data(sim))
+				return false;
+		}
+	}
+	return true;
+}
+
+static bool do_io(struct sim *sim, bool is_write, u64 pos, unsigned int len)
+{
+	if (!progress(sim))
+		return false;
+	if (is_write)
+		return issue_write(sim, pos, len);
+	else
+		return issue_read(sim, pos, len);
+}
+
+static bool run_synthetic(struct sim *sim)
+{
+	const struct sim_config *cfg = sim->cfg;
+	u64 i;
+
+	for (i = 0; i < cfg->n_ios; i++) {
+		const bool is_write = rand_next(sim) % 100 >= cfg->read_pct;
+		const unsigned int len = rand_next(sim) % cfg->max_len + 1;
+		const u64 pos = rand_next(sim) % (cfg->dev_size - len + 1);
+
+		if (!do_io(sim, is_write, pos, len))
+			return false;
+	}
+	return true;
+}
+
+static bool run_trace(struct sim *sim)
+{
+	const struct sim_config *cfg = sim->cfg;
+	FILE *fp;
+	char line[256];
+	unsigned int lineno = 0;
+	bool ret = true;
+
+	fp = fopen(cfg->trace_path, "r");
+	if (!fp) {
+		LOGe("open %s failed: %s\n", cfg->trace_path, strerror(errno));
+		return false;
+	}
+	while (ret && fgets(line, sizeof(line), fp)) {
+		char type;
+		unsigned long long pos;
+		unsigned int len;
+		char *p = line;
+
+		lineno++;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (*p == '#' || *p == '\n' || *p == '\0')
+			continue;
+		if (sscanf(p, "%c %llu %u", &type, &pos, &len) != 3 ||
+			(type != 'R' && type != 'W') ||
+			len == 0 || len > cfg->dev_size || pos > cfg->dev_size - len) {
+			LOGe("%s:%u: invalid line.\n", cfg->trace_path, lineno);
+			ret = false;
+			break;
+		}
+		ret = do_io(sim, type == 'W', pos, len);
+	}
+	fclose(fp);
+	return ret;
+}
+
+/**
+ * Compare the data device image with the expected one.
+ */
+static void verify_ddev(struct sim *sim)
+{
+	u64 pos;
+
+	for (pos = 0; pos < sim->cfg->dev_size; pos++) {
+		if (sim->ddev[pos] == sim->expected[pos])
+			continue;
+		if (sim->n_mismatch < 10) {
+			LOGe("data device mismatch: pos %" PRIu64 " lsid %" PRIu64
+				" expected lsid %" PRIu64 "\n"
+				, pos, sim->ddev[pos], sim->expected[pos]);
+		}
+		sim->n_mismatch++;
+	}
+}
+
+static void print_report(const struct sim *sim, u64 cpu_ns, bool is_consistent)
+{
+	const struct sim_config *cfg = sim->cfg;
+	const u64 n_ios = sim->n_read + sim->n_write;
+	unsigned int i;
+
+	printf("{\n"
+		"  \"version\": \"%s\",\n"
+		"  \"config\": {\"trace\": \"%s\", \"size\": %" PRIu64 ", "
+		"\"max_len\": %u, \"read_pct\": %u, \"log_qd\": %u, "
+		"\"data_qd\": %u, \"count\": %" PRIu64 ", \"seed\": %u},\n"
+		"  \"consistent\": %s,\n"
+		"  \"mismatch\": %" PRIu64 ",\n"
+		"  \"warnings\": %lu,\n"
+		"  \"read\": %" PRIu64 ",\n"
+		"  \"write\": %" PRIu64 ",\n"
+		"  \"read_copied\": %" PRIu64 ",\n"
+		"  \"overlap_delay\": %" PRIu64 ",\n"
+		"  \"overwritten\": %" PRIu64 ",\n"
+		"  \"max_pending_sectors\": %u,\n"
+		"  \"cpu_ns_per_io\": %.1f,\n"
+		"  \"ns_per_call\": {\n"
+		, WALB_VERSION_STR
+		, cfg->trace_path ? cfg->trace_path : ""
+		, cfg->dev_size, cfg->max_len, cfg->read_pct
+		, cfg->log_qd, cfg->data_qd, cfg->n_ios, cfg->seed
+		, is_consistent ? "true" : "false"
+		, sim->n_mismatch, kshim_n_warn
+		, sim->n_read, sim->n_write, sim->n_read_copied
+		, sim->n_overlap_delay, sim->n_overwritten
+		, sim->max_pending_sectors_seen
+		, n_ios ? (double)cpu_ns / n_ios : 0.0);
+	for (i = 0; i < FN_MAX; i++) {
+		const struct fn_stat *st = &sim->fn_stat[i];
+		printf("    \"%s\": %.1f%s\n"
+			, fn_name_[i]
+			, st->n_calls ? (double)st->ns / st->n_calls : 0.0
+			, i == FN_MAX - 1 ? "" : ",");
+	}
+	printf("  }\n"
+		"}\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct sim_config cfg;
+	struct sim sim;
+	u64 begin_ns, cpu_ns;
+	bool ret, is_consistent;
+
+	init_config(&cfg);
+	if (!parse_opt(argc, argv, &cfg)) {
+		show_help();
+		return 1;
+	}
+	if (!init_sim(&sim, &cfg))
+		return 1;
+
+	begin_ns = get_ns(CLOCK_PROCESS_CPUTIME_ID);
+	if (cfg.trace_path)
+		ret = run_trace(&sim);
+	else
+		ret = run_synthetic(&sim);
+	if (ret)
+		ret = drain(&sim);
+	cpu_ns = get_ns(CLOCK_PROCESS_CPUTIME_ID) - begin_ns;
+	if (!ret) {
+		LOGe("simulation failed.\n");
+		return 1;
+	}
+
+	verify_ddev(&sim);
+	is_consistent = sim.n_mismatch == 0 && kshim_n_warn == 0 &&
+		multimap_is_empty(sim.pending_data) &&
+		multimap_is_empty(sim.overlapped_data);
+	print_report(&sim, cpu_ns, is_consistent);
+	exit_sim(&sim);
+	return is_consistent ? 0 : 1;
+}
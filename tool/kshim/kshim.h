@@ -0,0 +1,419 @@
+/**
+ * kshim.h - Minimal kernel API shim to build walb kernel sources in userland.
+ *
+ * Only what treemap.c, pending_io.c and overlapped_io.c require is provided.
+ * Locks are no-ops because the users of this shim are single-threaded.
+ * linux/xxx.h headers in this directory just include this file.
+ */
+#ifndef WALB_KSHIM_H
+#define WALB_KSHIM_H
+
+#ifndef __KERNEL__
+#error Define __KERNEL__ to use the kernel shim.
+#endif
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+
+/*
+ * kern.h defines struct walb_dev and depends on almost all the kernel.
+ * The shimmed sources do not use it, so skip it
+ * and provide the walb headers it includes at the end of this file.
+ */
+#define WALB_KERN_H_KERNEL
+
+/*******************************************************************************
+ * Types.
+ *******************************************************************************/
+
+typedef unsigned char u8;
+typedef unsigned short u16;
+typedef unsigned int u32;
+typedef unsigned long long u64;
+typedef signed char s8;
+typedef short s16;
+typedef int s32;
+typedef long long s64;
+typedef unsigned int uint;
+typedef unsigned long ulong;
+typedef u64 sector_t;
+typedef unsigned int gfp_t;
+typedef u8 blk_status_t;
+
+#define U8_MAX ((u8)~0U)
+#define U16_MAX ((u16)~0U)
+#define U32_MAX ((u32)~0U)
+#define U64_MAX ((u64)~0ULL)
+
+/*******************************************************************************
+ * Compiler and misc macros.
+ *******************************************************************************/
+
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define min(x, y) ((x) < (y) ? (x) : (y))
+#define max(x, y) ((x) > (y) ? (x) : (y))
+
+#define MODULE_LICENSE(x)
+#define EXPORT_SYMBOL(x)
+#define EXPORT_SYMBOL_GPL(x)
+
+#define KERN_EMERG ""
+#define KERN_ALERT ""
+#define KERN_CRIT ""
+#define KERN_ERR ""
+#define KERN_ERROR ""
+#define KERN_WARNING ""
+#define KERN_NOTICE ""
+#define KERN_INFO ""
+#define KERN_DEBUG ""
+
+#define printk(...) fprintf(stderr, __VA_ARGS__)
+#define pr_warn_ratelimited(...) fprintf(stderr, __VA_ARGS__)
+#define pr_debug(...)
+
+/*
+ * WARN() does not stop the program like the kernel,
+ * but the count is kept to let the caller detect failures.
+ */
+extern unsigned long kshim_n_warn;
+
+#define WARN(cond, ...) ({					\
+			int __ret = !!(cond);			\
+			if (unlikely(__ret)) {			\
+				kshim_n_warn++;			\
+				fprintf(stderr, __VA_ARGS__);	\
+			}					\
+			__ret;					\
+		})
+#define WARN_ON(cond) ({						\
+			int __ret = !!(cond);				\
+			if (unlikely(__ret)) {				\
+				kshim_n_warn++;				\
+				fprintf(stderr, "WARNING at %s:%d %s()\n", \
+					__FILE__, __LINE__, __func__);	\
+			}						\
+			__ret;						\
+		})
+#define BUG() abort()
+#define BUG_ON(cond) do { if (unlikely(cond)) { BUG(); } } while (0)
+
+/*******************************************************************************
+ * Bit operations and atomic counters (not atomic).
+ *******************************************************************************/
+
+#define BITS_PER_LONG (8 * sizeof(unsigned long))
+
+static inline void set_bit(int nr, unsigned long *addr)
+{
+	addr[nr / BITS_PER_LONG] |= 1UL << (nr % BITS_PER_LONG);
+}
+static inline void clear_bit(int nr, unsigned long *addr)
+{
+	addr[nr / BITS_PER_LONG] &= ~(1UL << (nr % BITS_PER_LONG));
+}
+static inline int test_bit(int nr, const unsigned long *addr)
+{
+	return (addr[nr / BITS_PER_LONG] >> (nr % BITS_PER_LONG)) & 1UL;
+}
+static inline int test_and_set_bit(int nr, unsigned long *addr)
+{
+	const int old = test_bit(nr, addr);
+	set_bit(nr, addr);
+	return old;
+}
+static inline int test_and_clear_bit(int nr, unsigned long *addr)
+{
+	const int old = test_bit(nr, addr);
+	clear_bit(nr, addr);
+	return old;
+}
+
+typedef struct { int counter; } atomic_t;
+#define atomic_read(v) ((v)->counter)
+#define atomic_set(v, i) ((v)->counter = (i))
+#define atomic_inc(v) ((v)->counter++)
+#define atomic_dec(v) ((v)->counter--)
+
+typedef int spinlock_t;
+#define spin_lock_init(lock) (*(lock) = 0)
+#define spin_lock(lock) do { (void)(lock); } while (0)
+#define spin_unlock(lock) do { (void)(lock); } while (0)
+
+/*******************************************************************************
+ * Memory allocation.
+ *******************************************************************************/
+
+#define GFP_KERNEL 0x1U
+#define GFP_ATOMIC 0x2U
+#define GFP_NOIO 0x4U
+
+#define kmalloc(size, gfp) malloc(size)
+#define kzalloc(size, gfp) calloc(1, size)
+#define krealloc(p, size, gfp) realloc(p, size)
+#define kfree(p) free(p)
+
+struct kmem_cache
+{
+	size_t size;
+};
+
+static inline struct kmem_cache *kmem_cache_create(
+	const char *name, size_t size, size_t align,
+	unsigned long flags, void (*ctor)(void *))
+{
+	struct kmem_cache *cache = malloc(sizeof(*cache));
+	if (cache)
+		cache->size = size;
+	return cache;
+}
+static inline void kmem_cache_destroy(struct kmem_cache *cache)
+{
+	free(cache);
+}
+
+typedef struct mempool_s
+{
+	size_t size;
+} mempool_t;
+
+static inline mempool_t *mempool_create_kmalloc_pool(int min_nr, size_t size)
+{
+	mempool_t *pool = malloc(sizeof(*pool));
+	if (pool)
+		pool->size = size;
+	return pool;
+}
+static inline mempool_t *mempool_create_slab_pool(
+	int min_nr, struct kmem_cache *cache)
+{
+	return mempool_create_kmalloc_pool(min_nr, cache->size);
+}
+static inline void mempool_destroy(mempool_t *pool)
+{
+	free(pool);
+}
+static inline void *mempool_alloc(mempool_t *pool, gfp_t gfp_mask)
+{
+	return malloc(pool->size);
+}
+static inline void mempool_free(void *element, mempool_t *pool)
+{
+	free(element);
+}
+
+/*******************************************************************************
+ * Doubly linked lists.
+ *******************************************************************************/
+
+struct list_head
+{
+	struct list_head *next, *prev;
+};
+
+#define LIST_HEAD_INIT(name) { &(name), &(name) }
+#define LIST_HEAD(name) struct list_head name = LIST_HEAD_INIT(name)
+
+static inline void INIT_LIST_HEAD(struct list_head *list)
+{
+	list->next = list;
+	list->prev = list;
+}
+static inline void __list_add(
+	struct list_head *new, struct list_head *prev, struct list_head *next)
+{
+	next->prev = new;
+	new->next = next;
+	new->prev = prev;
+	prev->next = new;
+}
+static inline void list_add(struct list_head *new, struct list_head *head)
+{
+	__list_add(new, head, head->next);
+}
+static inline void list_add_tail(struct list_head *new, struct list_head *head)
+{
+	__list_add(new, head->prev, head);
+}
+static inline void __list_del_entry(struct list_head *entry)
+{
+	entry->next->prev = entry->prev;
+	entry->prev->next = entry->next;
+}
+static inline void list_del(struct list_head *entry)
+{
+	__list_del_entry(entry);
+	entry->next = NULL;
+	entry->prev = NULL;
+}
+static inline void list_del_init(struct list_head *entry)
+{
+	__list_del_entry(entry);
+	INIT_LIST_HEAD(entry);
+}
+static inline void list_move_tail(struct list_head *list, struct list_head *head)
+{
+	__list_del_entry(list);
+	list_add_tail(list, head);
+}
+static inline int list_empty(const struct list_head *head)
+{
+	return head->next == head;
+}
+
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+#define list_first_entry(ptr, type, member) \
+	list_entry((ptr)->next, type, member)
+#define list_next_entry(pos, member) \
+	list_entry((pos)->member.next, typeof(*(pos)), member)
+#define list_for_each_entry(pos, head, member)				\
+	for (pos = list_first_entry(head, typeof(*pos), member);	\
+	     &pos->member != (head);					\
+	     pos = list_next_entry(pos, member))
+#define list_for_each_entry_safe(pos, n, head, member)			\
+	for (pos = list_first_entry(head, typeof(*pos), member),	\
+		     n = list_next_entry(pos, member);			\
+	     &pos->member != (head);					\
+	     pos = n, n = list_next_entry(n, member))
+
+struct hlist_head
+{
+	struct hlist_node *first;
+};
+struct hlist_node
+{
+	struct hlist_node *next, **pprev;
+};
+
+#define INIT_HLIST_HEAD(ptr) ((ptr)->first = NULL)
+
+static inline int hlist_empty(const struct hlist_head *h)
+{
+	return !h->first;
+}
+static inline void hlist_add_head(struct hlist_node *n, struct hlist_head *h)
+{
+	struct hlist_node *first = h->first;
+	n->next = first;
+	if (first)
+		first->pprev = &n->next;
+	h->first = n;
+	n->pprev = &h->first;
+}
+static inline void hlist_del(struct hlist_node *n)
+{
+	struct hlist_node *next = n->next;
+	struct hlist_node **pprev = n->pprev;
+	*pprev = next;
+	if (next)
+		next->pprev = pprev;
+	n->next = NULL;
+	n->pprev = NULL;
+}
+
+#define hlist_entry(ptr, type, member) container_of(ptr, type, member)
+#define hlist_entry_safe(ptr, type, member) ({				\
+			typeof(ptr) ____ptr = (ptr);			\
+			____ptr ? hlist_entry(____ptr, type, member) : NULL; \
+		})
+#define hlist_for_each(pos, head) \
+	for (pos = (head)->first; pos; pos = pos->next)
+#define hlist_for_each_entry_safe(pos, n, head, member)			\
+	for (pos = hlist_entry_safe((head)->first, typeof(*pos), member); \
+	     pos && ({ n = pos->member.next; 1; });			\
+	     pos = hlist_entry_safe(n, typeof(*pos), member))
+
+/*******************************************************************************
+ * Red-black tree (tool/lib/rbtree.c).
+ *******************************************************************************/
+
+#include "../include/rbtree.h"
+
+/*******************************************************************************
+ * Block layer.
+ *******************************************************************************/
+
+#define DISK_NAME_LEN 32
+
+struct block_device;
+struct gendisk;
+
+enum req_opf
+{
+	REQ_OP_READ = 0,
+	REQ_OP_WRITE = 1,
+	REQ_OP_FLUSH = 2,
+	REQ_OP_DISCARD = 3,
+	REQ_OP_WRITE_SAME = 7,
+	REQ_OP_WRITE_ZEROES = 9,
+};
+
+#define REQ_OP_BITS 8
+#define REQ_OP_MASK ((1 << REQ_OP_BITS) - 1)
+
+struct bvec_iter
+{
+	sector_t bi_sector;
+	unsigned int bi_size;
+	unsigned int bi_idx;
+	unsigned int bi_bvec_done;
+};
+
+struct bio
+{
+	struct bio *bi_next;
+	unsigned int bi_opf;
+	blk_status_t bi_status;
+	struct bvec_iter bi_iter;
+	void *bi_private;
+};
+
+struct bio_list
+{
+	struct bio *head;
+	struct bio *tail;
+};
+
+#define bio_op(bio) ((bio)->bi_opf & REQ_OP_MASK)
+#define op_is_write(op) ((op) & 1)
+#define bio_sectors(bio) ((bio)->bi_iter.bi_size >> 9)
+
+struct completion
+{
+	unsigned int done;
+};
+
+static inline void init_completion(struct completion *x)
+{
+	x->done = 0;
+}
+static inline void complete(struct completion *x)
+{
+	x->done++;
+}
+
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct *work);
+struct work_struct
+{
+	work_func_t func;
+};
+
+#define INIT_WORK(work, f) ((work)->func = (f))
+
+/*******************************************************************************
+ * Substitute for kern.h.
+ *******************************************************************************/
+
+#include "linux/walb/logger.h"
+#include "linux/walb/check.h"
+
+#endif /* WALB_KSHIM_H */
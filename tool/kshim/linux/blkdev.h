@@ -0,0 +1,2 @@
+/* Userland shim. See ../kshim.h. */
+#include "../kshim.h"
@@ -6,29 +6,87 @@
  * @license 3-clause BSD, GPL version 2 or later.
  */
 #include <string.h>
+#include <stdlib.h>
 
 #include "linux/walb/block_size.h"
 #include "linux/walb/logger.h"
 #include "util.h"
 #include "walb_util.h"
 #include "logpack.h"
+#include "lz4.h"
 
 /*******************************************************************************
  * Private functions.
  *******************************************************************************/
 
+/**
+ * Get the size of log data to be checksummed [byte].
+ * For compressed records, that is the whole data in the log.
+ */
+static unsigned int get_log_record_checksum_size(
+	const struct walb_log_record *rec, unsigned int pbs)
+{
+	if (test_bit_u32(LOG_RECORD_COMPRESSED, &rec->flags))
+		return rec->compressed_pb * pbs;
+	return rec->io_size * LOGICAL_BLOCK_SIZE;
+}
+
+/**
+ * Decompress the data of a compressed log record.
+ *
+ * @rec log record.
+ * @sect_ary sector array containing the log data.
+ * @idx_pb index of the log data in the sector array [physical block].
+ * @buf buffer of rec->io_size logical blocks at least.
+ *
+ * RETURN:
+ *   true in success, or false if the data are broken.
+ */
+static bool decompress_log_record_data(
+	const struct walb_log_record *rec,
+	const struct sector_data_array *sect_ary, unsigned int idx_pb, u8 *buf)
+{
+	const unsigned int pbs = sect_ary->sector_size;
+	const unsigned int in_size = rec->compressed_pb * pbs;
+	const unsigned int size = rec->io_size * LOGICAL_BLOCK_SIZE;
+	u8 *in;
+	u32 clen;
+	bool ret = false;
+
+	in = (u8 *)malloc(in_size);
+	if (!in) {
+		LOGe("memory allocation failed.\n");
+		return false;
+	}
+	sector_array_copy_to(sect_ary, idx_pb * pbs, in, in_size);
+	memcpy(&clen, in, sizeof(clen));
+	if (clen > in_size - sizeof(u32)) {
+		LOGe("compressed size is invalid: %u.\n", clen);
+		goto fin;
+	}
+	if (lz4_decompress_safe(in + sizeof(u32), buf, clen, size) != (int)size) {
+		LOGe("decompression failed.\n");
+		goto fin;
+	}
+	ret = true;
+fin:
+	free(in);
+	return ret;
+}
+
 /*******************************************************************************
  * Public functions.
  *******************************************************************************/
 
 /**
- * Read logpack header sector from log device.
+ * Read logpack header sector(s) from log device.
  *
  * @fd log device fd opened.
  * @super_sectp super sector.
  * @lsid logpack lsid to read.
  * @logh_sect buffer to store logpack header data.
- *   This allocated size must be sector size.
+ *   This allocated size must be enough for the header.
+ *   See alloc_logpack().
  * @salt log checksum salt.
  *
  * RETURN:
@@ -39,13 +97,15 @@ bool read_logpack_header_from_wldev(
 	u64 lsid, u32 salt, struct sector_data *logh_sect)
 {
 	/* calc offset in the ring buffer */
+	const unsigned int pbs = super_sectp->physical_bs;
 	u64 ring_buffer_offset = get_ring_buffer_offset_2(super_sectp);
 	u64 ring_buffer_size = super_sectp->ring_buffer_size;
 	u64 off = ring_buffer_offset + lsid % ring_buffer_size;
 	struct walb_logpack_header *logh = get_logpack_header(logh_sect);
+	unsigned int n_pb;
 
-	/* read sector */
-	if (!sector_read(fd, off, logh_sect)) {
+	/* read the first sector */
+	if (!read_sector_raw(fd, (u8 *)logh, pbs, off)) {
 		LOGe("read logpack header (lsid %"PRIu64") failed.\n", lsid);
 		return false;
 	}
@@ -56,8 +116,25 @@ bool read_logpack_header_from_wldev(
 			lsid, logh->logpack_lsid);
 		return false;
 	}
+	if (!is_valid_logpack_header(logh)) {
+		LOGe("check logpack header failed.\n");
+		return false;
+	}
+
+	/* read the remaining sectors.
+	   A header never wraps around the ring buffer. */
+	n_pb = get_logpack_header_pb(logh);
+	if (n_pb * pbs > logh_sect->size) {
+		LOGe("logpack header is too large: %u.\n", n_pb);
+		return false;
+	}
+	if (n_pb > 1 && !read_sectors_raw(
+			fd, (u8 *)logh + pbs, pbs, off + 1, n_pb - 1)) {
+		LOGe("read logpack header (lsid %"PRIu64") failed.\n", lsid);
+		return false;
+	}
 	if (!is_valid_logpack_header_with_checksum(
-			logh, super_sectp->physical_bs, salt)) {
+			logh, pbs, salt, get_csum_type_of_super(super_sectp))) {
 		LOGe("check logpack header failed.\n");
 		return false;
 	}
@@ -78,11 +155,13 @@ void print_logpack_header(const struct walb_logpack_header* logh)
 		"n_records: %u\n"
 		"n_padding: %u\n"
 		"total_io_size: %u\n"
+		"n_header_pb: %u\n"
 		"logpack_lsid: %"PRIu64"\n",
 		logh->checksum,
 		logh->n_records,
 		logh->n_padding,
 		logh->total_io_size,
+		get_logpack_header_pb(logh),
 		logh->logpack_lsid);
 	for (i = 0; i < logh->n_records; i++) {
 		printf("record %d\n"
@@ -92,6 +171,9 @@ void print_logpack_header(const struct walb_logpack_header* logh)
 			"  is_exist: %u\n"
 			"  is_padding: %u\n"
 			"  is_discard: %u\n"
+			"  is_zero: %u\n"
+			"  is_compressed: %u\n"
+			"  compressed_pb: %u\n"
 			"  offset: %"PRIu64"\n"
 			"  io_size: %u\n",
 			i,
@@ -101,6 +183,9 @@ void print_logpack_header(const struct walb_logpack_header* logh)
 			test_bit_u32(LOG_RECORD_EXIST, &logh->record[i].flags),
 			test_bit_u32(LOG_RECORD_PADDING, &logh->record[i].flags),
 			test_bit_u32(LOG_RECORD_DISCARD, &logh->record[i].flags),
+			test_bit_u32(LOG_RECORD_ZERO, &logh->record[i].flags),
+			test_bit_u32(LOG_RECORD_COMPRESSED, &logh->record[i].flags),
+			logh->record[i].compressed_pb,
 			logh->record[i].offset,
 			logh->record[i].io_size);
 		printf("logpack lsid: %"PRIu64"\n",
@@ -122,7 +207,7 @@ bool write_logpack_header(
 	int fd, unsigned int pbs,
 	const struct walb_logpack_header* logh)
 {
-	return write_data(fd, (const u8 *)logh, pbs);
+	return write_data(fd, (const u8 *)logh, pbs * get_logpack_header_pb(logh));
 }
 
 /**
@@ -145,12 +230,11 @@ unsigned int read_logpack_data_from_wldev(
 	const struct walb_logpack_header* logh, u32 salt,
 	struct sector_data_array *sect_ary)
 {
-	const int lbs = super->logical_bs;
 	const int pbs = super->physical_bs;
 	int i;
 	int total_pb;
 
-	ASSERT(lbs == LOGICAL_BLOCK_SIZE);
+	ASSERT(super->logical_bs == LOGICAL_BLOCK_SIZE);
 	ASSERT_PBS(pbs);
 
 	if (logh->total_io_size > sect_ary->size) {
@@ -161,13 +245,12 @@ unsigned int read_logpack_data_from_wldev(
 	total_pb = 0;
 	for (i = 0; i < logh->n_records; i++) {
 		u64 log_off;
-		u32 log_lb, log_pb;
+		u32 log_pb;
 
-		if (test_bit_u32(LOG_RECORD_DISCARD, &logh->record[i].flags)) {
+		if (is_payload_free_log_record(&logh->record[i])) {
 			continue;
 		}
-		log_lb = logh->record[i].io_size;
-		log_pb = capacity_pb(pbs, log_lb);
+		log_pb = get_log_record_data_pb(&logh->record[i], pbs);
 		log_off = get_offset_of_lsid_2
 			(super, logh->record[i].lsid);
 		LOGd_("lsid: %"PRIu64" log_off: %"PRIu64"\n",
@@ -189,7 +272,8 @@ unsigned int read_logpack_data_from_wldev(
 		/* Confirm checksum */
 		u32 csum = sector_array_checksum(
 			sect_ary, total_pb * pbs,
-			log_lb * lbs, salt);
+			get_log_record_checksum_size(&logh->record[i], pbs), salt,
+			get_csum_type_of_super(super));
 		if (csum != logh->record[i].checksum) {
 			LOGe("log header checksum is invalid. %08x %08x\n",
 				csum, logh->record[i].checksum);
@@ -207,22 +291,34 @@ unsigned int read_logpack_data_from_wldev(
  * @fd file descriptor (opened, seeked)
  * @pbs physical block size [byte].
  * @salt checksum salt.
- * @logpack logpack to be filled. (allocated size must be physical_bs).
+ * @csum_type checksum type. WALB_CSUM_XXX.
+ * @logpack logpack to be filled.
+ *   (allocated size must be physical_bs * WALB_MAX_LOGPACK_HEADER_PB).
  *
  * RETURN:
  *   true in success, or false.
  */
 bool read_logpack_header(
-	int fd, unsigned int pbs, u32 salt,
+	int fd, unsigned int pbs, u32 salt, unsigned int csum_type,
 	struct walb_logpack_header* logh)
 {
-	/* Read */
+	unsigned int n_pb;
+
+	/* Read the first block and then the remaining. */
 	if (!read_data(fd, (u8 *)logh, pbs)) {
 		return false;
 	}
+	if (!is_valid_logpack_header(logh)) {
+		return false;
+	}
+	n_pb = get_logpack_header_pb(logh);
+	if (n_pb > 1 && !read_data(fd, (u8 *)logh + pbs, pbs * (n_pb - 1))) {
+		return false;
+	}
 
 	/* Check */
-	if (!is_valid_logpack_header_with_checksum(logh, pbs, salt)) {
+	if (!is_valid_logpack_header_with_checksum(
+			logh, pbs, salt, csum_type)) {
 		return false;
 	}
 
@@ -235,6 +331,7 @@ bool read_logpack_header(
  * @fd file descriptor (opened, seeked)
  * @logh corresponding logpack header.
  * @salt checksum salt.
+ * @csum_type checksum type. WALB_CSUM_XXX.
  * @sect_ary sector data array to be store data.
  *
  * RETURN:
@@ -242,7 +339,8 @@ bool read_logpack_header(
  */
 bool read_logpack_data(
 	int fd,
-	const struct walb_logpack_header* logh, u32 salt,
+	const struct walb_logpack_header* logh,
+	u32 salt, unsigned int csum_type,
 	struct sector_data_array *sect_ary)
 {
 	unsigned int pbs;
@@ -264,16 +362,15 @@ bool read_logpack_data(
 
 	total_pb = 0;
 	for (i = 0; i < n_req; i++) {
-		unsigned int idx_pb, log_lb, log_pb;
+		unsigned int idx_pb, log_pb;
 		u32 csum;
 		const struct walb_log_record *rec = &logh->record[i];
 
-		if (test_bit_u32(LOG_RECORD_DISCARD, &rec->flags)) {
+		if (is_payload_free_log_record(rec)) {
 			continue;
 		}
-		idx_pb = rec->lsid_local - 1;
-		log_lb = rec->io_size;
-		log_pb = capacity_pb(pbs, log_lb);
+		idx_pb = rec->lsid_local - get_logpack_header_pb(logh);
+		log_pb = get_log_record_data_pb(rec, pbs);
 		/* Read data of the log record. */
 		if (!sector_array_read(fd, sect_ary, idx_pb, log_pb)) {
 			LOGe("read log data failed.\n");
@@ -288,7 +385,7 @@ bool read_logpack_data(
 		csum = sector_array_checksum(
 			sect_ary,
 			idx_pb * pbs,
-			log_lb * LOGICAL_BLOCK_SIZE, salt);
+			get_log_record_checksum_size(rec, pbs), salt, csum_type);
 		if (csum != rec->checksum) {
 			LOGe("log record[%d] checksum is invalid. %08x %08x\n",
 				i, csum, rec->checksum);
@@ -331,7 +428,8 @@ bool redo_logpack(
 			continue;
 		}
 		off_lb = rec->offset;
-		idx_lb = addr_lb(sect_ary->sector_size, rec->lsid_local - 1);
+		idx_lb = addr_lb(sect_ary->sector_size,
+				rec->lsid_local - get_logpack_header_pb(logh));
 		n_lb = rec->io_size;
 		if (test_bit_u32(LOG_RECORD_DISCARD, &rec->flags)) {
 			/* If the data device supports discard request,
@@ -339,6 +437,35 @@ bool redo_logpack(
 			/* now editing */
 			continue;
 		}
+		if (test_bit_u32(LOG_RECORD_ZERO, &rec->flags)) {
+			if (!zeroout_area(fd, off_lb * LOGICAL_BLOCK_SIZE,
+						(u64)n_lb * LOGICAL_BLOCK_SIZE)) {
+				LOGe("zero-out sectors failed.\n");
+				return false;
+			}
+			continue;
+		}
+		if (test_bit_u32(LOG_RECORD_COMPRESSED, &rec->flags)) {
+			u8 *buf;
+			bool retb;
+
+			if (posix_memalign((void **)&buf, sect_ary->sector_size,
+						n_lb * LOGICAL_BLOCK_SIZE) != 0) {
+				LOGe("memory allocation failed.\n");
+				return false;
+			}
+			retb = decompress_log_record_data(
+				rec, sect_ary,
+				rec->lsid_local - get_logpack_header_pb(logh), buf)
+				&& write_sectors_raw(fd, buf, LOGICAL_BLOCK_SIZE,
+						off_lb, n_lb);
+			free(buf);
+			if (!retb) {
+				LOGe("write compressed sectors failed.\n");
+				return false;
+			}
+			continue;
+		}
 		if (!sector_array_pwrite_lb(fd, off_lb, sect_ary, idx_lb, n_lb)) {
 			LOGe("write sectors failed.\n");
 			return false;
@@ -350,7 +477,8 @@ bool redo_logpack(
 /**
  * Write an end logpack header block.
  */
-bool write_end_logpack_header(int fd, unsigned int pbs, u32 salt)
+bool write_end_logpack_header(
+	int fd, unsigned int pbs, u32 salt, unsigned int csum_type)
 {
 	bool ret = false;
 	struct walb_logpack_header *h;
@@ -365,8 +493,7 @@ bool write_end_logpack_header(int fd, unsigned int pbs, u32 salt)
 	h->sector_type = SECTOR_TYPE_LOGPACK;
 	h->n_records = 0;
 	h->logpack_lsid = (u64)(-1);
-	h->checksum = 0;
-	h->checksum = checksum((const u8 *)h, pbs, salt);
+	h->checksum = calc_logpack_header_checksum(h, pbs, salt, csum_type);
 
 	ret = write_data(fd, (const u8 *)h, pbs);
 	if (!ret) LOGe("write_data failed.\n");
@@ -415,10 +542,11 @@ bool write_invalid_logpack_header(
  * @invalid_idx new logpack header's n_records must be invalid_idx.
  * @pbs physical block size [byte].
  * @salt checksum salt.
+ * @csum_type checksum type. WALB_CSUM_XXX.
  */
 void shrink_logpack_header(
 	struct walb_logpack_header *logh, unsigned int invalid_idx,
-	unsigned int pbs, u32 salt)
+	unsigned int pbs, u32 salt, unsigned int csum_type)
 {
 	unsigned int i;
 
@@ -434,18 +562,17 @@ void shrink_logpack_header(
 	logh->total_io_size = 0;
 	for (i = 0; i < invalid_idx; i++) {
 		const struct walb_log_record *rec = &logh->record[i];
-		if (!test_bit_u32(LOG_RECORD_DISCARD, &rec->flags)) {
-			logh->total_io_size += capacity_pb(pbs, rec->io_size);
-		}
+		logh->total_io_size += get_log_record_data_pb(rec, pbs);
 		if (test_bit_u32(LOG_RECORD_PADDING, &rec->flags)) {
 			logh->n_padding++;
 		}
 	}
 
 	/* Calculate checksum. */
-	logh->checksum = 0;
-	logh->checksum = checksum((const u8 *)logh, pbs, salt);
-	ASSERT(is_valid_logpack_header_with_checksum(logh, pbs, salt));
+	logh->checksum = calc_logpack_header_checksum(
+		logh, pbs, salt, csum_type);
+	ASSERT(is_valid_logpack_header_with_checksum(
+			logh, pbs, salt, csum_type));
 }
 
 /**
@@ -494,8 +621,8 @@ struct logpack *alloc_logpack(
 	if (!pack) { goto error1; }
 	memset(pack, 0, sizeof(*pack));
 
-	/* Buffer for logpack header. */
-	pack->sectd = sector_alloc(pbs);
+	/* Buffer for logpack header of any size. */
+	pack->sectd = sector_alloc(pbs * WALB_MAX_LOGPACK_HEADER_PB);
 	if (!pack->sectd) { goto error1; }
 	pack->header = get_logpack_header(pack->sectd);
 
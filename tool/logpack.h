@@ -29,11 +29,12 @@ unsigned int read_logpack_data_from_wldev(
 void print_logpack_header(const struct walb_logpack_header* logh);
 
 bool read_logpack_header(
-	int fd, unsigned int pbs, u32 salt,
+	int fd, unsigned int pbs, u32 salt, unsigned int csum_type,
 	struct walb_logpack_header* logh);
 bool read_logpack_data(
 	int fd,
-	const struct walb_logpack_header* logh, u32 salt,
+	const struct walb_logpack_header* logh,
+	u32 salt, unsigned int csum_type,
 	struct sector_data_array *sect_ary);
 bool write_logpack_header(
 	int fd, unsigned int pbs,
@@ -44,13 +45,14 @@ bool redo_logpack(
 	const struct walb_logpack_header* logh,
 	const struct sector_data_array *sect_ary);
 
-bool write_end_logpack_header(int fd, unsigned int pbs, u32 salt);
+bool write_end_logpack_header(
+	int fd, unsigned int pbs, u32 salt, unsigned int csum_type);
 bool write_invalid_logpack_header(
 	int fd, const struct sector_data *super_sect, u64 lsid);
 
 void shrink_logpack_header(
 	struct walb_logpack_header *logh, unsigned int invalid_idx,
-	unsigned int pbs, u32 salt);
+	unsigned int pbs, u32 salt, unsigned int csum_type);
 
 unsigned int get_padding_size_in_logpack_header(
 	const struct walb_logpack_header *logh, unsigned int pbs);
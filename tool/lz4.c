@@ -0,0 +1,88 @@
+/**
+ * LZ4 block decompressor for userland tools.
+ *
+ * Copyright(C) 2013, Cybozu Labs, Inc.
+ * @license 3-clause BSD, GPL version 2 or later.
+ */
+#include <string.h>
+
+#include "lz4.h"
+
+/**
+ * Read an extended length field.
+ *
+ * RETURN:
+ *   false if the input is too short.
+ */
+static bool read_length(const u8 **srcp, const u8 *src_end, unsigned int *lenp)
+{
+	u8 c;
+
+	do {
+		if (*srcp >= src_end)
+			return false;
+		c = *(*srcp)++;
+		*lenp += c;
+	} while (c == 255);
+	return true;
+}
+
+/**
+ * Decompress an LZ4 block.
+ * Each sequence is a token, literals and a match
+ * of a 2-byte little-endian offset, except the last one without match.
+ * Any input never causes accesses out of the buffers.
+ *
+ * @src compressed data.
+ * @dst buffer for decompressed data.
+ * @src_size compressed size [byte].
+ * @dst_cap capacity of dst [byte].
+ *
+ * RETURN:
+ *   decompressed size [byte], or -1 if the data are broken.
+ */
+int lz4_decompress_safe(
+	const u8 *src, u8 *dst, unsigned int src_size, unsigned int dst_cap)
+{
+	const u8 *src_end = src + src_size;
+	u8 *op = dst;
+	u8 *dst_end = dst + dst_cap;
+
+	while (src < src_end) {
+		const u8 token = *src++;
+		unsigned int len = token >> 4;
+		unsigned int off;
+		const u8 *match;
+
+		/* Literals. */
+		if (len == 15 && !read_length(&src, src_end, &len))
+			return -1;
+		if (len > (unsigned int)(src_end - src)
+			|| len > (unsigned int)(dst_end - op))
+			return -1;
+		memcpy(op, src, len);
+		op += len;
+		src += len;
+		if (src == src_end)
+			break; /* The last sequence. */
+
+		/* Match. */
+		if (src_end - src < 2)
+			return -1;
+		off = src[0] | (src[1] << 8);
+		src += 2;
+		if (off == 0 || off > (unsigned int)(op - dst))
+			return -1;
+		len = token & 15;
+		if (len == 15 && !read_length(&src, src_end, &len))
+			return -1;
+		len += 4;
+		if (len > (unsigned int)(dst_end - op))
+			return -1;
+		/* Byte by byte since the match may overlap the output. */
+		match = op - off;
+		while (len-- > 0)
+			*op++ = *match++;
+	}
+	return op - dst;
+}
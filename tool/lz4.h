@@ -0,0 +1,25 @@
+/**
+ * LZ4 block decompressor for userland tools.
+ * The kernel compresses log data with its lib/lz4.
+ * This is a minimal implementation to avoid the dependency on liblz4.
+ *
+ * Copyright(C) 2013, Cybozu Labs, Inc.
+ * @license 3-clause BSD, GPL version 2 or later.
+ */
+#ifndef WALB_LZ4_USER_H
+#define WALB_LZ4_USER_H
+
+#include "linux/walb/common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int lz4_decompress_safe(
+	const u8 *src, u8 *dst, unsigned int src_size, unsigned int dst_cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WALB_LZ4_USER_H */
@@ -0,0 +1,955 @@
+/**
+ * Replay a blktrace capture against a block device.
+ *
+ * Queue (Q) events are replayed with O_DIRECT and kernel native AIO
+ * keeping READ/WRITE/DISCARD, preflush and FUA flags.
+ * Discards are done by worker threads because AIO does not support them,
+ * and a write with preflush is started when its flush completes.
+ * IOs are issued at the original timing (optionally scaled) or
+ * as fast as possible with a limited queue depth.
+ * With --baseline, the same trace is replayed against another device
+ * (typically the underlying data device) first, and latency added by walb
+ * is reported per IO class.
+ *
+ * Input is blkparse text output or binary trace data
+ * merged by 'blkparse -i NAME -d FILE'.
+ *
+ * Copyright(C) 2013, Cybozu Labs, Inc.
+ * @license 3-clause BSD, GPL version 2 or later.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <linux/fs.h>
+#include <linux/blktrace_api.h>
+
+#include "linux/walb/common.h"
+#include "linux/walb/logger.h"
+#include "util.h"
+#include "io_stat.h"
+#include "aio_sys.h"
+#include "version.h"
+
+/*******************************************************************************
+ * Trace.
+ *******************************************************************************/
+
+enum {
+	IO_CLASS_READ = 0,
+	IO_CLASS_WRITE,
+	IO_CLASS_FUA_WRITE,
+	IO_CLASS_FLUSH,
+	IO_CLASS_DISCARD,
+	IO_CLASS_MAX,
+};
+
+static const char *io_class_name_[IO_CLASS_MAX] = {
+	"read", "write", "fua_write", "flush", "discard",
+};
+
+/**
+ * A traced IO.
+ * A write with preflush is replayed as a flush and then the write.
+ */
+struct trace_io
+{
+	u64 time_ns; /* relative to the first IO. */
+	u64 sector; /* [512B]. */
+	u32 n_sectors;
+	u8 io_class;
+	bool is_preflush;
+};
+
+struct trace
+{
+	struct trace_io *ios;
+	size_t n_ios;
+	size_t capacity;
+	u32 max_sectors;
+};
+
+static bool trace_add(struct trace *tr, const struct trace_io *tio)
+{
+	if (tr->n_ios == tr->capacity) {
+		const size_t cap = tr->capacity ? tr->capacity * 2 : 1024;
+		struct trace_io *p = realloc(tr->ios, sizeof(*p) * cap);
+		if (!p) {
+			LOGe("memory allocation failed.\n");
+			return false;
+		}
+		tr->ios = p;
+		tr->capacity = cap;
+	}
+	tr->ios[tr->n_ios++] = *tio;
+	if (tio->io_class != IO_CLASS_DISCARD && tr->max_sectors < tio->n_sectors)
+		tr->max_sectors = tio->n_sectors;
+	return true;
+}
+
+static int cmp_trace_io_by_time(const void *a, const void *b)
+{
+	const struct trace_io *x = a, *y = b;
+
+	if (x->time_ns != y->time_ns)
+		return x->time_ns < y->time_ns ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Decide IO class from blkparse RWBS string such as "WS", "FWFS" and "D".
+ * A leading 'F' means preflush and 'F' after the operation means FUA.
+ *
+ * RETURN:
+ *   false if the IO must be ignored.
+ */
+static bool parse_rwbs(const char *rwbs, struct trace_io *tio)
+{
+	const char *p = rwbs;
+	bool is_fua;
+
+	tio->is_preflush = (*p == 'F');
+	if (tio->is_preflush)
+		p++;
+	is_fua = strchr(p + (*p ? 1 : 0), 'F') != NULL;
+	switch (*p) {
+	case 'R':
+		tio->io_class = IO_CLASS_READ;
+		break;
+	case 'W':
+		tio->io_class = is_fua ? IO_CLASS_FUA_WRITE : IO_CLASS_WRITE;
+		break;
+	case 'D':
+		tio->io_class = IO_CLASS_DISCARD;
+		break;
+	case 'N':
+		if (!tio->is_preflush)
+			return false;
+		tio->io_class = IO_CLASS_FLUSH;
+		tio->is_preflush = false;
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Parse a blkparse default output line.
+ * Example:
+ *   8,0    3        1     0.000000000  4162  Q  WS 123456 + 8 [fio]
+ *   8,0    1        2     0.000100000   123  Q FWS [kworker/1:1]
+ *
+ * RETURN:
+ *   1 if an IO is parsed, 0 if the line is ignored.
+ */
+static int parse_text_line(const char *line, struct trace_io *tio)
+{
+	unsigned long long sec, nsec, sector;
+	unsigned int n_sectors;
+	char action[4], rwbs[16];
+	int n;
+
+	n = sscanf(line, "%*s %*u %*u %llu.%llu %*u %3s %15s %llu + %u",
+		&sec, &nsec, action, rwbs, &sector, &n_sectors);
+	if (n < 4 || strcmp(action, "Q") != 0)
+		return 0;
+	memset(tio, 0, sizeof(*tio));
+	tio->time_ns = sec * 1000000000ULL + nsec;
+	if (!parse_rwbs(rwbs, tio))
+		return 0;
+	if (n == 6) {
+		tio->sector = sector;
+		tio->n_sectors = n_sectors;
+	}
+	if (tio->n_sectors == 0) {
+		/* Empty flush. */
+		if (!tio->is_preflush && tio->io_class != IO_CLASS_FLUSH)
+			return 0;
+		tio->io_class = IO_CLASS_FLUSH;
+		tio->is_preflush = false;
+	}
+	return 1;
+}
+
+static bool load_text_trace(FILE *fp, struct trace *tr)
+{
+	char line[512];
+
+	while (fgets(line, sizeof(line), fp)) {
+		struct trace_io tio;
+
+		if (parse_text_line(line, &tio) && !trace_add(tr, &tio))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Convert a binary blk_io_trace record.
+ *
+ * RETURN:
+ *   1 if an IO is converted, 0 if the record is ignored.
+ */
+static int convert_bin_record(const struct blk_io_trace *t, struct trace_io *tio)
+{
+	const u32 cat = t->action >> BLK_TC_SHIFT;
+
+	if ((t->action & 0xffff) != __BLK_TA_QUEUE || (cat & BLK_TC_PC))
+		return 0;
+	memset(tio, 0, sizeof(*tio));
+	tio->time_ns = t->time;
+	tio->sector = t->sector;
+	tio->n_sectors = t->bytes >> 9;
+	tio->is_preflush = (cat & BLK_TC_FLUSH) != 0;
+	if (cat & BLK_TC_DISCARD)
+		tio->io_class = IO_CLASS_DISCARD;
+	else if (cat & BLK_TC_WRITE)
+		tio->io_class = (cat & BLK_TC_FUA) ? IO_CLASS_FUA_WRITE : IO_CLASS_WRITE;
+	else if (tio->n_sectors > 0)
+		tio->io_class = IO_CLASS_READ;
+	if (tio->n_sectors == 0) {
+		if (!tio->is_preflush)
+			return 0;
+		tio->io_class = IO_CLASS_FLUSH;
+		tio->is_preflush = false;
+	}
+	return 1;
+}
+
+static bool load_bin_trace(FILE *fp, struct trace *tr)
+{
+	struct blk_io_trace t;
+
+	while (fread(&t, sizeof(t), 1, fp) == 1) {
+		struct trace_io tio;
+
+		if ((t.magic & 0xffffff00) != BLK_IO_TRACE_MAGIC) {
+			LOGe("bad magic in binary trace: %08x\n", t.magic);
+			return false;
+		}
+		if (t.pdu_len > 0 && fseek(fp, t.pdu_len, SEEK_CUR)) {
+			LOGe("fseek failed: %s\n", strerror(errno));
+			return false;
+		}
+		if (convert_bin_record(&t, &tio) && !trace_add(tr, &tio))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Load a trace file and sort IOs by time.
+ * The format is detected by the magic number.
+ */
+static bool load_trace(const char *path, struct trace *tr)
+{
+	FILE *fp;
+	u32 magic = 0;
+	bool ret;
+	size_t i;
+
+	memset(tr, 0, sizeof(*tr));
+	fp = fopen(path, "r");
+	if (!fp) {
+		LOGe("open %s failed: %s\n", path, strerror(errno));
+		return false;
+	}
+	if (fread(&magic, sizeof(magic), 1, fp) != 1)
+		magic = 0;
+	rewind(fp);
+	if ((magic & 0xffffff00) == BLK_IO_TRACE_MAGIC)
+		ret = load_bin_trace(fp, tr);
+	else
+		ret = load_text_trace(fp, tr);
+	fclose(fp);
+	if (!ret)
+		return false;
+	if (tr->n_ios == 0) {
+		LOGe("no queue event found in %s.\n", path);
+		return false;
+	}
+
+	qsort(tr->ios, tr->n_ios, sizeof(*tr->ios), cmp_trace_io_by_time);
+	for (i = tr->n_ios; i > 0; i--)
+		tr->ios[i - 1].time_ns -= tr->ios[0].time_ns;
+	return true;
+}
+
+/*******************************************************************************
+ * Configuration.
+ *******************************************************************************/
+
+struct replay_config
+{
+	const char *trace_path;
+	const char *dev_path;
+	const char *baseline_path; /* NULL if no baseline. */
+	bool is_afap; /* as fast as possible. */
+	double speed; /* time scale for original timing. */
+	unsigned int qd; /* max IOs in flight. */
+};
+
+enum {
+	OPT_BASELINE = 1,
+	OPT_AFAP,
+	OPT_SPEED,
+	OPT_QD,
+	OPT_HELP,
+};
+
+static void show_help(void)
+{
+	printf("Usage: replay [OPTIONS] TRACE_FILE BLOCK_DEVICE\n"
+		"TRACE_FILE:\n"
+		"  blkparse text output, or binary data made by\n"
+		"  'blkparse -i NAME -d FILE'. Queue (Q) events are replayed.\n"
+		"OPTIONS:\n"
+		"  --baseline DEV  replay against DEV first and report\n"
+		"                  latency added by BLOCK_DEVICE.\n"
+		"  --afap          as fast as possible instead of the original timing.\n"
+		"  --speed X       replay X times faster than the original. (default: 1)\n"
+		"  --qd N          max IOs in flight. (default: 256)\n"
+		"Results are printed to stdout in JSON.\n"
+		"CAUSION: write IOs destroy the contents of the devices.\n");
+}
+
+static void init_config(struct replay_config *cfg)
+{
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->speed = 1.0;
+	cfg->qd = 256;
+}
+
+/**
+ * RETURN:
+ *   true in success.
+ */
+static bool parse_opt(int argc, char *const argv[], struct replay_config *cfg)
+{
+	while (1) {
+		int option_index = 0;
+		bool ret = true;
+		char *end;
+		unsigned long val;
+		static const struct option long_options[] = {
+			{"baseline", 1, 0, OPT_BASELINE},
+			{"afap", 0, 0, OPT_AFAP},
+			{"speed", 1, 0, OPT_SPEED},
+			{"qd", 1, 0, OPT_QD},
+			{"help", 0, 0, OPT_HELP},
+			{0, 0, 0, 0}
+		};
+
+		int c = getopt_long(argc, argv, "", long_options, &option_index);
+		if (c == -1)
+			break;
+		switch (c) {
+		case OPT_BASELINE:
+			cfg->baseline_path = optarg;
+			break;
+		case OPT_AFAP:
+			cfg->is_afap = true;
+			break;
+		case OPT_SPEED:
+			cfg->speed = strtod(optarg, &end);
+			ret = end != optarg && *end == '\0' && cfg->speed > 0;
+			break;
+		case OPT_QD:
+			errno = 0;
+			val = strtoul(optarg, &end, 10);
+			ret = !errno && end != optarg && *end == '\0' &&
+				val > 0 && val <= UINT_MAX;
+			cfg->qd = val;
+			break;
+		case OPT_HELP:
+		default:
+			return false;
+		}
+		if (!ret) {
+			LOGe("invalid argument: %s\n", optarg);
+			return false;
+		}
+	}
+	if (optind != argc - 2) {
+		LOGe("specify a trace file and a block device.\n");
+		return false;
+	}
+	cfg->trace_path = argv[optind];
+	cfg->dev_path = argv[optind + 1];
+	return true;
+}
+
+/*******************************************************************************
+ * Replay.
+ *******************************************************************************/
+
+/*
+ * Number of worker threads for IOs that kernel native AIO can not do:
+ * discards and flushes on kernels without aio fsync for block devices.
+ */
+#define REPLAY_N_WORKERS 4
+
+struct io_slot
+{
+	struct iocb iocb;
+	u8 io_class;
+	u64 begin_ns;
+	int res; /* result of an IO done by a worker. */
+	struct io_slot *next; /* for the worker queues. */
+
+	/* IO to start when this one completes, for a write with preflush.
+	   next_class is IO_CLASS_MAX if there is none. */
+	u8 next_class;
+	u64 next_offset;
+	u64 next_size;
+};
+
+struct replay_result
+{
+	struct io_stat stat[IO_CLASS_MAX];
+	u64 n_skipped; /* out of range or unaligned IOs. */
+	u64 n_late; /* IOs issued more than 1ms later than scheduled. */
+	u64 max_lag_ns;
+	double elapsed_sec;
+};
+
+struct replayer
+{
+	const struct replay_config *cfg;
+	const struct trace *tr;
+	struct bdev_info info;
+	int fd;
+	aio_context_t ctx;
+	struct io_slot *slots;
+	struct io_slot **free_slots;
+	unsigned int n_free;
+	struct io_event *events;
+	u8 *buf; /* shared by all IOs because contents do not matter. */
+	bool is_aio_fsync_supported;
+	struct replay_result *res;
+
+	/* Signaled by the AIO completions and the workers. */
+	int efd;
+
+	/* Workers. The queues are protected by mutex. */
+	pthread_t workers[REPLAY_N_WORKERS];
+	unsigned int n_workers;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct io_slot *req_head, *req_tail;
+	struct io_slot *done_slots;
+	bool should_stop;
+};
+
+static bool start_io(struct replayer *rp, struct io_slot *slot,
+		u8 io_class, u64 offset, u64 size);
+
+/**
+ * Do a blocking IO in a worker.
+ *
+ * RETURN:
+ *   0 in success, or -errno.
+ */
+static int do_blocking_io(struct replayer *rp, const struct io_slot *slot)
+{
+	u64 range[2] = {slot->iocb.aio_offset, slot->iocb.aio_nbytes};
+
+	if (slot->io_class == IO_CLASS_DISCARD) {
+		if (ioctl(rp->fd, BLKDISCARD, &range))
+			return -errno;
+		return 0;
+	}
+	ASSERT(slot->io_class == IO_CLASS_FLUSH);
+	if (fdatasync(rp->fd))
+		return -errno;
+	return 0;
+}
+
+static void *worker(void *arg)
+{
+	struct replayer *rp = arg;
+	const u64 one = 1;
+	struct io_slot *slot;
+
+	for (;;) {
+		pthread_mutex_lock(&rp->mutex);
+		while (!rp->req_head && !rp->should_stop)
+			pthread_cond_wait(&rp->cond, &rp->mutex);
+		slot = rp->req_head;
+		if (slot) {
+			rp->req_head = slot->next;
+			if (!rp->req_head)
+				rp->req_tail = NULL;
+		}
+		pthread_mutex_unlock(&rp->mutex);
+		if (!slot)
+			break;
+
+		slot->res = do_blocking_io(rp, slot);
+
+		pthread_mutex_lock(&rp->mutex);
+		slot->next = rp->done_slots;
+		rp->done_slots = slot;
+		pthread_mutex_unlock(&rp->mutex);
+		if (write(rp->efd, &one, sizeof(one)) != sizeof(one))
+			LOGe("eventfd write failed: %s\n", strerror(errno));
+	}
+	return NULL;
+}
+
+static void queue_to_worker(struct replayer *rp, struct io_slot *slot)
+{
+	slot->next = NULL;
+	pthread_mutex_lock(&rp->mutex);
+	if (rp->req_tail)
+		rp->req_tail->next = slot;
+	else
+		rp->req_head = slot;
+	rp->req_tail = slot;
+	pthread_cond_signal(&rp->cond);
+	pthread_mutex_unlock(&rp->mutex);
+}
+
+static bool start_workers(struct replayer *rp)
+{
+	for (rp->n_workers = 0; rp->n_workers < REPLAY_N_WORKERS; rp->n_workers++) {
+		if (pthread_create(&rp->workers[rp->n_workers], NULL, worker, rp)) {
+			LOGe("pthread_create failed.\n");
+			return false;
+		}
+	}
+	return true;
+}
+
+static void stop_workers(struct replayer *rp)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&rp->mutex);
+	rp->should_stop = true;
+	pthread_cond_broadcast(&rp->cond);
+	pthread_mutex_unlock(&rp->mutex);
+	for (i = 0; i < rp->n_workers; i++)
+		pthread_join(rp->workers[i], NULL);
+	rp->n_workers = 0;
+}
+
+/**
+ * Account a completed IO and start the next IO chained to it if any.
+ */
+static bool complete_io(struct replayer *rp, struct io_slot *slot,
+			long res, u64 now_ns)
+{
+	if (res < 0) {
+		LOGe("%s IO failed: %s\n", io_class_name_[slot->io_class],
+			strerror(-res));
+		return false;
+	}
+	io_stat_add(&rp->res->stat[slot->io_class],
+		slot->iocb.aio_nbytes, now_ns - slot->begin_ns);
+	if (slot->next_class != IO_CLASS_MAX) {
+		const u8 io_class = slot->next_class;
+
+		slot->next_class = IO_CLASS_MAX;
+		return start_io(rp, slot, io_class,
+				slot->next_offset, slot->next_size);
+	}
+	rp->free_slots[rp->n_free++] = slot;
+	return true;
+}
+
+/**
+ * Reap completed IOs of both the AIO context and the workers.
+ * It returns after at least one IO completes or timeout expires.
+ *
+ * @timeout NULL for no timeout.
+ */
+static bool reap_ios(struct replayer *rp, const struct timespec *timeout)
+{
+	struct pollfd pfd = { .fd = rp->efd, .events = POLLIN };
+	struct timespec zero_ts = { 0, 0 };
+	struct io_slot *done;
+	u64 cnt, now_ns;
+	int n, i;
+
+	while (rp->n_free < rp->cfg->qd) {
+		/* Reset the counter before reaping not to miss a signal. */
+		if (read(rp->efd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN) {
+			LOGe("eventfd read failed: %s\n", strerror(errno));
+			return false;
+		}
+		n = sys_io_getevents(rp->ctx, 0, rp->cfg->qd, rp->events, &zero_ts);
+		if (n < 0) {
+			if (errno != EINTR) {
+				LOGe("io_getevents failed: %s\n", strerror(errno));
+				return false;
+			}
+			n = 0;
+		}
+		pthread_mutex_lock(&rp->mutex);
+		done = rp->done_slots;
+		rp->done_slots = NULL;
+		pthread_mutex_unlock(&rp->mutex);
+
+		now_ns = get_ns();
+		for (i = 0; i < n; i++) {
+			struct io_slot *slot =
+				(struct io_slot *)(uintptr_t)rp->events[i].data;
+			if (!complete_io(rp, slot, rp->events[i].res, now_ns))
+				return false;
+		}
+		if (n > 0 || done) {
+			while (done) {
+				struct io_slot *slot = done;
+				done = slot->next;
+				if (!complete_io(rp, slot, slot->res, now_ns))
+					return false;
+			}
+			return true;
+		}
+
+		n = ppoll(&pfd, 1, timeout, NULL);
+		if (n < 0 && errno != EINTR) {
+			LOGe("ppoll failed: %s\n", strerror(errno));
+			return false;
+		}
+		if (n == 0)
+			return true; /* timeout. */
+	}
+	return true;
+}
+
+static bool wait_for_free_slot(struct replayer *rp)
+{
+	while (rp->n_free == 0) {
+		if (!reap_ios(rp, NULL))
+			return false;
+	}
+	return true;
+}
+
+static bool drain_ios(struct replayer *rp)
+{
+	while (rp->n_free < rp->cfg->qd) {
+		if (!reap_ios(rp, NULL))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Wait until due_ns reaping completions meanwhile.
+ */
+static bool wait_until(struct replayer *rp, u64 due_ns)
+{
+	u64 now_ns;
+
+	while ((now_ns = get_ns()) < due_ns) {
+		struct timespec ts;
+		const u64 rest_ns = due_ns - now_ns;
+
+		if (rp->n_free == rp->cfg->qd) {
+			ts.tv_sec = rest_ns / 1000000000ULL;
+			ts.tv_nsec = rest_ns % 1000000000ULL;
+			nanosleep(&ts, NULL);
+			continue;
+		}
+		ts.tv_sec = rest_ns / 1000000000ULL;
+		ts.tv_nsec = rest_ns % 1000000000ULL;
+		if (!reap_ios(rp, &ts))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Start an IO with a slot.
+ * Discards and flushes without aio fsync support are done by the workers.
+ */
+static bool start_io(struct replayer *rp, struct io_slot *slot,
+		u8 io_class, u64 offset, u64 size)
+{
+	struct iocb *iocbp = &slot->iocb;
+
+	memset(iocbp, 0, sizeof(*iocbp));
+	iocbp->aio_data = (u64)(uintptr_t)slot;
+	iocbp->aio_fildes = rp->fd;
+	iocbp->aio_flags = IOCB_FLAG_RESFD;
+	iocbp->aio_resfd = rp->efd;
+	slot->io_class = io_class;
+	switch (io_class) {
+	case IO_CLASS_READ:
+		iocbp->aio_lio_opcode = IOCB_CMD_PREAD;
+		break;
+	case IO_CLASS_FUA_WRITE:
+		iocbp->aio_rw_flags = RWF_DSYNC;
+		/* fall through */
+	case IO_CLASS_WRITE:
+		iocbp->aio_lio_opcode = IOCB_CMD_PWRITE;
+		break;
+	case IO_CLASS_FLUSH:
+		iocbp->aio_lio_opcode = IOCB_CMD_FDSYNC;
+		break;
+	}
+	if (io_class != IO_CLASS_FLUSH) {
+		iocbp->aio_buf = (u64)(uintptr_t)rp->buf;
+		iocbp->aio_nbytes = size;
+		iocbp->aio_offset = offset;
+	}
+	slot->begin_ns = get_ns();
+	if (io_class == IO_CLASS_DISCARD ||
+		(io_class == IO_CLASS_FLUSH && !rp->is_aio_fsync_supported)) {
+		queue_to_worker(rp, slot);
+		return true;
+	}
+	if (sys_io_submit(rp->ctx, 1, &iocbp) == 1)
+		return true;
+
+	if (io_class == IO_CLASS_FLUSH && errno == EINVAL) {
+		/* Older kernels do not support aio fsync for block devices. */
+		rp->is_aio_fsync_supported = false;
+		queue_to_worker(rp, slot);
+		return true;
+	}
+	rp->free_slots[rp->n_free++] = slot;
+	LOGe("io_submit failed: %s\n", strerror(errno));
+	return false;
+}
+
+/**
+ * Submit an IO.
+ * A preflush is done before the IO, which is started
+ * when the flush completes without blocking the event loop.
+ */
+static bool submit_io(struct replayer *rp, u8 io_class, u64 offset, u64 size,
+		bool is_preflush)
+{
+	struct io_slot *slot;
+
+	if (!wait_for_free_slot(rp))
+		return false;
+	slot = rp->free_slots[--rp->n_free];
+	if (!is_preflush) {
+		slot->next_class = IO_CLASS_MAX;
+		return start_io(rp, slot, io_class, offset, size);
+	}
+	slot->next_class = io_class;
+	slot->next_offset = offset;
+	slot->next_size = size;
+	return start_io(rp, slot, IO_CLASS_FLUSH, 0, 0);
+}
+
+static bool replay_io(struct replayer *rp, const struct trace_io *tio)
+{
+	const u64 offset = tio->sector << 9;
+	const u64 size = (u64)tio->n_sectors << 9;
+
+	if (tio->io_class != IO_CLASS_FLUSH) {
+		if (offset + size > rp->info.size ||
+			offset % rp->info.lbs != 0 || size % rp->info.lbs != 0) {
+			rp->res->n_skipped++;
+			return true;
+		}
+	}
+	return submit_io(rp, tio->io_class, offset, size, tio->is_preflush);
+}
+
+static bool replay_all(struct replayer *rp)
+{
+	const struct replay_config *cfg = rp->cfg;
+	const struct trace *tr = rp->tr;
+	const u64 begin_ns = get_ns();
+	size_t i;
+
+	for (i = 0; i < tr->n_ios; i++) {
+		const struct trace_io *tio = &tr->ios[i];
+
+		if (!cfg->is_afap) {
+			const u64 due_ns = begin_ns + (u64)(tio->time_ns / cfg->speed);
+			u64 lag_ns;
+
+			if (!wait_until(rp, due_ns))
+				return false;
+			lag_ns = get_ns() - due_ns;
+			if (lag_ns > 1000000)
+				rp->res->n_late++;
+			if (rp->res->max_lag_ns < lag_ns)
+				rp->res->max_lag_ns = lag_ns;
+		}
+		if (!replay_io(rp, tio))
+			return false;
+	}
+	if (!drain_ios(rp))
+		return false;
+	rp->res->elapsed_sec = (get_ns() - begin_ns) / 1e9;
+	return true;
+}
+
+/**
+ * Replay a trace against a device.
+ */
+static bool replay(const struct replay_config *cfg, const struct trace *tr,
+		const char *dev_path, struct replay_result *res)
+{
+	struct replayer rp;
+	unsigned int i;
+	bool ret = false;
+
+	memset(&rp, 0, sizeof(rp));
+	memset(res, 0, sizeof(*res));
+	rp.cfg = cfg;
+	rp.tr = tr;
+	rp.res = res;
+	rp.is_aio_fsync_supported = true;
+	pthread_mutex_init(&rp.mutex, NULL);
+	pthread_cond_init(&rp.cond, NULL);
+	if (!open_bdev_and_get_info(dev_path, &rp.info, &rp.fd, O_RDWR | O_DIRECT))
+		return false;
+	rp.efd = eventfd(0, EFD_NONBLOCK);
+	if (rp.efd < 0) {
+		LOGe("eventfd failed: %s\n", strerror(errno));
+		close(rp.fd);
+		return false;
+	}
+
+	rp.slots = calloc(cfg->qd, sizeof(*rp.slots));
+	rp.free_slots = calloc(cfg->qd, sizeof(*rp.free_slots));
+	rp.events = calloc(cfg->qd, sizeof(*rp.events));
+	rp.buf = AMALLOC((size_t)tr->max_sectors << 9, 4096, 0);
+	if (!rp.slots || !rp.free_slots || !rp.events || !rp.buf) {
+		LOGe("memory allocation failed.\n");
+		goto fin;
+	}
+	memset(rp.buf, 0, (size_t)tr->max_sectors << 9);
+	for (i = 0; i < cfg->qd; i++)
+		rp.free_slots[rp.n_free++] = &rp.slots[i];
+	if (sys_io_setup(cfg->qd, &rp.ctx)) {
+		LOGe("io_setup failed: %s\n", strerror(errno));
+		goto fin;
+	}
+
+	if (start_workers(&rp))
+		ret = replay_all(&rp);
+	if (!ret)
+		drain_ios(&rp);
+	stop_workers(&rp);
+	sys_io_destroy(rp.ctx);
+fin:
+	FREE(rp.buf);
+	free(rp.events);
+	free(rp.free_slots);
+	free(rp.slots);
+	close(rp.efd);
+	close(rp.fd);
+	pthread_cond_destroy(&rp.cond);
+	pthread_mutex_destroy(&rp.mutex);
+	return ret;
+}
+
+/*******************************************************************************
+ * Report.
+ *******************************************************************************/
+
+static void print_result(const char *name, const char *dev_path,
+		const struct replay_result *res, bool is_last)
+{
+	unsigned int i;
+
+	printf("\"%s\": {\n"
+		"  \"device\": \"%s\",\n"
+		"  \"elapsed_sec\": %.3f,\n"
+		"  \"skipped\": %llu,\n"
+		"  \"late\": %llu,\n"
+		"  \"max_lag_ns\": %llu,\n"
+		, name, dev_path, res->elapsed_sec
+		, (unsigned long long)res->n_skipped
+		, (unsigned long long)res->n_late
+		, (unsigned long long)res->max_lag_ns);
+	for (i = 0; i < IO_CLASS_MAX; i++)
+		io_stat_print_json(io_class_name_[i], &res->stat[i],
+				res->elapsed_sec, i == IO_CLASS_MAX - 1);
+	printf("}%s\n", is_last ? "" : ",");
+}
+
+/**
+ * Print latency differences between the target and the baseline.
+ */
+static void print_added_latency(const struct replay_result *res,
+		const struct replay_result *base)
+{
+	unsigned int i;
+
+	printf("\"added_lat_ns\": {\n");
+	for (i = 0; i < IO_CLASS_MAX; i++) {
+		const struct io_stat *st = &res->stat[i];
+		const struct io_stat *bst = &base->stat[i];
+
+		printf("  \"%s\": {\"avg\": %lld, \"p50\": %lld, \"p99\": %lld, "
+			"\"p999\": %lld}%s\n"
+			, io_class_name_[i]
+			, (long long)(io_stat_avg(st) - io_stat_avg(bst))
+			, (long long)(io_stat_percentile(st, 500) - io_stat_percentile(bst, 500))
+			, (long long)(io_stat_percentile(st, 990) - io_stat_percentile(bst, 990))
+			, (long long)(io_stat_percentile(st, 999) - io_stat_percentile(bst, 999))
+			, i == IO_CLASS_MAX - 1 ? "" : ",");
+	}
+	printf("}\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct replay_config cfg;
+	struct trace tr;
+	struct replay_result res, base;
+	unsigned int i;
+	size_t n_ios[IO_CLASS_MAX];
+	int ret = 1;
+
+	init_config(&cfg);
+	if (!parse_opt(argc, argv, &cfg)) {
+		show_help();
+		return 1;
+	}
+	if (!load_trace(cfg.trace_path, &tr))
+		return 1;
+	if (cfg.baseline_path &&
+		!replay(&cfg, &tr, cfg.baseline_path, &base))
+		goto fin;
+	if (!replay(&cfg, &tr, cfg.dev_path, &res))
+		goto fin;
+
+	memset(n_ios, 0, sizeof(n_ios));
+	for (i = 0; i < tr.n_ios; i++)
+		n_ios[tr.ios[i].io_class]++;
+	printf("{\n"
+		"\"version\": \"%s\",\n"
+		"\"trace\": {\"path\": \"%s\", \"ios\": %zu, "
+		"\"duration_sec\": %.3f, \"read\": %zu, \"write\": %zu, "
+		"\"fua_write\": %zu, \"flush\": %zu, \"discard\": %zu},\n"
+		"\"config\": {\"afap\": %d, \"speed\": %.3f, \"qd\": %u},\n"
+		, WALB_VERSION_STR, cfg.trace_path, tr.n_ios
+		, tr.ios[tr.n_ios - 1].time_ns / 1e9
+		, n_ios[IO_CLASS_READ], n_ios[IO_CLASS_WRITE]
+		, n_ios[IO_CLASS_FUA_WRITE], n_ios[IO_CLASS_FLUSH]
+		, n_ios[IO_CLASS_DISCARD]
+		, cfg.is_afap, cfg.speed, cfg.qd);
+	print_result("target", cfg.dev_path, &res, !cfg.baseline_path);
+	if (cfg.baseline_path) {
+		print_result("baseline", cfg.baseline_path, &base, false);
+		print_added_latency(&res, &base);
+	}
+	printf("}\n");
+	ret = 0;
+fin:
+	free(tr.ios);
+	return ret;
+}
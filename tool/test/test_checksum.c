@@ -138,6 +138,30 @@ int main()
 	ASSERT(csum1 == csum2);
 	ASSERT(csum1 == csum3);
 
+	/* CRC32C check value and incremental calculation. */
+	ASSERT(walb_csum(WALB_CSUM_CRC32C, "123456789", 9, 0) == 0xE3069283);
+	gettimeofday(&tv, 0); t1 = time_double(&tv);
+	csum1 = walb_csum(WALB_CSUM_CRC32C, buf, size, salt);
+	gettimeofday(&tv, 0); t2 = time_double(&tv);
+	csum2tmp = walb_csum_init(WALB_CSUM_CRC32C, salt);
+	for (i = 0; i < MID_SIZE - 1; i++) {
+		csum2tmp = walb_csum_partial(
+			WALB_CSUM_CRC32C, csum2tmp, buf + mid[i], mid[i + 1] - mid[i]);
+	}
+	csum2 = walb_csum_finish(WALB_CSUM_CRC32C, csum2tmp);
+	printf("crc32c %u (%zu bytes %f sec)\n", csum1, size, t2 - t1);
+	ASSERT(csum1 == csum2);
+
+	/* A block with its own checksum. */
+	for (i = 0; i < 2; i++) {
+		const unsigned int type = i == 0 ? WALB_CSUM_SUM : WALB_CSUM_CRC32C;
+		u32 *csump = (u32 *)(buf + 8);
+		*csump = walb_csum_block(type, buf, 4096, 8, salt);
+		ASSERT(walb_csum_block(type, buf, 4096, 8, salt) == *csump);
+		if (type == WALB_CSUM_SUM)
+			ASSERT(checksum(buf, 4096, salt) == 0);
+	}
+
 #if 0
 	printf("copying...\n");
 	u8 *buf2 = alloc_buf(size);
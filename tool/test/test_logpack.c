@@ -33,9 +33,20 @@ void TEST_capacity_pb()
 	ASSERT(capacity_pb(4096, 25) == 4);
 }
 
+/**
+ * TEST of get_max_logpack_header_pb().
+ */
+void TEST_max_logpack_header_pb()
+{
+	ASSERT(get_max_logpack_header_pb(512) == 64);
+	ASSERT(get_max_logpack_header_pb(1024) == 32);
+	ASSERT(get_max_logpack_header_pb(4096) == 8);
+}
+
 int main()
 {
 	TEST_capacity_pb();
+	TEST_max_logpack_header_pb();
 
 	return 0;
 }
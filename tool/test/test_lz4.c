@@ -0,0 +1,284 @@
+/**
+ * test_lz4.c - Test for LZ4 block decompressor.
+ *
+ * Copyright(C) 2013, Cybozu Labs, Inc.
+ * @license 3-clause BSD, GPL version 2 or later.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz4.h"
+
+/**
+ * Unlike ASSERT, this is checked also with NDEBUG.
+ */
+#define CHECK(cond) do {						\
+		if (!(cond)) {						\
+			fprintf(stderr, "%s:%d: CHECK failed: %s\n",	\
+				__FILE__, __LINE__, #cond);		\
+			exit(1);					\
+		}							\
+	} while (0)
+
+/*******************************************************************************
+ * Reference compressor.
+ *
+ * A greedy LZ4 block compressor following the format rules
+ * the kernel lib/lz4 also follows:
+ * the last 5 bytes are literals and the last match starts
+ * at least 12 bytes before the end of the block.
+ *******************************************************************************/
+
+#define LZ4_REF_HASH_BITS 12
+#define LZ4_REF_MIN_MATCH 4
+#define LZ4_REF_LAST_LITERALS 5
+#define LZ4_REF_MF_LIMIT 12
+#define LZ4_REF_MAX_OFFSET 65535
+
+static u32 read_u32(const u8 *p)
+{
+	u32 v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static unsigned int hash_u32(u32 v)
+{
+	return (v * 2654435761U) >> (32 - LZ4_REF_HASH_BITS);
+}
+
+static u8 *put_length(u8 *op, unsigned int len)
+{
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = (u8)len;
+	return op;
+}
+
+/**
+ * Put a sequence.
+ *
+ * @match_len 0 for the last literals.
+ */
+static u8 *put_sequence(u8 *op, const u8 *lit, unsigned int lit_len,
+			unsigned int offset, unsigned int match_len)
+{
+	u8 *token = op++;
+	const unsigned int ml = match_len ? match_len - LZ4_REF_MIN_MATCH : 0;
+
+	*token = (u8)((lit_len < 15 ? lit_len : 15) << 4);
+	if (lit_len >= 15)
+		op = put_length(op, lit_len - 15);
+	memcpy(op, lit, lit_len);
+	op += lit_len;
+	if (match_len == 0)
+		return op;
+
+	*op++ = (u8)offset;
+	*op++ = (u8)(offset >> 8);
+	*token |= (u8)(ml < 15 ? ml : 15);
+	if (ml >= 15)
+		op = put_length(op, ml - 15);
+	return op;
+}
+
+/**
+ * RETURN:
+ *   compressed size. dst must have size + size / 255 + 16 bytes.
+ */
+static unsigned int lz4_ref_compress(const u8 *src, unsigned int size, u8 *dst)
+{
+	int table[1 << LZ4_REF_HASH_BITS];
+	unsigned int ip = 0, anchor = 0;
+	u8 *op = dst;
+
+	memset(table, 0xff, sizeof(table));
+	while (size >= LZ4_REF_MF_LIMIT && ip <= size - LZ4_REF_MF_LIMIT) {
+		const unsigned int h = hash_u32(read_u32(src + ip));
+		const int ref = table[h];
+		unsigned int len;
+
+		table[h] = ip;
+		if (ref < 0 || ip - ref > LZ4_REF_MAX_OFFSET ||
+			read_u32(src + ref) != read_u32(src + ip)) {
+			ip++;
+			continue;
+		}
+		len = LZ4_REF_MIN_MATCH;
+		while (ip + len < size - LZ4_REF_LAST_LITERALS &&
+			src[ref + len] == src[ip + len])
+			len++;
+		op = put_sequence(op, src + anchor, ip - anchor, ip - ref, len);
+		ip += len;
+		anchor = ip;
+	}
+	op = put_sequence(op, src + anchor, size - anchor, 0, 0);
+	return op - dst;
+}
+
+/*******************************************************************************
+ * Tests.
+ *******************************************************************************/
+
+/**
+ * TEST of literal-only blocks.
+ */
+void TEST_literal()
+{
+	const u8 src0[] = {0x50, 'h', 'e', 'l', 'l', 'o'};
+	u8 src1[3 + 300];
+	u8 dst[512];
+	unsigned int i;
+
+	CHECK(lz4_decompress_safe(src0, dst, sizeof(src0), sizeof(dst)) == 5);
+	CHECK(memcmp(dst, "hello", 5) == 0);
+	CHECK(lz4_decompress_safe(src0, dst, 0, sizeof(dst)) == 0);
+
+	/* Extended literal length: 15 + 255 + 30. */
+	src1[0] = 0xf0;
+	src1[1] = 255;
+	src1[2] = 30;
+	for (i = 0; i < 300; i++)
+		src1[3 + i] = (u8)i;
+	CHECK(lz4_decompress_safe(src1, dst, sizeof(src1), sizeof(dst)) == 300);
+	for (i = 0; i < 300; i++)
+		CHECK(dst[i] == (u8)i);
+}
+
+/**
+ * TEST of matches including overlapped ones.
+ */
+void TEST_match()
+{
+	/* 'a', match (offset 1, length 18), then 5 literals. */
+	const u8 src0[] = {0x1e, 'a', 0x01, 0x00, 0x50, 'a', 'a', 'a', 'a', 'a'};
+	/* "abc", match (offset 3, length 4 + 15 + 1), then 5 literals. */
+	const u8 src1[] = {0x3f, 'a', 'b', 'c', 0x03, 0x00, 1,
+			0x50, 'x', 'y', 'z', 'x', 'y'};
+	u8 dst[64];
+	int i;
+
+	CHECK(lz4_decompress_safe(src0, dst, sizeof(src0), sizeof(dst)) == 24);
+	for (i = 0; i < 24; i++)
+		CHECK(dst[i] == 'a');
+
+	CHECK(lz4_decompress_safe(src1, dst, sizeof(src1), sizeof(dst)) == 28);
+	for (i = 0; i < 23; i++)
+		CHECK(dst[i] == "abc"[i % 3]);
+	CHECK(memcmp(dst + 23, "xyzxy", 5) == 0);
+}
+
+/**
+ * TEST of broken blocks.
+ */
+void TEST_broken()
+{
+	const u8 zero_off[] = {0x1e, 'a', 0x00, 0x00, 0x50, 'a', 'a', 'a', 'a', 'a'};
+	const u8 far_off[] = {0x1e, 'a', 0x02, 0x00, 0x50, 'a', 'a', 'a', 'a', 'a'};
+	const u8 short_lit[] = {0x50, 'h', 'e'};
+	const u8 short_len[] = {0xf0, 255};
+	const u8 ok[] = {0x1e, 'a', 0x01, 0x00, 0x50, 'a', 'a', 'a', 'a', 'a'};
+	u8 dst[64];
+
+	CHECK(lz4_decompress_safe(zero_off, dst, sizeof(zero_off), sizeof(dst)) < 0);
+	CHECK(lz4_decompress_safe(far_off, dst, sizeof(far_off), sizeof(dst)) < 0);
+	CHECK(lz4_decompress_safe(short_lit, dst, sizeof(short_lit), sizeof(dst)) < 0);
+	CHECK(lz4_decompress_safe(short_len, dst, sizeof(short_len), sizeof(dst)) < 0);
+	/* Truncated in the match offset. */
+	CHECK(lz4_decompress_safe(ok, dst, 3, sizeof(dst)) < 0);
+	/* The output buffer is too small. */
+	CHECK(lz4_decompress_safe(ok, dst, sizeof(ok), 23) < 0);
+	CHECK(lz4_decompress_safe(ok, dst, sizeof(ok), 10) < 0);
+}
+
+/**
+ * Compress, decompress and compare.
+ *
+ * @is_compressible true if the compressed size must be smaller.
+ */
+static void check_round_trip(const u8 *src, unsigned int size, bool is_compressible)
+{
+	u8 *cmpr = malloc(size + size / 255 + 16);
+	u8 *dst = malloc(size + 1);
+	unsigned int cmpr_size;
+
+	CHECK(cmpr && dst);
+	cmpr_size = lz4_ref_compress(src, size, cmpr);
+	if (is_compressible)
+		CHECK(cmpr_size < size);
+	CHECK(lz4_decompress_safe(cmpr, dst, cmpr_size, size) == (int)size);
+	CHECK(memcmp(dst, src, size) == 0);
+	if (size > 0) {
+		/* The output buffer is too small. */
+		CHECK(lz4_decompress_safe(cmpr, dst, cmpr_size, size - 1) < 0);
+		/* Truncated. */
+		CHECK(lz4_decompress_safe(cmpr, dst, cmpr_size - 1, size) < 0);
+	}
+	free(dst);
+	free(cmpr);
+}
+
+/**
+ * TEST of data compressed by the reference compressor.
+ */
+void TEST_round_trip()
+{
+	const unsigned int size = 64 * 1024;
+	const char *text = "walb: block-level write-ahead logging. ";
+	u8 *buf = calloc(1, size);
+	u64 x = 88172645463325252ULL;
+	unsigned int i, n;
+
+	CHECK(buf);
+
+	/* Small blocks around the format limits. */
+	for (n = 0; n <= 32; n++) {
+		for (i = 0; i < n; i++)
+			buf[i] = "aaaab"[i % 5];
+		check_round_trip(buf, n, false);
+	}
+
+	/* Zeros with long match lengths. */
+	memset(buf, 0, size);
+	check_round_trip(buf, 4096, true);
+	check_round_trip(buf, size, true);
+
+	/* Repeated text. */
+	for (i = 0; i < size; i++)
+		buf[i] = text[i % strlen(text)];
+	check_round_trip(buf, size, true);
+
+	/* Incompressible data with long literal lengths. */
+	for (i = 0; i < size; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		buf[i] = (u8)x;
+	}
+	check_round_trip(buf, size, false);
+
+	/* Random data with copies at various distances. */
+	for (i = 0; i < 64; i++) {
+		const unsigned int len = 8 + i * 37 % 500;
+		const unsigned int from = i * 997 % (size / 2);
+		const unsigned int to = size / 2 + i * 1499 % (size / 2 - len);
+		memcpy(buf + to, buf + from, len);
+	}
+	check_round_trip(buf, size, false);
+
+	free(buf);
+}
+
+int main()
+{
+	TEST_literal();
+	TEST_match();
+	TEST_broken();
+	TEST_round_trip();
+
+	return 0;
+}
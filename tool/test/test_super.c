@@ -10,6 +10,7 @@
 #include "util.h"
 #include "walb_util.h"
 #include "linux/walb/super.h"
+#include "linux/walb/log_device.h"
 
 #define DATA_DEV_SIZE (32 * 1024 * 1024)
 #define LOG_DEV_SIZE  (16 * 1024 * 1024)
@@ -49,8 +50,108 @@ void test(int lbs, int pbs, u64 ddev_lb, u64 ldev_lb,
 	close(fd);
 }
 
+/**
+ * Test super sector slot choice.
+ */
+void test_choose_latest(void)
+{
+	ASSERT(choose_latest_super_sector(1, 0, 1, 0) == 0);
+	ASSERT(choose_latest_super_sector(1, 2, 1, 3) == 1);
+	ASSERT(choose_latest_super_sector(1, 4, 1, 3) == 0);
+	ASSERT(choose_latest_super_sector(0, 4, 1, 3) == 1);
+	ASSERT(choose_latest_super_sector(1, 4, 0, 5) == 0);
+	ASSERT(choose_latest_super_sector(0, 4, 0, 5) == -1);
+	ASSERT(get_super_sector_slot(0) == 0);
+	ASSERT(get_super_sector_slot(3) == 1);
+}
+
+/**
+ * Test striped log address mapping.
+ */
+void test_striped_log(void)
+{
+	UNUSED u64 off;
+
+	off = 5;
+	ASSERT(map_striped_log_offset(&off, 1, 16) == 0 && off == 5);
+	off = 5;
+	ASSERT(map_striped_log_offset(&off, 3, 16) == 0 && off == 5);
+	off = 16 + 5;
+	ASSERT(map_striped_log_offset(&off, 3, 16) == 1 && off == 5);
+	off = 16 * 2 + 5;
+	ASSERT(map_striped_log_offset(&off, 3, 16) == 2 && off == 5);
+	off = 16 * 4 + 5;
+	ASSERT(map_striped_log_offset(&off, 3, 16) == 1 && off == 16 + 5);
+	ASSERT(get_striped_log_size(100, 1, 16) == 100);
+	ASSERT(get_striped_log_size(100, 3, 16) == 96 * 3);
+}
+
+/**
+ * Test dirty bitmap layout and a clean bitmap image.
+ */
+void test_dirty_bitmap(unsigned int pbs)
+{
+	struct sector_data *super_sect = sector_alloc(pbs);
+	struct sector_data *blk_sect = sector_alloc(pbs);
+	struct walb_super_sector *super;
+	struct walb_dirty_bitmap_header *blk;
+	const u64 ddev_lb = DATA_DEV_SIZE / 512;
+	UNUSED u64 ring_size, off;
+	UNUSED bool ret;
+	int fd;
+
+	ASSERT(super_sect);
+	ASSERT(blk_sect);
+	ret = init_super_sector(super_sect, 512, pbs,
+				ddev_lb, LOG_DEV_SIZE / 512, NULL);
+	ASSERT(ret);
+	super = get_super_sector(super_sect);
+	ring_size = super->ring_buffer_size;
+
+	ASSERT(!init_dirty_bitmap_of_super(super, 3000));
+	ret = init_dirty_bitmap_of_super(super, 2048);
+	ASSERT(ret);
+	ASSERT(super->dirty_bitmap_pb == 1);
+	ASSERT(super->ring_buffer_size == ring_size - 1);
+	ASSERT(get_log_end_offset_2(super) ==
+		get_ring_buffer_offset_2(super) + ring_size);
+	ASSERT_SUPER_SECTOR(super_sect);
+
+	ASSERT(get_dirty_bitmap_n_bits(ddev_lb, 2048) == 32);
+	ASSERT(get_dirty_bitmap_n_bits(ddev_lb + 1, 2048) == 33);
+	ASSERT(get_dirty_bitmap_pb(get_n_bits_in_dirty_bitmap_block(pbs), pbs) == 1);
+	ASSERT(get_dirty_bitmap_pb(get_n_bits_in_dirty_bitmap_block(pbs) + 1, pbs) == 2);
+	ASSERT(get_dirty_region_shift(2048) == 11);
+	ASSERT(get_dirty_bitmap_bit(2047, 11, 32) == 0);
+	ASSERT(get_dirty_bitmap_bit(2048, 11, 32) == 1);
+	ASSERT(get_dirty_bitmap_bit(ddev_lb * 2, 11, 32) == 31);
+
+	fd = open(LOG_DEV_FILE, O_RDWR | O_CREAT | O_TRUNC, 00755);
+	ASSERT(fd > 0);
+	ret = write_clean_dirty_bitmap(&fd, super);
+	ASSERT(ret);
+	off = get_dirty_bitmap_offset_2(super);
+	ret = sector_read(fd, off, blk_sect);
+	ASSERT(ret);
+	blk = (struct walb_dirty_bitmap_header *)blk_sect->data;
+	ASSERT(is_valid_dirty_bitmap_block(blk, pbs, WALB_CSUM_SUM));
+	ASSERT(!(blk->flags & (1U << DIRTY_BITMAP_PINNED)));
+	ASSERT(get_dirty_bitmap_block_bits(blk)[0] == 0);
+	get_dirty_bitmap_block_bits(blk)[0] = 1;
+	ASSERT(!is_valid_dirty_bitmap_block(blk, pbs, WALB_CSUM_SUM));
+	close(fd);
+
+	sector_free(blk_sect);
+	sector_free(super_sect);
+}
+
 int main()
 {
+	test_choose_latest();
+	test_striped_log();
+	test_dirty_bitmap(512);
+	test_dirty_bitmap(4096);
+
 	int ddev_lb = DATA_DEV_SIZE / 512;
 	int ldev_lb = LOG_DEV_SIZE / 512;
 
@@ -232,6 +232,54 @@ bool discard_whole_area(int fd)
 	return true;
 }
 
+/**
+ * Fill an area of the device with zero.
+ * BLKZEROOUT is tried at first, which uses write-zeroes requests
+ * if the device supports them. Zero buffers are written otherwise.
+ *
+ * @fd opened file descriptor. O_DIRECT is allowed.
+ * @off offset [byte]. It must be aligned to the logical block size.
+ * @size size [byte]. It must be aligned to the logical block size.
+ *
+ * RETURN:
+ *   true in success, or false.
+ */
+bool zeroout_area(int fd, u64 off, u64 size)
+{
+	const size_t buf_size = 1 << 20;
+	u64 range[2] = { off, size };
+	void *buf;
+	bool ret = false;
+
+	if (fd < 0) {
+		LOGe("fd < 0.\n");
+		return false;
+	}
+	if (ioctl(fd, BLKZEROOUT, &range) == 0) {
+		return true;
+	}
+
+	if (posix_memalign(&buf, LOGICAL_BLOCK_SIZE, buf_size)) {
+		LOGe("posix_memalign failed.\n");
+		return false;
+	}
+	memset(buf, 0, buf_size);
+	while (size > 0) {
+		const size_t bytes = get_min_value(size, (u64)buf_size);
+		const ssize_t w = pwrite(fd, buf, bytes, off);
+		if (w < 0 || (size_t)w != bytes) {
+			LOGe("pwrite failed: %s.\n", strerror(errno));
+			goto fin;
+		}
+		off += bytes;
+		size -= bytes;
+	}
+	ret = true;
+fin:
+	free(buf);
+	return ret;
+}
+
 /**
  * Generate uuid
  *
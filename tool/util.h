@@ -39,6 +39,7 @@ bool get_bdev_info(const char *path, struct bdev_info *info_p);
 bool is_block_size_same(const struct bdev_info *info0, const struct bdev_info *info1);
 bool is_discard_supported(int fd);
 bool discard_whole_area(int fd);
+bool zeroout_area(int fd, u64 off, u64 size);
 
 /* uuid functions */
 bool generate_uuid(u8* uuid);
@@ -65,7 +65,10 @@ struct walblog_header
 	/* Must be WALBLOG_HEADER_SIZE */
 	u16 header_size;
 
-	u16 reserved1;
+	/* Checksum type for log header and IO data. WALB_CSUM_XXX.
+	   Older versions have 0 (WALB_CSUM_SUM) here.
+	   Walblog headers always use WALB_CSUM_SUM. */
+	u16 log_checksum_type;
 
 	/* Checksum of walblog_header. */
 	u32 checksum;
@@ -117,6 +120,7 @@ static inline void print_wlog_header(const struct walblog_header* wh)
 		"checksum: %08x\n"
 		"version: %" PRIu32"\n"
 		"log_checksum_salt: %" PRIu32"\n"
+		"log_checksum_type: %u\n"
 		"logical_bs: %" PRIu32"\n"
 		"physical_bs: %" PRIu32"\n"
 		"uuid: %s\n"
@@ -125,6 +129,7 @@ static inline void print_wlog_header(const struct walblog_header* wh)
 		wh->checksum,
 		wh->version,
 		wh->log_checksum_salt,
+		wh->log_checksum_type,
 		wh->logical_bs,
 		wh->physical_bs,
 		uuidstr,
@@ -147,7 +152,7 @@ static inline bool is_valid_wlog_header(const struct walblog_header* wh)
 		LOGx("wlog header sector type is invalid.\n");
 		return false;
 	}
-	if (wh->version != WALB_LOG_VERSION) {
+	if (!is_valid_log_version(wh->version)) {
 		LOGx("wlog header version is invalid.\n");
 		return false;
 	}
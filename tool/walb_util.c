@@ -462,14 +462,34 @@ void print_super_sector_raw(const struct walb_super_sector* super_sect)
 		"ring_buffer_size: %lu\n"
 		"oldest_lsid: %lu\n"
 		"written_lsid: %lu\n"
-		"device_size: %lu\n",
+		"device_size: %lu\n"
+		"generation: %lu\n"
+		"logpack_header_pb: %u\n"
+		"format_flags: %08x\n",
 		super_sect->name,
 		super_sect->ring_buffer_size,
 		super_sect->oldest_lsid,
 		super_sect->written_lsid,
-		super_sect->device_size);
+		super_sect->device_size,
+		super_sect->generation,
+		get_logpack_header_pb_of_super(super_sect),
+		super_sect->format_flags);
 	printf("ring_buffer_offset: %lu\n",
 		get_ring_buffer_offset_2(super_sect));
+	if (get_n_ldevs_of_super(super_sect) > 1) {
+		printf("n_ldevs: %u\n"
+			"log_stripe_pb: %u\n",
+			super_sect->n_ldevs,
+			super_sect->log_stripe_pb);
+	}
+	if (get_dirty_bitmap_pb_of_super(super_sect) > 0) {
+		printf("dirty_region_lb: %u\n"
+			"dirty_bitmap_pb: %u\n"
+			"dirty_bitmap_offset: %lu\n",
+			super_sect->dirty_region_lb,
+			super_sect->dirty_bitmap_pb,
+			get_dirty_bitmap_offset_2(super_sect));
+	}
 }
 
 /**
@@ -482,30 +502,21 @@ void print_super_sector(const struct sector_data *sect)
 }
 
 /**
- * Write super sector to the log device.
- *
- * @fd file descripter of log device.
- * @super_sect super sector data.
+ * Create a memory image of a super sector with its checksum.
  *
  * RETURN:
- *   true in success, or false.
+ *   allocated sector image in success, or NULL.
+ *   The caller must free() it.
  */
-bool write_super_sector_raw(int fd, const struct walb_super_sector* super_sect)
+static u8 *create_super_sector_image(const struct walb_super_sector* super_sect)
 {
-	u32 sect_sz;
+	const u32 sect_sz = super_sect->physical_bs;
 	u8 *buf;
 	struct walb_super_sector *p;
 	u32 csum;
-	u64 off0, off1;
-	bool ret0, ret1;
 
-	ASSERT(super_sect);
-
-	sect_sz = super_sect->physical_bs;
-
-	/* Memory image of sector. */
 	if (posix_memalign((void **)&buf, PAGE_SIZE, sect_sz) != 0) {
-		return false;
+		return NULL;
 	}
 	memset(buf, 0, sect_sz);
 	memcpy(buf, super_sect, sizeof(*super_sect));
@@ -515,12 +526,36 @@ bool write_super_sector_raw(int fd, const struct walb_super_sector* super_sect)
 	p->sector_type = SECTOR_TYPE_SUPER;
 
 	/* Calculate checksum. */
-	p->checksum = 0;
-	csum = checksum(buf, sect_sz, 0);
+	csum = calc_super_sector_checksum(p, sect_sz);
 	print_binary_hex(buf, sect_sz);/* debug */
 	p->checksum = csum;
 	print_binary_hex(buf, sect_sz);/* debug */
-	ASSERT(checksum(buf, sect_sz, 0) == 0);
+	return buf;
+}
+
+/**
+ * Write super sector to the log device.
+ *
+ * @fd file descripter of log device.
+ * @super_sect super sector data.
+ *
+ * RETURN:
+ *   true in success, or false.
+ */
+bool write_super_sector_raw(int fd, const struct walb_super_sector* super_sect)
+{
+	u32 sect_sz;
+	u8 *buf;
+	u64 off0, off1;
+	bool ret0, ret1;
+
+	ASSERT(super_sect);
+
+	sect_sz = super_sect->physical_bs;
+	buf = create_super_sector_image(super_sect);
+	if (!buf) {
+		return false;
+	}
 
 	/* Really write sector data. */
 	off0 = get_super_sector0_offset_2(super_sect);
@@ -532,6 +567,40 @@ bool write_super_sector_raw(int fd, const struct walb_super_sector* super_sect)
 	return ret0 && ret1;
 }
 
+/**
+ * Write super sector to the slot of its generation only.
+ *
+ * The other slot keeps the previous super sector
+ * so that it is still valid if this write is torn.
+ * Increment the generation before calling this.
+ *
+ * RETURN:
+ *   true in success, or false.
+ */
+bool write_super_sector_in_slot(int fd, const struct sector_data *sect)
+{
+	const struct walb_super_sector *super_sect;
+	u8 *buf;
+	u64 off;
+	bool ret;
+
+	if (!is_valid_super_sector(sect)) {
+		return false;
+	}
+	super_sect = get_super_sector_const(sect);
+	buf = create_super_sector_image(super_sect);
+	if (!buf) {
+		return false;
+	}
+	off = get_super_sector_offset(
+		super_sect->physical_bs,
+		get_super_sector_slot(super_sect->generation));
+	ret = write_sector_raw(fd, buf, super_sect->physical_bs, off);
+
+	free(buf);
+	return ret;
+}
+
 /**
  * Write super sector to the log device.
  *
@@ -546,17 +615,47 @@ bool write_super_sector(int fd, const struct sector_data *sect)
 	return write_super_sector_raw(fd, sect->data);
 }
 
+/**
+ * Read a super sector slot and validate it.
+ *
+ * RETURN:
+ *  true if the slot is read and valid, or false.
+ */
+static bool read_super_sector_slot(
+	int fd, unsigned int slot, struct sector_data *sect)
+{
+	u64 off = get_super_sector_offset(sect->size, slot);
+
+	if (!sector_read(fd, off, sect)) {
+		LOGe("Read sector failed.\n");
+		return false;
+	}
+	if (calc_super_sector_checksum(get_super_sector_const(sect), sect->size)
+		!= get_super_sector_const(sect)->checksum) {
+		LOGe("Checksum invalid (super sector%u).\n", slot);
+		return false;
+	}
+	if (!is_valid_super_sector(sect)) {
+		LOGe("Super sector invalid (super sector%u).\n", slot);
+		return false;
+	}
+	return true;
+}
+
 /**
  * Read super sector.
  *
- * Currently 2nd super sector is not read.
+ * Both super sector 0 and 1 are read and
+ * the valid one with the larger generation is chosen.
  *
  * RETURN:
  *  true in success, or false.
  */
 bool read_super_sector(int fd, struct sector_data *sect)
 {
-	u64 off0;
+	struct sector_data *sect1;
+	bool valid0, valid1;
+	int slot;
 
 	if (!is_valid_sector_data(sect)) {
 		LOGe("Sector data is not valid.\n");
@@ -564,22 +663,101 @@ bool read_super_sector(int fd, struct sector_data *sect)
 	}
 	ASSERT(sect->size <= PAGE_SIZE);
 
-	off0 = get_super_sector0_offset(sect->size);
-	if (!sector_read(fd, off0, sect)) {
-		LOGe("Read sector failed.\n");
+	sect1 = sector_alloc(sect->size);
+	if (!sect1) {
+		LOGe("Memory allocation failed.\n");
 		return false;
 	}
-	if (checksum(sect->data, sect->size, 0) != 0) {
-		LOGe("Checksum invalid.\n");
+	valid0 = read_super_sector_slot(fd, 0, sect);
+	valid1 = read_super_sector_slot(fd, 1, sect1);
+	slot = choose_latest_super_sector(
+		valid0, get_super_sector(sect)->generation,
+		valid1, get_super_sector(sect1)->generation);
+	if (slot == 1) {
+		sector_copy(sect, sect1);
+	}
+	sector_free(sect1);
+	if (slot < 0) {
+		LOGe("Both super sectors are invalid.\n");
 		return false;
 	}
-	if (!is_valid_super_sector(sect)) {
-		LOGe("Super sector invalid.\n");
+	return true;
+}
+
+/**
+ * Add a dirty bitmap to a super sector image.
+ * The ring buffer is shrunk by the bitmap size.
+ *
+ * @region_lb region size covered by a bit [logical block].
+ *   It must be a power of 2.
+ *
+ * RETURN:
+ *   true in success, or false.
+ */
+bool init_dirty_bitmap_of_super(
+	struct walb_super_sector *super_sect, u32 region_lb)
+{
+	const unsigned int pbs = super_sect->physical_bs;
+	u32 n_pb;
+
+	if (!is_valid_dirty_region_lb(region_lb)) {
+		LOGe("Dirty region size must be a power of 2.\n");
 		return false;
 	}
+	n_pb = get_dirty_bitmap_pb(
+		get_dirty_bitmap_n_bits(super_sect->device_size, region_lb), pbs);
+	if (super_sect->ring_buffer_size <= n_pb) {
+		LOGe("Log device is too small for the dirty bitmap.\n");
+		return false;
+	}
+	super_sect->ring_buffer_size -= n_pb;
+	super_sect->dirty_region_lb = region_lb;
+	super_sect->dirty_bitmap_pb = n_pb;
+	super_sect->format_flags |= 1U << SUPER_FORMAT_DIRTY_BITMAP;
 	return true;
 }
 
+/**
+ * Write a clean dirty bitmap to the log devices.
+ *
+ * @fds file descriptors of the log devices.
+ *   fds[i] is the i'th device of a striped log.
+ * @super_sect super sector image with the dirty bitmap.
+ *
+ * RETURN:
+ *   true in success, or false.
+ */
+bool write_clean_dirty_bitmap(
+	const int *fds, const struct walb_super_sector *super_sect)
+{
+	const unsigned int pbs = super_sect->physical_bs;
+	const u64 bmp_off = get_dirty_bitmap_offset_2(super_sect);
+	struct walb_dirty_bitmap_header *blk;
+	u32 i;
+	bool ret = true;
+
+	if (posix_memalign((void **)&blk, PAGE_SIZE, pbs) != 0)
+		return false;
+	memset(blk, 0, pbs);
+	blk->sector_type = SECTOR_TYPE_DIRTY_BITMAP;
+	blk->checksum = calc_dirty_bitmap_block_checksum(
+		blk, pbs, get_csum_type_of_super(super_sect));
+
+	for (i = 0; i < get_dirty_bitmap_pb_of_super(super_sect); i++) {
+		u64 off = bmp_off + i;
+		const unsigned int idx = map_striped_log_offset(
+			&off, get_n_ldevs_of_super(super_sect),
+			super_sect->log_stripe_pb);
+		if (!write_sector_raw(fds[idx], (const u8 *)blk, pbs, off)) {
+			LOGe("Write dirty bitmap block %u failed.\n", i);
+			ret = false;
+			break;
+		}
+	}
+	free(blk);
+	return ret;
+}
+
 /**
  * Print bitmap data.
  */
@@ -72,6 +72,13 @@ bool init_super_sector(
 void print_super_sector(const struct sector_data *sect);
 bool read_super_sector(int fd, struct sector_data *sect);
 bool write_super_sector(int fd, const struct sector_data *sect);
+bool write_super_sector_in_slot(int fd, const struct sector_data *sect);
+
+/* Dirty bitmap operations. */
+bool init_dirty_bitmap_of_super(
+	struct walb_super_sector *super_sect, u32 region_lb);
+bool write_clean_dirty_bitmap(
+	const int *fds, const struct walb_super_sector *super_sect);
 
 #ifdef __cplusplus
 }
@@ -72,10 +72,32 @@ struct config
 
 	size_t size; /* (size_t)(-1) means undefined. */
 
+	/* Logpack header size for format_ldev [physical block]. */
+	unsigned int logpack_header_pb;
+
+	/* Format flags for format_ldev. See SUPER_FORMAT_XXX. */
+	u32 format_flags;
+
+	/* Other log devices of a striped log. */
+	char *sub_ldev_names[WALB_MAX_LDEVS - 1];
+	unsigned int n_sub_ldevs;
+
+	/* Stripe size for format_ldev [KiB]. */
+	unsigned int stripe_kb;
+
+	/* Dirty region size for format_ldev [KiB]. 0 means no dirty bitmap. */
+	unsigned int dirty_region_kb;
+
 	/**
 	 * Parameters to create_wdev.
 	 */
 	struct walb_start_param param;
+
+	/**
+	 * Parameters to set_qos.
+	 * (u64)(-1) or (u32)(-1) means undefined.
+	 */
+	struct walb_qos_param qos;
 };
 
 /**
@@ -107,6 +129,13 @@ static const char *helpstr_options_ =
 	"  WDEV:   --wdev [walb device path]\n"
 	"  WLDEV:  --wldev [walblog device path]\n"
 	"  NAME:   --name [name of stuff]\n"
+	"  LOGPACK_HEADER_PB: --logpack_header_pb [size]"
+	" (1 <= size <= 64 and size * pbs <= 32KiB, default 1)\n"
+	"  CRC32C: --crc32c (use CRC32C for log checksums)\n"
+	"  SUB_LDEV: --sub_ldev [log device path] (repeatable, striped log)\n"
+	"  STRIPE_KB: --stripe_kb [size] (stripe size of striped log, default 64)\n"
+	"  DIRTY_REGION_KB: --dirty_region_kb [size]\n"
+	"          (region size of the dirty bitmap, a power of 2)\n"
 	"  WLOG:   walb log data as stream\n"
 	"  MAX_LOGPACK_KB: --max_logpack_kb [size]\n"
 	"  MAX_PENDING_MB: --max_pending_mb [size] \n"
@@ -115,7 +144,10 @@ static const char *helpstr_options_ =
 	"  FLUSH_INTERVAL_MB: --flush_interval_mb [size]\n"
 	"  FLUSH_INTERVAL_MS: --flush_interval_ms [timeout]\n"
 	"  N_PACK_BULK: --n_pack_bulk [size]\n"
-	"  N_IO_BULK: --n_io_bulk [size]\n";
+	"  N_IO_BULK: --n_io_bulk [size]\n"
+	"  QOS: --read_iops [iops] --write_iops [iops]\n"
+	"       --read_bps [byte/sec] --write_bps [byte/sec] --burst_ms [period]\n"
+	"       (0 means unlimited)\n";
 
 /**
  * Helper data structure for help command.
@@ -130,9 +162,12 @@ struct cmdhelp
  * Help string.
  */
 static struct cmdhelp cmdhelps_[] = {
-	{ "format_ldev LDEV DDEV (NAME) (DISCARD)",
+	{ "format_ldev LDEV DDEV (NAME) (DISCARD) (LOGPACK_HEADER_PB)"
+	  " (CRC32C)\n"
+	  "             "
+	  " (SUB_LDEV...) (STRIPE_KB) (DIRTY_REGION_KB)",
 	  "Format log device." },
-	{ "create_wdev LDEV DDEV (NAME)"
+	{ "create_wdev LDEV (SUB_LDEV...) DDEV (NAME)"
 	  " (MAX_LOGPACK_KB) (MAX_PENDING_MB) (MIN_PENDING_MB)\n"
 	  "             "
 	  " (QUEUE_STOP_TIMEOUT_MS) (FLUSH_INTERVAL_MB) (FLUSH_INTERVAL_MB)\n"
@@ -147,8 +182,14 @@ static struct cmdhelp cmdhelps_[] = {
 	  "Get checkpoint interval in [ms]." },
 	{ "cat_wldev WLDEV (LRANGE) > WLOG",
 	  "Extract wlog from walblog device." },
+	{ "stream_wlog WDEV WLDEV (LRANGE) (SIZE) > WLOG",
+	  "Extract wlog through the walb device waiting for new logs."
+	  " Without --lsid1 it does not stop."
+	  " SIZE is the buffer size [KiB] (default 1024)." },
 	{ "show_wldev WLDEV (LRANGE)",
 	  "Show wlog in walblog device." },
+	{ "show_logpack_headers WDEV (LRANGE)",
+	  "Show recent logpack headers kept in the walb device memory." },
 	{ "show_wlog (LRANGE) < WLOG",
 	  "Show wlog in stdin." },
 	{ "redo_wlog DDEV (LRANGE) < WLOG",
@@ -186,6 +227,17 @@ static struct cmdhelp cmdhelps_[] = {
 	  "Melt a frozen device." },
 	{ "is_frozen WDEV",
 	  "Check the device is frozen or not." },
+	{ "set_qos WDEV (QOS)",
+	  "Set IOPS/bandwidth limits. Unspecified ones are not changed." },
+	{ "get_qos WDEV",
+	  "Get IOPS/bandwidth limits." },
+	{ "get_dirty_bitmap WDEV",
+	  "Show regions written since the logs were last extracted"
+	  " [logical block]." },
+	{ "unpin_dirty_bitmap WDEV",
+	  "Unpin the dirty bitmap after a backup of the dirty regions." },
+	{ "status WDEV",
+	  "Show statistics of the device." },
 	{ "get_version",
 	  "Get walb driver version."},
 	{ "version",
@@ -215,6 +267,16 @@ enum
 	OPT_FLUSH_INTERVAL_MS,
 	OPT_N_PACK_BULK,
 	OPT_N_IO_BULK,
+	OPT_READ_IOPS,
+	OPT_WRITE_IOPS,
+	OPT_READ_BPS,
+	OPT_WRITE_BPS,
+	OPT_BURST_MS,
+	OPT_LOGPACK_HEADER_PB,
+	OPT_CRC32C,
+	OPT_SUB_LDEV,
+	OPT_STRIPE_KB,
+	OPT_DIRTY_REGION_KB,
 	OPT_HELP,
 };
 
@@ -231,15 +293,22 @@ static void init_config(struct config* cfg);
 static int parse_opt(int argc, char* const argv[], struct config *cfg);
 static bool init_walb_metadata(
 	int fd, unsigned int lbs, unsigned int pbs,
-	u64 ddev_lb, u64 ldev_lb, const char *name);
+	u64 ddev_lb, u64 ldev_lb, const char *name,
+	unsigned int logpack_header_pb, u32 format_flags,
+	unsigned int n_ldevs, u32 log_stripe_pb,
+	const int *sub_fds, u32 dirty_region_lb);
 static bool invoke_ioctl(
 	const char *wdev_name, struct walb_ctl *ctl, int open_flag);
 static bool ioctl_and_print_bool(const char *wdev_name, int cmd);
 static u64 get_ioctl_u64(const char* wdev_name, int command);
+static bool get_qos(const char *wdev_name, struct walb_qos_param *param);
 static bool dispatch(const struct config *cfg);
 static struct walblog_header *create_and_read_wlog_header(int inFd);
 static struct walb_super_sector *create_and_read_super_sector(
 	struct sector_data **sectdp, int fd, unsigned int pbs);
+static bool write_wlog_header(
+	int fd, const struct walb_super_sector *super, unsigned int lbs,
+	u64 begin_lsid, u64 end_lsid);
 
 /* commands. */
 static bool do_format_ldev(const struct config *cfg);
@@ -249,10 +318,12 @@ static bool do_take_checkpoint(const struct config *cfg);
 static bool do_set_checkpoint_interval(const struct config *cfg);
 static bool do_get_checkpoint_interval(const struct config *cfg);
 static bool do_cat_wldev(const struct config *cfg);
+static bool do_stream_wlog(const struct config *cfg);
 static bool do_redo_wlog(const struct config *cfg);
 static bool do_redo(const struct config *cfg);
 static bool do_show_wlog(const struct config *cfg);
 static bool do_show_wldev(const struct config *cfg);
+static bool do_show_logpack_headers(const struct config *cfg);
 static bool do_set_oldest_lsid(const struct config *cfg);
 static bool do_get_oldest_lsid(const struct config *cfg);
 static bool do_get_written_lsid(const struct config *cfg);
@@ -268,6 +339,11 @@ static bool do_is_log_overflow(const struct config *cfg);
 static bool do_freeze(const struct config *cfg);
 static bool do_melt(const struct config *cfg);
 static bool do_is_frozen(const struct config *cfg);
+static bool do_set_qos(const struct config *cfg);
+static bool do_get_qos(const struct config *cfg);
+static bool do_get_dirty_bitmap(const struct config *cfg);
+static bool do_unpin_dirty_bitmap(const struct config *cfg);
+static bool do_status(const struct config *cfg);
 static bool do_get_version(const struct config *cfg);
 static bool do_version(const struct config *cfg);
 static bool do_help(const struct config *cfg);
@@ -284,8 +360,10 @@ const struct map_str_to_fn cmd_map_[] = {
 	{ "set_checkpoint_interval", do_set_checkpoint_interval },
 	{ "get_checkpoint_interval", do_get_checkpoint_interval },
 	{ "cat_wldev", do_cat_wldev },
+	{ "stream_wlog", do_stream_wlog },
 	{ "show_wlog", do_show_wlog },
 	{ "show_wldev", do_show_wldev },
+	{ "show_logpack_headers", do_show_logpack_headers },
 	{ "redo_wlog", do_redo_wlog },
 	{ "redo", do_redo },
 	{ "set_oldest_lsid", do_set_oldest_lsid },
@@ -303,6 +381,11 @@ const struct map_str_to_fn cmd_map_[] = {
 	{ "freeze", do_freeze },
 	{ "melt", do_melt },
 	{ "is_frozen", do_is_frozen },
+	{ "set_qos", do_set_qos },
+	{ "get_qos", do_get_qos },
+	{ "get_dirty_bitmap", do_get_dirty_bitmap },
+	{ "unpin_dirty_bitmap", do_unpin_dirty_bitmap },
+	{ "status", do_status },
 	{ "get_version", do_get_version },
 	{ "version", do_version },
 	{ "help", do_help },
@@ -389,6 +472,11 @@ static void init_config(struct config* cfg)
 
 	cfg->size = (size_t)(-1);
 
+	cfg->logpack_header_pb = 1;
+	cfg->format_flags = 0;
+	cfg->n_sub_ldevs = 0;
+	cfg->stripe_kb = 64;
+
 	cfg->param.max_logpack_kb = 0;
 	cfg->param.max_pending_mb = 32;
 	cfg->param.min_pending_mb = 16;
@@ -397,6 +485,12 @@ static void init_config(struct config* cfg)
 	cfg->param.log_flush_interval_ms = 100;
 	cfg->param.n_pack_bulk = 128;
 	cfg->param.n_io_bulk = 1024;
+
+	cfg->qos.read_iops = (u64)(-1);
+	cfg->qos.write_iops = (u64)(-1);
+	cfg->qos.read_bps = (u64)(-1);
+	cfg->qos.write_bps = (u64)(-1);
+	cfg->qos.burst_ms = (u32)(-1);
 }
 
 /**
@@ -425,6 +519,16 @@ static int parse_opt(int argc, char* const argv[], struct config *cfg)
 			{"flush_interval_ms", 1, 0, OPT_FLUSH_INTERVAL_MS},
 			{"n_pack_bulk", 1, 0, OPT_N_PACK_BULK},
 			{"n_io_bulk", 1, 0, OPT_N_IO_BULK},
+			{"read_iops", 1, 0, OPT_READ_IOPS},
+			{"write_iops", 1, 0, OPT_WRITE_IOPS},
+			{"read_bps", 1, 0, OPT_READ_BPS},
+			{"write_bps", 1, 0, OPT_WRITE_BPS},
+			{"burst_ms", 1, 0, OPT_BURST_MS},
+			{"logpack_header_pb", 1, 0, OPT_LOGPACK_HEADER_PB},
+			{"crc32c", 0, 0, OPT_CRC32C},
+			{"sub_ldev", 1, 0, OPT_SUB_LDEV},
+			{"stripe_kb", 1, 0, OPT_STRIPE_KB},
+			{"dirty_region_kb", 1, 0, OPT_DIRTY_REGION_KB},
 			{"help", 0, 0, OPT_HELP},
 			{0, 0, 0, 0}
 		};
@@ -490,6 +594,41 @@ static int parse_opt(int argc, char* const argv[], struct config *cfg)
 		case OPT_N_IO_BULK:
 			cfg->param.n_io_bulk = atoi(optarg);
 			break;
+		case OPT_READ_IOPS:
+			cfg->qos.read_iops = atoll(optarg);
+			break;
+		case OPT_WRITE_IOPS:
+			cfg->qos.write_iops = atoll(optarg);
+			break;
+		case OPT_READ_BPS:
+			cfg->qos.read_bps = atoll(optarg);
+			break;
+		case OPT_WRITE_BPS:
+			cfg->qos.write_bps = atoll(optarg);
+			break;
+		case OPT_BURST_MS:
+			cfg->qos.burst_ms = atoi(optarg);
+			break;
+		case OPT_LOGPACK_HEADER_PB:
+			cfg->logpack_header_pb = atoi(optarg);
+			break;
+		case OPT_CRC32C:
+			cfg->format_flags |= 1U << SUPER_FORMAT_CRC32C;
+			break;
+		case OPT_SUB_LDEV:
+			if (cfg->n_sub_ldevs >= WALB_MAX_LDEVS - 1) {
+				LOGe("too many log devices (max %u).\n",
+					WALB_MAX_LDEVS);
+				return -1;
+			}
+			cfg->sub_ldev_names[cfg->n_sub_ldevs++] = optarg;
+			break;
+		case OPT_STRIPE_KB:
+			cfg->stripe_kb = atoi(optarg);
+			break;
+		case OPT_DIRTY_REGION_KB:
+			cfg->dirty_region_kb = atoi(optarg);
+			break;
 		case OPT_HELP:
 			cfg->cmd_str = "help";
 			return 0;
@@ -536,15 +675,28 @@ static int parse_opt(int argc, char* const argv[], struct config *cfg)
  * @ddev_lb device size [logical block].
  * @ldev_lb log device size [logical block]
  * @name name of the walb device, or NULL.
+ * @logpack_header_pb logpack header size [physical block].
+ * @format_flags format flags. See SUPER_FORMAT_XXX.
+ * @n_ldevs number of log devices.
+ * @log_stripe_pb stripe size of striped log [physical block].
+ *   Both are ignored if SUPER_FORMAT_STRIPED is not set.
+ * @sub_fds file descriptors of the other log devices of a striped log.
+ * @dirty_region_lb region size of the dirty bitmap [logical block].
+ *   0 means no dirty bitmap.
  *
  * RETURN:
  *   true in success, or false.
  */
 static bool init_walb_metadata(
 	int fd, unsigned int lbs, unsigned int pbs,
-	u64 ddev_lb, u64 ldev_lb, const char *name)
+	u64 ddev_lb, u64 ldev_lb, const char *name,
+	unsigned int logpack_header_pb, u32 format_flags,
+	unsigned int n_ldevs, u32 log_stripe_pb,
+	const int *sub_fds, u32 dirty_region_lb)
 {
 	struct sector_data *super_sect;
+	int fds[WALB_MAX_LDEVS];
+	unsigned int i;
 
 	ASSERT(0 < fd);
 	ASSERT(0 < lbs);
@@ -567,6 +719,17 @@ static bool init_walb_metadata(
 		LOGe("init super sector faield.\n");
 		goto error1;
 	}
+	get_super_sector(super_sect)->logpack_header_pb = logpack_header_pb;
+	get_super_sector(super_sect)->format_flags = format_flags;
+	if (format_flags & (1U << SUPER_FORMAT_STRIPED)) {
+		get_super_sector(super_sect)->n_ldevs = n_ldevs;
+		get_super_sector(super_sect)->log_stripe_pb = log_stripe_pb;
+	}
+	if (dirty_region_lb > 0 &&
+		!init_dirty_bitmap_of_super(
+			get_super_sector(super_sect), dirty_region_lb)) {
+		goto error1;
+	}
 
 	/* Write super sector */
 	if (!write_super_sector(fd, super_sect)) {
@@ -580,6 +743,23 @@ static bool init_walb_metadata(
 		goto error1;
 	}
 
+	/* Write a clean dirty bitmap. */
+	if (dirty_region_lb > 0) {
+		fds[0] = fd;
+		for (i = 1; i < n_ldevs; i++)
+			fds[i] = sub_fds[i - 1];
+		if (!write_clean_dirty_bitmap(fds, get_super_sector(super_sect))) {
+			LOGe("write dirty bitmap failed.\n");
+			goto error1;
+		}
+		for (i = 1; i < n_ldevs; i++) {
+			if (fdatasync_(fds[i])) {
+				perror("fdatasync failed.\n");
+				goto error1;
+			}
+		}
+	}
+
 #if 1
 	/* Read super sector and print for debug. */
 	sector_zeroclear(super_sect);
@@ -675,6 +855,24 @@ static u64 get_ioctl_u64(const char* wdev_name, int command)
 	}
 }
 
+/**
+ * Get QoS limits using walb device ioctl.
+ *
+ * RETURN:
+ *   true in success, or false.
+ */
+static bool get_qos(const char *wdev_name, struct walb_qos_param *param)
+{
+	struct walb_ctl ctl = {
+		.command = WALB_IOCTL_GET_QOS,
+		.u2k = { .buf_size = 0 },
+		.k2u = { .buf_size = sizeof(struct walb_qos_param),
+			 .buf = (void *)param },
+	};
+
+	return invoke_ioctl(wdev_name, &ctl, O_RDONLY);
+}
+
 /**
  * Dispatch command.
  */
@@ -731,6 +929,37 @@ error1:
 	return NULL;
 }
 
+/**
+ * Write a walblog header.
+ *
+ * RETURN:
+ *   true in success, or false.
+ */
+static bool write_wlog_header(
+	int fd, const struct walb_super_sector *super, unsigned int lbs,
+	u64 begin_lsid, u64 end_lsid)
+{
+	u8 buf[WALBLOG_HEADER_SIZE];
+	struct walblog_header *wh = (struct walblog_header *)buf;
+
+	memset(wh, 0, WALBLOG_HEADER_SIZE);
+	wh->header_size = WALBLOG_HEADER_SIZE;
+	wh->sector_type = SECTOR_TYPE_WALBLOG_HEADER;
+	wh->checksum = 0;
+	wh->version = WALB_LOG_VERSION;
+	wh->log_checksum_salt = super->log_checksum_salt;
+	wh->log_checksum_type = get_csum_type_of_super(super);
+	wh->logical_bs = lbs;
+	wh->physical_bs = super->physical_bs;
+	copy_uuid(wh->uuid, super->uuid);
+	wh->begin_lsid = begin_lsid;
+	wh->end_lsid = end_lsid;
+	/* Checksum */
+	wh->checksum = checksum((const u8 *)wh, WALBLOG_HEADER_SIZE, 0);
+	/* Write */
+	return write_data(fd, buf, WALBLOG_HEADER_SIZE);
+}
+
 /**
  * Create sector data and read from the log device.
  *
@@ -745,7 +974,6 @@ static struct walb_super_sector *create_and_read_super_sector(
 	struct sector_data **sectdp, int fd, unsigned int pbs)
 {
 	struct sector_data *sectd;
-	u64 off;
 
 	ASSERT(fd > 0);
 	ASSERT(is_valid_pbs(pbs));
@@ -755,13 +983,9 @@ static struct walb_super_sector *create_and_read_super_sector(
 		LOGe("memory allocation failed.\n");
 		return NULL;
 	}
-	off = get_super_sector0_offset(pbs);
-	if (!sector_read(fd, off, sectd)) {
-		LOGe("read super sector0 failed.\n");
-		goto error1;
-	}
-	if (!is_valid_super_sector(sectd)) {
-		LOGe("read super sector is not valid.\n");
+	/* The latest valid one of the two slots. */
+	if (!read_super_sector(fd, sectd)) {
+		LOGe("read super sector failed.\n");
 		goto error1;
 	}
 	*sectdp = sectd;
@@ -785,6 +1009,12 @@ static bool do_format_ldev(const struct config *cfg)
 	unsigned int lbs, pbs;
 	int fd;
 	struct bdev_info ldev_info, ddev_info;
+	int sub_fds[WALB_MAX_LDEVS - 1];
+	unsigned int i, n_sub_opened = 0;
+	const unsigned int n_ldevs = cfg->n_sub_ldevs + 1;
+	u64 ldev_lb;
+	u32 format_flags = cfg->format_flags;
+	u32 stripe_pb = 0;
 
 	ASSERT(cfg->cmd_str);
 	ASSERT(strcmp(cfg->cmd_str, "format_ldev") == 0);
@@ -805,6 +1035,13 @@ static bool do_format_ldev(const struct config *cfg)
 	}
 	lbs = ldev_info.lbs;
 	pbs = ldev_info.pbs;
+	if (cfg->logpack_header_pb == 0 ||
+		cfg->logpack_header_pb > get_max_logpack_header_pb(pbs)) {
+		LOGe("logpack_header_pb must be 1 to %u"
+			" for physical block size %u.\n",
+			get_max_logpack_header_pb(pbs), pbs);
+		goto error1;
+	}
 
 	/* Check logical/physical block sizes. */
 	LOGd("logical_bs: %u\n" "physical_bs: %u\n"
@@ -814,29 +1051,85 @@ static bool do_format_ldev(const struct config *cfg)
 		LOGe("device size is not multiple of lbs\n");
 		goto error1;
 	}
+	ldev_lb = ldev_info.size / lbs;
+
+	/* Open the other log devices of a striped log. */
+	if (n_ldevs > 1) {
+		u64 dev_pb = ldev_info.size / pbs;
+		if (cfg->stripe_kb == 0 || cfg->stripe_kb * 1024 % pbs != 0) {
+			LOGe("stripe_kb must be a positive multiple of pbs.\n");
+			goto error1;
+		}
+		stripe_pb = cfg->stripe_kb * 1024 / pbs;
+		if (stripe_pb < get_ring_buffer_offset(pbs)) {
+			LOGe("stripe_kb is too small.\n");
+			goto error1;
+		}
+		for (i = 0; i < cfg->n_sub_ldevs; i++) {
+			struct bdev_info sub_info;
+			if (!open_bdev_and_get_info(
+					cfg->sub_ldev_names[i], &sub_info,
+					&sub_fds[i], O_RDWR | O_DIRECT)) {
+				LOGe("check and open failed: %s.\n",
+					cfg->sub_ldev_names[i]);
+				goto error2;
+			}
+			n_sub_opened++;
+			if (!is_block_size_same(&ldev_info, &sub_info)) {
+				goto error2;
+			}
+			dev_pb = get_min_value(dev_pb, sub_info.size / pbs);
+		}
+		ldev_lb = addr_lb(pbs, get_striped_log_size(dev_pb, n_ldevs, stripe_pb));
+		if (ldev_lb <= addr_lb(pbs, get_ring_buffer_offset(pbs))) {
+			LOGe("log devices are too small.\n");
+			goto error2;
+		}
+		format_flags |= 1U << SUPER_FORMAT_STRIPED;
+	}
 
 	/* Discard if necessary. */
 	if (!cfg->nodiscard && is_discard_supported(fd)) {
 		LOGn("Try to discard whole area of the log device...");
 		if (!discard_whole_area(fd)) {
 			LOGe("Discard whole area failed.\n");
-			goto error1;
+			goto error2;
 		}
 		LOGn("done\n");
 	}
+	for (i = 0; i < n_sub_opened; i++) {
+		if (!cfg->nodiscard && is_discard_supported(sub_fds[i])) {
+			LOGn("Try to discard whole area of %s...",
+				cfg->sub_ldev_names[i]);
+			if (!discard_whole_area(sub_fds[i])) {
+				LOGe("Discard whole area failed.\n");
+				goto error2;
+			}
+			LOGn("done\n");
+		}
+	}
 
 	/* Initialize metadata. */
 	retb = init_walb_metadata(
 		fd, lbs, pbs,
 		ddev_info.size / lbs,
-		ldev_info.size / lbs,
-		cfg->name);
+		ldev_lb,
+		cfg->name, cfg->logpack_header_pb, format_flags,
+		n_ldevs, stripe_pb,
+		sub_fds, cfg->dirty_region_kb * 1024 / lbs);
 	if (!retb) {
 		LOGe("initialize walb log device failed.\n");
-		goto error1;
+		goto error2;
+	}
+	for (i = 0; i < n_sub_opened; i++) {
+		close_(sub_fds[i]);
 	}
 	return close_(fd) == 0;
 
+error2:
+	for (i = 0; i < n_sub_opened; i++) {
+		close_(sub_fds[i]);
+	}
 error1:
 	close_(fd);
 	return false;
@@ -849,6 +1142,7 @@ static bool do_create_wdev(const struct config *cfg)
 {
 	struct bdev_info ldev_info, ddev_info;
 	int fd, ret;
+	unsigned int i;
 	struct walb_start_param u2k_param;
 	struct walb_start_param k2u_param;
 	struct walb_ctl ctl = {
@@ -904,6 +1198,17 @@ static bool do_create_wdev(const struct config *cfg)
 	ctl.u2k.lminor = MINOR(ldev_info.devt);
 	ctl.u2k.dmajor = MAJOR(ddev_info.devt);
 	ctl.u2k.dminor = MINOR(ddev_info.devt);
+	u2k_param.n_sub_ldevs = cfg->n_sub_ldevs;
+	for (i = 0; i < cfg->n_sub_ldevs; i++) {
+		struct bdev_info sub_info;
+		if (!get_bdev_info(cfg->sub_ldev_names[i], &sub_info)) {
+			LOGe("create_wdev: check log device failed: %s.\n",
+				cfg->sub_ldev_names[i]);
+			goto error1;
+		}
+		u2k_param.sub_lmajor[i] = MAJOR(sub_info.devt);
+		u2k_param.sub_lminor[i] = MINOR(sub_info.devt);
+	}
 
 	print_walb_ctl(&ctl); /* debug */
 
@@ -1066,8 +1371,6 @@ static bool do_cat_wldev(const struct config *cfg)
 	struct logpack *pack;
 	u64 lsid, oldest_lsid, begin_lsid, end_lsid;
 	u32 salt;
-	u8 buf[WALBLOG_HEADER_SIZE];
-	struct walblog_header *wh = (struct walblog_header *)buf;
 
 	ASSERT(cfg->cmd_str);
 	ASSERT(strcmp(cfg->cmd_str, "cat_wldev") == 0);
@@ -1109,22 +1412,7 @@ static bool do_cat_wldev(const struct config *cfg)
 		goto error3;
 	}
 
-	/* Prepare and write walblog_header. */
-	memset(wh, 0, WALBLOG_HEADER_SIZE);
-	wh->header_size = WALBLOG_HEADER_SIZE;
-	wh->sector_type = SECTOR_TYPE_WALBLOG_HEADER;
-	wh->checksum = 0;
-	wh->version = WALB_LOG_VERSION;
-	wh->log_checksum_salt = salt;
-	wh->logical_bs = wldev_info.lbs;
-	wh->physical_bs = pbs;
-	copy_uuid(wh->uuid, super->uuid);
-	wh->begin_lsid = begin_lsid;
-	wh->end_lsid = end_lsid;
-	/* Checksum */
-	wh->checksum = checksum((const u8 *)wh, WALBLOG_HEADER_SIZE, 0);
-	/* Write */
-	if (!write_data(1, buf, WALBLOG_HEADER_SIZE)) {
+	if (!write_wlog_header(1, super, wldev_info.lbs, begin_lsid, end_lsid)) {
 		goto error3;
 	}
 	LOGd("lsid %"PRIu64" to %"PRIu64"\n", begin_lsid, end_lsid);
@@ -1156,12 +1444,13 @@ static bool do_cat_wldev(const struct config *cfg)
 			LOGn("shrinked from %u to %u records.\n"
 				, logh->n_records, invalid_idx);
 			shrink_logpack_header(
-				logh, invalid_idx, pbs, salt);
+				logh, invalid_idx, pbs, salt,
+				get_csum_type_of_super(super));
 			should_break = true;
 		}
 
 		/* Write logpack header and data. */
-		retb = write_data(1, (u8 *)logh, pbs);
+		retb = write_logpack_header(1, pbs, logh);
 		if (!retb) {
 			LOGe("write logpack header failed.\n");
 			goto error3;
@@ -1175,11 +1464,12 @@ static bool do_cat_wldev(const struct config *cfg)
 		}
 
 		if (should_break) { break; }
-		lsid += logh->total_io_size + 1;
+		lsid += get_logpack_header_pb(logh) + logh->total_io_size;
 	}
 
 	/* Write termination block. */
-	retb = write_end_logpack_header(1, pbs, salt);
+	retb = write_end_logpack_header(
+		1, pbs, salt, get_csum_type_of_super(super));
 	if (!retb) {
 		LOGe("write end block failed.\n");
 		goto error3;
@@ -1198,6 +1488,138 @@ error1:
 	return false;
 }
 
+/**
+ * Extract logpacks through the walb device and write them as a wlog.
+ *
+ * The walb device reads whole logpacks in a call and waits for new ones,
+ * so neither polling nor header-by-header reads are required.
+ * The walblog device is used only to get the super sector.
+ */
+static bool do_stream_wlog(const struct config *cfg)
+{
+	struct bdev_info wdev_info, wldev_info;
+	struct sector_data *super_sectd;
+	struct walb_super_sector *super;
+	int wdev_fd, wldev_fd;
+	unsigned int pbs;
+	u64 lsid, end_lsid;
+	u64 lsids[2];
+	size_t bufsize = 1024 * 1024; /* 1MB */
+	u8 *buf;
+	struct walb_ctl ctl = {
+		.command = WALB_IOCTL_READ_LOG,
+		.u2k = { .buf_size = 0 },
+	};
+
+	ASSERT(strcmp(cfg->cmd_str, "stream_wlog") == 0);
+
+	if (!open_bdev_and_get_info(cfg->wldev_name, &wldev_info, &wldev_fd, O_RDONLY | O_DIRECT)) {
+		return false;
+	}
+	pbs = wldev_info.pbs;
+	super = create_and_read_super_sector(&super_sectd, wldev_fd, pbs);
+	close_(wldev_fd);
+	if (!super) {
+		return false;
+	}
+	if (!open_bdev_and_get_info(cfg->wdev_name, &wdev_info, &wdev_fd, O_RDONLY)) {
+		goto error1;
+	}
+	if (cfg->size != (size_t)(-1)) {
+		bufsize = cfg->size * 1024;
+	}
+	if (bufsize == 0 || bufsize % pbs != 0) {
+		LOGe("buffer size must be a multiple of %u bytes.\n", pbs);
+		goto error2;
+	}
+	buf = (u8 *)malloc(bufsize);
+	if (!buf) {
+		LOGe("%s", NOMEM_STR);
+		goto error2;
+	}
+
+	/* Range. */
+	if (cfg->lsid0 == (u64)(-1)) {
+		ctl.command = WALB_IOCTL_GET_OLDEST_LSID;
+		if (ioctl(wdev_fd, WALB_IOCTL_WDEV, &ctl) < 0) {
+			LOGe("get oldest_lsid failed.\n");
+			goto error3;
+		}
+		lsid = ctl.val_u64;
+		ctl.command = WALB_IOCTL_READ_LOG;
+	} else {
+		lsid = cfg->lsid0;
+	}
+	ctl.u2k.buf_size = sizeof(lsids);
+	ctl.u2k.buf = (void *)lsids;
+	end_lsid = cfg->lsid1;
+	if (lsid > end_lsid) {
+		LOGe("lsid0 < lsid1 property is required.\n");
+		goto error3;
+	}
+	if (!write_wlog_header(1, super, wldev_info.lbs, lsid, end_lsid)) {
+		goto error3;
+	}
+
+	while (lsid < end_lsid) {
+		size_t size;
+
+		lsids[0] = lsid;
+		lsids[1] = end_lsid;
+		ctl.val_u32 = 1000; /* Wait for new logs at most 1 sec. */
+		ctl.k2u.buf_size = bufsize;
+		ctl.k2u.buf = (void *)buf;
+		if (ioctl(wdev_fd, WALB_IOCTL_WDEV, &ctl) < 0) {
+			u8 *buf2;
+			if (errno != ENOSPC) {
+				LOGe("read log failed at lsid %" PRIu64 ".\n", lsid);
+				goto error3;
+			}
+			/* Extend the buffer for a large logpack. */
+			bufsize = (size_t)ctl.val_u32 * pbs;
+			buf2 = (u8 *)realloc(buf, bufsize);
+			if (!buf2) {
+				LOGe("%s", NOMEM_STR);
+				goto error3;
+			}
+			buf = buf2;
+			continue;
+		}
+		size = (ctl.val_u64 - lsid) * pbs;
+		if (size > 0 && !write_data(1, buf, size)) {
+			LOGe("write logpacks failed.\n");
+			goto error3;
+		}
+		LOGd_("lsid %" PRIu64 " to %" PRIu64 " (%d logpacks)\n"
+			, lsid, ctl.val_u64, ctl.val_int);
+		lsid = ctl.val_u64;
+		if (ctl.val_u32 > 0 && lsid + ctl.val_u32 > end_lsid) {
+			/* The next logpack ends after end_lsid. */
+			break;
+		}
+	}
+
+	/* Write termination block. */
+	if (!write_end_logpack_header(
+			1, pbs, super->log_checksum_salt,
+			get_csum_type_of_super(super))) {
+		LOGe("write end block failed.\n");
+		goto error3;
+	}
+
+	free(buf);
+	sector_free(super_sectd);
+	return close_(wdev_fd) == 0;
+
+error3:
+	free(buf);
+error2:
+	close_(wdev_fd);
+error1:
+	sector_free(super_sectd);
+	return false;
+}
+
 /**
  * Redo wlog.
  *
@@ -1212,6 +1634,7 @@ static bool do_redo_wlog(const struct config *cfg)
 	int fd;
 	struct walblog_header *wh;
 	u32 salt;
+	unsigned int csum_type;
 	struct bdev_info ddev_info;
 	unsigned int lbs, pbs;
 	u64 lsid, begin_lsid, end_lsid;
@@ -1234,6 +1657,7 @@ static bool do_redo_wlog(const struct config *cfg)
 		goto error1;
 	}
 	salt = wh->log_checksum_salt;
+	csum_type = wh->log_checksum_type;
 	print_wlog_header(wh); /* debug */
 
 	/* Check block sizes of the device. */
@@ -1266,7 +1690,7 @@ static bool do_redo_wlog(const struct config *cfg)
 		struct walb_logpack_header *logh = pack->header;
 
 		/* Read logpack header */
-		if (!read_logpack_header(0, pbs, salt, logh)) {
+		if (!read_logpack_header(0, pbs, salt, csum_type, logh)) {
 			break;
 		}
 		if (is_end_logpack_header(logh)) {
@@ -1279,7 +1703,7 @@ static bool do_redo_wlog(const struct config *cfg)
 			goto error3;
 		}
 		if (!read_logpack_data(
-				0, logh, salt, pack->sectd_ary)) {
+				0, logh, salt, csum_type, pack->sectd_ary)) {
 			LOGe("read logpack data failed.\n");
 			goto error3;
 		}
@@ -1353,6 +1777,11 @@ static bool do_redo(const struct config *cfg)
 	}
 	super = get_super_sector(super_sectd);
 	salt = super->log_checksum_salt;
+	if (get_n_ldevs_of_super(super) > 1) {
+		LOGe("redo of striped log is not supported. "
+			"Start the walb device to redo it.\n");
+		goto error3;
+	}
 
 	/* Allocate logpack data. */
 	pack = alloc_logpack(pbs, bufsize / pbs);
@@ -1382,7 +1811,9 @@ static bool do_redo(const struct config *cfg)
 
 		if (invalid_idx == 0) { break; }
 		if (invalid_idx < logh->n_records) {
-			shrink_logpack_header(logh, invalid_idx, pbs, salt);
+			shrink_logpack_header(
+				logh, invalid_idx, pbs, salt,
+				get_csum_type_of_super(super));
 			should_break = true;
 		}
 
@@ -1393,13 +1824,14 @@ static bool do_redo(const struct config *cfg)
 		}
 
 		if (should_break) { break; }
-		lsid += logh->total_io_size + 1;
+		lsid += get_logpack_header_pb(logh) + logh->total_io_size;
 	}
 
 	/* Set new written_lsid and sync down. */
 	end_lsid = lsid;
 	super->written_lsid = end_lsid;
-	if (!write_super_sector(lfd, super_sectd)) {
+	super->generation++;
+	if (!write_super_sector_in_slot(lfd, super_sectd)) {
 		LOGe("write super sector failed.\n");
 		goto error4;
 	}
@@ -1433,6 +1865,7 @@ static bool do_show_wlog(const struct config *cfg)
 {
 	struct walblog_header *wh;
 	u32 salt;
+	unsigned int csum_type;
 	unsigned int pbs;
 	struct logpack *pack;
 	struct walb_logpack_header *logh;
@@ -1447,6 +1880,7 @@ static bool do_show_wlog(const struct config *cfg)
 	if (!wh) { return false; }
 	pbs = wh->physical_bs;
 	salt = wh->log_checksum_salt;
+	csum_type = wh->log_checksum_type;
 	print_wlog_header(wh);
 
 	pack = alloc_logpack(pbs, bufsize / pbs);
@@ -1467,7 +1901,7 @@ static bool do_show_wlog(const struct config *cfg)
 	lsid = begin_lsid;
 
 	/* Read, print and check each logpack */
-	while (read_logpack_header(0, pbs, salt, logh)) {
+	while (read_logpack_header(0, pbs, salt, csum_type, logh)) {
 		/* End block check. */
 		if (is_end_logpack_header(logh)) break;
 
@@ -1485,12 +1919,13 @@ static bool do_show_wlog(const struct config *cfg)
 		}
 
 		/* Read logpack data. */
-		if (!read_logpack_data(0, logh, salt, pack->sectd_ary)) {
+		if (!read_logpack_data(
+				0, logh, salt, csum_type, pack->sectd_ary)) {
 			LOGe("read logpack data failed.\n");
 			goto error2;
 		}
 
-		lsid += 1 + logh->total_io_size;
+		lsid += get_logpack_header_pb(logh) + logh->total_io_size;
 		total_padding_size += get_padding_size_in_logpack_header(logh, pbs);
 		n_packs++;
 	}
@@ -1513,6 +1948,76 @@ error1:
 	return false;
 }
 
+/**
+ * Show logpack headers got from the index in the walb device.
+ * The default range is from oldest_lsid to permanent_lsid.
+ */
+static bool do_show_logpack_headers(const struct config *cfg)
+{
+	struct bdev_info wdev_info;
+	const size_t bufsize = 1024 * 1024; /* 1MB */
+	u8 *buf;
+	u64 lsids[2];
+	u64 lsid, end_lsid;
+	struct walb_ctl ctl = {
+		.command = WALB_IOCTL_GET_LOGPACK_HEADERS,
+		.u2k = { .buf_size = sizeof(lsids), .buf = (void *)lsids },
+		.k2u = { .buf_size = bufsize },
+	};
+
+	ASSERT(strcmp(cfg->cmd_str, "show_logpack_headers") == 0);
+
+	if (!get_bdev_info(cfg->wdev_name, &wdev_info)) {
+		return false;
+	}
+	lsid = cfg->lsid0;
+	if (lsid == (u64)(-1)) {
+		lsid = get_ioctl_u64(cfg->wdev_name, WALB_IOCTL_GET_OLDEST_LSID);
+	}
+	end_lsid = cfg->lsid1;
+	if (end_lsid == (u64)(-1)) {
+		end_lsid = get_ioctl_u64(cfg->wdev_name, WALB_IOCTL_GET_PERMANENT_LSID);
+	}
+	if (lsid == (u64)(-1) || end_lsid == (u64)(-1)) {
+		return false;
+	}
+	buf = (u8 *)malloc(bufsize);
+	if (!buf) {
+		LOGe("%s", NOMEM_STR);
+		return false;
+	}
+	ctl.k2u.buf = (void *)buf;
+
+	while (lsid < end_lsid) {
+		size_t off = 0;
+		int i;
+
+		lsids[0] = lsid;
+		lsids[1] = end_lsid;
+		if (!invoke_ioctl(cfg->wdev_name, &ctl, O_RDONLY)) {
+			LOGe("logpack headers from lsid %" PRIu64 " are not in memory."
+				" Use show_wldev instead.\n", lsid);
+			goto error1;
+		}
+		if (ctl.val_int == 0) {
+			break;
+		}
+		for (i = 0; i < ctl.val_int; i++) {
+			const struct walb_logpack_header *logh =
+				(const struct walb_logpack_header *)(buf + off);
+			print_logpack_header(logh);
+			off += get_logpack_header_pb(logh) * wdev_info.pbs;
+		}
+		lsid = ctl.val_u64;
+	}
+	free(buf);
+	return true;
+
+error1:
+	free(buf);
+	return false;
+}
+
 /**
  * Show logpack header inside walblog device.
  */
@@ -1573,7 +2078,8 @@ static bool do_show_wldev(const struct config *cfg)
 		if (!retb) { break; }
 		print_logpack_header(pack->header);
 
-		lsid += pack->header->total_io_size + 1;
+		lsid += get_logpack_header_pb(pack->header)
+			+ pack->header->total_io_size;
 		total_padding_size +=
 			get_padding_size_in_logpack_header(pack->header, pbs);
 		n_packs++;
@@ -1903,6 +2409,230 @@ static bool do_is_frozen(const struct config *cfg)
 		cfg->wdev_name, WALB_IOCTL_IS_FROZEN);
 }
 
+/**
+ * Set QoS limits.
+ */
+static bool do_set_qos(const struct config *cfg)
+{
+	struct walb_qos_param param;
+	struct walb_ctl ctl = {
+		.command = WALB_IOCTL_SET_QOS,
+		.u2k = { .buf_size = sizeof(struct walb_qos_param),
+			 .buf = (void *)&param },
+		.k2u = { .buf_size = 0 },
+	};
+
+	ASSERT(strcmp(cfg->cmd_str, "set_qos") == 0);
+
+	if (!get_qos(cfg->wdev_name, &param)) {
+		return false;
+	}
+	if (cfg->qos.read_iops != (u64)(-1)) {
+		param.read_iops = cfg->qos.read_iops;
+	}
+	if (cfg->qos.write_iops != (u64)(-1)) {
+		param.write_iops = cfg->qos.write_iops;
+	}
+	if (cfg->qos.read_bps != (u64)(-1)) {
+		param.read_bps = cfg->qos.read_bps;
+	}
+	if (cfg->qos.write_bps != (u64)(-1)) {
+		param.write_bps = cfg->qos.write_bps;
+	}
+	if (cfg->qos.burst_ms != (u32)(-1)) {
+		param.burst_ms = cfg->qos.burst_ms;
+	}
+	if (!is_walb_qos_param_valid(&param)) {
+		LOGe("Invalid QoS parameters.\n");
+		return false;
+	}
+	return invoke_ioctl(cfg->wdev_name, &ctl, O_RDWR);
+}
+
+/**
+ * Get QoS limits.
+ */
+static bool do_get_qos(const struct config *cfg)
+{
+	struct walb_qos_param param;
+
+	ASSERT(strcmp(cfg->cmd_str, "get_qos") == 0);
+
+	if (!get_qos(cfg->wdev_name, &param)) {
+		return false;
+	}
+	printf("read_iops %" PRIu64 "\n"
+		"write_iops %" PRIu64 "\n"
+		"read_bps %" PRIu64 "\n"
+		"write_bps %" PRIu64 "\n"
+		"burst_ms %" PRIu32 "\n"
+		, param.read_iops, param.write_iops
+		, param.read_bps, param.write_bps, param.burst_ms);
+	return true;
+}
+
+/**
+ * Show dirty regions.
+ *
+ * Each line is "offset size" of a dirty range [logical block].
+ * Copy them to the backup after reset_wal then call unpin_dirty_bitmap.
+ */
+static bool do_get_dirty_bitmap(const struct config *cfg)
+{
+	struct bdev_info wdev_info;
+	struct walb_ctl ctl = {
+		.command = WALB_IOCTL_GET_DIRTY_BITMAP,
+		.u2k = { .buf_size = 0 },
+		.k2u = { .buf_size = 0 },
+	};
+	u8 *bits;
+	u64 n_bits, bit, dev_lb, n_dirty = 0;
+	u64 begin = (u64)(-1);
+	u32 region_lb;
+
+	ASSERT(strcmp(cfg->cmd_str, "get_dirty_bitmap") == 0);
+
+	if (!get_bdev_info(cfg->wdev_name, &wdev_info)) {
+		return false;
+	}
+	dev_lb = wdev_info.size / LOGICAL_BLOCK_SIZE;
+
+	/* Get the size first. */
+	if (!invoke_ioctl(cfg->wdev_name, &ctl, O_RDONLY)) {
+		return false;
+	}
+	n_bits = ctl.val_u64;
+	if (n_bits == 0) {
+		LOGe("The device has no dirty bitmap.\n");
+		return false;
+	}
+	bits = (u8 *)malloc(n_bits / 8);
+	if (!bits) {
+		LOGe("%s", NOMEM_STR);
+		return false;
+	}
+	ctl.k2u.buf_size = n_bits / 8;
+	ctl.k2u.buf = (void *)bits;
+	if (!invoke_ioctl(cfg->wdev_name, &ctl, O_RDONLY)) {
+		free(bits);
+		return false;
+	}
+	region_lb = ctl.val_u32;
+
+	printf("# region_lb %" PRIu32 " pinned %d\n", region_lb, ctl.val_int);
+	for (bit = 0; bit <= n_bits; bit++) {
+		const u64 off = bit * region_lb;
+		const bool is_dirty = bit < n_bits && off < dev_lb &&
+			(bits[bit / 8] & (1U << (bit % 8)));
+		if (is_dirty) {
+			n_dirty++;
+			if (begin == (u64)(-1))
+				begin = off;
+			continue;
+		}
+		if (begin != (u64)(-1)) {
+			/* The last bit covers the rest of the device. */
+			const u64 end = bit == n_bits || off >= dev_lb ? dev_lb : off;
+			printf("%" PRIu64 " %" PRIu64 "\n", begin, end - begin);
+			begin = (u64)(-1);
+		}
+		if (off >= dev_lb)
+			break;
+	}
+	printf("# dirty %" PRIu64 " regions\n", n_dirty);
+	free(bits);
+	return true;
+}
+
+/**
+ * Unpin the dirty bitmap.
+ */
+static bool do_unpin_dirty_bitmap(const struct config *cfg)
+{
+	struct walb_ctl ctl = {
+		.command = WALB_IOCTL_UNPIN_DIRTY_BITMAP,
+		.u2k = { .buf_size = 0 },
+		.k2u = { .buf_size = 0 },
+	};
+
+	ASSERT(strcmp(cfg->cmd_str, "unpin_dirty_bitmap") == 0);
+
+	return invoke_ioctl(cfg->wdev_name, &ctl, O_RDWR);
+}
+
+/**
+ * Show statistics.
+ */
+static bool do_status(const struct config *cfg)
+{
+	struct walb_status st;
+	struct walb_ctl ctl = {
+		.command = WALB_IOCTL_STATUS,
+		.u2k = { .buf_size = 0 },
+		.k2u = { .buf_size = sizeof(struct walb_status),
+			 .buf = (void *)&st },
+	};
+
+	ASSERT(strcmp(cfg->cmd_str, "status") == 0);
+
+	memset(&st, 0, sizeof(st));
+	if (!invoke_ioctl(cfg->wdev_name, &ctl, O_RDONLY)) {
+		return false;
+	}
+	if (st.version != WALB_STATUS_VERSION) {
+		LOGw("status version differs: kernel %u tool %u.\n"
+			, st.version, WALB_STATUS_VERSION);
+	}
+
+	printf("version %" PRIu32 "\n"
+		"n_read %" PRIu64 "\n"
+		"n_write %" PRIu64 "\n"
+		"n_discard %" PRIu64 "\n"
+		"n_flush %" PRIu64 "\n"
+		"logged_bytes %" PRIu64 "\n"
+		"n_logpack %" PRIu64 "\n"
+		"n_log_record %" PRIu64 "\n"
+		"avg_records_per_pack %.2f\n"
+		"n_log_flush %" PRIu64 "\n"
+		"n_log_flush_force %" PRIu64 "\n"
+		"n_log_flush_fua %" PRIu64 "\n"
+		"n_overlap_delay %" PRIu64 "\n"
+		"pending_sectors %" PRIu64 "\n"
+		"max_pending_sectors_seen %" PRIu64 "\n"
+		"n_queue_stop %" PRIu64 "\n"
+		"queue_stop_ms %" PRIu64 "\n"
+		"n_rb_stall %" PRIu64 "\n"
+		"rb_stall_ms %" PRIu64 "\n"
+		"n_admission_delay %" PRIu64 "\n"
+		"admission_delay_ms %" PRIu64 "\n"
+		"n_qos_throttled %" PRIu64 "\n"
+		"qos_throttled_ms %" PRIu64 "\n"
+		"latest_lsid %" PRIu64 "\n"
+		"permanent_lsid %" PRIu64 "\n"
+		"written_lsid %" PRIu64 "\n"
+		"oldest_lsid %" PRIu64 "\n"
+		"log_capacity %" PRIu64 "\n"
+		"log_usage %" PRIu64 "\n"
+		"n_zero_write %" PRIu64 "\n"
+		, st.version
+		, st.n_read, st.n_write, st.n_discard, st.n_flush
+		, st.logged_bytes, st.n_logpack, st.n_log_record
+		, st.n_logpack == 0 ? 0.0
+		: (double)st.n_log_record / (double)st.n_logpack
+		, st.n_log_flush, st.n_log_flush_force, st.n_log_flush_fua
+		, st.n_overlap_delay
+		, st.pending_sectors, st.max_pending_sectors_seen
+		, st.n_queue_stop, st.queue_stop_ms
+		, st.n_rb_stall, st.rb_stall_ms
+		, st.n_admission_delay, st.admission_delay_ms
+		, st.n_qos_throttled, st.qos_throttled_ms
+		, st.latest_lsid, st.permanent_lsid
+		, st.written_lsid, st.oldest_lsid
+		, st.log_capacity, st.log_usage
+		, st.n_zero_write);
+	return true;
+}
+
 /**
  * Get walb driver version.
  */